@@ -0,0 +1,329 @@
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "vfs/VFS.h"
+
+// Suite for the operations of a native FileSystem, and of path resolution in a MountRouter. Every tree and file is generated under the temp directory and
+// removed when the suite ends. The sizes come from the environment, the output format from the usual benchmark flags, e.g.
+//   VFS_BENCH_FILES=1000,100000 VFS_BENCH_DEPTH=1,4 VFS_BENCH_THREADS=8 vfs_bench --benchmark_format=json
+// which prints JSON to stdout, or --benchmark_out=vfs_bench.json --benchmark_out_format=json for a file.
+
+namespace {
+
+std::vector<long> listFromEnv(char const * name, std::vector<long> fallback)
+{
+    auto value = std::getenv(name);
+    if ( value == nullptr )
+        return fallback;
+
+    std::vector<long> list;
+    std::stringstream in(value);
+    std::string item;
+    while ( std::getline(in, item, ',') )
+    {
+        auto n = std::strtol(item.c_str(), nullptr, 10);
+        if ( n > 0 )
+            list.push_back(n);
+    }
+
+    return list.empty() ? fallback : list;
+}
+
+long fromEnv(char const * name, long fallback)
+{
+    return listFromEnv(name, { fallback }).front();
+}
+
+VFS::fs::path benchRoot()
+{
+    static VFS::fs::path root = [] ()
+    {
+        auto path = VFS::fs::temp_directory_path() / ( "vfs_bench_" + std::to_string(::getpid()) );
+        VFS::fs::remove_all(path);
+        VFS::fs::create_directories(path);
+        return path;
+    }();
+
+    return root;
+}
+
+// A tree of regular files, the directories fanned out FANOUT ways per level, with a FileSystem mounted on it.
+struct Tree
+{
+    constexpr static long FANOUT = 4;
+
+    std::shared_ptr<VFS::FileSystem> fs;
+    std::vector<std::string> files;     // relative paths
+
+    Tree(long count, long depth, std::size_t fileSize)
+    {
+        auto root = benchRoot() / ( "tree_" + std::to_string(count) + "_" + std::to_string(depth) );
+        VFS::fs::create_directories(root);
+
+        std::vector<std::string> dirs = { "." };
+        for ( long level = 0; level < depth; ++level )
+        {
+            std::vector<std::string> next;
+            for ( auto const & dir : dirs )
+            {
+                for ( long i = 0; i < FANOUT; ++i )
+                {
+                    next.push_back(dir + "/d" + std::to_string(i));
+                    VFS::fs::create_directory(root / next.back());
+                }
+            }
+            dirs.swap(next);
+        }
+
+        std::string content(fileSize, 'v');
+        for ( long i = 0; i < count; ++i )
+        {
+            files.push_back(dirs[i % dirs.size()] + "/f" + std::to_string(i));
+            std::ofstream{ root / files.back(), std::ios::binary } << content;
+        }
+
+        fs = std::make_shared<VFS::FileSystem>(root.string());
+    }
+
+    std::string const & pick(std::size_t i) const { return files[i % files.size()]; }
+};
+
+Tree & tree(long count, long depth)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<long, long>, std::unique_ptr<Tree>> trees;
+
+    std::lock_guard<std::mutex> lk(mutex);
+    auto & slot = trees[{ count, depth }];
+    if ( slot == nullptr )
+        slot.reset(new Tree(count, depth, fromEnv("VFS_BENCH_FILE_SIZE", 4096)));
+
+    return *slot;
+}
+
+// One large file to read and write at different sizes and offsets.
+std::shared_ptr<VFS::FileSystem> dataFs()
+{
+    constexpr std::size_t size = 64 << 20;
+    static std::shared_ptr<VFS::FileSystem> fs = [] ()
+    {
+        auto dir = benchRoot() / "data";
+        VFS::fs::create_directories(dir);
+        std::ofstream out(dir / "large", std::ios::binary);
+        std::string chunk(1 << 20, 'd');
+        for ( std::size_t done = 0; done < size; done += chunk.size() )
+            out << chunk;
+        out.close();
+        return std::make_shared<VFS::FileSystem>(dir.string());
+    }();
+
+    return fs;
+}
+
+std::size_t offsetFor(benchmark::State & state, std::mt19937_64 & random, std::size_t i, std::size_t size)
+{
+    constexpr std::size_t fileSize = 64 << 20;
+    auto slots = fileSize / size;
+    return ( state.range(1) != 0 ? random() % slots : i % slots ) * size;
+}
+
+void BM_Open(benchmark::State & state)
+{
+    auto & t = tree(state.range(0), state.range(1));
+    std::size_t i = state.thread_index() * 7919;
+    for ( auto _ : state )
+        benchmark::DoNotOptimize(t.fs->open(t.pick(i++)));
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Read(benchmark::State & state)
+{
+    auto file = dataFs()->open("large");
+    std::size_t size = state.range(0);
+    std::vector<char> buffer(size);
+    std::mt19937_64 random(state.thread_index());
+    std::size_t i = 0;
+    for ( auto _ : state )
+        benchmark::DoNotOptimize(file->read(buffer.data(), offsetFor(state, random, i++, size), size));
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+void BM_Write(benchmark::State & state)
+{
+    // every thread writes a file of its own
+    auto fs = dataFs();
+    auto name = "write_" + std::to_string(state.thread_index());
+    fs->touchFile(name);
+    auto file = fs->open(name);
+    std::size_t size = state.range(0);
+    std::vector<char> buffer(size, 'w');
+    std::mt19937_64 random(state.thread_index());
+    std::size_t i = 0;
+    for ( auto _ : state )
+        benchmark::DoNotOptimize(file->write(buffer.data(), offsetFor(state, random, i++, size), size));
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+void BM_ReadAll(benchmark::State & state)
+{
+    auto & t = tree(state.range(0), state.range(1));
+    std::size_t i = state.thread_index() * 7919;
+    std::size_t bytes = 0;
+    for ( auto _ : state )
+    {
+        auto file = t.fs->open(t.pick(i++), VFS::Perms::READ);
+        bytes += file->readAll().size();
+    }
+    state.SetBytesProcessed(bytes);
+}
+
+void BM_List(benchmark::State & state)
+{
+    auto & t = tree(state.range(0), state.range(1));
+    for ( auto _ : state )
+        benchmark::DoNotOptimize(t.fs->list());
+    state.SetItemsProcessed(state.iterations() * t.files.size());
+}
+
+void BM_Search(benchmark::State & state)
+{
+    auto & t = tree(state.range(0), state.range(1));
+    std::size_t i = state.thread_index() * 7919;
+    for ( auto _ : state )
+    {
+        auto const & path = t.pick(i++);
+        benchmark::DoNotOptimize(t.fs->search(path.substr(path.rfind('/') + 1)));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Lookup(benchmark::State & state)
+{
+    // what a stat() of a path does, lookups of different directories don't wait for each other
+    auto & t = tree(state.range(0), state.range(1));
+    std::size_t i = state.thread_index() * 7919;
+    for ( auto _ : state )
+    {
+        auto const & path = t.pick(i++);
+        benchmark::DoNotOptimize(t.fs->contain(path) && t.fs->type(path) == std::string(VFS::type::REGULAR));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Copy(benchmark::State & state)
+{
+    auto fs = dataFs();
+    std::size_t size = state.range(0);
+    auto prefix = "copy_" + std::to_string(state.thread_index()) + "_" + std::to_string(size);
+    {
+        std::ofstream out(fs->path() + prefix, std::ios::binary);
+        out << std::string(size, 'c');
+    }
+
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize(fs->copy(prefix, prefix + "_to"));
+        state.PauseTiming();
+        fs->remove(prefix + "_to");
+        state.ResumeTiming();
+    }
+    fs->remove(prefix);
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+void BM_MoveTo(benchmark::State & state)
+{
+    // a file of the tree goes back and forth between two names
+    auto & t = tree(state.range(0), state.range(1));
+    auto const & from = t.pick(state.thread_index());
+    auto to = from + "_moved";
+    for ( auto _ : state )
+    {
+        t.fs->moveTo(from, to);
+        t.fs->moveTo(to, from);
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+// Many small filesystems under one router, as a gateway exports them.
+std::shared_ptr<VFS::MountRouter> router(long mounts)
+{
+    static std::mutex mutex;
+    static std::map<long, std::shared_ptr<VFS::MountRouter>> routers;
+
+    std::lock_guard<std::mutex> lk(mutex);
+    auto & slot = routers[mounts];
+    if ( slot == nullptr )
+    {
+        slot = std::make_shared<VFS::MountRouter>("router");
+        for ( long i = 0; i < mounts; ++i )
+        {
+            auto fs = std::make_shared<VFS::MemoryFileSystem>("memfs");
+            fs->makeDir("dir");
+            fs->touchFile("dir/file");
+            slot->attach("exports/volume" + std::to_string(i) + "/data", fs);
+        }
+    }
+
+    return slot;
+}
+
+void BM_Route(benchmark::State & state)
+{
+    auto fs = router(state.range(0));
+    std::vector<std::string> paths;
+    for ( long i = 0; i < state.range(0); ++i )
+        paths.push_back("exports/volume" + std::to_string(i) + "/data/dir/file");
+
+    std::size_t i = state.thread_index() * 7919;
+    for ( auto _ : state )
+        benchmark::DoNotOptimize(fs->type(paths[i++ % paths.size()]));
+    state.SetItemsProcessed(state.iterations());
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    auto counts = listFromEnv("VFS_BENCH_FILES", { 1000, 10000 });
+    auto depths = listFromEnv("VFS_BENCH_DEPTH", { 1, 3 });
+    auto threads = static_cast<int>(fromEnv("VFS_BENCH_THREADS", 4));
+    std::vector<long> sizes = { 512, 4 << 10, 64 << 10, 1 << 20 };
+
+    auto threaded = [threads] (char const * name, void (*fn)(benchmark::State &)) -> benchmark::internal::Benchmark *
+    {
+        return benchmark::RegisterBenchmark(name, fn)->ThreadRange(1, threads)->UseRealTime();
+    };
+    for ( auto * bench : { threaded("open", BM_Open), threaded("readAll", BM_ReadAll), threaded("search", BM_Search), threaded("lookup", BM_Lookup),
+                          threaded("moveTo", BM_MoveTo) } )
+        bench->ArgsProduct({ counts, depths })->ArgNames({ "files", "depth" });
+
+    // list(dir) walks the tree with threads of its own
+    benchmark::RegisterBenchmark("list", BM_List)->ArgsProduct({ counts, depths })->ArgNames({ "files", "depth" })->UseRealTime();
+
+    for ( auto * bench : { threaded("read", BM_Read), threaded("write", BM_Write) } )
+        bench->ArgsProduct({ sizes, { 0, 1 } })->ArgNames({ "size", "random" });
+    threaded("copy", BM_Copy)->ArgsProduct({ sizes })->ArgNames({ "size" });
+    threaded("route", BM_Route)->ArgsProduct({ listFromEnv("VFS_BENCH_MOUNTS", { 10, 2000 }) })->ArgNames({ "mounts" });
+
+    benchmark::AddCustomContext("vfs_tree_fanout", std::to_string(Tree::FANOUT));
+    benchmark::AddCustomContext("vfs_file_size", std::to_string(fromEnv("VFS_BENCH_FILE_SIZE", 4096)));
+
+    benchmark::Initialize(&argc, argv);
+    if ( benchmark::ReportUnrecognizedArguments(argc, argv) )
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    VFS::fs::remove_all(benchRoot());
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "IFile.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Fixed-size cache of file blocks keyed by (file identity, block index), shared by every open file that is
+ given the same instance. The cache is split in shards with their own lock, each shard evicts with 2Q: blocks seen
+ once wait in a FIFO and only blocks that come back after leaving it are promoted to the LRU of hot blocks, so a
+ single large scan can't flush the hot set.
+ */
+class BlockCache
+{
+public:
+    // Identity of a file, (st_dev, st_ino) for files of the native filesystem.
+    struct FileId
+    {
+        std::uint64_t device;
+        std::uint64_t inode;
+    };
+
+    struct Stats
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t insertions;
+        std::uint64_t evictions;
+        std::uint64_t invalidations;
+    };
+
+    constexpr static std::size_t DEFAULT_CAPACITY = 64 * 1024 * 1024;
+    constexpr static std::size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+    constexpr static std::size_t DEFAULT_SHARDS = 16;
+
+public:
+    /**
+     * @param capacity - total bytes of cached data, rounded down to whole blocks per shard
+     * @param blockSize - bytes per block
+     * @param shards - number of independently locked shards, rounded up to a power of two
+     */
+    BlockCache(std::size_t capacity = DEFAULT_CAPACITY, std::size_t blockSize = DEFAULT_BLOCK_SIZE, std::size_t shards = DEFAULT_SHARDS);
+    DISABLE_COPY(BlockCache);
+    ~BlockCache();
+
+    /**
+     * @brief The process-wide cache with the default capacity, created on first use.
+     */
+    static std::shared_ptr<BlockCache> global();
+
+    std::size_t blockSize() const { return _blockSize; }
+
+    std::size_t capacity() const;
+
+    /**
+     * @brief Copy bytes of a cached block. A cached block shorter than blockSize() is the last block of the file.
+     *
+     * @param dst - receives at most size bytes
+     * @param inBlock - offset inside the block
+     * @param copied - bytes copied, less than size when the block ends first
+     * @return true - the block is cached
+     * @return false - miss, nothing copied
+     */
+    bool read(FileId id, std::uint64_t block, std::size_t inBlock, IFile::DataT * dst, std::size_t size, std::size_t & copied);
+
+    bool contains(FileId id, std::uint64_t block) const;
+
+    /**
+     * @brief Version of the shard that holds the block. Take it before reading the block from the file and give it
+     back to insert(), so that data read while a write invalidated the block is never cached.
+     */
+    std::uint64_t epoch(FileId id, std::uint64_t block) const;
+
+    void insert(FileId id, std::uint64_t block, IFile::DataT const * data, std::size_t length, std::uint64_t epoch);
+
+    /**
+     * @brief Drop the blocks first..last (inclusive) of a file, called after every write to that range.
+     */
+    void invalidate(FileId id, std::uint64_t first, std::uint64_t last);
+
+    /**
+     * @brief Drop every block of a file, for example when it is removed and its identity may be reused.
+     */
+    void invalidate(FileId id);
+
+    void clear();
+
+    Stats stats() const;
+
+private:
+    struct Key
+    {
+        FileId id;
+        std::uint64_t block;
+
+        bool operator==(Key const & other) const
+        {
+            return id.device == other.id.device && id.inode == other.id.inode && block == other.block;
+        }
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(Key const & key) const;
+    };
+
+    enum class Queue
+    {
+        IN,     // seen once, FIFO
+        HOT,    // seen again after leaving IN, LRU
+    };
+
+    struct Entry
+    {
+        IFile::Buffer data;
+        Queue queue;
+        std::list<Key>::iterator position;
+    };
+
+    struct Shard
+    {
+        std::unordered_map<Key, Entry, KeyHash> entries;
+        std::list<Key> in;      // front is the newest
+        std::list<Key> hot;     // front is the most recently used
+        std::list<Key> out;     // ghosts of blocks evicted from IN
+        std::unordered_map<Key, std::list<Key>::iterator, KeyHash> ghosts;
+        std::vector<IFile::Buffer> freeBuffers;
+        std::uint64_t epoch = 0;
+        mutable std::mutex mutex;
+    };
+
+    Shard & shardOf(Key const & key) const;
+
+    void evictOne(Shard & shard);
+
+    void erase(Shard & shard, std::unordered_map<Key, Entry, KeyHash>::iterator it);
+
+private:
+    std::size_t _blockSize;
+    std::size_t _blocksPerShard;
+    std::size_t _inLimit;       // blocks kept in IN before it gives them up
+    std::size_t _outLimit;      // ghosts remembered per shard
+    std::unique_ptr<Shard[]> _shards;
+    std::size_t _shardMask;
+
+    mutable std::atomic<std::uint64_t> _hits;
+    mutable std::atomic<std::uint64_t> _misses;
+    std::atomic<std::uint64_t> _insertions;
+    std::atomic<std::uint64_t> _evictions;
+    std::atomic<std::uint64_t> _invalidations;
+};
+
+}
+
+#endif // !BLOCKCACHE_H
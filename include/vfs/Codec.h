@@ -0,0 +1,69 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "IFile.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief A way to compress the blocks of a CompressedFile. Every stored block records the id of the codec it was
+ compressed with, so a file is read back whatever codec the filesystem is set to later, and blocks of one file may
+ use different ones. Codecs keep no state between calls and are used from many threads at once.
+ */
+class Codec
+{
+public:
+    enum Id : std::uint8_t
+    {
+        NONE = 0,   // stored as it is
+        ZLIB = 1,
+    };
+
+    constexpr static int DEFAULT_ZLIB_LEVEL = 6;
+
+public:
+    Codec() = default;
+    virtual ~Codec() = default;
+    DISABLE_COPY(Codec);
+
+    virtual Id id() const = 0;
+
+    virtual char const * name() const = 0;
+
+    /**
+     * @brief Compress size bytes of src into dst, which is resized to the compressed length.
+     *
+     * @return false - the codec failed
+     */
+    virtual bool compress(IFile::DataT const * src, std::size_t size, IFile::Buffer & dst) const = 0;
+
+    /**
+     * @param length - bytes of compressed data in src
+     * @param size - bytes the data had before it was compressed, dst holds at least that
+     * @return false - src isn't data of this codec or doesn't give size bytes
+     */
+    virtual bool decompress(IFile::DataT const * src, std::size_t length, IFile::DataT * dst, std::size_t size) const = 0;
+
+    /**
+     * @brief The codec that stores blocks as they are.
+     */
+    static std::shared_ptr<Codec> passthrough();
+
+    /**
+     * @return nullptr - the library was built without zlib
+     */
+    static std::shared_ptr<Codec> zlib(int level = DEFAULT_ZLIB_LEVEL);
+
+    /**
+     * @brief The codec blocks with id were stored with, nullptr if it isn't built in.
+     */
+    static std::shared_ptr<Codec> byId(Id id);
+};
+
+}
+
+#endif // !CODEC_H
@@ -0,0 +1,129 @@
+#ifndef COMPRESSEDFILE_H
+#define COMPRESSEDFILE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Codec.h"
+#include "IFile.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief A file whose content is stored as independently compressed blocks of BLOCK_SIZE bytes, with an index of
+ where every block is in the file it is stored in. A read decompresses only the blocks it touches, a write changes
+ blocks in memory and only those are compressed again, on the pool of IoEngine::global() and not by the writer.
+ Rewritten blocks go to free space, never over the data the synced index points to, and sync() or close() write the
+ index and then the header that points to it, so the file reads back as of the last sync after a crash.
+
+ Every open handle of one stored file shares its index and the blocks not stored yet, see load().
+ */
+class CompressedFile : public IFile
+{
+public:
+    constexpr static std::size_t BLOCK_SIZE = 64 * 1024;
+
+    // Blocks written and not stored that are kept in memory, and given to the pool at once, before writers store
+    // them on their own.
+    constexpr static std::size_t DIRTY_BLOCKS = 64;
+
+    struct Stats
+    {
+        std::uint64_t blocks;       // stored
+        std::uint64_t raw;          // bytes of the stored blocks before compression
+        std::uint64_t compressed;   // and after
+        std::uint64_t dirty;        // blocks not stored yet
+    };
+
+    struct Store;
+
+public:
+    /**
+     * @brief The state of the compressed file stored in file, or of a new one if file is empty, for the handles of it.
+     *
+     * @param codec - compresses the blocks written from now on
+     * @return nullptr - file holds something else, or a damaged index
+     */
+    static std::shared_ptr<Store> load(std::shared_ptr<IFile> file, std::shared_ptr<Codec> codec);
+
+    /**
+     * @brief Whether file holds a compressed file, going by the magic its header starts with.
+     */
+    static bool stored(IFile & file);
+
+    CompressedFile(std::shared_ptr<Store> store);
+    ~CompressedFile();
+    DISABLE_COPY(CompressedFile);
+
+    using IFile::read;
+    using IFile::write;
+
+    /**
+     * @brief Append at the end of the file.
+     */
+    std::size_t write(Buffer const & buf, std::size_t size) override;
+
+    std::size_t write(Buffer const & buf, std::size_t offset, std::size_t size) override;
+
+    Buffer read(std::size_t size) override;
+
+    Buffer read(std::size_t offset, std::size_t size) override;
+
+    Buffer readAll() override;
+
+    std::size_t read(DataT * dst, std::size_t offset, std::size_t size) override;
+
+    std::size_t write(DataT const * src, std::size_t offset, std::size_t size) override;
+
+    /**
+     * @brief Store the blocks still in memory, write the index and flush the file.
+     *
+     * @return long - 0, or a negative errno, also for a block that failed to be stored since the last sync
+     */
+    long sync() override;
+
+    long datasync() override;
+
+    void close() override;
+
+    FileInfo info() const override;
+
+    /**
+     * @brief The size of the content, not of the file it is stored in.
+     */
+    std::size_t size() const override;
+
+    std::string filename() const override;
+
+    FileInfo::PermisionsT permision() const override;
+
+    void setPermision(Perms perms) override;
+
+    void disableWrite() override;
+
+    void disableRead() override;
+
+    void disableAll() override;
+
+    Stats stats() const;
+
+private:
+    /**
+     * @brief Copy [inBlock, inBlock + size) of block into dst, from memory or from the file.
+     */
+    bool readBlock(std::size_t block, std::size_t inBlock, DataT * dst, std::size_t size);
+
+private:
+    std::shared_ptr<Store> _store;
+    std::size_t _readPos;
+    std::mutex _mutex;              // _readPos
+    std::uint64_t _cachedSerial;    // stored block that _cached holds, 0 for none
+    Buffer _cached;                 // the last block read from the file, decompressed
+    std::mutex _cacheMutex;
+};
+
+}
+
+#endif // !COMPRESSEDFILE_H
@@ -0,0 +1,83 @@
+#ifndef COPYENGINE_H
+#define COPYENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "IFile.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Copies regular files with the cheapest mechanism the filesystems allow, in this order: a reflink clone that
+ shares the extents (FICLONE), copy_file_range() which lets the kernel or the storage copy, sendfile() which at least
+ stays in the kernel, and a user-space loop with a large buffer. Only the data segments of the source are copied
+ (SEEK_DATA/SEEK_HOLE), so holes of sparse files stay holes. Files that aren't on a local disk are streamed through
+ the IFile interface instead.
+ */
+class CopyEngine
+{
+public:
+    enum class Strategy
+    {
+        NONE,
+        REFLINK,
+        COPY_FILE_RANGE,
+        SENDFILE,
+        BUFFERED,
+        STREAM,     // through IFile, between any two filesystems
+    };
+
+    struct Result
+    {
+        bool ok;
+        Strategy strategy;      // the slowest mechanism some part of the copy needed
+        std::uint64_t bytes;    // data bytes moved, holes not counted
+    };
+
+    /**
+     * @brief Called after every chunk with the bytes copied so far and the size of the source.
+     */
+    typedef std::function<void(std::uint64_t copied, std::uint64_t total)> Progress;
+
+    constexpr static std::size_t BUFFER_SIZE = 1024 * 1024;
+
+public:
+    /**
+     * @brief Copy the whole content of from into to, which is truncated to the size of from.
+     *
+     * @param first - the first mechanism to try, later ones are only used when it isn't supported
+     */
+    static Result copy(int from, int to, Strategy first = Strategy::REFLINK, Progress const & progress = nullptr);
+
+    /**
+     * @brief Copy a regular file to a new file with the same permissions. Fails if to exists, and removes it again
+     if the copy fails.
+     */
+    static Result copy(std::string const & from, std::string const & to, Strategy first = Strategy::REFLINK, Progress const & progress = nullptr);
+
+    /**
+     * @brief Copy the content of from into to, where either may be any IFile. Two buffers of BUFFER_SIZE alternate,
+     the next chunk is read asynchronously while the current one is written. Nothing reports success before to is
+     flushed to the storage with fsyncAsync().
+     *
+     * @return Result - strategy is STREAM, bytes is the size of the content
+     */
+    static Result stream(IFile & from, IFile & to, Progress const & progress = nullptr);
+
+    static char const * name(Strategy strategy);
+
+private:
+    /**
+     * @brief Copy [offset, offset + size) at the same offset, falling back to the next mechanism as needed.
+     *
+     * @return false - the copy failed with every mechanism left
+     */
+    static bool copyRange(int from, int to, std::uint64_t offset, std::uint64_t size, Strategy & strategy, Result & result, std::uint64_t total, Progress const & progress);
+};
+
+}
+
+#endif // !COPYENGINE_H
@@ -0,0 +1,133 @@
+#ifndef COPYUPFILE_H
+#define COPYUPFILE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "IFile.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief A file of an OverlayFS that is being copied from a read-only lower layer into the upper one block by
+ block. A block is copied the first time a write touches it, reads take every block from the layer it is in. Which
+ blocks are copied is shared by all open handles of the file and kept in a file of the upper layer, so the copy goes
+ on where it stopped after the overlay is mounted again. That file is written and synced by sync() and close(), after
+ the upper file, so it never marks a block copied that isn't on disk yet.
+ */
+class CopyUpFile : public IFile
+{
+public:
+    constexpr static std::size_t BLOCK_SIZE = 64 * 1024;
+
+    // The blocks of one file that are in the upper layer.
+    struct Blocks
+    {
+        std::uint32_t layer;        // of the overlay, where the rest of the file is
+        std::uint64_t lowerSize;
+        std::vector<char> copied;   // one per block of the lower file
+        std::shared_ptr<IFile> store;   // where the above is kept
+        bool dirty = false;
+        std::vector<char> pending;  // in memory only, blocks a write in progress covers whole
+        std::mutex mutex;
+        std::condition_variable cv; // pending dropped
+
+        bool complete() const;
+
+        Buffer serialize() const;
+
+        /**
+         * @return false - data isn't a serialized Blocks
+         */
+        bool parse(Buffer const & data);
+
+        /**
+         * @brief Write the map to store and sync it, if it changed.
+         */
+        bool save();
+    };
+
+public:
+    CopyUpFile(std::shared_ptr<IFile> lower, std::shared_ptr<IFile> upper, std::shared_ptr<Blocks> blocks);
+    ~CopyUpFile();
+    DISABLE_COPY(CopyUpFile);
+
+    using IFile::read;
+    using IFile::write;
+
+    std::size_t write(Buffer const & buf, std::size_t size) override;
+
+    std::size_t write(Buffer const & buf, std::size_t offset, std::size_t size) override;
+
+    Buffer read(std::size_t size) override;
+
+    Buffer read(std::size_t offset, std::size_t size) override;
+
+    Buffer readAll() override;
+
+    std::size_t read(DataT * dst, std::size_t offset, std::size_t size) override;
+
+    std::size_t write(DataT const * src, std::size_t offset, std::size_t size) override;
+
+    long sync() override;
+
+    long datasync() override;
+
+    void close() override;
+
+    FileInfo info() const override;
+
+    std::size_t size() const override;
+
+    std::string filename() const override;
+
+    FileInfo::PermisionsT permision() const override;
+
+    void setPermision(Perms perms) override;
+
+    void disableWrite() override;
+
+    void disableRead() override;
+
+    void disableAll() override;
+
+private:
+    /**
+     * @brief Whether block is still in the lower layer, without the lock.
+     */
+    bool below(std::size_t block) const;
+
+    /**
+     * @brief Copy the blocks of [offset, offset + size) the write doesn't cover whole, once no other write covers
+     them whole, and claim the others as pending in whole.
+     */
+    bool copyUp(std::size_t offset, std::size_t size, std::vector<std::size_t> & whole);
+
+    /**
+     * @brief Read the blocks claimed in whole from the upper layer from now on, those the write of n bytes at
+     offset got to the end of.
+     *
+     * @return std::size_t - the bytes written, up to the first of the blocks that weren't
+     */
+    std::size_t settle(std::vector<std::size_t> const & whole, std::size_t offset, std::size_t n);
+
+    /**
+     * @brief Sync the upper file, then save the map of the blocks that points into it.
+     */
+    long persist(bool dataOnly);
+
+private:
+    std::shared_ptr<IFile> _lower;
+    std::shared_ptr<IFile> _upper;
+    std::shared_ptr<Blocks> _blocks;
+    std::size_t _readPos;
+    std::mutex _mutex;  // _readPos
+};
+
+}
+
+#endif // !COPYUPFILE_H
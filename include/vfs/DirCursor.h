@@ -0,0 +1,85 @@
+#ifndef DIRCURSOR_H
+#define DIRCURSOR_H
+
+#include <dirent.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Streaming listing of a directory, recursive (depth first, like list()) or not. Entries come a batch at a
+ time straight from readdir, only the directories on the way down are kept open, so memory doesn't depend on the
+ size of the tree. Subdirectories are opened relative to their parent and never through a symbolic link. cookie() remembers the position after the last entry returned and a new cursor opened with it
+ continues from there, the way NFS READDIR pages through a directory.
+ */
+class DirCursor
+{
+public:
+    typedef std::vector<std::string> EntryList;
+
+    constexpr static std::size_t DEFAULT_BATCH = 256;
+
+    // Cookie of a cursor that returned everything.
+    constexpr static char const * END = "end";
+
+public:
+    /**
+     * @param directory - directory to list, entries are returned as directory + '/' + name
+     * @param recursive - descend into the subdirectories
+     * @param cookie - cookie() of an earlier cursor over the same directory, empty to start at the beginning
+     */
+    DirCursor(std::string const & directory, bool recursive = true, std::string const & cookie = "");
+
+    /**
+     * @brief The cursor over the directory open at dir, which it takes over, for a caller that opened it in a way a
+     path can't be, beneath another directory for one. Entries are named after directory all the same.
+     */
+    DirCursor(int dir, std::string const & directory, bool recursive = true, std::string const & cookie = "");
+    DISABLE_COPY(DirCursor);
+    ~DirCursor();
+
+    /**
+     * @brief The next entries, at most count of them.
+     *
+     * @return EntryList - empty once the listing is done
+     */
+    EntryList next(std::size_t count = DEFAULT_BATCH);
+
+    bool done() const { return _levels.empty(); }
+
+    /**
+     * @brief Opaque position after the last entry returned.
+     */
+    std::string cookie() const;
+
+private:
+    struct Level
+    {
+        DIR * dir;
+        std::string path;   // ends with '/'
+        std::string name;   // entry of the parent level this directory is
+    };
+
+    /**
+     * @brief Read the directory open at fd from position on, or -1 for the beginning, below the levels there are.
+     */
+    bool push(int fd, std::string const & path, std::string const & name, long position);
+
+    /**
+     * @brief Open the subdirectory name of the deepest level, never through a symbolic link or out of it.
+     */
+    int openBelow(std::string const & name) const;
+
+    void restore(std::string const & cookie);
+
+private:
+    std::vector<Level> _levels;
+    bool _recursive;
+};
+
+}
+
+#endif // !DIRCURSOR_H
@@ -1,14 +1,42 @@
 #ifndef FILESYSTEM_H
 #define FILESYSTEM_H
 
+#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <utility>
+#include "BlockCache.h"
+#include "Codec.h"
+#include "CompressedFile.h"
+#include "CopyEngine.h"
+#include "DirCursor.h"
+#include "HandleTable.h"
 #include "IFS.h"
 #include "IFile.h"
+#include "LockStats.h"
+#include "PathIndex.h"
+#include "PathHandle.h"
+#include "PathLocks.h"
+#include "RegularFile.h"
+#include "TreeWalker.h"
 #include "global.h"
 
 namespace VFS {
 
+/**
+ * @brief The native filesystem below a directory. The mount holds a descriptor of the directory and every name is
+ looked up relative to it with the *at() calls, never leaving it (see PathHandle::openBeneath()): list() and openDir()
+ walk from a descriptor opened that way and don't follow symbolic links below it, moves to another FileSystem look up
+ the target beneath its root. Only the path index behind contain() and search() checks its entries by the path of
+ the mount, it holds no more than the scans of the tree found, which don't follow symbolic links either. The calls
+ that take a PathHandle skip checking and normalizing the name again, those that take a string intern it first.
+ */
 class FileSystem : public IFS
 {
 public:
@@ -24,39 +52,195 @@ public:
 
     bool unmount() override;
 
+    /**
+     * @brief Opens of the same path share one descriptor from the handle table, see setHandleBudget().
+     */
     IFilePtr open(std::string const & filename, Perms mode = Perms::RW) override;
 
+    IFilePtr open(PathHandle const & path, Perms mode = Perms::RW);
+
     bool remove(std::string const & filename) override;
 
+    bool remove(PathHandle const & path);
+
     bool touchFile(std::string const & filename) override;
 
+    bool touchFile(PathHandle const & path);
+
     bool makeDir(std::string const & dir) override;
 
+    bool makeDir(PathHandle const & dir);
+
     bool moveTo(std::string const & from, std::string const & to) override;
 
+    /**
+     * @brief Fails when to exists, checked by the rename itself where the filesystem has RENAME_NOREPLACE.
+     */
+    bool moveTo(PathHandle const & from, PathHandle const & to);
+
+    /**
+     * @brief Renames when fsptr is a FileSystem on the same device. Otherwise the file, or the directory with
+     everything below it, is streamed into fsptr (see CopyEngine::stream()). Every file is removed from here only once
+     its copy is flushed, permissions and modification times are kept when fsptr is a FileSystem as well. A failure
+     part way leaves the entries not moved yet in place.
+     */
     bool moveTo(std::string const & from, IFSPtr fsptr, std::string const & to) override;
 
     EntryList list() override;
 
+    /**
+     * @brief Every entry below dir, in the order of TreeWalker::sortedBefore() however many threads walk the tree.
+     */
     EntryList list(std::string const & dir) override;
 
+    /**
+     * @brief Cursor over the entries list(dir) returns, in batches and in the order readdir gives them.
+     *
+     * @param recursive - descend into the subdirectories
+     * @param cookie - DirCursor::cookie() of an earlier cursor over dir, to continue where it stopped
+     * @return nullptr - dir isn't a directory of this filesystem
+     */
+    std::unique_ptr<DirCursor> openDir(std::string const & dir, bool recursive = true, std::string const & cookie = "");
+
     bool contain(std::string const & filename) override;
 
     std::string search(std::string const & filename) override;
 
+    /**
+     * @brief Every entry whose "./relative" path contains pattern, answered from the index without touching the
+     disk, so entries changed outside the filesystem show up once their directory is looked up again.
+     *
+     * @param offset - matches to skip, for paging
+     * @param limit - matches to return at most
+     */
+    EntryList searchAll(std::string const & pattern, std::size_t offset = 0, std::size_t limit = SearchIndex::ALL);
+
+    /**
+     * @brief Like searchAll() for the entries whose relative path starts with prefix, for completion.
+     */
+    EntryList searchPrefix(std::string const & prefix, std::size_t offset = 0, std::size_t limit = SearchIndex::ALL);
+
     bool copy(std::string const & from, std::string const & to) override;
 
+    /**
+     * @brief copy() that tells which mechanism moved the data and how much of it, see CopyEngine.
+     */
+    CopyEngine::Result copyFile(std::string const & from, std::string const & to, CopyEngine::Progress const & progress = nullptr);
+
+    CopyEngine::Result copyFile(PathHandle const & from, PathHandle const & to, CopyEngine::Progress const & progress = nullptr);
+
     type::FILETYPE type(std::string const & filename) override;
 
+    type::FILETYPE type(PathHandle const & path);
+
+    /**
+     * @brief Share a block cache between all files opened from now on, for example BlockCache::global().
+     Files already open keep the cache they were opened with. Pass nullptr to stop caching.
+     */
+    void setBlockCache(std::shared_ptr<BlockCache> cache);
+
+    std::shared_ptr<BlockCache> blockCache();
+
+    /**
+     * @brief Buffer the writes of files opened for writing from now on, see RegularFile::setWriteBehind(). Limit 0
+     (the default) writes straight to the files.
+     */
+    void setWriteBehind(std::size_t limit, std::chrono::milliseconds delay = RegularFile::DEFAULT_WRITE_BEHIND_DELAY);
+
+    /**
+     * @brief Store the files created below dir, "." for all of them, as a CompressedFile with codec from now on,
+     nullptr keeps them as they are again, also below a directory that is compressed. Files open already stay as they
+     are. A file there that isn't empty and wasn't compressed is opened as it is. A compressed file is told by its
+     header and opened as one wherever it is, also after it was moved or copied out of the directory or compression
+     was turned off, its blocks are read with the codec they were stored with and new ones are stored as they are
+     outside a compressed directory. Moves to another filesystem decompress it.
+     *
+     * @return false - dir isn't a valid path
+     */
+    bool setCompression(std::shared_ptr<Codec> codec, std::string const & dir = ".");
+
+    /**
+     * @brief Threads that list(dir) walks the tree with, 0 (the default) for one per core.
+     */
+    void setWalkThreads(std::size_t threads);
+
+    /**
+     * @brief Descriptors kept open for reuse by later opens (HandleTable::DEFAULT_BUDGET by default), 0 to open
+     every file anew.
+     */
+    void setHandleBudget(std::size_t budget);
+
+    HandleTable::Stats handleStats() const;
+
+    /**
+     * @brief Time the waits for and holds of the mount lock from now on, by operation, and the range locks of the
+     files opened while enabled, see RegularFile::setLockStats(). Off by default, the locks are taken as they are then.
+     */
+    void setLockStats(bool enabled);
+
+    /**
+     * @brief What the mount lock recorded, nullptr if it was never enabled. Disabling keeps the numbers.
+     */
+    std::shared_ptr<LockStats> lockStats();
+
 private:
-    bool validFilename(std::string const & filename);
+    typedef LockStats::Guard<std::shared_lock<std::shared_mutex>> SharedGuard;
+    typedef LockStats::Guard<std::unique_lock<std::shared_mutex>> UniqueGuard;
+
+    /**
+     * @brief Stream the entry name of the directory open at dir, from below the root, and what is below it to to in
+     target, and remove it here afterwards.
+     *
+     * @param disk - target as a FileSystem, whose metadata can be set, nullptr for another one
+     */
+    bool moveAcross(int dir, std::string const & name, std::string const & from, IFS & target, std::string const & to, FileSystem * disk);
+
+    /**
+     * @brief Give name the permissions and times of st and make its entry durable, after a move from another
+     FileSystem.
+     */
+    void settle(std::string const & name, struct stat const & st);
 
     bool hasPermision(Perms perm);
 
+    /**
+     * @brief Drop what is kept about a regular file that is gone, its inode number may be reused by the next file.
+     */
+    void forget(dev_t device, ino_t inode);
+
+    /**
+     * @brief The file name below the root to read what it holds, through a CompressedFile if it is stored
+     compressed, with _mutex held.
+     */
+    IFilePtr openContent(std::string const & name, dev_t device, ino_t inode);
+
+    /**
+     * @brief The store of the compressed file with that inode while it is open, nullptr otherwise.
+     */
+    std::shared_ptr<CompressedFile::Store> storeOf(std::uint64_t device, std::uint64_t inode);
+
+    /**
+     * @brief The codec of the closest directory of name that setCompression() was given, with _mutex held.
+     */
+    std::shared_ptr<Codec> codecFor(std::string const & name) const;
+
 private:
     std::string _path;
-    bool _mounted;
-    std::mutex _mutex;
+    std::atomic<bool> _mounted;
+    int _root;  // descriptor of _path while mounted, what every name is looked up from
+    std::shared_ptr<BlockCache> _cache;
+    std::size_t _behindLimit;
+    std::chrono::milliseconds _behindDelay;
+    PathIndex _index;
+    std::shared_ptr<TreeWalker> _walker;    // std::atomic_load and std::atomic_store only
+    PathLocks _locks;
+    HandleTable _handles;
+    std::shared_ptr<LockStats> _lockStats;
+    std::atomic<LockStats *> _timedLocks;   // _lockStats while enabled
+    std::map<std::string, std::shared_ptr<Codec>> _codecs;  // by directory
+    std::map<std::pair<std::uint64_t, std::uint64_t>, std::weak_ptr<CompressedFile::Store>> _stores;   // by (st_dev, st_ino)
+    std::mutex _storesMutex;
+    std::shared_mutex _mutex;   // mount state, shared by every operation on the mount
 };
 
 }
@@ -0,0 +1,107 @@
+#ifndef GROUPCOMMIT_H
+#define GROUPCOMMIT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Turns the fsync() requests of many threads and files into group commits. A single committer thread takes
+ every request that arrived since the previous commit, syncs each descriptor once for all of them through
+ IoEngine::global() so the flushes of different files overlap, and wakes the callers together. Requests that come in
+ while a commit runs form the next one. The committer also runs the delayed flushes of write-behind buffers.
+ */
+class GroupCommit
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void()> Task;
+
+    struct Stats
+    {
+        std::uint64_t requests;
+        std::uint64_t commits;
+        std::uint64_t syncs;    // fsync calls made, one per descriptor and commit
+    };
+
+public:
+    GroupCommit();
+    DISABLE_COPY(GroupCommit);
+
+    /**
+     * @brief Runs the commit in progress, timers that aren't due are dropped.
+     */
+    ~GroupCommit();
+
+    /**
+     * @brief The process-wide committer, created on first use.
+     */
+    static std::shared_ptr<GroupCommit> global();
+
+    /**
+     * @brief Wait until fd was synced by a commit that started after the call.
+     *
+     * @param dataOnly - fdatasync() is enough, a request for the full fsync() on the same descriptor wins
+     * @return long - 0, or a negative errno
+     */
+    long sync(int fd, bool dataOnly = false);
+
+    /**
+     * @brief Run task on the committer thread at when.
+     *
+     * @return std::uint64_t - id for cancel()
+     */
+    std::uint64_t schedule(Clock::time_point when, Task task);
+
+    /**
+     * @brief Drop a task that hasn't run yet, or wait for it if it is running. Must not be called from a task.
+     */
+    void cancel(std::uint64_t id);
+
+    Stats stats() const;
+
+private:
+    struct Request
+    {
+        int fd;
+        bool dataOnly;
+        long result;
+        bool done;
+    };
+
+    typedef std::multimap<Clock::time_point, std::pair<std::uint64_t, Task>> Timers;
+
+    void run();
+
+    /**
+     * @brief Sync every descriptor of the batch once and fill in the results.
+     */
+    void commit(std::vector<Request *> & batch);
+
+private:
+    std::vector<Request *> _pending;
+    Timers _timers;
+    std::unordered_map<std::uint64_t, Timers::iterator> _ids;
+    std::uint64_t _nextId;
+    std::uint64_t _running;     // id of the task being run, 0 for none
+    Stats _stats;
+    bool _stopping;
+    mutable std::mutex _mutex;
+    std::condition_variable _wake;  // the committer waits for requests and timers
+    std::condition_variable _done;  // callers wait for their commit and cancel() for a running task
+    std::thread _committer;
+};
+
+}
+
+#endif // !GROUPCOMMIT_H
@@ -0,0 +1,136 @@
+#ifndef HANDLETABLE_H
+#define HANDLETABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "BlockCache.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Descriptors of native files kept open by path, so that opening the same file again costs one fstat()
+ instead of open(), stat() and close(). Every open of a path shares its handle, which is only closed when the table
+ and every file using it have let go of it. Past the budget, the least recently used handles no file holds are
+ closed. A handle whose file was unlinked or replaced is noticed (no links left) and opened again; the filesystem
+ forgets the paths it removes or renames itself with invalidate().
+ */
+class HandleTable
+{
+public:
+    constexpr static std::size_t DEFAULT_BUDGET = 256;
+
+    // One open descriptor shared by the files opened through the table.
+    class Handle
+    {
+    public:
+        Handle(int fd, BlockCache::FileId id, unsigned mode);
+        ~Handle();
+        DISABLE_COPY(Handle);
+
+        int fd() const { return _fd; }
+
+        BlockCache::FileId id() const { return _id; }
+
+        /**
+         * @brief st_mode as of the last time the handle was acquired.
+         */
+        unsigned mode() const { return _mode; }
+
+        /**
+         * @brief Whether the file holds a compressed one: 1 or 0, -1 while nobody looked yet.
+         */
+        int compressed() const { return _compressed; }
+
+        void setCompressed(bool compressed) { _compressed = compressed ? 1 : 0; }
+
+    private:
+        friend class HandleTable;
+        int _fd;
+        BlockCache::FileId _id;
+        std::atomic<unsigned> _mode;
+        std::atomic<int> _compressed;
+    };
+
+    typedef std::shared_ptr<Handle> HandlePtr;
+
+    struct Stats
+    {
+        std::uint64_t hits;
+        std::uint64_t opens;
+        std::uint64_t evictions;
+    };
+
+public:
+    /**
+     * @param budget - descriptors kept open for reuse, 0 to open every file anew
+     */
+    HandleTable(std::size_t budget = DEFAULT_BUDGET);
+    DISABLE_COPY(HandleTable);
+    ~HandleTable();
+
+    /**
+     * @brief The handle of a regular file, opened read-write if allowed and read-only otherwise.
+     *
+     * @param path - absolute path
+     * @return nullptr - path doesn't exist or isn't a regular file
+     */
+    HandlePtr acquire(std::string const & path);
+
+    /**
+     * @brief acquire() of a path relative to the directory dir, opened with PathHandle::openBeneath(). The table is
+     keyed by path alone, so one table serves one directory.
+     */
+    HandlePtr acquire(int dir, std::string const & path);
+
+    /**
+     * @brief Forget path and everything below it. Files already open keep their handle.
+     */
+    void invalidate(std::string const & path);
+
+    void clear();
+
+    void setBudget(std::size_t budget);
+
+    /**
+     * @brief Handles the table holds.
+     */
+    std::size_t size() const;
+
+    Stats stats() const;
+
+private:
+    typedef std::list<std::string> Lru;    // most recently used first
+
+    struct Entry
+    {
+        HandlePtr handle;
+        Lru::iterator position;
+    };
+
+    /**
+     * @brief Close unused handles from the back of the LRU order until the table fits the budget.
+     */
+    void evict();
+
+    void erase(std::unordered_map<std::string, Entry>::iterator it);
+
+private:
+    std::unordered_map<std::string, Entry> _entries;
+    Lru _lru;
+    std::size_t _budget;
+    std::uint64_t _hits;
+    std::uint64_t _opens;
+    std::uint64_t _evictions;
+    mutable std::mutex _mutex;
+};
+
+}
+
+#endif // !HANDLETABLE_H
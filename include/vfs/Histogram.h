@@ -0,0 +1,76 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace VFS {
+
+/**
+ * @brief Distribution of non-negative values, latencies in nanoseconds for example, in log-linear buckets like an HDR
+ histogram: every power of two is split into SUB_BUCKETS equal buckets, so a value is known to within 1/SUB_BUCKETS of
+ itself however large it is. Values from 2^MAX_EXPONENT on are counted in the last bucket. Histograms of the same
+ kind add up with merge().
+ */
+class Histogram
+{
+public:
+    constexpr static unsigned SUB_BITS = 4;
+    constexpr static std::uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+    constexpr static unsigned MAX_EXPONENT = 44;   // about 4.9 hours in nanoseconds
+    constexpr static std::size_t BUCKETS = ( MAX_EXPONENT - SUB_BITS + 1 ) * SUB_BUCKETS;
+
+public:
+    Histogram();
+
+    void record(std::uint64_t value);
+
+    /**
+     * @brief Add count values that fall into bucket, for recorders that keep the buckets themselves.
+     */
+    void add(std::size_t bucket, std::uint64_t count);
+
+    void merge(Histogram const & other);
+
+    std::uint64_t count() const { return _count; }
+
+    /**
+     * @brief Smallest and largest value of the bucket the extreme values fell into, 0 while empty.
+     */
+    std::uint64_t min() const;
+
+    std::uint64_t max() const;
+
+    double mean() const;
+
+    /**
+     * @brief Value below which the given share of the values fall, the upper bound of its bucket.
+     *
+     * @param percentile - 0 to 100
+     */
+    std::uint64_t percentile(double percentile) const;
+
+    std::uint64_t at(std::size_t bucket) const { return _buckets[bucket]; }
+
+    static std::size_t bucketOf(std::uint64_t value);
+
+    /**
+     * @brief Smallest value of a bucket.
+     */
+    static std::uint64_t lowerBound(std::size_t bucket);
+
+    /**
+     * @brief Largest value of a bucket.
+     */
+    static std::uint64_t upperBound(std::size_t bucket);
+
+private:
+    std::array<std::uint64_t, BUCKETS> _buckets;
+    std::uint64_t _count;
+    double _sum;    // of the middles of the buckets
+};
+
+}
+
+#endif // !HISTOGRAM_H
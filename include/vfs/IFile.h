@@ -2,6 +2,8 @@
 #define IFILE_H
 
 #include <cstddef>
+#include <functional>
+#include <future>
 #include <string>
 #include <vector>
 #include "FileInfo.h"
@@ -22,6 +24,29 @@ public:
     typedef char DataT;
     typedef std::vector<DataT> Buffer;
 
+    // One range of a batched read, read holds the bytes read into dst afterwards.
+    struct ReadRange
+    {
+        std::size_t offset;
+        std::size_t size;
+        DataT * dst;
+        std::size_t read = 0;
+    };
+
+    // One range of a batched write, written holds the bytes written from src afterwards.
+    struct WriteRange
+    {
+        std::size_t offset;
+        std::size_t size;
+        DataT const * src;
+        std::size_t written = 0;
+    };
+
+    /**
+     * @brief Completion of an asynchronous operation: bytes transferred, 0 for fsyncAsync(), or a negative errno.
+     */
+    typedef std::function<void(long result)> Completion;
+
 public:
     IFile() = default;
     virtual ~IFile() = default;
@@ -69,6 +94,107 @@ public:
 
     virtual Buffer readAll() = 0;
 
+    /**
+     * @brief Read data from the offset position into memory owned by the caller, nothing is allocated.
+     *
+     * @param dst - at least size bytes long
+     * @param offset - relative to the start position of the file
+     * @param size - need to read
+     * @return std::size_t - bytes copied into dst, less than size when the end of the file is reached
+     */
+    virtual std::size_t read(DataT * dst, std::size_t offset, std::size_t size) = 0;
+
+    /**
+     * @brief Write data from memory owned by the caller, the data doesn't need to live in a Buffer.
+     *
+     * @param src - at least size bytes long
+     * @param offset - relative to the start position of the file
+     * @param size - wrote to this file
+     * @return std::size_t - successfully wrote size
+     */
+    virtual std::size_t write(DataT const * src, std::size_t offset, std::size_t size) = 0;
+
+    /**
+     * @brief Read data from the offset position into a buffer that is reused across calls. The buffer only grows,
+     so reading the same amount again neither allocates nor clears memory. Its size is set to the bytes read.
+     *
+     * @param buf - reused buffer
+     * @param offset - relative to the start position of the file
+     * @param size - need to read
+     * @return std::size_t - bytes read, equal to buf.size() afterwards
+     */
+    std::size_t read(Buffer & buf, std::size_t offset, std::size_t size)
+    {
+        if ( buf.size() < size )
+            buf.resize(size);
+
+        auto n = read(buf.data(), offset, size);
+        buf.resize(n);
+
+        return n;
+    }
+
+    /**
+     * @brief Read many ranges of the file at once, for example the pieces of a compound request. The default reads
+     them one by one, implementations may sort and merge them into fewer system calls.
+     *
+     * @param ranges - every range gets its own read count
+     * @return std::size_t - bytes read over all ranges
+     */
+    virtual std::size_t readBatch(std::vector<ReadRange> & ranges);
+
+    /**
+     * @brief Write many ranges at once, gathered from separate buffers. Ranges that overlap each other are written
+     in the order of their offsets.
+     *
+     * @param ranges - every range gets its own write count
+     * @return std::size_t - bytes written over all ranges
+     */
+    virtual std::size_t writeBatch(std::vector<WriteRange> & ranges);
+
+    /**
+     * @brief Start reading into dst and return at once, done is called from another thread when the data is there.
+     The file and dst must outlive the call to done. The default runs read() on the pool of IoEngine::global().
+     *
+     * @param dst - at least size bytes long
+     * @param offset - relative to the start position of the file
+     * @param size - need to read
+     * @param done - gets the bytes read, fewer than size at the end of the file
+     */
+    virtual void readAsync(DataT * dst, std::size_t offset, std::size_t size, Completion done);
+
+    /**
+     * @brief Start writing src and return at once, done is called from another thread when the data is written.
+     */
+    virtual void writeAsync(DataT const * src, std::size_t offset, std::size_t size, Completion done);
+
+    /**
+     * @brief Flush what was written to the storage and call done. The default has nothing to flush.
+     */
+    virtual void fsyncAsync(Completion done);
+
+    /**
+     * @brief readAsync() with a future instead of a callback.
+     */
+    std::future<long> readAsync(DataT * dst, std::size_t offset, std::size_t size);
+
+    std::future<long> writeAsync(DataT const * src, std::size_t offset, std::size_t size);
+
+    std::future<long> fsyncAsync();
+
+    /**
+     * @brief Write out whatever is still buffered and wait until the file is on the storage, like fsync(). The
+     default waits for fsyncAsync().
+     *
+     * @return long - 0, or a negative errno, also for a buffered write that failed since the last sync
+     */
+    virtual long sync();
+
+    /**
+     * @brief sync() without the metadata that isn't needed to read the data back, like fdatasync().
+     */
+    virtual long datasync();
+
     virtual void close() = 0;
 
     /**
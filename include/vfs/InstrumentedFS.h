@@ -0,0 +1,77 @@
+#ifndef INSTRUMENTEDFS_H
+#define INSTRUMENTEDFS_H
+
+#include <memory>
+#include <string>
+#include "IFS.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Decorator that times every call to the filesystem it wraps and records it in a Metrics. A call counts as
+ failed when it returns false, nullptr or type::NOTFOUND. Files opened through it are InstrumentedFiles recording
+ into the same Metrics, so one snapshot() covers the filesystem and all of its files. With a Tracer every call is
+ also traced, for Replay.
+ */
+class InstrumentedFS : public IFS
+{
+public:
+    /**
+     * @param fs - the filesystem to measure
+     * @param metrics - may be shared between several filesystems, a new one if nullptr
+     * @param tracer - traces the calls of the filesystem and its files if not nullptr
+     */
+    InstrumentedFS(IFSPtr fs, std::shared_ptr<Metrics> metrics = nullptr, std::shared_ptr<Tracer> tracer = nullptr);
+    DISABLE_COPY(InstrumentedFS);
+    ~InstrumentedFS();
+
+    std::string path() const override;
+
+    bool isMounted() const override;
+
+    bool mount(std::string const & path) override;
+
+    bool unmount() override;
+
+    IFilePtr open(std::string const & filename, Perms mode = Perms::RW) override;
+
+    bool remove(std::string const & filename) override;
+
+    bool touchFile(std::string const & filename) override;
+
+    bool makeDir(std::string const & dir) override;
+
+    bool moveTo(std::string const & from, std::string const & to) override;
+
+    bool moveTo(std::string const & from, IFSPtr fsptr, std::string const & to) override;
+
+    EntryList list() override;
+
+    EntryList list(std::string const & dir) override;
+
+    bool contain(std::string const & filename) override;
+
+    std::string search(std::string const & filename) override;
+
+    bool copy(std::string const & from, std::string const & to) override;
+
+    type::FILETYPE type(std::string const & filename) override;
+
+    IFSPtr inner() const { return _fs; }
+
+    std::shared_ptr<Metrics> metrics() const { return _metrics; }
+
+    std::shared_ptr<Tracer> tracer() const { return _tracer; }
+
+private:
+    IFSPtr _fs;
+    std::shared_ptr<Metrics> _metrics;
+    std::shared_ptr<Tracer> _tracer;
+};
+
+}
+
+#endif // !INSTRUMENTEDFS_H
@@ -0,0 +1,94 @@
+#ifndef INSTRUMENTEDFILE_H
+#define INSTRUMENTEDFILE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "IFile.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Decorator that times every call to the file it wraps and records it in a Metrics, together with the bytes
+ moved. Asynchronous calls are timed until their completion runs. InstrumentedFS::open() hands these out, with the
+ tracer of the filesystem and the handle and path its open was traced with.
+ */
+class InstrumentedFile : public IFile
+{
+public:
+    InstrumentedFile(std::shared_ptr<IFile> file, std::shared_ptr<Metrics> metrics, std::shared_ptr<Tracer> tracer = nullptr,
+                     std::uint64_t handle = 0, std::string const & path = std::string());
+    ~InstrumentedFile();
+    DISABLE_COPY(InstrumentedFile);
+
+    using IFile::read;
+    using IFile::write;
+    using IFile::readAsync;
+    using IFile::writeAsync;
+    using IFile::fsyncAsync;
+
+    std::size_t write(Buffer const & buf, std::size_t size) override;
+
+    std::size_t write(Buffer const & buf, std::size_t offset, std::size_t size) override;
+
+    Buffer read(std::size_t size) override;
+
+    Buffer read(std::size_t offset, std::size_t size) override;
+
+    Buffer readAll() override;
+
+    std::size_t read(DataT * dst, std::size_t offset, std::size_t size) override;
+
+    std::size_t write(DataT const * src, std::size_t offset, std::size_t size) override;
+
+    std::size_t readBatch(std::vector<ReadRange> & ranges) override;
+
+    std::size_t writeBatch(std::vector<WriteRange> & ranges) override;
+
+    void readAsync(DataT * dst, std::size_t offset, std::size_t size, Completion done) override;
+
+    void writeAsync(DataT const * src, std::size_t offset, std::size_t size, Completion done) override;
+
+    void fsyncAsync(Completion done) override;
+
+    long sync() override;
+
+    long datasync() override;
+
+    void close() override;
+
+    FileInfo info() const override;
+
+    std::size_t size() const override;
+
+    std::string filename() const override;
+
+    FileInfo::PermisionsT permision() const override;
+
+    void setPermision(Perms perms) override;
+
+    void disableWrite() override;
+
+    void disableRead() override;
+
+    void disableAll() override;
+
+    std::shared_ptr<IFile> inner() const { return _file; }
+
+private:
+    Completion timed(Metrics::Op op, std::uint64_t offset, std::uint64_t size, Completion done) const;
+
+private:
+    std::shared_ptr<IFile> _file;
+    std::shared_ptr<Metrics> _metrics;
+    std::shared_ptr<Tracer> _tracer;
+    std::uint64_t _handle;
+    std::string _path;      // as opened
+};
+
+}
+
+#endif // !INSTRUMENTEDFILE_H
@@ -0,0 +1,149 @@
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include <sys/uio.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "global.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace VFS {
+
+/**
+ * @brief Asynchronous positional I/O on file descriptors. On Linux requests go through an io_uring: they are put
+ in the submission ring by the calling thread and a single thread reaps the completion ring, so hundreds of requests
+ can be in flight without a thread each. When io_uring isn't available (old kernel, seccomp) the same requests run
+ on a small thread pool. Callbacks run on the reaping thread or on a pool thread and must not block.
+ */
+class IoEngine
+{
+public:
+    /**
+     * @brief Completion of a request: bytes transferred (fewer only at the end of the file), 0 for fsync, or a
+     negative errno.
+     */
+    typedef std::function<void(long result)> Callback;
+
+    constexpr static unsigned DEFAULT_ENTRIES = 256;
+    constexpr static std::size_t DEFAULT_THREADS = 4;
+
+public:
+    /**
+     * @param entries - requests in flight in the ring before submitters wait
+     * @param threads - threads of the pool, used for submit() and when there is no ring
+     * @param uring - try io_uring first, false always uses the pool
+     */
+    IoEngine(unsigned entries = DEFAULT_ENTRIES, std::size_t threads = DEFAULT_THREADS, bool uring = true);
+    DISABLE_COPY(IoEngine);
+
+    /**
+     * @brief Waits for every request in flight.
+     */
+    ~IoEngine();
+
+    /**
+     * @brief The process-wide engine, created on first use.
+     */
+    static std::shared_ptr<IoEngine> global();
+
+    bool usesUring() const { return _ring >= 0; }
+
+    /**
+     * @brief Read size bytes at offset into dst, which must stay valid until done is called.
+     */
+    void read(int fd, void * dst, std::size_t size, std::uint64_t offset, Callback done);
+
+    void write(int fd, void const * src, std::size_t size, std::uint64_t offset, Callback done);
+
+    /**
+     * @param dataOnly - fdatasync(), skip metadata that isn't needed to read the data back
+     */
+    void fsync(int fd, bool dataOnly, Callback done);
+
+    /**
+     * @brief Run work on the pool and pass what it returns to done.
+     */
+    void submit(std::function<long()> work, Callback done);
+
+private:
+    enum class Op
+    {
+        READ,
+        WRITE,
+        FSYNC,
+    };
+
+    struct Request
+    {
+        Op op;
+        int fd;
+        char * data;
+        std::size_t size;
+        std::uint64_t offset;
+        std::size_t done;       // bytes already transferred, short transfers are resubmitted
+        bool dataOnly;
+        Callback callback;
+        iovec iov;
+    };
+
+    void start(Request * request);
+
+    bool setupRing(unsigned entries);
+
+    void teardownRing();
+
+    /**
+     * @brief Put a request in the submission ring. New requests wait for a free slot, resubmissions already own one.
+     *
+     * @return 0 or a negative errno
+     */
+    long push(Request * request, bool fresh);
+
+    void reap();
+
+    void finish(Request * request, long result);
+
+    static long perform(Request & request);
+
+    void work();
+
+private:
+    int _ring;
+    unsigned _entries;          // completion slots, requests in flight at most
+    void * _sqRing;
+    std::size_t _sqRingSize;
+    void * _cqRing;
+    std::size_t _cqRingSize;
+    io_uring_sqe * _sqes;
+    std::size_t _sqesSize;
+    unsigned * _sqTail;
+    unsigned * _sqMask;
+    unsigned * _sqArray;
+    unsigned * _cqHead;
+    unsigned * _cqTail;
+    unsigned * _cqMask;
+    io_uring_cqe * _cqes;
+    std::size_t _inflight;
+    std::mutex _ringMutex;
+    std::condition_variable _slots;
+    std::thread _reaper;
+
+    std::deque<std::function<void()>> _tasks;
+    bool _stopping;
+    std::mutex _poolMutex;
+    std::condition_variable _poolCv;
+    std::vector<std::thread> _workers;
+};
+
+}
+
+#endif // !IOENGINE_H
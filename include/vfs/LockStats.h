@@ -0,0 +1,176 @@
+#ifndef LOCKSTATS_H
+#define LOCKSTATS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Histogram.h"
+#include "Metrics.h"
+#include "ThreadShards.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Contention of one lock, by the operation that took it: how often it was taken, how often it wasn't free at
+ once, and how long it was waited for and held, in nanoseconds. Recording goes to per-thread counters like Metrics,
+ but the times are only counted by power of two: every file may have a LockStats, and a shard of every thread for
+ every one of them with buckets as fine as Metrics has would be far bigger than what it counts. The histograms of
+ snapshot() put a time at the largest value of its power of two. A thread that ends adds its counts to those of the
+ threads that ended before and frees its shards.
+ Locks report here through Guard, or Wait for locks that are more than a mutex, only while they are given a LockStats.
+ */
+class LockStats
+{
+public:
+    typedef Metrics::Clock Clock;
+
+    struct OpStats
+    {
+        Metrics::Op op;
+        std::uint64_t acquisitions;
+        std::uint64_t contended;    // the lock wasn't free at the first try
+        Histogram wait;
+        Histogram hold;
+    };
+
+    // Times one acquisition from its construction to done(). Without a LockStats it only takes the lock.
+    class Wait
+    {
+    public:
+        explicit Wait(LockStats * stats) : _stats(stats), _start(stats != nullptr ? Clock::now() : Clock::time_point()), _contended(false) {}
+        DISABLE_COPY(Wait);
+
+        template<typename Lock>
+        void lock(Lock & lock)
+        {
+            if ( _stats == nullptr )
+            {
+                lock.lock();
+            }
+            else if ( !lock.try_lock() )
+            {
+                _contended = true;
+                lock.lock();
+            }
+        }
+
+        /**
+         * @brief The lock was free but something else had to be waited for, like a condition.
+         */
+        void contended() { _contended = true; }
+
+        /**
+         * @brief Record the wait.
+         *
+         * @return Clock::time_point - now, to time the hold from, or the epoch without a LockStats
+         */
+        Clock::time_point done(Metrics::Op op)
+        {
+            if ( _stats == nullptr )
+                return Clock::time_point();
+
+            auto now = Clock::now();
+            _stats->recordWait(op, nanos(now - _start), _contended);
+            return now;
+        }
+
+    private:
+        LockStats * _stats;
+        Clock::time_point _start;
+        bool _contended;
+    };
+
+    // A std::unique_lock or std::shared_lock that reports its wait and hold.
+    template<typename Lock>
+    class Guard
+    {
+    public:
+        template<typename Mutex>
+        Guard(LockStats * stats, Metrics::Op op, Mutex & mutex)
+            : _stats(stats)
+              , _op(op)
+              , _lock(mutex, std::defer_lock)
+              , _since()
+        {
+            Wait wait(stats);
+            wait.lock(_lock);
+            _since = wait.done(op);
+        }
+        DISABLE_COPY(Guard);
+
+        ~Guard()
+        {
+            if ( _stats == nullptr || !_lock.owns_lock() )
+                return;
+
+            auto held = Clock::now() - _since;
+            _lock.unlock();
+            _stats->recordHold(_op, nanos(held));
+        }
+
+    private:
+        LockStats * _stats;
+        Metrics::Op _op;
+        Lock _lock;
+        Clock::time_point _since;
+    };
+
+public:
+    LockStats();
+    DISABLE_COPY(LockStats);
+    ~LockStats();
+
+    void recordWait(Metrics::Op op, std::uint64_t nanos, bool contended);
+
+    void recordHold(Metrics::Op op, std::uint64_t nanos);
+
+    /**
+     * @brief The operations that took the lock at least once.
+     */
+    std::vector<OpStats> snapshot() const;
+
+    void reset();
+
+    static std::uint64_t nanos(Clock::duration duration)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
+
+private:
+    // Times by power of two, the last one takes what is longer.
+    constexpr static std::size_t BUCKETS = Histogram::MAX_EXPONENT + 1;
+
+    struct Counters
+    {
+        std::atomic<std::uint64_t> acquisitions;
+        std::atomic<std::uint64_t> contended;
+        std::array<std::atomic<std::uint64_t>, BUCKETS> wait;
+        std::array<std::atomic<std::uint64_t>, BUCKETS> hold;
+    };
+
+    // The counters of one thread.
+    struct alignas(64) Shard
+    {
+        std::array<Counters, static_cast<std::size_t>(Metrics::Op::COUNT)> ops;
+    };
+
+    static std::size_t bucketOf(std::uint64_t nanos);
+
+    static std::unique_ptr<Shard> newShard();
+
+    static void clear(Shard & shard);
+
+    static void fold(Shard & into, Shard const & from);
+
+private:
+    ThreadShards<Shard> _shards;
+};
+
+}
+
+#endif // !LOCKSTATS_H
@@ -0,0 +1,133 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "HandleTable.h"
+#include "IFile.h"
+#include "global.h"
+
+namespace VFS {
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief A file of the native filesystem served from a shared memory mapping, meant for read-only or read-mostly
+ data. Reads are a copy out of the page cache without any syscall, view() avoids even that copy. When the file grows
+ the mapping is replaced by a larger one; the previous mappings stay valid until close() so views never dangle.
+ Shrinking the file from elsewhere while it is mapped is not supported.
+ */
+class MappedFile : public IFile
+{
+public:
+    enum class Access
+    {
+        NORMAL,
+        SEQUENTIAL,
+        RANDOM,
+        WILLNEED,
+    };
+
+public:
+    MappedFile(std::string const & filename, bool writable = false);
+
+    /**
+     * @brief Map the descriptor of a handle from a HandleTable read-only instead of opening filename.
+     */
+    MappedFile(std::string const & filename, HandleTable::HandlePtr handle);
+    ~MappedFile();
+    DISABLE_COPY(MappedFile);
+
+    using IFile::read;
+    using IFile::write;
+    using IFile::fsyncAsync;
+
+    std::size_t write(Buffer const & buf, std::size_t size) override;
+
+    std::size_t write(Buffer const & buf, std::size_t offset, std::size_t size) override;
+
+    Buffer read(std::size_t size) override;
+
+    Buffer readAll() override;
+
+    Buffer read(std::size_t offset, std::size_t size) override;
+
+    std::size_t read(DataT * dst, std::size_t offset, std::size_t size) override;
+
+    std::size_t write(DataT const * src, std::size_t offset, std::size_t size) override;
+
+    void fsyncAsync(Completion done) override;
+
+    void close() override;
+
+    FileInfo info() const override;
+
+    std::size_t size() const override;
+
+    std::string filename() const override;
+
+    FileInfo::PermisionsT permision() const override;
+
+    void setPermision(Perms perms) override;
+
+    void disableWrite() override;
+
+    void disableRead() override;
+
+    void disableAll() override;
+
+    /**
+     * @brief Borrow the bytes in [offset, offset + size) straight from the mapping. The view is shorter when the
+     range crosses the end of the file, and stays valid until the file is closed.
+     *
+     * @param offset - relative to the start position of the file
+     * @param size - need to read
+     * @return std::string_view - empty if the file is not readable or offset is beyond the end
+     */
+    std::string_view view(std::size_t offset, std::size_t size);
+
+    /**
+     * @brief Tell the kernel how the mapping will be accessed (madvise). The hint is kept for later remaps.
+     */
+    void advise(Access access);
+
+private:
+    typedef std::pair<void *, std::size_t> Mapping;
+
+    /**
+     * @brief Make sure the bytes up to end are mapped if the file is that long, remapping when it has grown.
+     */
+    void ensureMapped(std::size_t end);
+
+    void applyAdvice() const;
+
+    bool canRead() const;
+
+    bool canWrite() const;
+
+private:
+    std::string _filename;  // absolute path
+    HandleTable::HandlePtr _handle;     // owns _fd when the file was opened through a HandleTable
+    int _fd;
+    std::atomic<bool> _access;
+    std::atomic<bool> _readable;
+    std::atomic<bool> _writable;
+    Access _advice;
+    char * _base;
+    std::size_t _mapped;    // bytes of the file known to be inside the mapping
+    std::size_t _capacity;  // length of the mapping, may run past the end of the file
+    std::vector<Mapping> _retired;
+    std::size_t _readPos;
+    mutable std::shared_mutex _mutex;   // guards the mapping, exclusive only to remap
+    std::mutex _cursorMutex;            // guards _readPos and appends
+};
+
+}
+
+#endif // !MAPPEDFILE_H
@@ -0,0 +1,73 @@
+#ifndef MEMORYFILE_H
+#define MEMORYFILE_H
+
+#include <mutex>
+#include <string>
+#include "IFile.h"
+#include "MemoryNode.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief An open handle to a regular file of a MemoryFileSystem. Every handle keeps its own read cursor while the
+ content and permissions live in the shared node, so a removed file stays readable until its last handle is gone.
+ */
+class MemoryFile : public IFile
+{
+public:
+    MemoryFile(MemoryNode::NodePtr node, std::string const & filename);
+    ~MemoryFile();
+    DISABLE_COPY(MemoryFile);
+
+    using IFile::read;
+    using IFile::write;
+
+    std::size_t write(Buffer const & buf, std::size_t size) override;
+
+    std::size_t write(Buffer const & buf, std::size_t offset, std::size_t size) override;
+
+    Buffer read(std::size_t size) override;
+
+    Buffer readAll() override;
+
+    Buffer read(std::size_t offset, std::size_t size) override;
+
+    std::size_t read(DataT * dst, std::size_t offset, std::size_t size) override;
+
+    std::size_t write(DataT const * src, std::size_t offset, std::size_t size) override;
+
+    void close() override;
+
+    FileInfo info() const override;
+
+    std::size_t size() const override;
+
+    std::string filename() const override;
+
+    FileInfo::PermisionsT permision() const override;
+
+    void setPermision(Perms perms) override;
+
+    void disableWrite() override;
+
+    void disableRead() override;
+
+    void disableAll() override;
+
+private:
+    bool canRead() const;
+
+    bool canWrite() const;
+
+private:
+    MemoryNode::NodePtr _node;
+    std::string _filename;  // relative to the mounted filesystem
+    bool _access;
+    std::size_t _readPos;
+    mutable std::mutex _mutex;
+};
+
+}
+
+#endif // !MEMORYFILE_H
@@ -0,0 +1,88 @@
+#ifndef MEMORYFILESYSTEM_H
+#define MEMORYFILESYSTEM_H
+
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "IFS.h"
+#include "IFile.h"
+#include "MemoryNode.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Filesystem that lives entirely in RAM. The mount path is only a name for the namespace, the tree itself
+ belongs to the object and survives unmount/mount. No operation touches the native filesystem.
+ */
+class MemoryFileSystem : public IFS
+{
+public:
+    MemoryFileSystem(std::string const & path);
+    DISABLE_COPY(MemoryFileSystem);
+    ~MemoryFileSystem();
+
+    std::string path() const override;
+
+    bool isMounted() const override;
+
+    bool mount(std::string const & path) override;
+
+    bool unmount() override;
+
+    IFilePtr open(std::string const & filename, Perms mode = Perms::RW) override;
+
+    bool remove(std::string const & filename) override;
+
+    bool touchFile(std::string const & filename) override;
+
+    bool makeDir(std::string const & dir) override;
+
+    bool moveTo(std::string const & from, std::string const & to) override;
+
+    bool moveTo(std::string const & from, IFSPtr fsptr, std::string const & to) override;
+
+    EntryList list() override;
+
+    EntryList list(std::string const & dir) override;
+
+    bool contain(std::string const & filename) override;
+
+    std::string search(std::string const & filename) override;
+
+    bool copy(std::string const & from, std::string const & to) override;
+
+    type::FILETYPE type(std::string const & filename) override;
+
+private:
+    typedef std::vector<std::string> Components;
+
+    bool split(std::string const & filename, Components & parts) const;
+
+    MemoryNode::NodePtr lookup(Components const & parts) const;
+
+    MemoryNode::NodePtr parentOf(Components const & parts) const;
+
+    bool create(std::string const & filename, MemoryNode::Kind kind);
+
+    MemoryNode::NodePtr detach(std::string const & filename);
+
+    bool attach(std::string const & filename, MemoryNode::NodePtr node);
+
+    /**
+     * @brief Copy node to another filesystem, created holds what was made there, parents first.
+     */
+    bool exportTo(MemoryNode::NodePtr const & node, IFSPtr const & fsptr, std::string const & to, std::vector<std::string> & created) const;
+
+    void walk(MemoryNode::NodePtr const & dir, std::string const & prefix, EntryList & result) const;
+
+private:
+    std::string _path;
+    bool _mounted;
+    MemoryNode::NodePtr _root;
+    mutable std::shared_mutex _mutex;
+};
+
+}
+
+#endif // !MEMORYFILESYSTEM_H
@@ -0,0 +1,92 @@
+#ifndef MEMORYNODE_H
+#define MEMORYNODE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "IFile.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief One entry of the in-memory tree. A directory owns its children by name, a regular file owns its content
+ as a list of fixed-size chunks (extents), so growing a file never moves the bytes already written and a missing
+ chunk is a hole that reads back as zeros. Chunks are shared between copies and cloned on the first write.
+ */
+class MemoryNode
+{
+public:
+    typedef std::shared_ptr<MemoryNode> NodePtr;
+    typedef std::map<std::string, NodePtr> Children;
+    typedef std::shared_ptr<IFile::DataT[]> Chunk;
+
+    enum class Kind
+    {
+        REGULAR,
+        DIRECTORY,
+    };
+
+    constexpr static std::size_t CHUNK_SIZE = 64 * 1024;
+
+public:
+    explicit MemoryNode(Kind kind);
+    DISABLE_COPY(MemoryNode);
+    ~MemoryNode() = default;
+
+    bool isDirectory() const { return _kind == Kind::DIRECTORY; }
+
+    /**
+     * @brief Copy up to size bytes starting at offset into dst.
+     *
+     * @return std::size_t - bytes copied, 0 if offset is at or beyond the end of the file
+     */
+    std::size_t read(IFile::DataT * dst, std::size_t offset, std::size_t size) const;
+
+    /**
+     * @brief Write size bytes from src at offset, growing the file if needed.
+     *
+     * @return std::size_t - bytes written
+     */
+    std::size_t write(IFile::DataT const * src, std::size_t offset, std::size_t size);
+
+    /**
+     * @brief Write size bytes from src at the current end of the file, atomically with respect to other writers.
+     */
+    std::size_t append(IFile::DataT const * src, std::size_t size);
+
+    /**
+     * @brief Replace the content of this file with the content of other. Only the chunk table is copied.
+     */
+    void cloneContent(MemoryNode const & other);
+
+    std::size_t size() const;
+
+    std::chrono::system_clock::time_point modifiedTime() const;
+
+    // Directory entries, guarded by the owning MemoryFileSystem.
+    Children children;
+
+    // Permissions shared by every open handle of this node, like the mode bits of an inode.
+    std::atomic<bool> readable;
+    std::atomic<bool> writable;
+
+private:
+    std::size_t writeLocked(IFile::DataT const * src, std::size_t offset, std::size_t size);
+
+private:
+    Kind _kind;
+    std::vector<Chunk> _chunks;
+    std::size_t _size;
+    std::chrono::system_clock::time_point _mtime;
+    mutable std::shared_mutex _mutex;
+};
+
+} // namespace VFS
+
+#endif // !MEMORYNODE_H
@@ -0,0 +1,136 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Histogram.h"
+#include "ThreadShards.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Call counts, bytes, failures and latency histograms per operation, as recorded by InstrumentedFS and
+ InstrumentedFile. Every thread records into counters of its own, which only it writes, so recording never waits and
+ never shares a cache line with another thread. snapshot() adds the threads up; counts of threads that ended are kept.
+ */
+class Metrics
+{
+public:
+    enum class Op
+    {
+        MOUNT,
+        UNMOUNT,
+        OPEN,
+        REMOVE,
+        TOUCH_FILE,
+        MAKE_DIR,
+        MOVE_TO,
+        LIST,
+        CONTAIN,
+        SEARCH,
+        COPY,
+        TYPE,
+        READ,
+        WRITE,
+        READ_ALL,
+        READ_BATCH,
+        WRITE_BATCH,
+        READ_ASYNC,
+        WRITE_ASYNC,
+        FSYNC,
+        SYNC,
+        SIZE,
+        INFO,
+        CLOSE,
+        CONFIGURE,      // setters of a filesystem or file
+        COUNT,
+    };
+
+    struct OpStats
+    {
+        Op op;
+        std::uint64_t calls;
+        std::uint64_t bytes;
+        std::uint64_t errors;
+        Histogram latency;      // nanoseconds
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    // Measures one call from its construction to done().
+    class Timer
+    {
+    public:
+        Timer(Metrics & metrics, Op op) : _metrics(metrics), _op(op), _start(Clock::now()) {}
+        DISABLE_COPY(Timer);
+
+        void done(std::uint64_t bytes = 0, bool error = false)
+        {
+            _metrics.record(_op, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _start).count(), bytes, error);
+        }
+
+    private:
+        Metrics & _metrics;
+        Op _op;
+        Clock::time_point _start;
+    };
+
+public:
+    Metrics();
+    DISABLE_COPY(Metrics);
+    ~Metrics();
+
+    static char const * name(Op op);
+
+    void record(Op op, std::uint64_t nanos, std::uint64_t bytes = 0, bool error = false);
+
+    /**
+     * @brief The totals of every operation that was called at least once.
+     */
+    std::vector<OpStats> snapshot() const;
+
+    /**
+     * @brief snapshot() as a JSON object keyed by operation name, with percentiles and the non-empty buckets.
+     */
+    std::string toJson() const;
+
+    /**
+     * @brief Start counting from zero. Calls recorded at the same time may be kept or lost.
+     */
+    void reset();
+
+private:
+    struct Counters
+    {
+        std::atomic<std::uint64_t> calls;
+        std::atomic<std::uint64_t> bytes;
+        std::atomic<std::uint64_t> errors;
+        std::array<std::atomic<std::uint64_t>, Histogram::BUCKETS> buckets;
+    };
+
+    // The counters of one thread.
+    struct alignas(64) Shard
+    {
+        std::array<Counters, static_cast<std::size_t>(Op::COUNT)> ops;
+    };
+
+    static std::unique_ptr<Shard> newShard();
+
+    static void clear(Shard & shard);
+
+    static void fold(Shard & into, Shard const & from);
+
+private:
+    ThreadShards<Shard> _shards;
+};
+
+}
+
+#endif // !METRICS_H
@@ -0,0 +1,139 @@
+#ifndef MOUNTROUTER_H
+#define MOUNTROUTER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "IFS.h"
+#include "IFile.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief One namespace over many filesystems attached under path prefixes. Every call goes to the filesystem of the
+ longest prefix of its path, with the prefix taken off, moves and copies between two of them are done across.
+ Directories above a prefix that no filesystem holds are there as empty ones, a prefix itself can't be removed or
+ moved.
+
+ The prefixes are kept in a compressed radix tree that is never changed, attach() and detach() publish a new one
+ that shares what didn't change. A call takes the tree there is when it starts and holds it until it returns, so
+ resolving a path takes no lock of the router. A detached filesystem is released once no call uses a tree that holds
+ it.
+ */
+class MountRouter : public IFS
+{
+public:
+    typedef std::vector<std::pair<std::string, IFSPtr>> MountList;
+
+public:
+    MountRouter(std::string const & path);
+    DISABLE_COPY(MountRouter);
+    ~MountRouter();
+
+    /**
+     * @param prefix - relative, "" or "." for the root
+     *
+     * @return false - the prefix is taken or fs isn't mounted
+     */
+    bool attach(std::string const & prefix, IFSPtr fs);
+
+    bool detach(std::string const & prefix);
+
+    /**
+     * @brief The prefixes and their filesystems, ordered by prefix.
+     */
+    MountList mounts() const;
+
+    std::string path() const override;
+
+    bool isMounted() const override;
+
+    bool mount(std::string const & path) override;
+
+    bool unmount() override;
+
+    IFilePtr open(std::string const & filename, Perms mode = Perms::RW) override;
+
+    bool remove(std::string const & filename) override;
+
+    bool touchFile(std::string const & filename) override;
+
+    bool makeDir(std::string const & dir) override;
+
+    bool moveTo(std::string const & from, std::string const & to) override;
+
+    bool moveTo(std::string const & from, IFSPtr fsptr, std::string const & to) override;
+
+    EntryList list() override;
+
+    /**
+     * @brief What the filesystems under dir hold, with the directories they are attached at, sorted.
+     */
+    EntryList list(std::string const & dir) override;
+
+    bool contain(std::string const & filename) override;
+
+    std::string search(std::string const & filename) override;
+
+    bool copy(std::string const & from, std::string const & to) override;
+
+    type::FILETYPE type(std::string const & filename) override;
+
+private:
+    struct Node;
+    typedef std::shared_ptr<Node const> NodePtr;
+
+    struct Node
+    {
+        std::string label;      // the part of the prefix from the parent on
+        std::string prefix;     // the whole of it with a trailing '/', where fs is attached
+        IFSPtr fs;
+        std::vector<NodePtr> children;  // by the first character of their label
+    };
+
+    struct Route
+    {
+        NodePtr root;           // the tree node is in, held for the whole call
+        Node const * node;      // nullptr when no prefix matches
+        std::string rest;       // the path in node->fs, "." for the prefix itself
+        bool above;             // the path is a directory above some prefix
+    };
+
+    /**
+     * @brief The relative path without "." and empty parts, false for ".." or absolute paths.
+     */
+    static bool normalize(std::string const & filename, std::string & path);
+
+    static void resolve(Node const & root, std::string const & path, Route & route);
+
+    /**
+     * @param root - the tree to resolve in, nullptr for the current one, so that two routes of one call see the same
+     * @return false - the filename isn't valid or the router isn't mounted
+     */
+    bool route(std::string const & filename, std::string & path, Route & route, NodePtr const & root = nullptr) const;
+
+    static NodePtr insert(Node const & node, std::string const & prefix, std::size_t pos, IFSPtr const & fs);
+
+    /**
+     * @return NodePtr - the node without prefix, nullptr if nothing is left of it
+     */
+    static NodePtr erase(Node const & node, std::string const & prefix, std::size_t pos, bool root, bool & found);
+
+    static void collect(Node const & node, std::vector<Node const *> & nodes);
+
+    void publish(NodePtr root);
+
+private:
+    std::string _path;
+    std::atomic<bool> _mounted;
+    NodePtr _root;      // std::atomic_load and std::atomic_store only
+    mutable std::mutex _mutex;  // writers, _path
+};
+
+}
+
+#endif // !MOUNTROUTER_H
@@ -0,0 +1,162 @@
+#ifndef OVERLAYFS_H
+#define OVERLAYFS_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CopyUpFile.h"
+#include "IFS.h"
+#include "IFile.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Union of a writable upper filesystem stacked over read-only lower ones, like overlayfs. Only the upper one
+ is ever changed: new files go there, a lower file opened for writing is copied up block by block as it is written
+ (see CopyUpFile), and removing what a lower layer holds leaves a whiteout in the upper one. A directory that was
+ removed and made again hides what the lower layers hold in it. Whiteouts and the copy-up state are files whose
+ names start with WHITEOUT, they never show. No other name may start with it, so the copy-up state, which starts
+ with it twice, is never the whiteout of a file.
+
+ Every lookup is answered from a merged index built at mount, the layers are only read when a file is opened. The
+ index is all an overlay keeps of its layers, so a mount sees what they hold then.
+ */
+class OverlayFS : public IFS
+{
+public:
+    constexpr static char const * const WHITEOUT = ".wh.";
+    constexpr static char const * const COPY_UP = ".wh..wh..cu.";
+
+public:
+    /**
+     * @param path - the name of the overlay, prefixes what list() returns
+     * @param upper - where the changes go
+     * @param lowers - read-only, the first one is on top
+     */
+    OverlayFS(std::string const & path, IFSPtr upper, std::vector<IFSPtr> lowers);
+    DISABLE_COPY(OverlayFS);
+    ~OverlayFS();
+
+    std::string path() const override;
+
+    bool isMounted() const override;
+
+    /**
+     * @brief Index the layers again under a new name.
+     */
+    bool mount(std::string const & path) override;
+
+    bool unmount() override;
+
+    /**
+     * @brief A file of a lower layer is opened there for reading, and copied up for writing.
+     */
+    IFilePtr open(std::string const & filename, Perms mode = Perms::RW) override;
+
+    /**
+     * @brief Directories only when nothing shows in them any more.
+     */
+    bool remove(std::string const & filename) override;
+
+    bool touchFile(std::string const & filename) override;
+
+    bool makeDir(std::string const & dir) override;
+
+    /**
+     * @brief A lower file is copied to the new name, a directory that a lower layer holds can't be moved.
+     */
+    bool moveTo(std::string const & from, std::string const & to) override;
+
+    /**
+     * @brief Regular files only, streamed to the other filesystem.
+     */
+    bool moveTo(std::string const & from, IFSPtr fsptr, std::string const & to) override;
+
+    EntryList list() override;
+
+    EntryList list(std::string const & dir) override;
+
+    bool contain(std::string const & filename) override;
+
+    std::string search(std::string const & filename) override;
+
+    /**
+     * @brief Regular files only, the copy goes to the upper layer.
+     */
+    bool copy(std::string const & from, std::string const & to) override;
+
+    type::FILETYPE type(std::string const & filename) override;
+
+private:
+    struct Entry
+    {
+        std::size_t layer;      // the topmost that holds it, 0 for the upper one
+        bool directory;
+        bool below;             // a lower layer holds it, removing it takes a whiteout
+        bool partial;           // in the upper layer, the blocks not yet copied are in layer source
+        std::size_t source;
+    };
+
+    typedef std::map<std::string, Entry> Index;
+
+    /**
+     * @brief The path relative to the overlay without "." and empty parts, false for ".." or outside the layers.
+     */
+    static bool normalize(std::string const & filename, std::string & path);
+
+    static std::string hidden(std::string const & path, char const * prefix);
+
+    void build();
+
+    void insert(std::string const & path, Entry const & entry);
+
+    /**
+     * @brief Remove path and what is below it from the index.
+     */
+    void erase(std::string const & path);
+
+    bool parentExists(std::string const & path) const;
+
+    /**
+     * @brief Make the directories above path in the upper layer.
+     */
+    bool makeParents(std::string const & path);
+
+    /**
+     * @brief The copy-up state of a partial file, loaded if no handle has it.
+     */
+    std::shared_ptr<CopyUpFile::Blocks> blocks(std::string const & path, Entry const & entry);
+
+    IFilePtr openLocked(std::string const & path, Perms mode);
+
+    /**
+     * @brief Write the content of an entry into a new file of the upper layer.
+     */
+    bool copyFile(std::string const & from, std::string const & to);
+
+    /**
+     * @brief Copy the blocks of a partial file that are still below, it is an upper file from then on.
+     */
+    bool finishCopyUp(std::string const & path, Entry & entry);
+
+    bool removeLocked(std::string const & path);
+
+private:
+    std::string _path;
+    bool _mounted;
+    std::vector<IFSPtr> _layers;    // the upper one first
+    Index _index;
+    std::unordered_map<std::string, std::set<std::string>> _names;  // paths by their last part, for search()
+    std::unordered_map<std::string, std::weak_ptr<CopyUpFile::Blocks>> _partials;
+    mutable std::shared_mutex _mutex;
+};
+
+}
+
+#endif // !OVERLAYFS_H
@@ -0,0 +1,83 @@
+#ifndef PATHHANDLE_H
+#define PATHHANDLE_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief A relative path checked, normalized and hashed once, for the calls of a FileSystem that take one. Equal
+ paths are interned into one entry, so handles compare and hash by pointer and cost a reference count to copy.
+ "a//b/./c/.." and "a/b" are the same handle; a path that is absolute or climbs above where it starts with ".." is
+ not valid. What the path names is only looked up by the filesystem it is used with, below its root directory.
+ */
+class PathHandle
+{
+public:
+    PathHandle() = default;
+
+    /**
+     * @brief The handle of path, not valid() if it is absolute, empty or climbs out with "..".
+     */
+    static PathHandle intern(std::string const & path);
+
+    /**
+     * @brief Open path below the directory dir like openat(), but never resolving to anything outside it, neither
+     by ".." nor by symbolic links (RESOLVE_BENEATH where the kernel has openat2()). Without openat2() the path is
+     walked a part at a time and no part of it may be a symbolic link, not even one that stays below dir.
+     *
+     * @return int - the descriptor, -1 with errno set if it failed; EXDEV for a path that leads outside dir, ELOOP
+     for a symbolic link on the way without openat2()
+     */
+    static int openBeneath(int dir, std::string const & path, int flags, unsigned mode = 0);
+
+    bool valid() const { return _data != nullptr; }
+
+    /**
+     * @brief The normalized path, "." for the directory it starts from.
+     */
+    std::string const & str() const;
+
+    std::size_t hash() const { return _data != nullptr ? _data->hash : 0; }
+
+    /**
+     * @brief other is this path or below it, by whole parts of the path.
+     */
+    bool contains(PathHandle const & other) const;
+
+    bool operator==(PathHandle const & other) const { return _data == other._data; }
+
+    bool operator!=(PathHandle const & other) const { return _data != other._data; }
+
+private:
+    struct Data
+    {
+        std::string path;
+        std::size_t hash;
+    };
+
+    PathHandle(std::shared_ptr<Data const> data) : _data(std::move(data)) {}
+
+    static bool normalize(std::string const & path, std::string & normalized);
+
+private:
+    std::shared_ptr<Data const> _data;
+};
+
+}
+
+namespace std {
+
+template<>
+struct hash<VFS::PathHandle>
+{
+    std::size_t operator()(VFS::PathHandle const & handle) const { return handle.hash(); }
+};
+
+}
+
+#endif // !PATHHANDLE_H
@@ -0,0 +1,150 @@
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include <sys/types.h>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SearchIndex.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief In-memory index of the entries below a mounted directory, a tree of path components like the kernel's
+ dentry cache. Lookups walk one node per component and run in parallel under a shared lock. Every directory
+ remembers the inode and modification time it had when it was read, and the parent of a looked up entry is checked
+ against them with a single stat: a directory that changed behind the index's back is read again under the
+ exclusive lock, one that vanished is dropped. Paths are relative to the root.
+ A SearchIndex over the same entries is kept up to date with the tree for substring and prefix queries.
+ */
+class PathIndex
+{
+public:
+    typedef std::vector<std::string> Components;
+
+public:
+    PathIndex();
+    DISABLE_COPY(PathIndex);
+    ~PathIndex();
+
+    /**
+     * @brief Index the whole tree below root, replacing what was indexed before.
+     *
+     * @param root - absolute path that ends with '/'
+     */
+    void build(std::string const & root);
+
+    void clear();
+
+    /**
+     * @brief Exact lookup of a file or directory.
+     *
+     * @param relative - path relative to the root, "./" prefixes and repeated '/' are fine
+     */
+    bool contains(std::string const & relative);
+
+    void insert(std::string const & relative, bool directory);
+
+    /**
+     * @brief Forget an entry, with everything below it if it is a directory.
+     */
+    void erase(std::string const & relative);
+
+    void move(std::string const & from, std::string const & to);
+
+    /**
+     * @brief Visit the indexed paths depth first, without touching the disk. Stops when visit returns false.
+     */
+    void forEach(std::function<bool(std::string const & relative)> const & visit) const;
+
+    std::size_t size() const;
+
+    /**
+     * @brief Indexed paths that contain pattern, as "./relative". Only directories revalidated since they changed
+     on the disk are up to date.
+     *
+     * @param offset - matches to skip, for paging
+     * @param limit - matches to return at most
+     */
+    SearchIndex::EntryList find(std::string const & pattern, std::size_t offset = 0, std::size_t limit = SearchIndex::ALL) const;
+
+    /**
+     * @brief Indexed paths that start with prefix, as "./relative". The "./" of prefix may be left out.
+     */
+    SearchIndex::EntryList findPrefix(std::string const & prefix, std::size_t offset = 0, std::size_t limit = SearchIndex::ALL) const;
+
+    /**
+     * @brief Split a relative path into its components. Fails on absolute paths and on "..".
+     */
+    static bool split(std::string const & relative, Components & parts);
+
+private:
+    struct Node
+    {
+        std::unordered_map<std::string, std::unique_ptr<Node>> children;
+        bool directory = false;
+        bool scanned = false;   // children were read from the disk
+        ino_t inode = 0;
+        timespec mtime = {};
+    };
+
+    enum class Lookup
+    {
+        FOUND,
+        MISSING,
+        STALE,      // a directory on the way changed or isn't read yet
+    };
+
+    /**
+     * @brief Lookup that doesn't change the tree, safe under the shared lock.
+     */
+    Lookup lookup(Components const & parts) const;
+
+    /**
+     * @brief Read the children of a directory from the disk, keeping the subtrees of the names that are still there.
+     *
+     * @return false - the directory doesn't exist anymore
+     */
+    bool scan(Node & node, std::string const & absolute);
+
+    /**
+     * @brief Compare a directory with what the disk says and scan it again if it changed.
+     *
+     * @return false - the directory doesn't exist anymore
+     */
+    bool revalidate(Node & node, std::string const & absolute);
+
+    void scanTree(Node & node, std::string const & absolute);
+
+    Node * find(Components const & parts, std::size_t count) const;
+
+    void refreshParent(Components const & parts);
+
+    static std::string join(Components const & parts);
+
+    /**
+     * @brief Take a subtree out of the search index.
+     *
+     * @return the number of entries in the subtree
+     */
+    std::size_t forget(Node const & node, std::string const & relative);
+
+    std::size_t remember(Node const & node, std::string const & relative);
+
+private:
+    std::string _root;
+    std::unique_ptr<Node> _tree;
+    std::size_t _entries;
+    SearchIndex _search;
+    mutable std::shared_mutex _mutex;
+};
+
+}
+
+#endif // !PATHINDEX_H
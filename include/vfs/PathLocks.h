@@ -0,0 +1,79 @@
+#ifndef PATHLOCKS_H
+#define PATHLOCKS_H
+
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Locks for the paths of a filesystem, a fixed table of reader-writer locks that every path hashes into.
+ A mutation locks its path exclusively and every ancestor shared, so creating "a/b/c" and removing "a" exclude
+ each other while two files of the same directory are created in parallel. All the stripes an operation needs are
+ taken at once in increasing order, which keeps a rename that locks two paths free of deadlocks.
+ */
+class PathLocks
+{
+public:
+    constexpr static std::size_t DEFAULT_STRIPES = 256;
+
+    // Holds the stripes of one operation until it is destroyed.
+    class Guard
+    {
+    public:
+        Guard() = default;
+        Guard(Guard && other) noexcept : _held(std::move(other._held)) { other._held.clear(); }
+        Guard & operator=(Guard && other) noexcept;
+        Guard(Guard const &) = delete;
+        Guard & operator=(Guard const &) = delete;
+        ~Guard() { unlock(); }
+
+        void unlock();
+
+    private:
+        friend class PathLocks;
+        std::vector<std::pair<std::shared_mutex *, bool>> _held;   // lock, exclusive
+    };
+
+public:
+    /**
+     * @param stripes - number of locks, rounded up to a power of two
+     */
+    PathLocks(std::size_t stripes = DEFAULT_STRIPES);
+    DISABLE_COPY(PathLocks);
+    ~PathLocks();
+
+    /**
+     * @brief Lock path exclusively and its ancestors shared.
+     *
+     * @param path - path relative to the root, "./" prefixes and repeated '/' are fine
+     */
+    Guard lock(std::string const & path);
+
+    /**
+     * @brief Lock two paths at once, for renames and copies.
+     */
+    Guard lock(std::string const & first, std::string const & second);
+
+    std::size_t stripes() const { return _mask + 1; }
+
+private:
+    typedef std::vector<std::pair<std::size_t, bool>> Request;   // stripe, exclusive
+
+    void add(Request & request, std::string const & path) const;
+
+    Guard acquire(Request & request);
+
+private:
+    std::unique_ptr<std::shared_mutex[]> _stripes;
+    std::size_t _mask;
+};
+
+}
+
+#endif // !PATHLOCKS_H
@@ -1,25 +1,68 @@
 #ifndef REGULARFILE_H
 #define REGULARFILE_H
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
-#include <fstream>
+#include <cstdint>
 #include <filesystem>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
+#include "BlockCache.h"
+#include "HandleTable.h"
 #include "IFile.h"
+#include "LockStats.h"
 #include "global.h"
 
 namespace VFS {
 
 namespace fs = std::filesystem;
 
+/**
+ * @brief A file of the native filesystem accessed through a raw descriptor with positional I/O (pread/pwrite).
+ Reads with an explicit offset share no cursor and take no lock, writes only wait for writes to overlapping ranges.
+ With a BlockCache, reads are served block by block from the cache and every write drops the blocks it covers.
+ In write-behind mode (setWriteBehind()) small writes are kept in memory and coalesced until a size or time threshold
+ is reached, and sync() hands the descriptor to GroupCommit::global().
+ Reads that follow each other are detected per open file and the data after them is read ahead (setReadAhead()).
+ */
 class RegularFile : public IFile
 {
 public:
-    RegularFile(std::string const & filename);
+    constexpr static std::size_t DEFAULT_WRITE_BEHIND = 1024 * 1024;
+    constexpr static std::chrono::milliseconds DEFAULT_WRITE_BEHIND_DELAY{ 50 };
+    constexpr static std::size_t DEFAULT_READ_AHEAD = 2 * 1024 * 1024;
+    constexpr static std::size_t READ_AHEAD_START = 128 * 1024;
+
+    struct ReadAheadStats
+    {
+        std::uint64_t sequential;   // reads that continued a stream
+        std::uint64_t random;       // reads that didn't
+        std::uint64_t windows;      // read-aheads started
+        std::uint64_t prefetched;   // bytes read ahead into the block cache, or hinted to the kernel without one
+        std::size_t window;         // current window, 0 while no stream is detected
+    };
+
+public:
+    RegularFile(std::string const & filename, std::shared_ptr<BlockCache> cache = nullptr);
+
+    /**
+     * @brief Use the descriptor of a handle from a HandleTable instead of opening filename, close() lets go of it.
+     */
+    RegularFile(std::string const & filename, HandleTable::HandlePtr handle, std::shared_ptr<BlockCache> cache = nullptr);
     ~RegularFile();
     DISABLE_COPY(RegularFile);
 
+    using IFile::read;
+    using IFile::write;
+    using IFile::readAsync;
+    using IFile::writeAsync;
+    using IFile::fsyncAsync;
+
     std::size_t write(Buffer const & buf, std::size_t size) override;
 
     std::size_t write(Buffer const & buf, std::size_t offset, std::size_t size) override;
@@ -30,6 +73,77 @@ public:
 
     Buffer read(std::size_t offset, std::size_t size) override;
 
+    std::size_t read(DataT * dst, std::size_t offset, std::size_t size) override;
+
+    std::size_t write(DataT const * src, std::size_t offset, std::size_t size) override;
+
+    /**
+     * @brief Ranges that follow each other in the file are read with one preadv, through the block cache if the
+     file has one.
+     */
+    std::size_t readBatch(std::vector<ReadRange> & ranges) override;
+
+    /**
+     * @brief Ranges that follow each other in the file are written with one pwritev, all of them claimed at once.
+     */
+    std::size_t writeBatch(std::vector<WriteRange> & ranges) override;
+
+    /**
+     * @brief Read through IoEngine::global() straight into dst. The block cache is neither used nor filled.
+     */
+    void readAsync(DataT * dst, std::size_t offset, std::size_t size, Completion done) override;
+
+    /**
+     * @brief Write through IoEngine::global(). The range is locked until the write completes, so the call waits
+     for overlapping writes in flight and must not be made from a completion of one of them.
+     */
+    void writeAsync(DataT const * src, std::size_t offset, std::size_t size, Completion done) override;
+
+    void fsyncAsync(Completion done) override;
+
+    /**
+     * @brief Flush the write-behind buffer and fsync() as part of a group commit.
+     */
+    long sync() override;
+
+    long datasync() override;
+
+    /**
+     * @brief Buffer the writes from now on, or write them straight to the file again with limit 0. Writes to
+     adjacent or overlapping ranges are merged, the buffer is written out once it holds limit bytes or delay after the
+     first buffered write, whichever comes first. Reads of a buffered range, batched and asynchronous calls, sync()
+     and close() write it out before they go on. Other open files of the same path see the data once it is written.
+     *
+     * @param limit - bytes buffered at most, a single write of that size or more goes straight to the file
+     * @param delay - time a buffered write may wait
+     */
+    void setWriteBehind(std::size_t limit = DEFAULT_WRITE_BEHIND, std::chrono::milliseconds delay = DEFAULT_WRITE_BEHIND_DELAY);
+
+    /**
+     * @brief Read ahead of sequential reads with a window of at most maxWindow bytes, 0 turns it off. On by default
+     with DEFAULT_READ_AHEAD. A read that starts where the last one ended, give or take a block, continues the stream;
+     from the second one on, the window after it is read asynchronously, into the block cache if the file has one and
+     by the kernel (POSIX_FADV_WILLNEED) otherwise. The window starts at READ_AHEAD_START and doubles every time the
+     reads reach the half of it, a read anywhere else collapses it.
+     *
+     * @param dropBehind - drop the data the stream is done with from the page cache (POSIX_FADV_DONTNEED), for
+     files read once that shouldn't push out what others use
+     */
+    void setReadAhead(std::size_t maxWindow = DEFAULT_READ_AHEAD, bool dropBehind = false);
+
+    ReadAheadStats readAheadStats() const;
+
+    /**
+     * @brief Time the waits for and holds of the write ranges and the read cursor from now on, by operation. A
+     write waiting for an overlapping one counts as contended. Off by default.
+     */
+    void setLockStats(bool enabled);
+
+    /**
+     * @brief What the locks recorded, nullptr if it was never enabled.
+     */
+    std::shared_ptr<LockStats> lockStats();
+
     void close() override;
 
     FileInfo info() const override;
@@ -48,14 +162,140 @@ public:
 
     void disableAll() override;
 
+private:
+    typedef std::pair<std::size_t, std::size_t> Range;  // [first, second)
+
+    // The stream of reads of this file, under _aheadMutex.
+    struct Stream
+    {
+        std::size_t next = 0;       // where the next read of the stream is expected
+        std::size_t streak = 0;     // reads in a row that continued it
+        std::size_t window = 0;
+        std::size_t end = 0;        // end of what was read ahead
+        std::size_t trigger = 0;    // reads reaching it start the next window
+        std::size_t dropped = 0;    // the page cache was dropped below it
+        ReadAheadStats stats = {};
+    };
+
+    // A range claimed by a write in flight.
+    struct Claim
+    {
+        Range range;
+        Metrics::Op op;
+        LockStats::Clock::time_point since;     // the epoch while the stats are off
+    };
+
+    bool canRead() const;
+
+    bool canWrite() const;
+
+    /**
+     * @brief Read through the block cache if there is one, straight from the descriptor otherwise.
+     */
+    std::size_t readAt(DataT * dst, std::size_t offset, std::size_t size) const;
+
+    std::size_t readCached(DataT * dst, std::size_t offset, std::size_t size) const;
+
+    std::size_t preadAll(DataT * dst, std::size_t offset, std::size_t size) const;
+
+    void invalidate(std::size_t offset, std::size_t size);
+
+    /**
+     * @brief Record a read of n bytes at offset and start the next read-ahead once a stream reaches it.
+     */
+    void readAhead(std::size_t offset, std::size_t n);
+
+    /**
+     * @brief Read [offset, offset + size) into the block cache with asynchronous requests, blocks already cached
+     are skipped.
+     */
+    void prefetch(std::size_t offset, std::size_t size);
+
+    /**
+     * @brief posix_fadvise() of the descriptor, the access pattern only if no other file shares it.
+     */
+    void advise(std::size_t offset, std::size_t size, int advice);
+
+    std::size_t pwriteAll(DataT const * src, std::size_t offset, std::size_t size);
+
+    /**
+     * @brief Wait until no in-flight write overlaps [offset, offset + size) and claim the range. An append passes
+     the end of the file by itself so that concurrent appends get adjacent ranges.
+     */
+    std::size_t lockRange(std::size_t offset, std::size_t size, bool append, Metrics::Op op);
+
+    void unlockRange(std::size_t offset, std::size_t size);
+
+    /**
+     * @brief Claim several ranges at once, they only need to be free of writes by other calls.
+     */
+    void lockRanges(std::vector<Range> const & ranges, Metrics::Op op);
+
+    void waitRanges(std::unique_lock<std::mutex> & lk, std::vector<Range> const & ranges, LockStats::Wait & wait, Metrics::Op op);
+
+    void unlockRanges(std::vector<Range> const & ranges);
+
+    /**
+     * @brief writeBatch() without the checks, ranges go straight to the file.
+     */
+    std::size_t writeRanges(std::vector<WriteRange> & ranges);
+
+    /**
+     * @brief Put a write into the write-behind buffer.
+     *
+     * @param append - write at the end of the file and the buffer, offset is ignored
+     */
+    std::size_t writeBehind(DataT const * src, std::size_t offset, std::size_t size, bool append);
+
+    /**
+     * @brief Merge [offset, offset + size) into the buffered extents, called with _behindMutex held.
+     */
+    void coalesce(DataT const * src, std::size_t offset, std::size_t size);
+
+    /**
+     * @brief Write out the buffer, or only if some of it overlaps [offset, offset + size).
+     */
+    void flush();
+
+    void flush(std::size_t offset, std::size_t size);
+
+    void flushLocked();
+
+    /**
+     * @brief Have the buffer written out after the delay unless that is already planned, with _behindMutex held.
+     */
+    void scheduleFlush();
+
+    long syncAll(bool dataOnly);
+
 private:
     std::string _filename;  // absolute path
-    std::fstream _file;
-    bool _access;
-    fs::perms _perms;
-    bool _writing;
+    HandleTable::HandlePtr _handle;     // owns _fd when the file was opened through a HandleTable
+    std::atomic<int> _fd;
+    std::atomic<bool> _access;
+    std::atomic<fs::perms> _perms;
+    mutable std::atomic<std::size_t> _inflight;  // calls and asynchronous requests using _fd, close() waits for them
+    std::size_t _readPos;   // cursor of read(size)
+    std::size_t _appendEnd; // end of the appends in flight
+    std::vector<Claim> _ranges;
+    std::shared_ptr<BlockCache> _cache;
+    BlockCache::FileId _id;
     std::mutex _mutex;
     std::condition_variable_any _cv;
+    std::atomic<std::size_t> _behindLimit;  // 0 while writes go straight to the file
+    std::chrono::milliseconds _behindDelay;
+    std::map<std::size_t, Buffer> _dirty;   // buffered extents by offset, never adjacent or overlapping
+    std::atomic<std::size_t> _dirtyBytes;
+    std::atomic<std::size_t> _dirtyEnd;
+    std::atomic<long> _behindError;         // first failed flush since the last sync
+    std::uint64_t _flushTimer;              // pending GroupCommit task, 0 for none
+    std::mutex _behindMutex;
+    std::shared_ptr<LockStats> _lockStats;
+    std::atomic<LockStats *> _timedLocks;   // _lockStats while enabled
+    std::atomic<std::size_t> _aheadLimit;   // 0 while read-ahead is off
+    std::atomic<bool> _dropBehind;
+    Stream _stream;
+    mutable std::mutex _aheadMutex;
 };
 
 }
@@ -0,0 +1,70 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "IFS.h"
+#include "Tracer.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Drives the calls of a trace against any IFS again, with one thread for every thread of the trace. A call
+ starts only once every call that ended before it started in the trace is done, so what one thread made is there
+ for the others at either speed. Files are found by the handle of their traced open, a call on a file whose open
+ failed is skipped. Mount and unmount are skipped, the filesystem stays as it is given.
+ */
+class Replay
+{
+public:
+    enum class Speed
+    {
+        ORIGINAL,   // every call starts when it started in the trace
+        FAST,       // every thread calls as fast as it can
+    };
+
+    struct Result
+    {
+        std::uint64_t calls;
+        std::uint64_t errors;   // calls that failed now but not in the trace
+        std::uint64_t skipped;
+        std::chrono::nanoseconds elapsed;
+    };
+
+public:
+    Replay(std::vector<Tracer::Event> events);
+    DISABLE_COPY(Replay);
+
+    /**
+     * @brief Make the files and directories the trace opens, as large as it reads them, where they are missing.
+     For running a trace against an empty filesystem. What the trace makes by itself is left to it.
+     */
+    void prepare(IFS & fs) const;
+
+    Result run(IFS::IFSPtr fs, Speed speed);
+
+    std::size_t threads() const { return _threads.size(); }
+
+private:
+    /**
+     * @return false - the call failed
+     */
+    bool call(IFS & fs, Tracer::Event const & event, IFile::Buffer & buffer, Result & result);
+
+    IFS::IFilePtr file(std::uint64_t handle);
+
+private:
+    std::vector<std::vector<Tracer::Event>> _threads;   // the events of every traced thread, by start
+    std::unordered_map<std::uint64_t, IFS::IFilePtr> _files;
+    std::mutex _mutex;  // _files
+};
+
+}
+
+#endif // !REPLAY_H
@@ -0,0 +1,76 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Substring index over path names. Every path is cut in trigrams (three consecutive bytes) and every trigram
+ keeps the sorted list of the paths it occurs in. A query intersects the lists of its own trigrams, starting from
+ the shortest, and only checks the few paths left. Patterns shorter than three bytes fall back to a scan.
+ Removed paths are tombstoned and the lists are compacted once tombstones outnumber live paths.
+ */
+class SearchIndex
+{
+public:
+    typedef std::vector<std::string> EntryList;
+
+    constexpr static std::size_t ALL = std::numeric_limits<std::size_t>::max();
+
+public:
+    SearchIndex();
+    DISABLE_COPY(SearchIndex);
+    ~SearchIndex();
+
+    void add(std::string const & path);
+
+    void remove(std::string const & path);
+
+    void clear();
+
+    /**
+     * @brief Paths that contain pattern, in the order they were added.
+     *
+     * @param offset - matches to skip, for paging
+     * @param limit - matches to return at most
+     */
+    EntryList find(std::string const & pattern, std::size_t offset = 0, std::size_t limit = ALL) const;
+
+    /**
+     * @brief Paths that start with prefix, in the order they were added.
+     */
+    EntryList findPrefix(std::string const & prefix, std::size_t offset = 0, std::size_t limit = ALL) const;
+
+    std::size_t size() const { return _ids.size(); }
+
+private:
+    typedef std::uint32_t Id;
+    typedef std::uint32_t Trigram;
+
+    static std::vector<Trigram> trigrams(std::string const & text);
+
+    /**
+     * @brief Visit, in id order, the live paths whose trigrams include all of pattern's, until visit returns false.
+     */
+    template<typename Visit>
+    void candidates(std::string const & pattern, Visit visit) const;
+
+    void compact();
+
+private:
+    std::vector<std::string> _paths;   // by id, empty once removed
+    std::unordered_map<std::string, Id> _ids;
+    std::unordered_map<Trigram, std::vector<Id>> _postings;
+    std::size_t _removed;
+};
+
+}
+
+#endif // !SEARCHINDEX_H
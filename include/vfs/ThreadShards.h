@@ -0,0 +1,157 @@
+#ifndef THREADSHARDS_H
+#define THREADSHARDS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Add to a counter that only the calling thread writes, a relaxed load and store is all that takes.
+ */
+inline void bumpOwned(std::atomic<std::uint64_t> & counter, std::uint64_t by)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+/**
+ * @brief A Shard for every thread that calls local(), for what only that thread writes and others read from time to
+ time with forEach(). The last ThreadShards a thread used is found without a lock or a lookup, the others by a search
+ through what the thread holds. A thread that ends adds its shards to the ended one of every ThreadShards given a
+ fold and frees them, or leaves them to the ThreadShards. A thread forgets the ThreadShards that are gone when it takes
+ a new shard.
+ */
+template<typename Shard>
+class ThreadShards
+{
+public:
+    typedef void (*Fold)(Shard & into, Shard const & from);
+
+    /**
+     * @param ended - where fold adds the shard of a thread that ends, nullptr to keep the shards of all threads
+     */
+    explicit ThreadShards(std::unique_ptr<Shard> ended = nullptr, Fold fold = nullptr)
+        : _state(std::make_shared<State>())
+    {
+        static std::atomic<std::uint64_t> nextId(1);
+        _state->id = nextId++;
+        _state->ended = std::move(ended);
+        _state->fold = _state->ended != nullptr ? fold : nullptr;
+    }
+    DISABLE_COPY(ThreadShards);
+
+    /**
+     * @brief The shard of the calling thread, the std::unique_ptr<Shard> of make() on its first call.
+     */
+    template<typename Make>
+    Shard & local(Make make)
+    {
+        auto id = _state->id;
+        if ( _lastId == id )
+            return *_last;
+
+        auto & entries = owned().entries;
+        auto it = std::find_if(entries.begin(), entries.end(), [id] (Entry const & entry) { return entry.id == id; });
+        if ( it == entries.end() )
+        {
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [] (Entry const & entry)
+            {
+                return entry.state.expired();
+            }), entries.end());
+
+            std::unique_ptr<Shard> shard(make());
+            std::lock_guard<std::mutex> lk(_state->mutex);
+            entries.push_back(Entry{ id, _state, shard.get() });
+            _state->shards.push_back(std::move(shard));
+            it = entries.end() - 1;
+        }
+
+        _lastId = id;
+        _last = it->shard;
+
+        return *_last;
+    }
+
+    /**
+     * @brief f(shard) for the shard of every thread, the ended one last, under the lock that threads take to add or
+     give back a shard.
+     */
+    template<typename F>
+    void forEach(F f) const
+    {
+        std::lock_guard<std::mutex> lk(_state->mutex);
+        for ( auto const & shard : _state->shards )
+            f(*shard);
+        if ( _state->ended != nullptr )
+            f(*_state->ended);
+    }
+
+private:
+    // What the threads share with the ThreadShards, which may be gone when one of them ends.
+    struct State
+    {
+        std::uint64_t id;   // never reused, threads find their shard by it
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::unique_ptr<Shard> ended;
+        Fold fold;
+        std::mutex mutex;
+    };
+
+    struct Entry
+    {
+        std::uint64_t id;
+        std::weak_ptr<State> state;
+        Shard * shard;
+    };
+
+    // The shards of one thread.
+    struct Owned
+    {
+        std::vector<Entry> entries;
+
+        ~Owned()
+        {
+            for ( auto const & entry : entries )
+            {
+                auto state = entry.state.lock();
+                if ( state == nullptr || state->fold == nullptr )
+                    continue;
+
+                std::lock_guard<std::mutex> lk(state->mutex);
+                state->fold(*state->ended, *entry.shard);
+                auto & shards = state->shards;
+                shards.erase(std::find_if(shards.begin(), shards.end(), [&entry] (std::unique_ptr<Shard> const & shard)
+                {
+                    return shard.get() == entry.shard;
+                }));
+            }
+        }
+    };
+
+    static Owned & owned()
+    {
+        thread_local Owned owned;
+        return owned;
+    }
+
+private:
+    static thread_local std::uint64_t _lastId;
+    static thread_local Shard * _last;
+
+    std::shared_ptr<State> _state;
+};
+
+template<typename Shard>
+thread_local std::uint64_t ThreadShards<Shard>::_lastId = 0;
+
+template<typename Shard>
+thread_local Shard * ThreadShards<Shard>::_last = nullptr;
+
+}
+
+#endif // !THREADSHARDS_H
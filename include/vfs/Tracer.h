@@ -0,0 +1,188 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Metrics.h"
+#include "ThreadShards.h"
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Records calls of IFS and IFile, as seen by InstrumentedFS and InstrumentedFile, into a trace file. Every
+ thread writes its events into a ring of its own without locks or allocation, a background thread drains the rings
+ into the file every FLUSH_INTERVAL. Events that find their ring full are dropped and counted.
+
+ The file starts with MAGIC and the version, then one record per event in native byte order: start, latency, handle,
+ offset, size and bytes as 64-bit, thread as 32-bit, op and error as 8-bit, the lengths of path and target as 16-bit,
+ followed by the two paths. Op is the value of Metrics::Op, so operations are only ever added to its end.
+ */
+class Tracer
+{
+public:
+    constexpr static char const MAGIC[8] = { 'V', 'F', 'S', 'T', 'R', 'A', 'C', 'E' };
+    constexpr static std::uint32_t VERSION = 1;
+    constexpr static std::size_t DEFAULT_SLOTS = 4096;  // events per thread between two drains
+    constexpr static std::size_t MAX_PATHS = 256;       // bytes of path and target together, longer ones are cut
+    constexpr static std::uint64_t CURSOR = ~std::uint64_t(0);  // offset of calls at the read cursor or append
+    constexpr static std::chrono::milliseconds FLUSH_INTERVAL{ 10 };
+
+    typedef Metrics::Clock Clock;
+
+    struct Event
+    {
+        std::uint64_t start;    // nanoseconds since the tracer was made
+        std::uint64_t latency;  // nanoseconds
+        std::uint64_t handle;   // the open file, 0 for calls of the filesystem
+        std::uint64_t offset;   // CURSOR if the call had none
+        std::uint64_t size;     // asked for, the Perms of an open
+        std::uint64_t bytes;    // moved
+        std::uint32_t thread;   // numbered from 0 in the order of their first event
+        Metrics::Op op;
+        bool error;
+        std::string path;
+        std::string target;     // of moveTo and copy
+    };
+
+    struct Stats
+    {
+        std::uint64_t recorded;
+        std::uint64_t dropped;
+    };
+
+    // Times one call for a Metrics and, while there is a Tracer, traces it. The paths are borrowed until done().
+    class Call
+    {
+    public:
+        Call(Metrics & metrics, Tracer * tracer, Metrics::Op op, std::uint64_t handle, std::string const & path,
+             std::uint64_t offset = CURSOR, std::uint64_t size = 0, std::string const * target = nullptr)
+            : _metrics(metrics)
+              , _tracer(tracer)
+              , _op(op)
+              , _handle(handle)
+              , _path(path)
+              , _target(target)
+              , _offset(offset)
+              , _size(size)
+              , _start(Clock::now())
+        {
+        }
+        DISABLE_COPY(Call);
+
+        void done(std::uint64_t bytes = 0, bool error = false)
+        {
+            auto end = Clock::now();
+            _metrics.record(_op, std::chrono::duration_cast<std::chrono::nanoseconds>(end - _start).count(), bytes, error);
+            if ( _tracer != nullptr )
+                _tracer->record(_op, _start, end, _handle, _path, _target != nullptr ? *_target : std::string(), _offset, _size, bytes, error);
+        }
+
+    private:
+        Metrics & _metrics;
+        Tracer * _tracer;
+        Metrics::Op _op;
+        std::uint64_t _handle;
+        std::string const & _path;
+        std::string const * _target;
+        std::uint64_t _offset;
+        std::uint64_t _size;
+        Clock::time_point _start;
+    };
+
+public:
+    /**
+     * @param path - the trace file, replaced if it exists
+     * @param slots - size of the ring of every thread, rounded up to a power of two
+     */
+    Tracer(std::string const & path, std::size_t slots = DEFAULT_SLOTS);
+    DISABLE_COPY(Tracer);
+    ~Tracer();
+
+    /**
+     * @brief The trace file could be created.
+     */
+    bool good() const { return _file != nullptr; }
+
+    void record(Metrics::Op op, Clock::time_point start, Clock::time_point end, std::uint64_t handle, std::string const & path,
+                std::string const & target, std::uint64_t offset, std::uint64_t size, std::uint64_t bytes, bool error);
+
+    /**
+     * @brief Write out what the rings hold now, without waiting for the background thread.
+     */
+    void flush();
+
+    /**
+     * @brief A number for a newly opened file, never 0.
+     */
+    std::uint64_t nextHandle() { return _handles++; }
+
+    Stats stats() const;
+
+    /**
+     * @brief Read a trace file, the events ordered by start.
+     *
+     * @return false - the file is missing, not a trace or cut short; events holds what could be read
+     */
+    static bool load(std::string const & path, std::vector<Event> & events);
+
+private:
+    struct Slot
+    {
+        std::uint64_t start;
+        std::uint64_t latency;
+        std::uint64_t handle;
+        std::uint64_t offset;
+        std::uint64_t size;
+        std::uint64_t bytes;
+        Metrics::Op op;
+        bool error;
+        std::uint16_t pathLength;
+        std::uint16_t targetLength;
+        char paths[MAX_PATHS];
+    };
+
+    // Single producer, the thread it belongs to, single consumer, whoever drains under _drainMutex.
+    struct Ring
+    {
+        Ring(std::size_t slots, std::uint32_t thread);
+
+        std::unique_ptr<Slot[]> slots;
+        std::size_t mask;
+        std::uint32_t thread;
+        alignas(64) std::atomic<std::uint64_t> head;    // next slot to fill
+        std::atomic<std::uint64_t> dropped;
+        alignas(64) std::atomic<std::uint64_t> tail;    // next slot to drain
+    };
+
+    std::unique_ptr<Ring> newRing();
+
+    void drain();
+
+    void run();
+
+private:
+    std::size_t _slots;
+    Clock::time_point _epoch;
+    std::FILE * _file;
+    std::atomic<std::uint64_t> _handles;
+    std::atomic<std::uint32_t> _threads;
+    ThreadShards<Ring> _rings;
+    std::mutex _mutex;              // _stop
+    std::mutex _drainMutex;         // _file and the tails of the rings
+    std::condition_variable _cv;
+    bool _stop;
+    std::thread _flusher;
+};
+
+}
+
+#endif // !TRACER_H
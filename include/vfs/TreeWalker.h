@@ -0,0 +1,102 @@
+#ifndef TREEWALKER_H
+#define TREEWALKER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "global.h"
+
+namespace VFS {
+
+/**
+ * @brief Recursive directory walk spread over a pool of threads. Every thread has its own queue of directories to
+ read: it takes the most recent one of its own queue (depth first, the directory is likely still cached) and when its
+ queue is empty it steals the oldest one of another thread, which is usually the biggest subtree left. Directories
+ are opened relative to a descriptor of the root with openat() and read with readdir(), no path is resolved from '/'.
+ A thread with nothing to read sleeps until a directory is queued. The calling thread walks the root itself and only
+ calls on the pool when the root has subdirectories. The pool is started by the first walk that needs it and waits
+ for the next one, it helps one walk at a time: a walk that finds it busy is done by its calling thread alone.
+ */
+class TreeWalker
+{
+public:
+    typedef std::vector<std::string> EntryList;
+
+    /**
+     * @brief Called for every entry below the root with root + '/' + relative path.
+     */
+    typedef std::function<void(std::string const & path, bool directory)> Visit;
+
+public:
+    /**
+     * @param threads - threads walking the tree, 0 for one per core
+     */
+    TreeWalker(std::size_t threads = 0);
+    DISABLE_COPY(TreeWalker);
+    ~TreeWalker();
+
+    std::size_t threads() const { return _threads; }
+
+    /**
+     * @brief Visit every entry below root. Unless sorted, visit is called from several threads at once and in
+     no particular order. Sorted collects the entries first and visits them from the calling thread in the order
+     of sortedBefore().
+     *
+     * @return false - root isn't a directory that can be read
+     */
+    bool walk(std::string const & root, Visit const & visit, bool sorted = false);
+
+    /**
+     * @brief Every entry below root, like list(), in the order of sortedBefore() if sorted.
+     */
+    EntryList collect(std::string const & root, bool sorted = false);
+
+    /**
+     * @brief collect() below the directory open at dir, which stays the caller's, with the entries named after root.
+     For a caller that opened dir in a way a path can't be, beneath another directory for one.
+     */
+    EntryList collect(int dir, std::string const & root, bool sorted = false);
+
+    /**
+     * @brief Depth first order with the names of a directory sorted bytewise: paths compare component by
+     component, so a directory comes right before its children.
+     */
+    static bool sortedBefore(std::string const & a, std::string const & b);
+
+private:
+    typedef std::function<void(std::size_t worker, std::string && path, bool directory)> Emit;
+
+    bool run(std::string const & root, Emit const & emit);
+
+    bool run(int dir, std::string const & root, Emit const & emit);
+
+    /**
+     * @brief work(0) on the calling thread and work(1) to work(count) on the pool, unless another walk has it, and wait
+     for all of them.
+     */
+    void spread(std::function<void(std::size_t worker)> const & work, std::size_t count);
+
+    // The loop of the thread of the pool that is worker.
+    void help(std::size_t worker);
+
+private:
+    std::size_t _threads;
+    std::mutex _walkMutex;                      // held by the walk the pool helps
+    std::mutex _poolMutex;                      // what follows
+    std::condition_variable _poolCv;
+    std::vector<std::thread> _pool;
+    std::function<void(std::size_t)> const * _work;
+    std::size_t _wanted;                        // workers the walk asked for
+    std::size_t _busy;                          // of those, the ones not done yet
+    std::uint64_t _round;                       // walks helped so far
+    bool _stop;
+};
+
+}
+
+#endif // !TREEWALKER_H
@@ -1,9 +1,36 @@
 #ifndef VFS_H
 #define VFS_H
 
+#include "BlockCache.h"
+#include "Codec.h"
+#include "CompressedFile.h"
+#include "CopyEngine.h"
+#include "CopyUpFile.h"
+#include "DirCursor.h"
 #include "FileInfo.h"
 #include "FileSystem.h"
+#include "GroupCommit.h"
+#include "HandleTable.h"
+#include "Histogram.h"
+#include "InstrumentedFS.h"
+#include "InstrumentedFile.h"
+#include "IoEngine.h"
+#include "LockStats.h"
+#include "MappedFile.h"
+#include "MemoryFile.h"
+#include "MemoryFileSystem.h"
+#include "Metrics.h"
+#include "MountRouter.h"
+#include "OverlayFS.h"
+#include "PathHandle.h"
+#include "PathIndex.h"
+#include "PathLocks.h"
 #include "RegularFile.h"
+#include "Replay.h"
+#include "SearchIndex.h"
+#include "ThreadShards.h"
+#include "Tracer.h"
+#include "TreeWalker.h"
 #include "global.h"
 
 #endif // !VFS_H
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <cstring>
+#include "vfs/BlockCache.h"
+
+namespace VFS {
+
+BlockCache::BlockCache(std::size_t capacity, std::size_t blockSize, std::size_t shards)
+    : _blockSize(std::max<std::size_t>(blockSize, 1))
+      , _blocksPerShard(0)
+      , _inLimit(0)
+      , _outLimit(0)
+      , _shards()
+      , _shardMask(0)
+      , _hits(0)
+      , _misses(0)
+      , _insertions(0)
+      , _evictions(0)
+      , _invalidations(0)
+{
+    std::size_t count = 1;
+    while ( count < shards )
+        count <<= 1;
+
+    _shards.reset(new Shard[count]);
+    _shardMask = count - 1;
+    _blocksPerShard = std::max<std::size_t>(capacity / _blockSize / count, 1);
+
+    // the sizes suggested by the 2Q paper: a quarter of the blocks for IN, ghosts for half of them
+    _inLimit = std::max<std::size_t>(_blocksPerShard / 4, 1);
+    _outLimit = std::max<std::size_t>(_blocksPerShard / 2, 1);
+}
+
+BlockCache::~BlockCache() = default;
+
+std::shared_ptr<BlockCache> BlockCache::global()
+{
+    static std::shared_ptr<BlockCache> cache = std::make_shared<BlockCache>();
+    return cache;
+}
+
+std::size_t BlockCache::capacity() const
+{
+    return _blocksPerShard * ( _shardMask + 1 ) * _blockSize;
+}
+
+bool BlockCache::read(FileId id, std::uint64_t block, std::size_t inBlock, IFile::DataT * dst, std::size_t size, std::size_t & copied)
+{
+    Key key{ id, block };
+    auto & shard = shardOf(key);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+
+    auto it = shard.entries.find(key);
+    if ( it == shard.entries.end() )
+    {
+        ++_misses;
+        return false;
+    }
+
+    auto & entry = it->second;
+    if ( entry.queue == Queue::HOT )
+        shard.hot.splice(shard.hot.begin(), shard.hot, entry.position);
+
+    copied = inBlock < entry.data.size() ? std::min(size, entry.data.size() - inBlock) : 0;
+    if ( copied != 0 )
+        std::memcpy(dst, entry.data.data() + inBlock, copied);
+    ++_hits;
+
+    return true;
+}
+
+bool BlockCache::contains(FileId id, std::uint64_t block) const
+{
+    Key key{ id, block };
+    auto & shard = shardOf(key);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+
+    return shard.entries.count(key) != 0;
+}
+
+std::uint64_t BlockCache::epoch(FileId id, std::uint64_t block) const
+{
+    auto & shard = shardOf(Key{ id, block });
+    std::lock_guard<std::mutex> lk(shard.mutex);
+
+    return shard.epoch;
+}
+
+void BlockCache::insert(FileId id, std::uint64_t block, IFile::DataT const * data, std::size_t length, std::uint64_t epoch)
+{
+    Key key{ id, block };
+    auto & shard = shardOf(key);
+    std::lock_guard<std::mutex> lk(shard.mutex);
+
+    // a write invalidated something in this shard since the caller read the block
+    if ( shard.epoch != epoch || shard.entries.count(key) != 0 )
+        return;
+
+    while ( shard.entries.size() >= _blocksPerShard )
+        evictOne(shard);
+
+    // a block that comes back after it was given up by IN is hot
+    auto queue = Queue::IN;
+    auto ghost = shard.ghosts.find(key);
+    if ( ghost != shard.ghosts.end() )
+    {
+        shard.out.erase(ghost->second);
+        shard.ghosts.erase(ghost);
+        queue = Queue::HOT;
+    }
+
+    auto & list = ( queue == Queue::HOT ? shard.hot : shard.in );
+    list.push_front(key);
+
+    Entry entry;
+    if ( !shard.freeBuffers.empty() )
+    {
+        entry.data = std::move(shard.freeBuffers.back());
+        shard.freeBuffers.pop_back();
+    }
+    entry.data.assign(data, data + std::min(length, _blockSize));
+    entry.queue = queue;
+    entry.position = list.begin();
+    shard.entries.emplace(key, std::move(entry));
+    ++_insertions;
+}
+
+void BlockCache::invalidate(FileId id, std::uint64_t first, std::uint64_t last)
+{
+    for ( auto block = first; block <= last; ++block )
+    {
+        Key key{ id, block };
+        auto & shard = shardOf(key);
+        std::lock_guard<std::mutex> lk(shard.mutex);
+
+        ++shard.epoch;
+        auto it = shard.entries.find(key);
+        if ( it != shard.entries.end() )
+        {
+            erase(shard, it);
+            ++_invalidations;
+        }
+    }
+}
+
+void BlockCache::invalidate(FileId id)
+{
+    for ( std::size_t i = 0; i <= _shardMask; ++i )
+    {
+        auto & shard = _shards[i];
+        std::lock_guard<std::mutex> lk(shard.mutex);
+
+        ++shard.epoch;
+        for ( auto it = shard.entries.begin(); it != shard.entries.end(); )
+        {
+            auto next = std::next(it);
+            if ( it->first.id.device == id.device && it->first.id.inode == id.inode )
+            {
+                erase(shard, it);
+                ++_invalidations;
+            }
+            it = next;
+        }
+    }
+}
+
+void BlockCache::clear()
+{
+    for ( std::size_t i = 0; i <= _shardMask; ++i )
+    {
+        auto & shard = _shards[i];
+        std::lock_guard<std::mutex> lk(shard.mutex);
+
+        ++shard.epoch;
+        shard.entries.clear();
+        shard.in.clear();
+        shard.hot.clear();
+        shard.out.clear();
+        shard.ghosts.clear();
+        shard.freeBuffers.clear();
+    }
+}
+
+BlockCache::Stats BlockCache::stats() const
+{
+    return { _hits.load(), _misses.load(), _insertions.load(), _evictions.load(), _invalidations.load() };
+}
+
+std::size_t BlockCache::KeyHash::operator()(Key const & key) const
+{
+    // splitmix64 finalizer over the three words
+    auto mix = [] (std::uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    };
+
+    return mix(key.id.device ^ mix(key.id.inode ^ mix(key.block)));
+}
+
+BlockCache::Shard & BlockCache::shardOf(Key const & key) const
+{
+    return _shards[KeyHash()(key) & _shardMask];
+}
+
+void BlockCache::evictOne(Shard & shard)
+{
+    if ( shard.in.size() > _inLimit || shard.hot.empty() )
+    {
+        // IN gives up its oldest block and remembers it as a ghost
+        auto key = shard.in.back();
+        erase(shard, shard.entries.find(key));
+
+        shard.out.push_front(key);
+        shard.ghosts[key] = shard.out.begin();
+        if ( shard.out.size() > _outLimit )
+        {
+            shard.ghosts.erase(shard.out.back());
+            shard.out.pop_back();
+        }
+    }
+    else
+    {
+        erase(shard, shard.entries.find(shard.hot.back()));
+    }
+
+    ++_evictions;
+}
+
+void BlockCache::erase(Shard & shard, std::unordered_map<Key, Entry, KeyHash>::iterator it)
+{
+    auto & entry = it->second;
+    ( entry.queue == Queue::HOT ? shard.hot : shard.in ).erase(entry.position);
+    if ( shard.freeBuffers.size() < 4 )
+        shard.freeBuffers.emplace_back(std::move(entry.data));
+    shard.entries.erase(it);
+}
+
+}
@@ -0,0 +1,112 @@
+#include <climits>
+#include <cstring>
+#include "vfs/Codec.h"
+
+#ifdef VFS_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace VFS {
+
+constexpr int Codec::DEFAULT_ZLIB_LEVEL;
+
+namespace {
+
+class Passthrough : public Codec
+{
+public:
+    Id id() const override { return NONE; }
+
+    char const * name() const override { return "none"; }
+
+    bool compress(IFile::DataT const * src, std::size_t size, IFile::Buffer & dst) const override
+    {
+        dst.assign(src, src + size);
+        return true;
+    }
+
+    bool decompress(IFile::DataT const * src, std::size_t length, IFile::DataT * dst, std::size_t size) const override
+    {
+        if ( length != size )
+            return false;
+
+        std::memcpy(dst, src, size);
+        return true;
+    }
+};
+
+#ifdef VFS_HAS_ZLIB
+class Zlib : public Codec
+{
+public:
+    explicit Zlib(int level) : _level(level) {}
+
+    Id id() const override { return ZLIB; }
+
+    char const * name() const override { return "zlib"; }
+
+    bool compress(IFile::DataT const * src, std::size_t size, IFile::Buffer & dst) const override
+    {
+        if ( size > ULONG_MAX )
+            return false;
+
+        dst.resize(::compressBound(static_cast<uLong>(size)));
+        auto length = static_cast<uLongf>(dst.size());
+        if ( ::compress2(reinterpret_cast<Bytef *>(dst.data()), &length, reinterpret_cast<Bytef const *>(src), static_cast<uLong>(size), _level) != Z_OK )
+            return false;
+
+        dst.resize(length);
+        return true;
+    }
+
+    bool decompress(IFile::DataT const * src, std::size_t length, IFile::DataT * dst, std::size_t size) const override
+    {
+        auto got = static_cast<uLongf>(size);
+        auto result = ::uncompress(reinterpret_cast<Bytef *>(dst), &got, reinterpret_cast<Bytef const *>(src), static_cast<uLong>(length));
+
+        return result == Z_OK && got == size;
+    }
+
+private:
+    int _level;
+};
+#endif
+
+}
+
+std::shared_ptr<Codec> Codec::passthrough()
+{
+    static auto codec = std::make_shared<Passthrough>();
+    return codec;
+}
+
+std::shared_ptr<Codec> Codec::zlib(int level)
+{
+#ifdef VFS_HAS_ZLIB
+    if ( level == DEFAULT_ZLIB_LEVEL )
+    {
+        static auto codec = std::make_shared<Zlib>(level);
+        return codec;
+    }
+
+    return std::make_shared<Zlib>(level);
+#else
+    (void)level;
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<Codec> Codec::byId(Id id)
+{
+    switch ( id )
+    {
+        case NONE:
+            return passthrough();
+        case ZLIB:
+            return zlib();
+    }
+
+    return nullptr;
+}
+
+}
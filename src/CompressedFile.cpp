@@ -0,0 +1,708 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <shared_mutex>
+#include <vector>
+#include "vfs/CompressedFile.h"
+#include "vfs/IoEngine.h"
+
+namespace VFS {
+
+constexpr std::size_t CompressedFile::BLOCK_SIZE;
+constexpr std::size_t CompressedFile::DIRTY_BLOCKS;
+
+namespace {
+
+constexpr char const MAGIC[4] = { 'V', 'F', 'C', 'Z' };
+constexpr std::uint32_t VERSION = 1;
+constexpr std::uint64_t HEADER_SIZE = 64;       // what Header takes at the start of the file, the rest is reserved
+constexpr std::uint64_t ALIGNMENT = 512;        // of the space given to a block, so a rewrite often fits in place
+constexpr std::size_t MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+struct Header
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t blockSize;
+    std::uint32_t reserved;
+    std::uint64_t size;         // of the content
+    std::uint64_t indexOffset;
+    std::uint64_t count;        // entries of the index, one per block
+};
+
+struct IndexEntry
+{
+    std::uint64_t offset;
+    std::uint32_t length;
+    std::uint32_t raw;
+    std::uint32_t capacity;
+    std::uint8_t codec;
+    std::uint8_t reserved[3];
+};
+
+static_assert(sizeof(Header) <= HEADER_SIZE, "the header outgrew its space");
+static_assert(sizeof(IndexEntry) == 24, "index entries are stored as they are in memory");
+
+std::uint64_t aligned(std::uint64_t length)
+{
+    return ( length + ALIGNMENT - 1 ) / ALIGNMENT * ALIGNMENT;
+}
+
+}
+
+struct CompressedFile::Store : std::enable_shared_from_this<CompressedFile::Store>
+{
+    // Where a block is stored, a block never written has length 0 and reads as zeros.
+    struct Slot
+    {
+        std::uint64_t offset = 0;
+        std::uint32_t length = 0;       // compressed
+        std::uint32_t raw = 0;          // before, the block is zeros from there to its end
+        std::uint32_t capacity = 0;     // space it takes in the file
+        Codec::Id codec = Codec::NONE;
+        std::uint64_t serial = 0;       // in memory only, new for every version of a block stored
+    };
+
+    // A block written since it was stored, the whole of it up to the end of the file.
+    struct Dirty
+    {
+        Buffer data;
+        std::uint64_t version = 0;
+        bool queued = false;            // someone is storing it
+    };
+
+    std::shared_ptr<IFile> file;
+    std::shared_ptr<Codec> codec;
+    std::size_t blockSize = BLOCK_SIZE;
+    std::uint64_t size = 0;
+    std::vector<Slot> index;
+    std::map<std::size_t, Dirty> dirty;
+    std::map<std::uint64_t, std::uint64_t> free;    // unused space by offset, never adjacent
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> released;  // still in the synced index, free after the next sync
+    std::uint64_t end = HEADER_SIZE;    // of the space in use
+    std::uint64_t indexOffset = 0;      // of the stored index
+    std::uint64_t indexLength = 0;
+    std::uint64_t nextSerial = 1;
+    std::size_t queued = 0;             // blocks being stored
+    long error = 0;                     // first block that failed since the last sync
+    bool changed = false;               // the index or the size differ from the stored ones
+    std::mutex mutex;
+    std::condition_variable cv;         // queued dropped
+    std::shared_mutex space;            // held shared while a stored block is read, released space isn't reused then
+
+    ~Store()
+    {
+        if ( file != nullptr )
+            file->close();
+    }
+
+    bool parse();
+
+    std::uint64_t allocate(std::uint64_t length);
+
+    void giveBack(std::uint64_t offset, std::uint64_t length);
+
+    /**
+     * @brief Have block stored, by the pool unless it is behind by DIRTY_BLOCKS already, with mutex held in lk.
+     */
+    void queue(std::size_t block, std::unique_lock<std::mutex> & lk);
+
+    /**
+     * @brief Compress the newest version of block and store it, until no write changed it in the meantime.
+     */
+    void storeBlock(std::size_t block);
+
+    bool fetch(Slot const & slot, DataT * dst);
+
+    long commit(bool flush, bool dataOnly);
+};
+
+bool CompressedFile::Store::parse()
+{
+    auto fileSize = file->size();
+    if ( fileSize == 0 )
+        return true;
+
+    Header header;
+    if ( fileSize < HEADER_SIZE || file->read(reinterpret_cast<DataT *>(&header), 0, sizeof(header)) != sizeof(header) )
+        return false;
+    if ( std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION )
+        return false;
+    if ( header.blockSize == 0 || header.blockSize > MAX_BLOCK_SIZE )
+        return false;
+
+    auto length = header.count * sizeof(IndexEntry);
+    if ( header.count > fileSize / sizeof(IndexEntry) || header.indexOffset < HEADER_SIZE || header.indexOffset > fileSize
+         || header.indexOffset + length > fileSize )
+        return false;
+
+    std::vector<IndexEntry> entries(header.count);
+    if ( file->read(reinterpret_cast<DataT *>(entries.data()), header.indexOffset, length) != length )
+        return false;
+
+    blockSize = header.blockSize;
+    size = header.size;
+    indexOffset = header.indexOffset;
+    indexLength = length;
+    end = std::max(HEADER_SIZE, indexOffset + indexLength);
+
+    // the space between what the index points to is free
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> used = { { indexOffset, indexLength } };
+    index.resize(entries.size());
+    for ( std::size_t i = 0; i < entries.size(); ++i )
+    {
+        auto const & entry = entries[i];
+        if ( entry.length == 0 )
+            continue;
+        if ( entry.length > entry.capacity || entry.raw > blockSize || entry.offset < HEADER_SIZE || entry.offset > fileSize
+             || entry.offset + entry.capacity > fileSize )
+            return false;
+        if ( Codec::byId(static_cast<Codec::Id>(entry.codec)) == nullptr )
+            return false;
+
+        auto & slot = index[i];
+        slot.offset = entry.offset;
+        slot.length = entry.length;
+        slot.raw = entry.raw;
+        slot.capacity = entry.capacity;
+        slot.codec = static_cast<Codec::Id>(entry.codec);
+        slot.serial = nextSerial++;
+        used.emplace_back(slot.offset, slot.capacity);
+        end = std::max(end, slot.offset + slot.capacity);
+    }
+
+    std::sort(used.begin(), used.end());
+    auto pos = HEADER_SIZE;
+    for ( auto const & range : used )
+    {
+        if ( range.first > pos )
+            free.emplace(pos, range.first - pos);
+        pos = std::max(pos, range.first + range.second);
+    }
+
+    return true;
+}
+
+std::uint64_t CompressedFile::Store::allocate(std::uint64_t length)
+{
+    for ( auto it = free.begin(); it != free.end(); ++it )
+    {
+        if ( it->second < length )
+            continue;
+
+        auto offset = it->first;
+        auto rest = it->second - length;
+        free.erase(it);
+        if ( rest != 0 )
+            free.emplace(offset + length, rest);
+        return offset;
+    }
+
+    auto offset = end;
+    end += length;
+
+    return offset;
+}
+
+void CompressedFile::Store::giveBack(std::uint64_t offset, std::uint64_t length)
+{
+    auto next = free.lower_bound(offset);
+    if ( next != free.end() && offset + length == next->first )
+    {
+        length += next->second;
+        next = free.erase(next);
+    }
+    if ( next != free.begin() )
+    {
+        auto prev = std::prev(next);
+        if ( prev->first + prev->second == offset )
+        {
+            prev->second += length;
+            return;
+        }
+    }
+
+    free.emplace(offset, length);
+}
+
+void CompressedFile::Store::queue(std::size_t block, std::unique_lock<std::mutex> & lk)
+{
+    auto it = dirty.find(block);
+    if ( it == dirty.end() || it->second.queued )
+        return;
+
+    it->second.queued = true;
+    ++queued;
+    if ( queued <= DIRTY_BLOCKS )
+    {
+        auto self = shared_from_this();
+        IoEngine::global()->submit([self, block] () { self->storeBlock(block); return 0L; }, [] (long) {});
+        return;
+    }
+
+    // the pool doesn't keep up, the writer does it and slows down with it
+    lk.unlock();
+    storeBlock(block);
+    lk.lock();
+}
+
+void CompressedFile::Store::storeBlock(std::size_t block)
+{
+    Buffer raw;
+    Buffer packed;
+    std::unique_lock<std::mutex> lk(mutex);
+    for ( auto it = dirty.find(block); it != dirty.end(); )
+    {
+        raw = it->second.data;
+        auto version = it->second.version;
+        auto codec = this->codec;
+        lk.unlock();
+
+        // blocks that don't get smaller are kept as they are
+        Slot slot;
+        slot.codec = codec->id();
+        if ( !codec->compress(raw.data(), raw.size(), packed) || packed.size() >= raw.size() )
+        {
+            packed.swap(raw);
+            slot.codec = Codec::NONE;
+        }
+        slot.length = static_cast<std::uint32_t>(packed.size());
+        slot.raw = static_cast<std::uint32_t>(slot.codec == Codec::NONE ? packed.size() : raw.size());
+        slot.capacity = static_cast<std::uint32_t>(aligned(packed.size()));
+
+        lk.lock();
+        slot.offset = allocate(slot.capacity);
+        lk.unlock();
+        bool written = packed.empty() || file->write(packed.data(), slot.offset, packed.size()) == packed.size();
+        lk.lock();
+
+        it = dirty.find(block);
+        if ( !written )
+        {
+            // the write is lost, sync() tells
+            giveBack(slot.offset, slot.capacity);
+            if ( error == 0 )
+                error = -EIO;
+            if ( it->second.version == version )
+                break;
+            continue;
+        }
+
+        if ( index.size() <= block )
+            index.resize(block + 1);
+        auto & old = index[block];
+        if ( old.capacity != 0 )
+            released.emplace_back(old.offset, old.capacity);
+        slot.serial = nextSerial++;
+        old = slot;
+        changed = true;
+
+        // written again meanwhile, store the newer version as well
+        if ( it->second.version == version )
+            break;
+    }
+
+    // a write from now on makes a new entry, stored by another call
+    auto it = dirty.find(block);
+    if ( it != dirty.end() )
+        dirty.erase(it);
+    --queued;
+    cv.notify_all();
+}
+
+bool CompressedFile::Store::fetch(Slot const & slot, DataT * dst)
+{
+    thread_local Buffer packed;
+    if ( packed.size() < slot.length )
+        packed.resize(slot.length);
+    if ( file->read(packed.data(), slot.offset, slot.length) != slot.length )
+        return false;
+
+    auto codec = Codec::byId(slot.codec);
+    if ( codec == nullptr || !codec->decompress(packed.data(), slot.length, dst, slot.raw) )
+        return false;
+    std::memset(dst + slot.raw, 0, blockSize - slot.raw);
+
+    return true;
+}
+
+long CompressedFile::Store::commit(bool flush, bool dataOnly)
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    while ( !dirty.empty() )
+    {
+        std::vector<std::size_t> blocks;
+        for ( auto const & entry : dirty )
+        {
+            if ( !entry.second.queued )
+                blocks.push_back(entry.first);
+        }
+        for ( auto block : blocks )
+            queue(block, lk);
+        cv.wait(lk, [this] () { return queued == 0; });
+    }
+
+    auto result = error;
+    error = 0;
+    if ( changed )
+    {
+        // the blocks and the index reach the disk before the header that points to them
+        std::vector<IndexEntry> entries(index.size());
+        for ( std::size_t i = 0; i < index.size(); ++i )
+        {
+            auto const & slot = index[i];
+            entries[i] = { slot.offset, slot.length, slot.raw, slot.capacity, slot.codec, {} };
+        }
+        auto length = entries.size() * sizeof(IndexEntry);
+        auto capacity = aligned(length);
+        auto offset = allocate(capacity);
+        Header header = { { MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3] }, VERSION, static_cast<std::uint32_t>(blockSize), 0, size, offset, entries.size() };
+        if ( file->write(reinterpret_cast<DataT const *>(entries.data()), offset, length) != length || file->datasync() != 0
+             || file->write(reinterpret_cast<DataT const *>(&header), 0, sizeof(header)) != sizeof(header) )
+        {
+            giveBack(offset, capacity);
+            return result != 0 ? result : -EIO;
+        }
+
+        // nothing points to the space given up before any more
+        if ( indexLength != 0 )
+            released.emplace_back(indexOffset, aligned(indexLength));
+        indexOffset = offset;
+        indexLength = length;
+        changed = false;
+    }
+
+    if ( flush )
+    {
+        auto synced = dataOnly ? file->datasync() : file->sync();
+        if ( result == 0 )
+            result = synced;
+
+        // until the header is on the disk the one there before may still be what a crash leaves, the space it
+        // points to is reused only from now on
+        if ( synced == 0 )
+        {
+            std::unique_lock<std::shared_mutex> readers(space);
+            for ( auto const & range : released )
+                giveBack(range.first, range.second);
+            released.clear();
+        }
+    }
+
+    return result;
+}
+
+std::shared_ptr<CompressedFile::Store> CompressedFile::load(std::shared_ptr<IFile> file, std::shared_ptr<Codec> codec)
+{
+    if ( file == nullptr || codec == nullptr )
+        return nullptr;
+
+    auto store = std::make_shared<Store>();
+    store->file = std::move(file);
+    store->codec = std::move(codec);
+    if ( !store->parse() )
+    {
+        // not ours to close
+        store->file = nullptr;
+        return nullptr;
+    }
+
+    return store;
+}
+
+bool CompressedFile::stored(IFile & file)
+{
+    char magic[sizeof(MAGIC)];
+    if ( file.read(reinterpret_cast<DataT *>(magic), 0, sizeof(magic)) != sizeof(magic) )
+        return false;
+
+    return std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+CompressedFile::CompressedFile(std::shared_ptr<Store> store)
+    : _store(store)
+      , _readPos(0)
+      , _mutex()
+      , _cachedSerial(0)
+      , _cached()
+      , _cacheMutex()
+{
+}
+
+CompressedFile::~CompressedFile()
+{
+    close();
+}
+
+std::size_t CompressedFile::write(Buffer const & buf, std::size_t size)
+{
+    return write(buf.data(), this->size(), std::min(size, buf.size()));
+}
+
+std::size_t CompressedFile::write(Buffer const & buf, std::size_t offset, std::size_t size)
+{
+    return write(buf.data(), offset, std::min(size, buf.size()));
+}
+
+CompressedFile::Buffer CompressedFile::read(std::size_t size)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    Buffer buf(size);
+    buf.resize(read(buf.data(), _readPos, size));
+    _readPos += buf.size();
+
+    return buf;
+}
+
+CompressedFile::Buffer CompressedFile::read(std::size_t offset, std::size_t size)
+{
+    Buffer buf(size);
+    buf.resize(read(buf.data(), offset, size));
+
+    return buf;
+}
+
+CompressedFile::Buffer CompressedFile::readAll()
+{
+    return read(0, size());
+}
+
+std::size_t CompressedFile::read(DataT * dst, std::size_t offset, std::size_t size)
+{
+    auto total = this->size();
+    if ( _store == nullptr || offset >= total )
+        return 0;
+    size = std::min(size, total - offset);
+
+    auto blockSize = _store->blockSize;
+    std::size_t done = 0;
+    while ( done < size )
+    {
+        auto pos = offset + done;
+        auto want = std::min(blockSize - pos % blockSize, size - done);
+        if ( !readBlock(pos / blockSize, pos % blockSize, dst + done, want) )
+            break;
+        done += want;
+    }
+
+    return done;
+}
+
+std::size_t CompressedFile::write(DataT const * src, std::size_t offset, std::size_t size)
+{
+    if ( _store == nullptr || size == 0 )
+        return 0;
+
+    auto & store = *_store;
+    auto blockSize = store.blockSize;
+    std::size_t done = 0;
+    std::unique_lock<std::mutex> lk(store.mutex);
+    while ( done < size )
+    {
+        auto pos = offset + done;
+        auto block = pos / blockSize;
+        auto inBlock = pos % blockSize;
+        auto want = std::min(blockSize - inBlock, size - done);
+
+        if ( store.dirty.find(block) == store.dirty.end() )
+        {
+            // a write that leaves some of the block as it was starts from the stored block
+            auto start = block * blockSize;
+            auto current = store.size > start ? std::min<std::uint64_t>(blockSize, store.size - start) : 0;
+            Buffer data;
+            if ( inBlock != 0 || want < current )
+            {
+                auto serial = block < store.index.size() ? store.index[block].serial : 0;
+                data.resize(blockSize);
+                lk.unlock();
+                bool loaded = readBlock(block, 0, data.data(), blockSize);
+                lk.lock();
+                if ( !loaded )
+                    break;
+
+                // another write got to the block first, start over from what it left
+                auto now = block < store.index.size() ? store.index[block].serial : 0;
+                if ( store.dirty.find(block) != store.dirty.end() || now != serial )
+                    continue;
+                data.resize(current);
+            }
+            store.dirty.emplace(block, Store::Dirty{ std::move(data), 0, false });
+        }
+
+        auto & entry = store.dirty[block];
+        if ( entry.data.size() < inBlock + want )
+            entry.data.resize(inBlock + want);
+        std::memcpy(entry.data.data() + inBlock, src + done, want);
+        ++entry.version;
+        store.size = std::max<std::uint64_t>(store.size, pos + want);
+        store.changed = true;
+        done += want;
+
+        // a block written up to its end is done with, it is compressed while the writer goes on
+        if ( inBlock + want == blockSize )
+        {
+            store.queue(block, lk);
+        }
+        else if ( store.dirty.size() > DIRTY_BLOCKS )
+        {
+            std::vector<std::size_t> blocks;
+            for ( auto const & dirty : store.dirty )
+            {
+                if ( !dirty.second.queued )
+                    blocks.push_back(dirty.first);
+            }
+            for ( auto b : blocks )
+                store.queue(b, lk);
+        }
+    }
+
+    return done;
+}
+
+long CompressedFile::sync()
+{
+    return _store != nullptr ? _store->commit(true, false) : -EBADF;
+}
+
+long CompressedFile::datasync()
+{
+    return _store != nullptr ? _store->commit(true, true) : -EBADF;
+}
+
+void CompressedFile::close()
+{
+    if ( _store == nullptr )
+        return;
+
+    // the file of the store closes with the last handle
+    _store->commit(false, false);
+    _store = nullptr;
+}
+
+FileInfo CompressedFile::info() const
+{
+    if ( _store == nullptr )
+        return {};
+
+    auto info = _store->file->info();
+    info._size = size();
+
+    return info;
+}
+
+std::size_t CompressedFile::size() const
+{
+    if ( _store == nullptr )
+        return 0;
+
+    std::lock_guard<std::mutex> lk(_store->mutex);
+    return _store->size;
+}
+
+std::string CompressedFile::filename() const
+{
+    return _store != nullptr ? _store->file->filename() : std::string();
+}
+
+FileInfo::PermisionsT CompressedFile::permision() const
+{
+    return _store != nullptr ? _store->file->permision() : "--";
+}
+
+void CompressedFile::setPermision(Perms perms)
+{
+    if ( _store != nullptr )
+        _store->file->setPermision(perms);
+}
+
+void CompressedFile::disableWrite()
+{
+    if ( _store != nullptr )
+        _store->file->disableWrite();
+}
+
+void CompressedFile::disableRead()
+{
+    if ( _store != nullptr )
+        _store->file->disableRead();
+}
+
+void CompressedFile::disableAll()
+{
+    if ( _store != nullptr )
+        _store->file->disableAll();
+}
+
+CompressedFile::Stats CompressedFile::stats() const
+{
+    Stats stats = {};
+    if ( _store == nullptr )
+        return stats;
+
+    std::lock_guard<std::mutex> lk(_store->mutex);
+    for ( auto const & slot : _store->index )
+    {
+        if ( slot.length == 0 )
+            continue;
+        ++stats.blocks;
+        stats.raw += slot.raw;
+        stats.compressed += slot.length;
+    }
+    stats.dirty = _store->dirty.size();
+
+    return stats;
+}
+
+bool CompressedFile::readBlock(std::size_t block, std::size_t inBlock, DataT * dst, std::size_t size)
+{
+    auto & store = *_store;
+    auto copy = [inBlock, dst, size] (Buffer const & data)
+    {
+        auto available = data.size() > inBlock ? std::min(size, data.size() - inBlock) : 0;
+        std::memcpy(dst, data.data() + inBlock, available);
+        std::memset(dst + available, 0, size - available);
+    };
+
+    std::unique_lock<std::mutex> lk(store.mutex);
+    auto it = store.dirty.find(block);
+    if ( it != store.dirty.end() )
+    {
+        copy(it->second.data);
+        return true;
+    }
+
+    auto slot = block < store.index.size() ? store.index[block] : Store::Slot();
+    if ( slot.length == 0 )
+    {
+        std::memset(dst, 0, size);
+        return true;
+    }
+
+    std::shared_lock<std::shared_mutex> readers(store.space);
+    lk.unlock();
+    {
+        // reads that go through a block in pieces decompress it once
+        std::lock_guard<std::mutex> cached(_cacheMutex);
+        if ( _cachedSerial == slot.serial )
+        {
+            copy(_cached);
+            return true;
+        }
+    }
+
+    Buffer data(store.blockSize);
+    if ( !store.fetch(slot, data.data()) )
+        return false;
+    readers.unlock();
+    copy(data);
+
+    std::lock_guard<std::mutex> cached(_cacheMutex);
+    _cached.swap(data);
+    _cachedSerial = slot.serial;
+
+    return true;
+}
+
+}
@@ -0,0 +1,245 @@
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include "vfs/CopyEngine.h"
+
+namespace VFS {
+
+namespace {
+
+// The mechanism isn't available for this pair of files, as opposed to an I/O error.
+bool unsupported(int error)
+{
+    return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == ENOTTY
+        || error == EBADF || error == ETXTBSY || error == EPERM;
+}
+
+// Closes a descriptor when the scope ends.
+class FdGuard
+{
+public:
+    explicit FdGuard(int fd) : _fd(fd) {}
+    ~FdGuard() { if ( _fd >= 0 ) ::close(_fd); }
+    DISABLE_COPY(FdGuard);
+
+    int get() const { return _fd; }
+
+private:
+    int _fd;
+};
+
+}
+
+CopyEngine::Result CopyEngine::copy(int from, int to, Strategy first, Progress const & progress)
+{
+    Result result{ false, Strategy::NONE, 0 };
+    struct stat st;
+    if ( ::fstat(from, &st) != 0 || !S_ISREG(st.st_mode) || ::ftruncate(to, 0) != 0 )
+        return result;
+    std::uint64_t total = st.st_size;
+
+    auto strategy = first == Strategy::NONE ? Strategy::REFLINK : first;
+    if ( strategy == Strategy::REFLINK )
+    {
+        // the clone shares the extents, holes included, nothing is moved
+        if ( ::ioctl(to, FICLONE, from) == 0 )
+        {
+            result = { true, Strategy::REFLINK, total };
+            if ( progress )
+                progress(total, total);
+            return result;
+        }
+        strategy = Strategy::COPY_FILE_RANGE;
+    }
+
+    // walk the data segments, a filesystem without SEEK_DATA has a single one
+    std::uint64_t offset = 0;
+    while ( offset < total )
+    {
+        auto data = ::lseek(from, static_cast<off_t>(offset), SEEK_DATA);
+        if ( data < 0 && errno == ENXIO )
+            break;  // only a hole is left
+        if ( data < 0 )
+            data = static_cast<off_t>(offset);
+
+        auto hole = ::lseek(from, data, SEEK_HOLE);
+        if ( hole < 0 )
+            hole = static_cast<off_t>(total);
+        auto end = std::min<std::uint64_t>(hole, total);
+
+        if ( !copyRange(from, to, data, end - data, strategy, result, total, progress) )
+            return result;
+        offset = end;
+    }
+
+    // a trailing hole only exists through the size
+    if ( ::ftruncate(to, static_cast<off_t>(total)) != 0 )
+        return result;
+
+    if ( result.strategy == Strategy::NONE )
+        result.strategy = strategy;
+    result.ok = true;
+
+    return result;
+}
+
+CopyEngine::Result CopyEngine::copy(std::string const & from, std::string const & to, Strategy first, Progress const & progress)
+{
+    FdGuard in(::open(from.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if ( in.get() < 0 || ::fstat(in.get(), &st) != 0 || !S_ISREG(st.st_mode) )
+        return { false, Strategy::NONE, 0 };
+
+    FdGuard out(::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777));
+    if ( out.get() < 0 )
+        return { false, Strategy::NONE, 0 };
+
+    auto result = copy(in.get(), out.get(), first, progress);
+    if ( !result.ok )
+        ::unlink(to.c_str());
+
+    return result;
+}
+
+CopyEngine::Result CopyEngine::stream(IFile & from, IFile & to, Progress const & progress)
+{
+    Result result{ false, Strategy::STREAM, 0 };
+    std::uint64_t total = from.size();
+    std::unique_ptr<char[]> buffers[2] = { std::unique_ptr<char[]>(new char[BUFFER_SIZE]), std::unique_ptr<char[]>(new char[BUFFER_SIZE]) };
+
+    // the read of the next chunk is in flight while the current one is written
+    auto reading = from.readAsync(buffers[0].get(), 0, BUFFER_SIZE);
+    std::size_t current = 0;
+    while ( true )
+    {
+        auto n = reading.get();
+        if ( n < 0 )
+            return result;
+        if ( n == 0 )
+            break;
+
+        auto offset = result.bytes;
+        auto chunk = buffers[current].get();
+        current ^= 1;
+        reading = from.readAsync(buffers[current].get(), offset + n, BUFFER_SIZE);
+
+        if ( to.write(chunk, offset, n) != static_cast<std::size_t>(n) )
+        {
+            reading.wait();     // the buffer must outlive the read
+            return result;
+        }
+        result.bytes += n;
+        if ( progress )
+            progress(result.bytes, std::max(total, result.bytes));
+    }
+
+    result.ok = to.fsyncAsync().get() == 0;
+
+    return result;
+}
+
+char const * CopyEngine::name(Strategy strategy)
+{
+    switch ( strategy )
+    {
+        case Strategy::REFLINK:
+            return "reflink";
+        case Strategy::COPY_FILE_RANGE:
+            return "copy_file_range";
+        case Strategy::SENDFILE:
+            return "sendfile";
+        case Strategy::BUFFERED:
+            return "buffered";
+        case Strategy::STREAM:
+            return "stream";
+        default:
+            return "none";
+    }
+}
+
+bool CopyEngine::copyRange(int from, int to, std::uint64_t offset, std::uint64_t size, Strategy & strategy, Result & result, std::uint64_t total, Progress const & progress)
+{
+    auto moved = [&] (std::uint64_t n)
+    {
+        offset += n;
+        size -= n;
+        result.bytes += n;
+        result.strategy = std::max(result.strategy, strategy);
+        if ( progress )
+            progress(result.bytes, total);
+    };
+
+    while ( size > 0 && strategy == Strategy::COPY_FILE_RANGE )
+    {
+        loff_t in = offset;
+        loff_t out = offset;
+        auto n = ::copy_file_range(from, &in, to, &out, std::min<std::uint64_t>(size, 1ull << 30), 0);
+        if ( n > 0 )
+            moved(n);
+        else if ( n == 0 )
+            return false;   // the source shrank under us
+        else if ( errno == EINTR )
+            continue;
+        else if ( unsupported(errno) )
+            strategy = Strategy::SENDFILE;
+        else
+            return false;
+    }
+
+    while ( size > 0 && strategy == Strategy::SENDFILE )
+    {
+        // sendfile writes at the position of the target
+        off_t in = static_cast<off_t>(offset);
+        if ( ::lseek(to, static_cast<off_t>(offset), SEEK_SET) < 0 )
+        {
+            strategy = Strategy::BUFFERED;
+            break;
+        }
+        auto n = ::sendfile(to, from, &in, std::min<std::uint64_t>(size, 1ull << 30));
+        if ( n > 0 )
+            moved(n);
+        else if ( n == 0 )
+            return false;
+        else if ( errno == EINTR )
+            continue;
+        else if ( unsupported(errno) )
+            strategy = Strategy::BUFFERED;
+        else
+            return false;
+    }
+
+    if ( size == 0 )
+        return true;
+
+    std::unique_ptr<char[]> buffer(new char[BUFFER_SIZE]);
+    while ( size > 0 )
+    {
+        auto n = ::pread(from, buffer.get(), std::min<std::uint64_t>(size, BUFFER_SIZE), static_cast<off_t>(offset));
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            return false;
+
+        std::size_t written = 0;
+        while ( written < static_cast<std::size_t>(n) )
+        {
+            auto w = ::pwrite(to, buffer.get() + written, n - written, static_cast<off_t>(offset + written));
+            if ( w < 0 && errno == EINTR )
+                continue;
+            if ( w <= 0 )
+                return false;
+            written += w;
+        }
+        moved(n);
+    }
+
+    return true;
+}
+
+}
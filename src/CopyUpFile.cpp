@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "vfs/CopyUpFile.h"
+
+namespace VFS {
+
+constexpr std::size_t CopyUpFile::BLOCK_SIZE;
+
+namespace {
+
+constexpr char const MAGIC[4] = { 'V', 'F', 'C', 'U' };
+
+}
+
+bool CopyUpFile::Blocks::complete() const
+{
+    return std::all_of(copied.begin(), copied.end(), [] (char block) { return block != 0; });
+}
+
+IFile::Buffer CopyUpFile::Blocks::serialize() const
+{
+    Buffer data(MAGIC, MAGIC + sizeof(MAGIC));
+    data.insert(data.end(), reinterpret_cast<char const *>(&layer), reinterpret_cast<char const *>(&layer) + sizeof(layer));
+    data.insert(data.end(), reinterpret_cast<char const *>(&lowerSize), reinterpret_cast<char const *>(&lowerSize) + sizeof(lowerSize));
+    data.insert(data.end(), copied.begin(), copied.end());
+
+    return data;
+}
+
+bool CopyUpFile::Blocks::parse(Buffer const & data)
+{
+    auto header = sizeof(MAGIC) + sizeof(layer) + sizeof(lowerSize);
+    if ( data.size() < header || std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) != 0 )
+        return false;
+
+    std::memcpy(&layer, data.data() + sizeof(MAGIC), sizeof(layer));
+    std::memcpy(&lowerSize, data.data() + sizeof(MAGIC) + sizeof(layer), sizeof(lowerSize));
+    auto count = ( lowerSize + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+    if ( data.size() != header + count )
+        return false;
+
+    copied.assign(data.begin() + header, data.end());
+
+    return true;
+}
+
+bool CopyUpFile::Blocks::save()
+{
+    std::lock_guard<std::mutex> lk(mutex);
+    if ( !dirty || store == nullptr )
+        return true;
+
+    auto data = serialize();
+    if ( store->write(data.data(), 0, data.size()) != data.size() || store->datasync() != 0 )
+        return false;
+
+    dirty = false;
+    return true;
+}
+
+CopyUpFile::CopyUpFile(std::shared_ptr<IFile> lower, std::shared_ptr<IFile> upper, std::shared_ptr<Blocks> blocks)
+    : _lower(lower)
+      , _upper(upper)
+      , _blocks(blocks)
+      , _readPos(0)
+      , _mutex()
+{
+}
+
+CopyUpFile::~CopyUpFile()
+{
+    close();
+}
+
+std::size_t CopyUpFile::write(Buffer const & buf, std::size_t size)
+{
+    return write(buf.data(), this->size(), std::min(size, buf.size()));
+}
+
+std::size_t CopyUpFile::write(Buffer const & buf, std::size_t offset, std::size_t size)
+{
+    return write(buf.data(), offset, std::min(size, buf.size()));
+}
+
+CopyUpFile::Buffer CopyUpFile::read(std::size_t size)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    Buffer buf(size);
+    buf.resize(read(buf.data(), _readPos, size));
+    _readPos += buf.size();
+
+    return buf;
+}
+
+CopyUpFile::Buffer CopyUpFile::read(std::size_t offset, std::size_t size)
+{
+    Buffer buf(size);
+    buf.resize(read(buf.data(), offset, size));
+
+    return buf;
+}
+
+CopyUpFile::Buffer CopyUpFile::readAll()
+{
+    return read(0, size());
+}
+
+std::size_t CopyUpFile::read(DataT * dst, std::size_t offset, std::size_t size)
+{
+    auto total = this->size();
+    if ( _upper == nullptr || offset >= total )
+        return 0;
+    size = std::min(size, total - offset);
+
+    // runs of blocks in the same layer are read with one call
+    std::size_t done = 0;
+    while ( done < size )
+    {
+        auto pos = offset + done;
+        bool lower = below(pos / BLOCK_SIZE);
+        auto end = pos;
+        while ( end < offset + size && below(end / BLOCK_SIZE) == lower )
+            end = std::min(( end / BLOCK_SIZE + 1 ) * BLOCK_SIZE, offset + size);
+
+        auto want = end - pos;
+        auto n = lower ? _lower->read(dst + done, pos, want) : _upper->read(dst + done, pos, want);
+        // holes in either layer read as zeros
+        if ( n < want )
+            std::memset(dst + done + n, 0, want - n);
+        done += want;
+    }
+
+    return done;
+}
+
+std::size_t CopyUpFile::write(DataT const * src, std::size_t offset, std::size_t size)
+{
+    std::vector<std::size_t> whole;
+    if ( _upper == nullptr || size == 0 || !copyUp(offset, size, whole) )
+        return 0;
+
+    return settle(whole, offset, _upper->write(src, offset, size));
+}
+
+long CopyUpFile::sync()
+{
+    if ( _upper == nullptr )
+        return -EBADF;
+
+    return persist(false);
+}
+
+long CopyUpFile::datasync()
+{
+    if ( _upper == nullptr )
+        return -EBADF;
+
+    return persist(true);
+}
+
+void CopyUpFile::close()
+{
+    if ( _upper == nullptr )
+        return;
+
+    bool dirty;
+    {
+        std::lock_guard<std::mutex> lk(_blocks->mutex);
+        dirty = _blocks->dirty;
+    }
+    if ( dirty )
+        persist(true);
+    _upper->close();
+    _lower->close();
+    _upper = nullptr;
+}
+
+long CopyUpFile::persist(bool dataOnly)
+{
+    // the map must never say a block is copied before the block is on disk
+    auto result = dataOnly ? _upper->datasync() : _upper->sync();
+    if ( result != 0 )
+        return result;
+
+    return _blocks->save() ? 0 : -EIO;
+}
+
+FileInfo CopyUpFile::info() const
+{
+    if ( _upper == nullptr )
+        return {};
+
+    auto info = _upper->info();
+    info._size = size();
+
+    return info;
+}
+
+std::size_t CopyUpFile::size() const
+{
+    if ( _upper == nullptr )
+        return 0;
+
+    return std::max<std::size_t>(_blocks->lowerSize, _upper->size());
+}
+
+std::string CopyUpFile::filename() const
+{
+    return _upper != nullptr ? _upper->filename() : std::string();
+}
+
+FileInfo::PermisionsT CopyUpFile::permision() const
+{
+    return _upper != nullptr ? _upper->permision() : "--";
+}
+
+void CopyUpFile::setPermision(Perms perms)
+{
+    if ( _upper != nullptr )
+        _upper->setPermision(perms);
+}
+
+void CopyUpFile::disableWrite()
+{
+    if ( _upper != nullptr )
+        _upper->disableWrite();
+}
+
+void CopyUpFile::disableRead()
+{
+    if ( _upper != nullptr )
+        _upper->disableRead();
+}
+
+void CopyUpFile::disableAll()
+{
+    if ( _upper != nullptr )
+        _upper->disableAll();
+}
+
+bool CopyUpFile::below(std::size_t block) const
+{
+    std::lock_guard<std::mutex> lk(_blocks->mutex);
+    return block < _blocks->copied.size() && _blocks->copied[block] == 0;
+}
+
+bool CopyUpFile::copyUp(std::size_t offset, std::size_t size, std::vector<std::size_t> & whole)
+{
+    auto first = offset / BLOCK_SIZE;
+    auto last = ( offset + size - 1 ) / BLOCK_SIZE;
+
+    // the lock keeps another write from copying a block over data written into it since, a block another write
+    // covers whole is copied once that one is done
+    std::unique_lock<std::mutex> lk(_blocks->mutex);
+    auto & copied = _blocks->copied;
+    auto & pending = _blocks->pending;
+    pending.resize(copied.size());
+    _blocks->cv.wait(lk, [&pending, first, last] ()
+    {
+        return std::none_of(pending.begin() + std::min(first, pending.size()), pending.begin() + std::min(last + 1, pending.size()),
+                            [] (char block) { return block != 0; });
+    });
+
+    Buffer block;
+    for ( auto b : { first, last } )
+    {
+        auto start = b * BLOCK_SIZE;
+        bool covered = offset <= start && start + BLOCK_SIZE <= offset + size;
+        if ( b >= copied.size() || copied[b] != 0 || covered )
+            continue;
+
+        auto length = std::min<std::size_t>(BLOCK_SIZE, _blocks->lowerSize - start);
+        block.resize(length);
+        auto n = _lower->read(block.data(), start, length);
+        if ( _upper->write(block.data(), start, n) != n )
+            return false;
+        copied[b] = 1;
+        _blocks->dirty = true;
+    }
+
+    // the others are read from the lower layer until the write is done
+    for ( auto b = first; b <= last && b < copied.size(); ++b )
+    {
+        if ( copied[b] == 0 )
+        {
+            pending[b] = 1;
+            whole.push_back(b);
+        }
+    }
+
+    return true;
+}
+
+std::size_t CopyUpFile::settle(std::vector<std::size_t> const & whole, std::size_t offset, std::size_t n)
+{
+    if ( whole.empty() )
+        return n;
+
+    auto written = n;
+    {
+        std::lock_guard<std::mutex> lk(_blocks->mutex);
+        for ( auto b : whole )
+        {
+            _blocks->pending[b] = 0;
+            if ( ( b + 1 ) * BLOCK_SIZE <= offset + n )
+            {
+                _blocks->copied[b] = 1;
+                _blocks->dirty = true;
+            }
+            else
+            {
+                written = std::min(written, b * BLOCK_SIZE > offset ? b * BLOCK_SIZE - offset : 0);
+            }
+        }
+    }
+    _blocks->cv.notify_all();
+
+    return written;
+}
+
+}
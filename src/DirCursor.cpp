@@ -0,0 +1,147 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include "vfs/DirCursor.h"
+
+namespace VFS {
+
+DirCursor::DirCursor(std::string const & directory, bool recursive, std::string const & cookie)
+    : DirCursor(cookie != END ? ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1, directory, recursive, cookie)
+{
+}
+
+DirCursor::DirCursor(int dir, std::string const & directory, bool recursive, std::string const & cookie)
+    : _levels()
+      , _recursive(recursive)
+{
+    if ( cookie == END )
+    {
+        if ( dir >= 0 )
+            ::close(dir);
+        return;
+    }
+
+    auto path = directory;
+    if ( path.empty() || path.back() != '/' )
+        path.push_back('/');
+
+    if ( push(dir, path, "", -1) )
+        restore(cookie);
+}
+
+DirCursor::~DirCursor()
+{
+    for ( auto & level : _levels )
+        ::closedir(level.dir);
+}
+
+DirCursor::EntryList DirCursor::next(std::size_t count)
+{
+    EntryList batch;
+    while ( batch.size() < count && !_levels.empty() )
+    {
+        auto dir = _levels.back().dir;
+        auto entry = ::readdir(dir);
+        if ( entry == nullptr )
+        {
+            ::closedir(dir);
+            _levels.pop_back();
+            continue;
+        }
+
+        std::string name = entry->d_name;
+        if ( name == "." || name == ".." )
+            continue;
+
+        bool directory = entry->d_type == DT_DIR;
+        if ( entry->d_type == DT_UNKNOWN )
+        {
+            struct stat st;
+            directory = ::fstatat(::dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        auto path = _levels.back().path + name;
+        batch.push_back(path);
+
+        // depth first, the children follow their directory
+        if ( _recursive && directory )
+            push(openBelow(name), path + '/', name, -1);
+    }
+
+    return batch;
+}
+
+std::string DirCursor::cookie() const
+{
+    if ( _levels.empty() )
+        return END;
+
+    // per level: length of the name, ':', the name, the readdir position, ';'
+    std::string cookie;
+    for ( auto const & level : _levels )
+    {
+        cookie += std::to_string(level.name.size()) + ':' + level.name;
+        cookie += std::to_string(::telldir(level.dir)) + ';';
+    }
+
+    return cookie;
+}
+
+bool DirCursor::push(int fd, std::string const & path, std::string const & name, long position)
+{
+    DIR * dir = fd >= 0 ? ::fdopendir(fd) : nullptr;
+    if ( dir == nullptr )
+    {
+        if ( fd >= 0 )
+            ::close(fd);
+        return false;
+    }
+
+    if ( position >= 0 )
+        ::seekdir(dir, position);
+    _levels.push_back({ dir, path, name });
+
+    return true;
+}
+
+void DirCursor::restore(std::string const & cookie)
+{
+    char const * at = cookie.c_str();
+    char const * end = at + cookie.size();
+    for ( std::size_t depth = 0; at < end; ++depth )
+    {
+        char * stop = nullptr;
+        auto length = std::strtoul(at, &stop, 10);
+        if ( stop == at || *stop != ':' || length > static_cast<std::size_t>(end - stop - 1) )
+            return;
+        std::string name(stop + 1, length);
+
+        at = stop + 1 + length;
+        auto position = std::strtol(at, &stop, 10);
+        if ( stop == at || *stop != ';' )
+            return;
+        at = stop + 1;
+
+        if ( depth == 0 )
+        {
+            ::seekdir(_levels.front().dir, position);
+            continue;
+        }
+
+        // a directory removed since then is skipped, its parent is already past it
+        if ( !push(openBelow(name), _levels.back().path + name + '/', name, position) )
+            return;
+    }
+}
+
+int DirCursor::openBelow(std::string const & name) const
+{
+    // the names of a cookie come from the caller
+    if ( name.empty() || name == "." || name == ".." || name.find('/') != std::string::npos )
+        return -1;
+
+    return ::openat(::dirfd(_levels.back().dir), name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+}
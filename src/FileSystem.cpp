@@ -1,15 +1,69 @@
-#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
 #include <mutex>
-#include "vfs/RegularFile.h"
+#include <shared_mutex>
+#include <vector>
 #include "vfs/FileSystem.h"
+#include "vfs/MappedFile.h"
+#include "vfs/RegularFile.h"
+#include "vfs/TreeWalker.h"
 
 namespace VFS {
 
 namespace fs = std::filesystem;
 
+namespace {
+
+// The directory the last part of a path is in, opened beneath the root for a path with more than one part.
+struct ParentDir
+{
+    ParentDir(int root, std::string const & path)
+        : fd(root)
+          , owned(false)
+          , name(path)
+    {
+        auto slash = path.rfind('/');
+        if ( slash == std::string::npos )
+            return;
+
+        name = path.substr(slash + 1);
+        fd = PathHandle::openBeneath(root, path.substr(0, slash), O_PATH | O_DIRECTORY);
+        owned = fd >= 0;
+    }
+    DISABLE_COPY(ParentDir);
+
+    ~ParentDir()
+    {
+        if ( owned )
+            ::close(fd);
+    }
+
+    int fd;
+    bool owned;
+    std::string name;
+};
+
+}
+
 FileSystem::FileSystem(std::string const & path)
     : _path (path)
       , _mounted(false)
+      , _root(-1)
+      , _cache()
+      , _behindLimit(0)
+      , _behindDelay(RegularFile::DEFAULT_WRITE_BEHIND_DELAY)
+      , _index()
+      , _walker(std::make_shared<TreeWalker>())
+      , _locks()
+      , _handles()
+      , _lockStats()
+      , _timedLocks(nullptr)
+      , _codecs()
+      , _stores()
+      , _storesMutex()
       , _mutex()
 {
     if ( *_path.rbegin() != '/' )
@@ -22,115 +76,269 @@ FileSystem::~FileSystem() { unmount(); }
 
 bool FileSystem::mount(std::string const & path)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    UniqueGuard lock(_timedLocks, Metrics::Op::MOUNT, _mutex);
     if ( _mounted )
         return false;
 
-    if ( !fs::exists(path) || !fs::is_directory(path) )
+    int root = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if ( root < 0 )
     {
         _path = "";
         return false;
     }
 
+    _root = root;
     _path = path;
+    if ( *_path.rbegin() != '/' )
+        _path.push_back('/');
     _mounted = true;
     // fs::current_path(_path);
+    _index.build(_path);
 
     return _mounted;
 }
 
 bool FileSystem::unmount()
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    UniqueGuard lock(_timedLocks, Metrics::Op::UNMOUNT, _mutex);
     if ( !_mounted )
         return false;
 
     _mounted = false;
     _path = "";
+    _index.clear();
+    _handles.clear();
+    ::close(_root);
+    _root = -1;
 
     return true;
 }
 
 IFS::IFilePtr FileSystem::open(std::string const & filename, Perms mode)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if ( !_mounted || !fs::exists(filename) || !validFilename(filename) || !hasPermision(mode) )
+    return open(PathHandle::intern(filename), mode);
+}
+
+IFS::IFilePtr FileSystem::open(PathHandle const & path, Perms mode)
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::OPEN, _mutex);
+    if ( !_mounted || !path.valid() || !hasPermision(mode) )
+        return nullptr;
+
+    // the handle table answers for files missing and directories too
+    auto handle = _handles.acquire(_root, path.str());
+    if ( handle == nullptr )
         return nullptr;
 
-    auto absolute = _path + filename;
-    return !fs::is_directory(absolute) ? IFilePtr( new RegularFile(absolute) ) : nullptr;
+    // the opens of a compressed file share the index of its blocks and those not stored yet, a file is compressed
+    // wherever it was moved or copied to, below a directory that isn't its new blocks are stored as they are
+    auto absolute = _path + path.str();
+    auto id = handle->id();
+    auto store = storeOf(id.device, id.inode);
+    auto codec = codecFor(path.str());
+    // whether the file is compressed is read once per descriptor, a store loaded for it marks it so
+    if ( store == nullptr && codec == nullptr )
+    {
+        if ( handle->compressed() < 0 )
+        {
+            RegularFile probe(absolute, handle);
+            handle->setCompressed(CompressedFile::stored(probe));
+        }
+        if ( handle->compressed() > 0 )
+            codec = Codec::passthrough();
+    }
+    if ( store == nullptr && codec != nullptr )
+    {
+        std::lock_guard<std::mutex> lk(_storesMutex);
+        auto & slot = _stores[{ id.device, id.inode }];
+        store = slot.lock();
+        if ( store == nullptr )
+        {
+            for ( auto it = _stores.begin(); it != _stores.end(); )
+                it = it->second.expired() && &it->second != &slot ? _stores.erase(it) : std::next(it);
+            store = CompressedFile::load(std::make_shared<RegularFile>(absolute, handle, _cache), codec);
+            slot = store;
+        }
+        if ( store != nullptr )
+            handle->setCompressed(true);
+    }
+    if ( store != nullptr )
+        return IFilePtr( new CompressedFile(store) );
+
+    // read-only opens are served from a memory mapping
+    if ( mode == Perms::READ )
+        return IFilePtr( new MappedFile(absolute, std::move(handle)) );
+
+    auto file = new RegularFile(absolute, std::move(handle), _cache);
+    if ( _behindLimit != 0 )
+        file->setWriteBehind(_behindLimit, _behindDelay);
+    if ( _timedLocks != nullptr )
+        file->setLockStats(true);
+
+    return IFilePtr( file );
 }
 
 bool FileSystem::remove(std::string const & filename)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if ( !_mounted )
+    return remove(PathHandle::intern(filename));
+}
+
+bool FileSystem::remove(PathHandle const & path)
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::REMOVE, _mutex);
+    if ( !_mounted || !path.valid() || path.str() == "." )
+        return false;
+
+    auto const & name = path.str();
+    auto guard = _locks.lock(name);
+    ParentDir parent(_root, name);
+    struct stat st;
+    if ( parent.fd < 0 || ::fstatat(parent.fd, parent.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 )
         return false;
 
-    auto absolute = _path + filename;
-    if ( !validFilename(filename) || !fs::exists(absolute) )
+    // the inode number may be reused by the next file created, forget what was cached for this one
+    if ( S_ISREG(st.st_mode) )
+        forget(st.st_dev, st.st_ino);
+
+    if ( ::unlinkat(parent.fd, parent.name.c_str(), S_ISDIR(st.st_mode) ? AT_REMOVEDIR : 0) != 0 )
         return false;
 
-    return fs::remove(absolute);
+    _handles.invalidate(name);
+    _index.erase(name);
+
+    return true;
 }
 
 bool FileSystem::touchFile(std::string const & filename)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if ( !_mounted || !validFilename(filename) )
+    return touchFile(PathHandle::intern(filename));
+}
+
+bool FileSystem::touchFile(PathHandle const & path)
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::TOUCH_FILE, _mutex);
+    if ( !_mounted || !path.valid() )
         return false;
-    auto absolute = _path + filename;
-    if ( fs::exists(absolute) )
+
+    auto const & name = path.str();
+    auto guard = _locks.lock(name);
+    int fd = PathHandle::openBeneath(_root, name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if ( fd < 0 )
         return false;
 
-    std::ofstream{absolute};
+    ::close(fd);
+    _index.insert(name, false);
 
     return true;
 }
 
 bool FileSystem::makeDir(std::string const & filename)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if ( !_mounted )
+    return makeDir(PathHandle::intern(filename));
+}
+
+bool FileSystem::makeDir(PathHandle const & dir)
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::MAKE_DIR, _mutex);
+    if ( !_mounted || !dir.valid() )
         return false;
 
-    auto absolute = _path + filename;
-    if ( !validFilename(filename) || fs::exists(absolute) )
+    auto const & name = dir.str();
+    auto guard = _locks.lock(name);
+    ParentDir parent(_root, name);
+    if ( parent.fd < 0 || ::mkdirat(parent.fd, parent.name.c_str(), 0777) != 0 )
         return false;
 
-    return fs::create_directory(absolute);
+    _index.insert(name, true);
+
+    return true;
 }
 
 bool FileSystem::moveTo(std::string const & from, std::string const & to)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if ( !_mounted || !validFilename(from) || !validFilename(to) )
+    return moveTo(PathHandle::intern(from), PathHandle::intern(to));
+}
+
+bool FileSystem::moveTo(PathHandle const & from, PathHandle const & to)
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::MOVE_TO, _mutex);
+    if ( !_mounted || !from.valid() || !to.valid() )
         return false;
-    auto fromAbsolute = _path + from;
-    auto toAbsolute = _path + to;
-    if ( !fs::exists(fromAbsolute) || fs::exists(toAbsolute))
+
+    auto guard = _locks.lock(from.str(), to.str());
+    ParentDir source(_root, from.str());
+    ParentDir target(_root, to.str());
+    if ( source.fd < 0 || target.fd < 0 )
         return false;
 
-    fs::rename(fromAbsolute, toAbsolute);
+    if ( ::renameat2(source.fd, source.name.c_str(), target.fd, target.name.c_str(), RENAME_NOREPLACE) != 0 )
+    {
+        // filesystems without RENAME_NOREPLACE check first, as every rename did before
+        struct stat st;
+        if ( ( errno != EINVAL && errno != ENOSYS ) || ::fstatat(target.fd, target.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 )
+            return false;
+        if ( ::renameat(source.fd, source.name.c_str(), target.fd, target.name.c_str()) != 0 )
+            return false;
+    }
+
+    _handles.invalidate(from.str());
+    _handles.invalidate(to.str());
+    _index.move(from.str(), to.str());
 
     return true;
 }
 
 bool FileSystem::moveTo(std::string const & from, IFSPtr fsptr, std::string const & to)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
+    if ( fsptr.get() == this )
+        return moveTo(from, to);
+
+    SharedGuard lock(_timedLocks, Metrics::Op::MOVE_TO, _mutex);
     if ( !_mounted || fsptr == nullptr || !fsptr->isMounted() )
         return false;
 
-    if ( !validFilename(from) || !validFilename(to) )
+    auto source = PathHandle::intern(from);
+    auto target = PathHandle::intern(to);
+    if ( !source.valid() || source.str() == "." || !target.valid() )
         return false;
+    auto guard = _locks.lock(source.str());
 
-    auto fromAbsolute = _path + from;
-    auto toAbsolute = fsptr->path() + to;
-    if ( !fs::exists(fromAbsolute) || fs::exists(toAbsolute))
+    // the type constants of another translation unit are other pointers, compare the text
+    ParentDir parent(_root, source.str());
+    struct stat st;
+    if ( parent.fd < 0 || ::fstatat(parent.fd, parent.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0
+         || std::string(fsptr->type(to)) != type::NOTFOUND )
         return false;
 
-    fs::rename(fromAbsolute, toAbsolute);
+    // a rename is enough while both sides are on the same device, to is looked up beneath the other root as well
+    auto disk = dynamic_cast<FileSystem *>(fsptr.get());
+    if ( disk != nullptr )
+    {
+        int renamed = -1;
+        {
+            SharedGuard into(disk->_timedLocks, Metrics::Op::MOVE_TO, disk->_mutex);
+            ParentDir dest(disk->_root, target.str());
+            if ( !disk->_mounted || dest.fd < 0 )
+                return false;
+            renamed = ::renameat(parent.fd, parent.name.c_str(), dest.fd, dest.name.c_str());
+        }
+        if ( renamed == 0 )
+        {
+            // the index of the target filesystem sees the new entry when it revalidates the directory
+            _handles.invalidate(source.str());
+            _index.erase(source.str());
+            return true;
+        }
+        if ( errno != EXDEV )
+            return false;
+    }
+
+    // a move that failed left the source, or what of it wasn't moved yet, the index and the handles notice the rest
+    if ( !moveAcross(parent.fd, parent.name, source.str(), *fsptr, target.str(), disk) )
+        return false;
+
+    _handles.invalidate(source.str());
+    _index.erase(source.str());
 
     return true;
 }
@@ -145,126 +353,398 @@ IFS::EntryList FileSystem::list()
 
 IFS::EntryList FileSystem::list(std::string const & dir)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if ( !_mounted || !validFilename(dir))
-        return {};
+    std::string absolute;
+    int fd = -1;
+    {
+        SharedGuard lock(_timedLocks, Metrics::Op::LIST, _mutex);
+        auto path = PathHandle::intern(dir);
+        if ( !_mounted || !path.valid() )
+            return {};
+        absolute = _path + path.str();
+        fd = PathHandle::openBeneath(_root, path.str(), O_RDONLY | O_DIRECTORY);
+        if ( fd < 0 )
+            return {};
+    }
 
-    auto absolute = _path + dir;
-    if ( !fs::exists(absolute) )
-        return {};
+    // the walk reads the disk only from the directory it was given, it doesn't need the filesystem lock
+    auto entries = std::atomic_load(&_walker)->collect(fd, absolute, true);
+    ::close(fd);
 
-    auto iters = fs::recursive_directory_iterator(absolute);
-    EntryList result;
-    result.reserve(10);
-    for ( auto const& dir_entry : iters )
-        result.emplace_back( std::move( dir_entry.path().string() ) );
+    return entries;
+}
 
-    return result;
+std::unique_ptr<DirCursor> FileSystem::openDir(std::string const & dir, bool recursive, std::string const & cookie)
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::LIST, _mutex);
+    auto path = PathHandle::intern(dir);
+    if ( !_mounted || !path.valid() )
+        return nullptr;
+
+    int fd = PathHandle::openBeneath(_root, path.str(), O_RDONLY | O_DIRECTORY);
+    if ( fd < 0 )
+        return nullptr;
+
+    return std::unique_ptr<DirCursor>(new DirCursor(fd, _path + path.str(), recursive, cookie));
 }
 
 bool FileSystem::contain(std::string const & filename)
 {
+    auto path = PathHandle::intern(filename);
+    if ( !_mounted || !path.valid() )
+        return false;
+
+    if ( _index.contains(path.str()) )
+        return true;
+
     return search(filename) != type::NOTFOUND;
 }
 
 std::string FileSystem::search(std::string const & filename)
 {
-    if ( !_mounted || !validFilename(filename) )
+    if ( !_mounted || !PathHandle::intern(filename).valid() )
         return type::NOTFOUND;
 
-    auto entry = list();
-    auto it = std::find_if(entry.begin(), entry.end(), [&filename] (std::string const & item) -> bool
+    // the match comes from memory, it is checked against the disk before it is returned
+    while ( true )
     {
-        return item.find(filename) != std::string::npos;
-    });
+        auto matches = _index.find(filename, 0, 1);
+        if ( matches.empty() )
+            return type::NOTFOUND;
+        if ( _index.contains(matches.front()) )
+            return matches.front();
+    }
+}
+
+IFS::EntryList FileSystem::searchAll(std::string const & pattern, std::size_t offset, std::size_t limit)
+{
+    if ( !_mounted )
+        return {};
 
-    return it != entry.end() ? *it : type::NOTFOUND;
+    return _index.find(pattern, offset, limit);
 }
 
-bool FileSystem::copy(std::string const & from, std::string const & to)
+IFS::EntryList FileSystem::searchPrefix(std::string const & prefix, std::size_t offset, std::size_t limit)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
     if ( !_mounted )
-        return false;
+        return {};
 
-    if ( !validFilename(from) || !validFilename(to) )
-        return false;
+    return _index.findPrefix(prefix, offset, limit);
+}
 
-    auto fromAbsolute = _path + from;
-    auto toAbsolute = _path + to;
-    if ( !fs::exists(fromAbsolute) || fs::exists(toAbsolute))
-        return false;
+bool FileSystem::copy(std::string const & from, std::string const & to)
+{
+    return copyFile(from, to).ok;
+}
 
-    return fs::copy_file(fromAbsolute, toAbsolute);
+CopyEngine::Result FileSystem::copyFile(std::string const & from, std::string const & to, CopyEngine::Progress const & progress)
+{
+    return copyFile(PathHandle::intern(from), PathHandle::intern(to), progress);
+}
+
+CopyEngine::Result FileSystem::copyFile(PathHandle const & from, PathHandle const & to, CopyEngine::Progress const & progress)
+{
+    CopyEngine::Result failed{ false, CopyEngine::Strategy::NONE, 0 };
+    SharedGuard lock(_timedLocks, Metrics::Op::COPY, _mutex);
+    if ( !_mounted || !from.valid() || !to.valid() )
+        return failed;
+    auto guard = _locks.lock(from.str(), to.str());
+
+    int in = PathHandle::openBeneath(_root, from.str(), O_RDONLY);
+    struct stat st;
+    if ( in < 0 || ::fstat(in, &st) != 0 || !S_ISREG(st.st_mode) )
+    {
+        if ( in >= 0 )
+            ::close(in);
+        return failed;
+    }
+
+    // the copy is of the file on the disk, blocks of a compressed one that is open are stored first
+    if ( auto store = storeOf(st.st_dev, st.st_ino) )
+        CompressedFile(store).datasync();
+
+    int out = PathHandle::openBeneath(_root, to.str(), O_WRONLY | O_CREAT | O_EXCL, st.st_mode & 07777);
+    if ( out < 0 )
+    {
+        ::close(in);
+        return failed;
+    }
+
+    auto result = CopyEngine::copy(in, out, CopyEngine::Strategy::REFLINK, progress);
+    ::close(in);
+    ::close(out);
+    if ( !result.ok )
+    {
+        ParentDir parent(_root, to.str());
+        if ( parent.fd >= 0 )
+            ::unlinkat(parent.fd, parent.name.c_str(), 0);
+        return result;
+    }
+
+    _index.insert(to.str(), false);
+
+    return result;
 }
 
 type::FILETYPE FileSystem::type(std::string const & filename)
 {
-    if ( std::lock_guard<std::mutex> lock(_mutex); !_mounted || !validFilename(filename) )
+    return type(PathHandle::intern(filename));
+}
+
+type::FILETYPE FileSystem::type(PathHandle const & path)
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::TYPE, _mutex);
+    if ( !_mounted || !path.valid() )
         return type::NOTFOUND;
 
-    fs::file_status fs{fs::status(_path + filename)};
-    switch (fs.type())
+    // symbolic links are followed while they stay beneath the root, one that can't be is a SYMLINK
+    struct stat st;
+    int fd = PathHandle::openBeneath(_root, path.str(), O_PATH);
+    if ( fd < 0 )
     {
-        case fs::file_type::fifo:
-            return type::PIPE;
-            break;
-        case fs::file_type::unknown:
-            return type::UNKOWN;
-            break;
-        case fs::file_type::socket:
-            return type::SOCKET;
-            break;
-        case fs::file_type::symlink:
-            return type::SYMLINK;
-            break;
-        case fs::file_type::directory:
-            return type::DIRECTORY;
-            break;
-        case fs::file_type::regular:
-            return type::REGULAR;
-            break;
-        case fs::file_type::block:
-            return type::BLOCK;
-            break;
-        case fs::file_type::not_found:
+        if ( errno == ENOENT || errno == ENOTDIR )
             return type::NOTFOUND;
-            break;
-        case fs::file_type::none:
+        if ( errno != EXDEV && errno != ELOOP )
+            return type::NONE;
+
+        ParentDir parent(_root, path.str());
+        if ( parent.fd < 0 || ::fstatat(parent.fd, parent.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 )
             return type::NONE;
-            break;
-        default:
-            return type::IMPLDEFINE;
-            break;
     }
+    else
+    {
+        int stated = ::fstat(fd, &st);
+        ::close(fd);
+        if ( stated != 0 )
+            return type::NONE;
+    }
+
+    if ( S_ISFIFO(st.st_mode) )
+        return type::PIPE;
+    if ( S_ISSOCK(st.st_mode) )
+        return type::SOCKET;
+    if ( S_ISLNK(st.st_mode) )
+        return type::SYMLINK;
+    if ( S_ISDIR(st.st_mode) )
+        return type::DIRECTORY;
+    if ( S_ISREG(st.st_mode) )
+        return type::REGULAR;
+    if ( S_ISBLK(st.st_mode) )
+        return type::BLOCK;
+
+    return type::IMPLDEFINE;
 }
 
-bool FileSystem::validFilename(std::string const & filename)
+void FileSystem::setBlockCache(std::shared_ptr<BlockCache> cache)
 {
-    auto it = filename.begin();
-    std::uint8_t prefix_with_double_dot = 0;
-    auto fn = [&prefix_with_double_dot] (char ch)
-    {
-        if ( ch == '.' ) ++prefix_with_double_dot;
-    };
-    std::for_each(it, it + 2, fn);
-    if ( *filename.begin() == '/' || prefix_with_double_dot == 2  )
+    UniqueGuard lock(_timedLocks, Metrics::Op::CONFIGURE, _mutex);
+    _cache = std::move(cache);
+}
+
+std::shared_ptr<BlockCache> FileSystem::blockCache()
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::CONFIGURE, _mutex);
+    return _cache;
+}
+
+void FileSystem::setWriteBehind(std::size_t limit, std::chrono::milliseconds delay)
+{
+    UniqueGuard lock(_timedLocks, Metrics::Op::CONFIGURE, _mutex);
+    _behindLimit = limit;
+    _behindDelay = delay;
+}
+
+bool FileSystem::setCompression(std::shared_ptr<Codec> codec, std::string const & dir)
+{
+    auto path = PathHandle::intern(dir);
+    if ( !path.valid() )
         return false;
 
+    UniqueGuard lock(_timedLocks, Metrics::Op::CONFIGURE, _mutex);
+    if ( codec == nullptr && path.str() == "." )
+        _codecs.erase(path.str());
+    else
+        _codecs[path.str()] = std::move(codec);
+
     return true;
 }
 
+void FileSystem::setWalkThreads(std::size_t threads)
+{
+    std::atomic_store(&_walker, std::make_shared<TreeWalker>(threads));
+}
+
+void FileSystem::setHandleBudget(std::size_t budget)
+{
+    _handles.setBudget(budget);
+}
+
+HandleTable::Stats FileSystem::handleStats() const
+{
+    return _handles.stats();
+}
+
+void FileSystem::setLockStats(bool enabled)
+{
+    UniqueGuard lock(_timedLocks, Metrics::Op::CONFIGURE, _mutex);
+    if ( enabled && _lockStats == nullptr )
+        _lockStats = std::make_shared<LockStats>();
+    _timedLocks = enabled ? _lockStats.get() : nullptr;
+}
+
+std::shared_ptr<LockStats> FileSystem::lockStats()
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::CONFIGURE, _mutex);
+    return _lockStats;
+}
+
+bool FileSystem::moveAcross(int dir, std::string const & name, std::string const & from, IFS & target, std::string const & to, FileSystem * disk)
+{
+    struct stat st;
+    if ( ::fstatat(dir, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 )
+        return false;
+
+    if ( S_ISDIR(st.st_mode) )
+    {
+        if ( !target.makeDir(to) )
+            return false;
+
+        int fd = ::openat(dir, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        DIR * entries = fd >= 0 ? ::fdopendir(fd) : nullptr;
+        if ( entries == nullptr )
+        {
+            if ( fd >= 0 )
+                ::close(fd);
+            return false;
+        }
+
+        // the names are read before the entries go
+        std::vector<std::string> names;
+        while ( auto entry = ::readdir(entries) )
+        {
+            std::string child = entry->d_name;
+            if ( child != "." && child != ".." )
+                names.push_back(std::move(child));
+        }
+        bool moved = true;
+        for ( std::size_t i = 0; i < names.size() && moved; ++i )
+            moved = moveAcross(::dirfd(entries), names[i], from + "/" + names[i], target, to + "/" + names[i], disk);
+        ::closedir(entries);
+        if ( !moved )
+            return false;
+    }
+    else if ( S_ISREG(st.st_mode) )
+    {
+        if ( !target.touchFile(to) )
+            return false;
+        auto out = target.open(to, Perms::RW);
+        auto in = openContent(from, st.st_dev, st.st_ino);
+        if ( out == nullptr || in == nullptr || !CopyEngine::stream(*in, *out).ok )
+        {
+            // the source is left as it was
+            out = nullptr;
+            target.remove(to);
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    // the mtime of a directory is set last, moving its entries changed it
+    if ( disk != nullptr )
+        disk->settle(to, st);
+
+    if ( S_ISREG(st.st_mode) )
+        forget(st.st_dev, st.st_ino);
+
+    return ::unlinkat(dir, name.c_str(), S_ISDIR(st.st_mode) ? AT_REMOVEDIR : 0) == 0;
+}
+
+void FileSystem::settle(std::string const & name, struct stat const & st)
+{
+    SharedGuard lock(_timedLocks, Metrics::Op::MOVE_TO, _mutex);
+    ParentDir parent(_root, name);
+    if ( !_mounted || parent.fd < 0 )
+        return;
+
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    ::fchmodat(parent.fd, parent.name.c_str(), st.st_mode & 07777, 0);
+    ::utimensat(parent.fd, parent.name.c_str(), times, AT_SYMLINK_NOFOLLOW);
+
+    // the new entry itself must be durable before the old one goes
+    auto slash = name.rfind('/');
+    int fd = PathHandle::openBeneath(_root, slash == std::string::npos ? std::string(".") : name.substr(0, slash), O_RDONLY | O_DIRECTORY);
+    if ( fd >= 0 )
+    {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+std::shared_ptr<Codec> FileSystem::codecFor(std::string const & name) const
+{
+    if ( _codecs.empty() )
+        return nullptr;
+
+    auto dir = name;
+    while ( true )
+    {
+        auto it = _codecs.find(dir);
+        if ( it != _codecs.end() )
+            return it->second;
+        if ( dir == "." )
+            return nullptr;
+
+        auto slash = dir.rfind('/');
+        dir = slash == std::string::npos ? std::string(".") : dir.substr(0, slash);
+    }
+}
+
+void FileSystem::forget(dev_t device, ino_t inode)
+{
+    std::uint64_t dev = device;
+    std::uint64_t ino = inode;
+    if ( _cache != nullptr )
+        _cache->invalidate({ dev, ino });
+
+    std::lock_guard<std::mutex> lk(_storesMutex);
+    _stores.erase({ dev, ino });
+}
+
+IFS::IFilePtr FileSystem::openContent(std::string const & name, dev_t device, ino_t inode)
+{
+    auto handle = _handles.acquire(_root, name);
+    if ( handle == nullptr )
+        return nullptr;
+
+    // an open file may hold blocks that aren't stored yet
+    auto file = std::make_shared<RegularFile>(_path + name, std::move(handle));
+    auto store = storeOf(device, inode);
+    if ( store == nullptr && CompressedFile::stored(*file) )
+        store = CompressedFile::load(file, Codec::passthrough());
+
+    return store != nullptr ? IFilePtr( new CompressedFile(store) ) : file;
+}
+
+std::shared_ptr<CompressedFile::Store> FileSystem::storeOf(std::uint64_t device, std::uint64_t inode)
+{
+    std::lock_guard<std::mutex> lk(_storesMutex);
+    auto it = _stores.find({ device, inode });
+
+    return it != _stores.end() ? it->second.lock() : nullptr;
+}
+
 bool FileSystem::hasPermision(Perms perm)
 {
     if ( perm == Perms::RW )
         return true;
 
-    using std::filesystem::perms;
-
-    auto const & allPerms = fs::status(_path).permissions();
-    perms per = ( perm == Perms::READ ? perms::owner_read : perms::owner_write );
+    struct stat st;
+    if ( ::fstat(_root, &st) != 0 )
+        return false;
 
-    return perms::none != ( perms::owner_read & per ) && perms::none != ( perms::owner_write & per );
+    return ( st.st_mode & ( perm == Perms::READ ? S_IRUSR : S_IWUSR ) ) != 0;
 }
 
 }
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include "vfs/GroupCommit.h"
+#include "vfs/IoEngine.h"
+
+namespace VFS {
+
+GroupCommit::GroupCommit()
+    : _pending()
+      , _timers()
+      , _ids()
+      , _nextId(1)
+      , _running(0)
+      , _stats{ 0, 0, 0 }
+      , _stopping(false)
+      , _mutex()
+      , _wake()
+      , _done()
+      , _committer()
+{
+    _committer = std::thread(&GroupCommit::run, this);
+}
+
+GroupCommit::~GroupCommit()
+{
+    {
+        std::lock_guard<std::mutex> lk(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    _committer.join();
+}
+
+std::shared_ptr<GroupCommit> GroupCommit::global()
+{
+    static std::shared_ptr<GroupCommit> committer = std::make_shared<GroupCommit>();
+    return committer;
+}
+
+long GroupCommit::sync(int fd, bool dataOnly)
+{
+    Request request{ fd, dataOnly, 0, false };
+    std::unique_lock<std::mutex> lk(_mutex);
+    _pending.push_back(&request);
+    ++_stats.requests;
+    _wake.notify_one();
+    _done.wait(lk, [&request] () { return request.done; });
+
+    return request.result;
+}
+
+std::uint64_t GroupCommit::schedule(Clock::time_point when, Task task)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    auto id = _nextId++;
+    _ids.emplace(id, _timers.emplace(when, std::make_pair(id, std::move(task))));
+    _wake.notify_one();
+
+    return id;
+}
+
+void GroupCommit::cancel(std::uint64_t id)
+{
+    std::unique_lock<std::mutex> lk(_mutex);
+    auto it = _ids.find(id);
+    if ( it != _ids.end() )
+    {
+        _timers.erase(it->second);
+        _ids.erase(it);
+    }
+    _done.wait(lk, [this, id] () { return _running != id; });
+}
+
+GroupCommit::Stats GroupCommit::stats() const
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    return _stats;
+}
+
+void GroupCommit::run()
+{
+    std::unique_lock<std::mutex> lk(_mutex);
+    while ( true )
+    {
+        bool due = !_timers.empty() && _timers.begin()->first <= Clock::now();
+        if ( !_stopping && _pending.empty() && !due )
+        {
+            // woken by every request and new timer, the earliest deadline is looked up again each time
+            if ( _timers.empty() )
+            {
+                _wake.wait(lk);
+            }
+            else
+            {
+                auto deadline = _timers.begin()->first;
+                _wake.wait_until(lk, deadline);
+            }
+            continue;
+        }
+
+        if ( !_pending.empty() )
+        {
+            // whoever asks from now on waits for the next commit
+            std::vector<Request *> batch;
+            batch.swap(_pending);
+            lk.unlock();
+            commit(batch);
+            lk.lock();
+
+            ++_stats.commits;
+            for ( auto request : batch )
+                request->done = true;
+            _done.notify_all();
+        }
+
+        while ( !_timers.empty() && _timers.begin()->first <= Clock::now() )
+        {
+            auto task = std::move(_timers.begin()->second);
+            _ids.erase(task.first);
+            _timers.erase(_timers.begin());
+
+            _running = task.first;
+            lk.unlock();
+            task.second();
+            lk.lock();
+            _running = 0;
+            _done.notify_all();
+        }
+
+        if ( _stopping && _pending.empty() )
+            return;
+    }
+}
+
+void GroupCommit::commit(std::vector<Request *> & batch)
+{
+    // one sync per descriptor, the full one if any request needs it
+    std::vector<std::pair<int, bool>> fds;   // fd, dataOnly
+    for ( auto request : batch )
+    {
+        auto it = std::find_if(fds.begin(), fds.end(), [request] (std::pair<int, bool> const & fd) { return fd.first == request->fd; });
+        if ( it == fds.end() )
+            fds.emplace_back(request->fd, request->dataOnly);
+        else
+            it->second = it->second && request->dataOnly;
+    }
+
+    // the syncs of all descriptors are in flight together
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::size_t left = fds.size();
+    std::vector<long> results(fds.size(), 0);
+    auto engine = IoEngine::global();
+    for ( std::size_t i = 0; i < fds.size(); ++i )
+    {
+        engine->fsync(fds[i].first, fds[i].second, [&, i] (long result)
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            results[i] = result;
+            if ( --left == 0 )
+                finished.notify_one();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lk(mutex);
+        finished.wait(lk, [&left] () { return left == 0; });
+    }
+
+    for ( auto request : batch )
+    {
+        auto it = std::find_if(fds.begin(), fds.end(), [request] (std::pair<int, bool> const & fd) { return fd.first == request->fd; });
+        request->result = results[it - fds.begin()];
+    }
+
+    std::lock_guard<std::mutex> lk(_mutex);
+    _stats.syncs += fds.size();
+}
+
+}
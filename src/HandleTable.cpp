@@ -0,0 +1,171 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include "vfs/HandleTable.h"
+#include "vfs/PathHandle.h"
+
+namespace VFS {
+
+HandleTable::Handle::Handle(int fd, BlockCache::FileId id, unsigned mode)
+    : _fd(fd)
+      , _id(id)
+      , _mode(mode)
+      , _compressed(-1)
+{
+}
+
+HandleTable::Handle::~Handle()
+{
+    if ( _fd >= 0 )
+        ::close(_fd);
+}
+
+HandleTable::HandleTable(std::size_t budget)
+    : _entries()
+      , _lru()
+      , _budget(budget)
+      , _hits(0)
+      , _opens(0)
+      , _evictions(0)
+      , _mutex()
+{
+}
+
+HandleTable::~HandleTable() = default;
+
+HandleTable::HandlePtr HandleTable::acquire(std::string const & path)
+{
+    return acquire(AT_FDCWD, path);
+}
+
+HandleTable::HandlePtr HandleTable::acquire(int dir, std::string const & path)
+{
+    HandlePtr cached;
+    {
+        std::lock_guard<std::mutex> lk(_mutex);
+        auto it = _entries.find(path);
+        if ( it != _entries.end() )
+        {
+            cached = it->second.handle;
+            _lru.splice(_lru.begin(), _lru, it->second.position);
+        }
+    }
+
+    // the only system call of a hit, it also tells whether the file is still there
+    struct stat st;
+    if ( cached != nullptr && ::fstat(cached->fd(), &st) == 0 && st.st_nlink > 0 )
+    {
+        cached->_mode = st.st_mode;
+        std::lock_guard<std::mutex> lk(_mutex);
+        ++_hits;
+        return cached;
+    }
+
+    // opened without the table lock, opens of other paths go on meanwhile
+    auto open = [dir, &path] (int flags)
+    {
+        return dir == AT_FDCWD ? ::open(path.c_str(), flags | O_CLOEXEC) : PathHandle::openBeneath(dir, path, flags);
+    };
+    int fd = open(O_RDWR);
+    if ( fd < 0 && errno != EXDEV )
+        fd = open(O_RDONLY);
+    if ( fd >= 0 && ( ::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ) )
+    {
+        ::close(fd);
+        fd = -1;
+    }
+
+    std::lock_guard<std::mutex> lk(_mutex);
+    auto it = _entries.find(path);
+    if ( it != _entries.end() && it->second.handle == cached )
+        erase(it);  // stale
+    else if ( it != _entries.end() && fd >= 0 )
+    {
+        // another open of the same path won the race, share its handle
+        ::close(fd);
+        ++_hits;
+        _lru.splice(_lru.begin(), _lru, it->second.position);
+        return it->second.handle;
+    }
+
+    if ( fd < 0 )
+        return nullptr;
+
+    ++_opens;
+    auto handle = std::make_shared<Handle>(fd, BlockCache::FileId{ static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino) }, st.st_mode);
+    if ( _budget == 0 )
+        return handle;
+
+    _lru.push_front(path);
+    _entries.emplace(path, Entry{ handle, _lru.begin() });
+    evict();
+
+    return handle;
+}
+
+void HandleTable::invalidate(std::string const & path)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    auto dir = !path.empty() && path.back() == '/' ? path : path + '/';
+    for ( auto it = _entries.begin(); it != _entries.end(); )
+    {
+        auto const & key = it->first;
+        if ( key == path || key.compare(0, dir.size(), dir) == 0 )
+            erase(it++);
+        else
+            ++it;
+    }
+}
+
+void HandleTable::clear()
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    _entries.clear();
+    _lru.clear();
+}
+
+void HandleTable::setBudget(std::size_t budget)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    _budget = budget;
+    evict();
+}
+
+std::size_t HandleTable::size() const
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    return _entries.size();
+}
+
+HandleTable::Stats HandleTable::stats() const
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    return { _hits, _opens, _evictions };
+}
+
+void HandleTable::evict()
+{
+    // handles still in use stay, the budget is exceeded until they are released
+    auto it = _lru.end();
+    while ( _entries.size() > _budget && it != _lru.begin() )
+    {
+        --it;
+        auto entry = _entries.find(*it);
+        if ( entry->second.handle.use_count() > 1 )
+            continue;
+
+        auto next = std::next(it);
+        erase(entry);
+        ++_evictions;
+        it = next;
+    }
+}
+
+void HandleTable::erase(std::unordered_map<std::string, Entry>::iterator it)
+{
+    _lru.erase(it->second.position);
+    _entries.erase(it);
+}
+
+}
@@ -0,0 +1,112 @@
+#include "vfs/Histogram.h"
+
+namespace VFS {
+
+Histogram::Histogram()
+    : _buckets()
+      , _count(0)
+      , _sum(0)
+{
+}
+
+void Histogram::record(std::uint64_t value)
+{
+    add(bucketOf(value), 1);
+}
+
+void Histogram::add(std::size_t bucket, std::uint64_t count)
+{
+    if ( count == 0 || bucket >= BUCKETS )
+        return;
+
+    _buckets[bucket] += count;
+    _count += count;
+    _sum += ( static_cast<double>(lowerBound(bucket)) + static_cast<double>(upperBound(bucket)) ) / 2 * count;
+}
+
+void Histogram::merge(Histogram const & other)
+{
+    for ( std::size_t i = 0; i < BUCKETS; ++i )
+        _buckets[i] += other._buckets[i];
+    _count += other._count;
+    _sum += other._sum;
+}
+
+std::uint64_t Histogram::min() const
+{
+    for ( std::size_t i = 0; i < BUCKETS; ++i )
+        if ( _buckets[i] != 0 )
+            return lowerBound(i);
+
+    return 0;
+}
+
+std::uint64_t Histogram::max() const
+{
+    for ( std::size_t i = BUCKETS; i > 0; --i )
+        if ( _buckets[i - 1] != 0 )
+            return upperBound(i - 1);
+
+    return 0;
+}
+
+double Histogram::mean() const
+{
+    return _count != 0 ? _sum / _count : 0;
+}
+
+std::uint64_t Histogram::percentile(double percentile) const
+{
+    if ( _count == 0 )
+        return 0;
+
+    // the rank of the value asked for, counted from 1
+    auto rank = static_cast<std::uint64_t>(percentile / 100 * _count + 0.5);
+    if ( rank < 1 )
+        rank = 1;
+
+    std::uint64_t seen = 0;
+    for ( std::size_t i = 0; i < BUCKETS; ++i )
+    {
+        seen += _buckets[i];
+        if ( seen >= rank )
+            return upperBound(i);
+    }
+
+    return max();
+}
+
+std::size_t Histogram::bucketOf(std::uint64_t value)
+{
+    // below SUB_BUCKETS every value has a bucket of its own
+    if ( value < SUB_BUCKETS )
+        return static_cast<std::size_t>(value);
+
+    unsigned exponent = 63 - __builtin_clzll(value);
+    if ( exponent >= MAX_EXPONENT )
+        return BUCKETS - 1;
+
+    auto sub = ( value >> ( exponent - SUB_BITS ) ) & ( SUB_BUCKETS - 1 );
+    return ( exponent - SUB_BITS + 1 ) * SUB_BUCKETS + sub;
+}
+
+std::uint64_t Histogram::lowerBound(std::size_t bucket)
+{
+    if ( bucket < SUB_BUCKETS )
+        return bucket;
+
+    unsigned exponent = static_cast<unsigned>(bucket / SUB_BUCKETS) + SUB_BITS - 1;
+    auto sub = bucket % SUB_BUCKETS;
+    return ( std::uint64_t(1) << exponent ) + ( sub << ( exponent - SUB_BITS ) );
+}
+
+std::uint64_t Histogram::upperBound(std::size_t bucket)
+{
+    if ( bucket < SUB_BUCKETS )
+        return bucket;
+
+    unsigned exponent = static_cast<unsigned>(bucket / SUB_BUCKETS) + SUB_BITS - 1;
+    return lowerBound(bucket) + ( std::uint64_t(1) << ( exponent - SUB_BITS ) ) - 1;
+}
+
+}
@@ -0,0 +1,89 @@
+#include <memory>
+#include "vfs/IFile.h"
+#include "vfs/IoEngine.h"
+
+namespace VFS {
+
+namespace {
+
+// A completion that fulfills a promise, for the overloads that return a future.
+IFile::Completion fulfill(std::future<long> & future)
+{
+    auto promise = std::make_shared<std::promise<long>>();
+    future = promise->get_future();
+    return [promise] (long result) { promise->set_value(result); };
+}
+
+}
+
+std::size_t IFile::readBatch(std::vector<ReadRange> & ranges)
+{
+    std::size_t total = 0;
+    for ( auto & range : ranges )
+    {
+        range.read = read(range.dst, range.offset, range.size);
+        total += range.read;
+    }
+
+    return total;
+}
+
+std::size_t IFile::writeBatch(std::vector<WriteRange> & ranges)
+{
+    std::size_t total = 0;
+    for ( auto & range : ranges )
+    {
+        range.written = write(range.src, range.offset, range.size);
+        total += range.written;
+    }
+
+    return total;
+}
+
+void IFile::readAsync(DataT * dst, std::size_t offset, std::size_t size, Completion done)
+{
+    IoEngine::global()->submit([this, dst, offset, size] () { return static_cast<long>(read(dst, offset, size)); }, std::move(done));
+}
+
+void IFile::writeAsync(DataT const * src, std::size_t offset, std::size_t size, Completion done)
+{
+    IoEngine::global()->submit([this, src, offset, size] () { return static_cast<long>(write(src, offset, size)); }, std::move(done));
+}
+
+void IFile::fsyncAsync(Completion done)
+{
+    IoEngine::global()->submit([] () { return 0L; }, std::move(done));
+}
+
+std::future<long> IFile::readAsync(DataT * dst, std::size_t offset, std::size_t size)
+{
+    std::future<long> future;
+    readAsync(dst, offset, size, fulfill(future));
+    return future;
+}
+
+std::future<long> IFile::writeAsync(DataT const * src, std::size_t offset, std::size_t size)
+{
+    std::future<long> future;
+    writeAsync(src, offset, size, fulfill(future));
+    return future;
+}
+
+std::future<long> IFile::fsyncAsync()
+{
+    std::future<long> future;
+    fsyncAsync(fulfill(future));
+    return future;
+}
+
+long IFile::sync()
+{
+    return fsyncAsync().get();
+}
+
+long IFile::datasync()
+{
+    return sync();
+}
+
+}
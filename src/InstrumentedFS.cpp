@@ -0,0 +1,169 @@
+#include "vfs/InstrumentedFS.h"
+#include "vfs/InstrumentedFile.h"
+
+namespace VFS {
+
+namespace {
+
+std::string const NO_PATH;
+
+}
+
+InstrumentedFS::InstrumentedFS(IFSPtr fs, std::shared_ptr<Metrics> metrics, std::shared_ptr<Tracer> tracer)
+    : _fs(fs)
+      , _metrics(metrics != nullptr ? metrics : std::make_shared<Metrics>())
+      , _tracer(tracer)
+{
+}
+
+InstrumentedFS::~InstrumentedFS() = default;
+
+std::string InstrumentedFS::path() const
+{
+    return _fs->path();
+}
+
+bool InstrumentedFS::isMounted() const
+{
+    return _fs->isMounted();
+}
+
+bool InstrumentedFS::mount(std::string const & path)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::MOUNT, 0, path);
+    auto ok = _fs->mount(path);
+    call.done(0, !ok);
+
+    return ok;
+}
+
+bool InstrumentedFS::unmount()
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::UNMOUNT, 0, NO_PATH);
+    auto ok = _fs->unmount();
+    call.done(0, !ok);
+
+    return ok;
+}
+
+IFS::IFilePtr InstrumentedFS::open(std::string const & filename, Perms mode)
+{
+    // the handle names the file in the trace, failed opens get one too
+    auto handle = _tracer != nullptr ? _tracer->nextHandle() : 0;
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::OPEN, handle, filename, Tracer::CURSOR, mode);
+    auto file = _fs->open(filename, mode);
+    call.done(0, file == nullptr);
+
+    if ( file == nullptr )
+        return nullptr;
+
+    return std::make_shared<InstrumentedFile>(file, _metrics, _tracer, handle, filename);
+}
+
+bool InstrumentedFS::remove(std::string const & filename)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::REMOVE, 0, filename);
+    auto ok = _fs->remove(filename);
+    call.done(0, !ok);
+
+    return ok;
+}
+
+bool InstrumentedFS::touchFile(std::string const & filename)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::TOUCH_FILE, 0, filename);
+    auto ok = _fs->touchFile(filename);
+    call.done(0, !ok);
+
+    return ok;
+}
+
+bool InstrumentedFS::makeDir(std::string const & dir)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::MAKE_DIR, 0, dir);
+    auto ok = _fs->makeDir(dir);
+    call.done(0, !ok);
+
+    return ok;
+}
+
+bool InstrumentedFS::moveTo(std::string const & from, std::string const & to)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::MOVE_TO, 0, from, Tracer::CURSOR, 0, &to);
+    auto ok = _fs->moveTo(from, to);
+    call.done(0, !ok);
+
+    return ok;
+}
+
+bool InstrumentedFS::moveTo(std::string const & from, IFSPtr fsptr, std::string const & to)
+{
+    // the wrapped filesystem recognizes its own kind only without the decorator around it
+    while ( auto instrumented = std::dynamic_pointer_cast<InstrumentedFS>(fsptr) )
+        fsptr = instrumented->inner();
+
+    // the trace has no way to name another filesystem, it shows a move within this one
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::MOVE_TO, 0, from, Tracer::CURSOR, 0, &to);
+    auto ok = _fs->moveTo(from, fsptr, to);
+    call.done(0, !ok);
+
+    return ok;
+}
+
+IFS::EntryList InstrumentedFS::list()
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::LIST, 0, NO_PATH);
+    auto entries = _fs->list();
+    call.done();
+
+    return entries;
+}
+
+IFS::EntryList InstrumentedFS::list(std::string const & dir)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::LIST, 0, dir);
+    auto entries = _fs->list(dir);
+    call.done();
+
+    return entries;
+}
+
+bool InstrumentedFS::contain(std::string const & filename)
+{
+    // not finding the file is an answer, not a failure
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::CONTAIN, 0, filename);
+    auto found = _fs->contain(filename);
+    call.done();
+
+    return found;
+}
+
+std::string InstrumentedFS::search(std::string const & filename)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::SEARCH, 0, filename);
+    auto found = _fs->search(filename);
+    call.done(0, found == type::NOTFOUND);
+
+    return found;
+}
+
+bool InstrumentedFS::copy(std::string const & from, std::string const & to)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::COPY, 0, from, Tracer::CURSOR, 0, &to);
+    auto ok = _fs->copy(from, to);
+    call.done(0, !ok);
+
+    return ok;
+}
+
+type::FILETYPE InstrumentedFS::type(std::string const & filename)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::TYPE, 0, filename);
+    auto found = _fs->type(filename);
+    // type:: constants differ per translation unit, compare the text
+    call.done(0, std::string(found) == type::NOTFOUND);
+
+    return found;
+}
+
+}
@@ -0,0 +1,216 @@
+#include "vfs/InstrumentedFile.h"
+
+namespace VFS {
+
+InstrumentedFile::InstrumentedFile(std::shared_ptr<IFile> file, std::shared_ptr<Metrics> metrics, std::shared_ptr<Tracer> tracer,
+                                   std::uint64_t handle, std::string const & path)
+    : _file(file)
+      , _metrics(metrics)
+      , _tracer(tracer)
+      , _handle(handle)
+      , _path(path.empty() ? file->filename() : path)
+{
+}
+
+InstrumentedFile::~InstrumentedFile() = default;
+
+std::size_t InstrumentedFile::write(Buffer const & buf, std::size_t size)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::WRITE, _handle, _path, Tracer::CURSOR, size);
+    auto n = _file->write(buf, size);
+    call.done(n, n < size);
+
+    return n;
+}
+
+std::size_t InstrumentedFile::write(Buffer const & buf, std::size_t offset, std::size_t size)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::WRITE, _handle, _path, offset, size);
+    auto n = _file->write(buf, offset, size);
+    call.done(n, n < size);
+
+    return n;
+}
+
+IFile::Buffer InstrumentedFile::read(std::size_t size)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::READ, _handle, _path, Tracer::CURSOR, size);
+    auto buf = _file->read(size);
+    call.done(buf.size());
+
+    return buf;
+}
+
+IFile::Buffer InstrumentedFile::read(std::size_t offset, std::size_t size)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::READ, _handle, _path, offset, size);
+    auto buf = _file->read(offset, size);
+    call.done(buf.size());
+
+    return buf;
+}
+
+IFile::Buffer InstrumentedFile::readAll()
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::READ_ALL, _handle, _path);
+    auto buf = _file->readAll();
+    call.done(buf.size());
+
+    return buf;
+}
+
+std::size_t InstrumentedFile::read(DataT * dst, std::size_t offset, std::size_t size)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::READ, _handle, _path, offset, size);
+    auto n = _file->read(dst, offset, size);
+    call.done(n);
+
+    return n;
+}
+
+std::size_t InstrumentedFile::write(DataT const * src, std::size_t offset, std::size_t size)
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::WRITE, _handle, _path, offset, size);
+    auto n = _file->write(src, offset, size);
+    call.done(n, n < size);
+
+    return n;
+}
+
+std::size_t InstrumentedFile::readBatch(std::vector<ReadRange> & ranges)
+{
+    // traced as one range from the first offset over all the bytes
+    std::size_t size = 0;
+    for ( auto const & range : ranges )
+        size += range.size;
+
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::READ_BATCH, _handle, _path, ranges.empty() ? 0 : ranges.front().offset, size);
+    auto n = _file->readBatch(ranges);
+    call.done(n);
+
+    return n;
+}
+
+std::size_t InstrumentedFile::writeBatch(std::vector<WriteRange> & ranges)
+{
+    std::size_t size = 0;
+    for ( auto const & range : ranges )
+        size += range.size;
+
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::WRITE_BATCH, _handle, _path, ranges.empty() ? 0 : ranges.front().offset, size);
+    auto n = _file->writeBatch(ranges);
+    call.done(n, n < size);
+
+    return n;
+}
+
+void InstrumentedFile::readAsync(DataT * dst, std::size_t offset, std::size_t size, Completion done)
+{
+    _file->readAsync(dst, offset, size, timed(Metrics::Op::READ_ASYNC, offset, size, std::move(done)));
+}
+
+void InstrumentedFile::writeAsync(DataT const * src, std::size_t offset, std::size_t size, Completion done)
+{
+    _file->writeAsync(src, offset, size, timed(Metrics::Op::WRITE_ASYNC, offset, size, std::move(done)));
+}
+
+void InstrumentedFile::fsyncAsync(Completion done)
+{
+    _file->fsyncAsync(timed(Metrics::Op::FSYNC, Tracer::CURSOR, 0, std::move(done)));
+}
+
+long InstrumentedFile::sync()
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::SYNC, _handle, _path);
+    auto result = _file->sync();
+    call.done(0, result < 0);
+
+    return result;
+}
+
+long InstrumentedFile::datasync()
+{
+    // a size of 1 tells the trace it was datasync()
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::SYNC, _handle, _path, Tracer::CURSOR, 1);
+    auto result = _file->datasync();
+    call.done(0, result < 0);
+
+    return result;
+}
+
+void InstrumentedFile::close()
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::CLOSE, _handle, _path);
+    _file->close();
+    call.done();
+}
+
+FileInfo InstrumentedFile::info() const
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::INFO, _handle, _path);
+    auto info = _file->info();
+    call.done();
+
+    return info;
+}
+
+std::size_t InstrumentedFile::size() const
+{
+    Tracer::Call call(*_metrics, _tracer.get(), Metrics::Op::SIZE, _handle, _path);
+    auto size = _file->size();
+    call.done();
+
+    return size;
+}
+
+std::string InstrumentedFile::filename() const
+{
+    return _file->filename();
+}
+
+FileInfo::PermisionsT InstrumentedFile::permision() const
+{
+    return _file->permision();
+}
+
+void InstrumentedFile::setPermision(Perms perms)
+{
+    _file->setPermision(perms);
+}
+
+void InstrumentedFile::disableWrite()
+{
+    _file->disableWrite();
+}
+
+void InstrumentedFile::disableRead()
+{
+    _file->disableRead();
+}
+
+void InstrumentedFile::disableAll()
+{
+    _file->disableAll();
+}
+
+IFile::Completion InstrumentedFile::timed(Metrics::Op op, std::uint64_t offset, std::uint64_t size, Completion done) const
+{
+    // the Metrics and the Tracer may be left alone with the completion when the file goes away first
+    auto metrics = _metrics;
+    auto tracer = _tracer;
+    auto handle = _handle;
+    auto path = _path;
+    auto start = Metrics::Clock::now();
+    return [metrics, tracer, handle, path, op, offset, size, start, done] (long result)
+    {
+        auto end = Metrics::Clock::now();
+        std::uint64_t bytes = result > 0 ? result : 0;
+        metrics->record(op, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), bytes, result < 0);
+        if ( tracer != nullptr )
+            tracer->record(op, start, end, handle, path, std::string(), offset, size, bytes, result < 0);
+        if ( done )
+            done(result);
+    };
+}
+
+}
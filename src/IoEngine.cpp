@@ -0,0 +1,358 @@
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "vfs/IoEngine.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define VFS_HAS_IO_URING 1
+#else
+#define VFS_HAS_IO_URING 0
+#endif
+
+namespace VFS {
+
+IoEngine::IoEngine(unsigned entries, std::size_t threads, bool uring)
+    : _ring(-1)
+      , _entries(0)
+      , _sqRing(nullptr)
+      , _sqRingSize(0)
+      , _cqRing(nullptr)
+      , _cqRingSize(0)
+      , _sqes(nullptr)
+      , _sqesSize(0)
+      , _sqTail(nullptr)
+      , _sqMask(nullptr)
+      , _sqArray(nullptr)
+      , _cqHead(nullptr)
+      , _cqTail(nullptr)
+      , _cqMask(nullptr)
+      , _cqes(nullptr)
+      , _inflight(0)
+      , _ringMutex()
+      , _slots()
+      , _reaper()
+      , _tasks()
+      , _stopping(false)
+      , _poolMutex()
+      , _poolCv()
+      , _workers()
+{
+    if ( uring && setupRing(std::max(entries, 1u)) )
+        _reaper = std::thread(&IoEngine::reap, this);
+
+    for ( std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i )
+        _workers.emplace_back(&IoEngine::work, this);
+}
+
+IoEngine::~IoEngine()
+{
+    if ( _ring >= 0 )
+    {
+        {
+            std::unique_lock<std::mutex> lk(_ringMutex);
+            _slots.wait(lk, [this] () { return _inflight == 0; });
+        }
+
+        // a request without user data tells the reaper to stop
+        push(nullptr, false);
+        _reaper.join();
+        teardownRing();
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(_poolMutex);
+        _stopping = true;
+    }
+    _poolCv.notify_all();
+    for ( auto & worker : _workers )
+        worker.join();
+}
+
+std::shared_ptr<IoEngine> IoEngine::global()
+{
+    static std::shared_ptr<IoEngine> engine = std::make_shared<IoEngine>();
+    return engine;
+}
+
+void IoEngine::read(int fd, void * dst, std::size_t size, std::uint64_t offset, Callback done)
+{
+    start(new Request{ Op::READ, fd, static_cast<char *>(dst), size, offset, 0, false, std::move(done), {} });
+}
+
+void IoEngine::write(int fd, void const * src, std::size_t size, std::uint64_t offset, Callback done)
+{
+    // the ring only reads from the buffer, the request type is shared with reads
+    start(new Request{ Op::WRITE, fd, const_cast<char *>(static_cast<char const *>(src)), size, offset, 0, false, std::move(done), {} });
+}
+
+void IoEngine::fsync(int fd, bool dataOnly, Callback done)
+{
+    start(new Request{ Op::FSYNC, fd, nullptr, 0, 0, 0, dataOnly, std::move(done), {} });
+}
+
+void IoEngine::submit(std::function<long()> work, Callback done)
+{
+    {
+        std::lock_guard<std::mutex> lk(_poolMutex);
+        _tasks.emplace_back([work = std::move(work), done = std::move(done)] () { done(work()); });
+    }
+    _poolCv.notify_one();
+}
+
+void IoEngine::start(Request * request)
+{
+    if ( _ring < 0 || ( request->op != Op::FSYNC && request->size == 0 ) )
+    {
+        submit([request] () { return perform(*request); }, [request] (long result)
+        {
+            auto callback = std::move(request->callback);
+            delete request;
+            callback(result);
+        });
+        return;
+    }
+
+    auto error = push(request, true);
+    if ( error != 0 )
+        finish(request, error);
+}
+
+#if VFS_HAS_IO_URING
+
+bool IoEngine::setupRing(unsigned entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if ( fd < 0 )
+        return false;
+
+    _ring = fd;
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+    if ( single )
+        _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+
+    _sqRing = ::mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if ( _sqRing == MAP_FAILED )
+        _sqRing = nullptr;
+    _cqRing = single ? _sqRing : ::mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if ( _cqRing == MAP_FAILED )
+        _cqRing = nullptr;
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void * sqes = ::mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    _sqes = sqes != MAP_FAILED ? static_cast<io_uring_sqe *>(sqes) : nullptr;
+
+    if ( _sqRing == nullptr || _cqRing == nullptr || _sqes == nullptr )
+    {
+        teardownRing();
+        return false;
+    }
+
+    auto sq = static_cast<char *>(_sqRing);
+    auto cq = static_cast<char *>(_cqRing);
+    _sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    _sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    _sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    _cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    _cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    _entries = params.cq_entries;
+
+    return true;
+}
+
+void IoEngine::teardownRing()
+{
+    if ( _sqes != nullptr )
+        ::munmap(_sqes, _sqesSize);
+    if ( _cqRing != nullptr && _cqRing != _sqRing )
+        ::munmap(_cqRing, _cqRingSize);
+    if ( _sqRing != nullptr )
+        ::munmap(_sqRing, _sqRingSize);
+    _sqes = nullptr;
+    _cqRing = nullptr;
+    _sqRing = nullptr;
+
+    ::close(_ring);
+    _ring = -1;
+}
+
+long IoEngine::push(Request * request, bool fresh)
+{
+    std::unique_lock<std::mutex> lk(_ringMutex);
+    // a callback that submits from the reaper can't wait for a slot, only the reaper frees them
+    if ( fresh )
+    {
+        if ( std::this_thread::get_id() != _reaper.get_id() )
+            _slots.wait(lk, [this] () { return _inflight < _entries; });
+        ++_inflight;
+    }
+
+    // without SQPOLL the kernel consumes the entry during io_uring_enter, so the ring is never full here
+    unsigned tail = *_sqTail;
+    unsigned index = tail & *_sqMask;
+    auto & sqe = _sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.user_data = reinterpret_cast<std::uint64_t>(request);
+    if ( request == nullptr )
+    {
+        sqe.opcode = IORING_OP_NOP;
+    }
+    else if ( request->op == Op::FSYNC )
+    {
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fd = request->fd;
+        sqe.fsync_flags = request->dataOnly ? IORING_FSYNC_DATASYNC : 0;
+    }
+    else
+    {
+        request->iov.iov_base = request->data + request->done;
+        request->iov.iov_len = request->size - request->done;
+        sqe.opcode = request->op == Op::READ ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe.fd = request->fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(&request->iov);
+        sqe.len = 1;
+        sqe.off = request->offset + request->done;
+    }
+    _sqArray[index] = index;
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    while ( true )
+    {
+        if ( ::syscall(__NR_io_uring_enter, _ring, 1, 0, 0, nullptr, 0) >= 0 )
+            return 0;
+        if ( errno == EINTR || errno == EAGAIN || errno == EBUSY )
+            continue;
+
+        // the entry wasn't consumed, take it back
+        long error = -errno;
+        __atomic_store_n(_sqTail, tail, __ATOMIC_RELEASE);
+        return error;
+    }
+}
+
+void IoEngine::reap()
+{
+    while ( true )
+    {
+        if ( ::syscall(__NR_io_uring_enter, _ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR )
+            std::this_thread::yield();
+
+        unsigned head = *_cqHead;
+        unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        bool stop = false;
+        while ( head != tail )
+        {
+            auto const & cqe = _cqes[head & *_cqMask];
+            auto request = reinterpret_cast<Request *>(cqe.user_data);
+            long result = cqe.res;
+            __atomic_store_n(_cqHead, ++head, __ATOMIC_RELEASE);
+
+            if ( request == nullptr )
+                stop = true;
+            else
+                finish(request, result);
+        }
+
+        if ( stop )
+            return;
+    }
+}
+
+#else
+
+bool IoEngine::setupRing(unsigned)
+{
+    return false;
+}
+
+void IoEngine::teardownRing()
+{
+}
+
+long IoEngine::push(Request *, bool)
+{
+    return -ENOSYS;
+}
+
+void IoEngine::reap()
+{
+}
+
+#endif
+
+void IoEngine::finish(Request * request, long result)
+{
+    // pairs with the unlock in push(), the ordering the ring gives is invisible to race detectors
+    std::unique_lock<std::mutex> lk(_ringMutex);
+    if ( result > 0 && request->op != Op::FSYNC )
+    {
+        request->done += result;
+        if ( request->done < request->size )
+        {
+            lk.unlock();
+            if ( push(request, false) == 0 )
+                return;
+            lk.lock();
+        }
+    }
+
+    if ( request->op != Op::FSYNC && ( result >= 0 || request->done != 0 ) )
+        result = static_cast<long>(request->done);
+
+    auto callback = std::move(request->callback);
+    delete request;
+    --_inflight;
+    lk.unlock();
+    _slots.notify_all();
+
+    callback(result);
+}
+
+long IoEngine::perform(Request & request)
+{
+    if ( request.op == Op::FSYNC )
+        return ( request.dataOnly ? ::fdatasync(request.fd) : ::fsync(request.fd) ) == 0 ? 0 : -errno;
+
+    while ( request.done < request.size )
+    {
+        auto n = request.op == Op::READ
+            ? ::pread(request.fd, request.data + request.done, request.size - request.done, request.offset + request.done)
+            : ::pwrite(request.fd, request.data + request.done, request.size - request.done, request.offset + request.done);
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n < 0 )
+            return request.done != 0 ? static_cast<long>(request.done) : -errno;
+        if ( n == 0 )
+            break;
+        request.done += n;
+    }
+
+    return static_cast<long>(request.done);
+}
+
+void IoEngine::work()
+{
+    while ( true )
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lk(_poolMutex);
+            _poolCv.wait(lk, [this] () { return _stopping || !_tasks.empty(); });
+            if ( _tasks.empty() )
+                return;
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        task();
+    }
+}
+
+}
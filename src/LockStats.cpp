@@ -0,0 +1,104 @@
+#include <algorithm>
+#include "vfs/LockStats.h"
+
+namespace VFS {
+
+LockStats::LockStats()
+    : _shards(newShard(), fold)
+{
+}
+
+LockStats::~LockStats() = default;
+
+void LockStats::recordWait(Metrics::Op op, std::uint64_t nanos, bool contended)
+{
+    auto & counters = _shards.local(newShard).ops[static_cast<std::size_t>(op)];
+    bumpOwned(counters.acquisitions, 1);
+    if ( contended )
+        bumpOwned(counters.contended, 1);
+    bumpOwned(counters.wait[bucketOf(nanos)], 1);
+}
+
+void LockStats::recordHold(Metrics::Op op, std::uint64_t nanos)
+{
+    bumpOwned(_shards.local(newShard).ops[static_cast<std::size_t>(op)].hold[bucketOf(nanos)], 1);
+}
+
+std::vector<LockStats::OpStats> LockStats::snapshot() const
+{
+    std::vector<OpStats> stats;
+    for ( std::size_t i = 0; i < static_cast<std::size_t>(Metrics::Op::COUNT); ++i )
+        stats.push_back(OpStats{ static_cast<Metrics::Op>(i), 0, 0, Histogram(), Histogram() });
+
+    _shards.forEach([&stats] (Shard const & shard)
+    {
+        for ( auto & op : stats )
+        {
+            auto const & counters = shard.ops[static_cast<std::size_t>(op.op)];
+            op.acquisitions += counters.acquisitions.load(std::memory_order_relaxed);
+            op.contended += counters.contended.load(std::memory_order_relaxed);
+            for ( std::size_t b = 0; b < BUCKETS; ++b )
+            {
+                // the largest time of the power of two
+                auto bucket = Histogram::bucketOf(( std::uint64_t(2) << b ) - 1);
+                op.wait.add(bucket, counters.wait[b].load(std::memory_order_relaxed));
+                op.hold.add(bucket, counters.hold[b].load(std::memory_order_relaxed));
+            }
+        }
+    });
+
+    // a lock still held has a wait without a hold
+    stats.erase(std::remove_if(stats.begin(), stats.end(), [] (OpStats const & op) { return op.acquisitions == 0; }),
+                stats.end());
+
+    return stats;
+}
+
+void LockStats::reset()
+{
+    _shards.forEach(clear);
+}
+
+std::size_t LockStats::bucketOf(std::uint64_t nanos)
+{
+    return nanos < 2 ? 0 : std::min<std::size_t>(63 - __builtin_clzll(nanos), BUCKETS - 1);
+}
+
+std::unique_ptr<LockStats::Shard> LockStats::newShard()
+{
+    std::unique_ptr<Shard> shard(new Shard());
+    clear(*shard);
+
+    return shard;
+}
+
+void LockStats::clear(Shard & shard)
+{
+    for ( auto & counters : shard.ops )
+    {
+        counters.acquisitions = 0;
+        counters.contended = 0;
+        for ( auto & bucket : counters.wait )
+            bucket = 0;
+        for ( auto & bucket : counters.hold )
+            bucket = 0;
+    }
+}
+
+void LockStats::fold(Shard & into, Shard const & from)
+{
+    for ( std::size_t i = 0; i < into.ops.size(); ++i )
+    {
+        auto & counters = into.ops[i];
+        auto const & added = from.ops[i];
+        bumpOwned(counters.acquisitions, added.acquisitions.load(std::memory_order_relaxed));
+        bumpOwned(counters.contended, added.contended.load(std::memory_order_relaxed));
+        for ( std::size_t b = 0; b < BUCKETS; ++b )
+        {
+            bumpOwned(counters.wait[b], added.wait[b].load(std::memory_order_relaxed));
+            bumpOwned(counters.hold[b], added.hold[b].load(std::memory_order_relaxed));
+        }
+    }
+}
+
+}
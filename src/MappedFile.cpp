@@ -0,0 +1,326 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include "vfs/MappedFile.h"
+#include "vfs/IoEngine.h"
+#include "vfs/IFS.h"
+
+namespace VFS {
+
+namespace {
+
+// Mappings grow at least geometrically so that a file extended in small steps is remapped O(log n) times.
+std::size_t mappingCapacity(std::size_t size, std::size_t current)
+{
+    static std::size_t const page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto capacity = std::max(size, current * 2);
+    return ( capacity + page - 1 ) / page * page;
+}
+
+int adviceFlag(MappedFile::Access access)
+{
+    switch (access)
+    {
+        case MappedFile::Access::SEQUENTIAL:
+            return MADV_SEQUENTIAL;
+        case MappedFile::Access::RANDOM:
+            return MADV_RANDOM;
+        case MappedFile::Access::WILLNEED:
+            return MADV_WILLNEED;
+        default:
+            return MADV_NORMAL;
+    }
+}
+
+}
+
+MappedFile::MappedFile(std::string const & filename, bool writable)
+    : _filename(filename)
+      , _handle()
+      , _fd(::open(_filename.c_str(), ( writable ? O_RDWR : O_RDONLY ) | O_CLOEXEC))
+      , _access(_fd >= 0)
+      , _readable(true)
+      , _writable(writable)
+      , _advice(Access::NORMAL)
+      , _base(nullptr)
+      , _mapped(0)
+      , _capacity(0)
+      , _retired()
+      , _readPos(0)
+      , _mutex()
+      , _cursorMutex()
+{
+    ensureMapped(1);
+}
+
+MappedFile::MappedFile(std::string const & filename, HandleTable::HandlePtr handle)
+    : _filename(filename)
+      , _handle(std::move(handle))
+      , _fd(_handle != nullptr ? _handle->fd() : -1)
+      , _access(_fd >= 0)
+      , _readable(true)
+      , _writable(false)
+      , _advice(Access::NORMAL)
+      , _base(nullptr)
+      , _mapped(0)
+      , _capacity(0)
+      , _retired()
+      , _readPos(0)
+      , _mutex()
+      , _cursorMutex()
+{
+    ensureMapped(1);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+std::size_t MappedFile::write(Buffer const & buf, std::size_t size)
+{
+    if ( !canWrite() )
+        return 0;
+
+    // appends are serialized so that each one lands after the previous
+    std::lock_guard<std::mutex> lk(_cursorMutex);
+    return write(buf.data(), this->size(), std::min(size, buf.size()));
+}
+
+std::size_t MappedFile::write(Buffer const & buf, std::size_t offset, std::size_t size)
+{
+    return write(buf.data(), offset, std::min(size, buf.size()));
+}
+
+std::size_t MappedFile::write(DataT const * src, std::size_t offset, std::size_t size)
+{
+    if ( !canWrite() )
+        return 0;
+
+    // the mapping is shared, so it sees the new bytes through the page cache; growth is picked up on next read
+    std::shared_lock<std::shared_mutex> lk(_mutex);
+    std::size_t done = 0;
+    while ( _fd >= 0 && done < size )
+    {
+        auto n = ::pwrite(_fd, src + done, size - done, offset + done);
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            break;
+        done += n;
+    }
+
+    return done;
+}
+
+MappedFile::Buffer MappedFile::read(std::size_t size)
+{
+    if ( !canRead() )
+        return {};
+
+    std::lock_guard<std::mutex> lk(_cursorMutex);
+    auto v = view(_readPos, size);
+    _readPos += v.size();
+
+    return Buffer(v.begin(), v.end());
+}
+
+MappedFile::Buffer MappedFile::readAll()
+{
+    auto v = view(0, size());
+    return Buffer(v.begin(), v.end());
+}
+
+MappedFile::Buffer MappedFile::read(std::size_t offset, std::size_t size)
+{
+    auto v = view(offset, size);
+    return Buffer(v.begin(), v.end());
+}
+
+std::size_t MappedFile::read(DataT * dst, std::size_t offset, std::size_t size)
+{
+    if ( !canRead() )
+        return 0;
+
+    ensureMapped(offset + size);
+
+    std::shared_lock<std::shared_mutex> lk(_mutex);
+    if ( _base == nullptr || offset >= _mapped )
+        return 0;
+
+    auto n = std::min(size, _mapped - offset);
+    std::memcpy(dst, _base + offset, n);
+
+    return n;
+}
+
+std::string_view MappedFile::view(std::size_t offset, std::size_t size)
+{
+    if ( !canRead() )
+        return {};
+
+    ensureMapped(offset + size);
+
+    std::shared_lock<std::shared_mutex> lk(_mutex);
+    if ( _base == nullptr || offset >= _mapped )
+        return {};
+
+    return std::string_view(_base + offset, std::min(size, _mapped - offset));
+}
+
+void MappedFile::advise(Access access)
+{
+    std::unique_lock<std::shared_mutex> lk(_mutex);
+    _advice = access;
+    applyAdvice();
+}
+
+void MappedFile::fsyncAsync(Completion done)
+{
+    IoEngine::global()->submit([this] () -> long
+    {
+        std::shared_lock<std::shared_mutex> lk(_mutex);
+        if ( _fd < 0 )
+            return -EBADF;
+        return ::fsync(_fd) == 0 ? 0 : -errno;
+    }, std::move(done));
+}
+
+void MappedFile::close()
+{
+    std::unique_lock<std::shared_mutex> lk(_mutex);
+    if ( _fd < 0 )
+        return;
+
+    _access = false;
+    for ( auto const & mapping : _retired )
+        ::munmap(mapping.first, mapping.second);
+    _retired.clear();
+    if ( _base != nullptr )
+        ::munmap(_base, _capacity);
+    _base = nullptr;
+    _mapped = 0;
+    _capacity = 0;
+
+    if ( _handle == nullptr )
+        ::close(_fd);
+    _handle = nullptr;
+    _fd = -1;
+}
+
+FileInfo MappedFile::info() const
+{
+    using namespace std::chrono;
+
+    auto fileTime = fs::last_write_time(_filename);
+    auto sctp = time_point_cast<system_clock::duration>(fileTime - fs::file_time_type::clock::now() + system_clock::now());
+    auto cftime = system_clock::to_time_t(sctp);
+
+    return { type::REGULAR, permision(), size(), std::ctime(&cftime), _filename };
+}
+
+std::size_t MappedFile::size() const
+{
+    std::shared_lock<std::shared_mutex> lk(_mutex);
+    struct stat st;
+    if ( _fd >= 0 && ::fstat(_fd, &st) == 0 )
+        return st.st_size;
+
+    std::error_code ec;
+    auto size = fs::file_size(_filename, ec);
+    return ec ? 0 : size;
+}
+
+std::string MappedFile::filename() const
+{
+    return _filename;
+}
+
+FileInfo::PermisionsT MappedFile::permision() const
+{
+    return _writable ? FileInfo::RW : FileInfo::READ;
+}
+
+void MappedFile::setPermision(Perms perms)
+{
+    if ( perms == Perms::READ )
+        _readable = true;
+    else if ( perms == Perms::WRITE )
+        _writable = true;
+    else
+        _readable = _writable = true;
+}
+
+void MappedFile::disableWrite()
+{
+    _writable = false;
+}
+
+void MappedFile::disableRead()
+{
+    _readable = false;
+}
+
+void MappedFile::disableAll()
+{
+    _access = false;
+}
+
+void MappedFile::ensureMapped(std::size_t end)
+{
+    struct stat st;
+    {
+        std::shared_lock<std::shared_mutex> lk(_mutex);
+        if ( end <= _mapped || _fd < 0 )
+            return;
+        if ( ::fstat(_fd, &st) != 0 || static_cast<std::size_t>(st.st_size) <= _mapped )
+            return;
+    }
+
+    std::unique_lock<std::shared_mutex> lk(_mutex);
+    std::size_t size = st.st_size;
+    if ( _fd < 0 || size <= _mapped )
+        return;
+
+    // the file grew inside the current mapping, pages past the old end are valid now
+    if ( size <= _capacity )
+    {
+        _mapped = size;
+        return;
+    }
+
+    auto capacity = mappingCapacity(size, _capacity);
+    auto base = ::mmap(nullptr, capacity, PROT_READ, MAP_SHARED, _fd, 0);
+    if ( base == MAP_FAILED )
+        return;
+
+    if ( _base != nullptr )
+        _retired.emplace_back(_base, _capacity);
+    _base = static_cast<char *>(base);
+    _mapped = size;
+    _capacity = capacity;
+    applyAdvice();
+}
+
+void MappedFile::applyAdvice() const
+{
+    if ( _base != nullptr )
+        ::madvise(_base, _capacity, adviceFlag(_advice));
+}
+
+bool MappedFile::canRead() const
+{
+    return _access && _readable;
+}
+
+bool MappedFile::canWrite() const
+{
+    return _access && _writable;
+}
+
+}
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <ctime>
+#include "vfs/MemoryFile.h"
+#include "vfs/IFS.h"
+
+namespace VFS {
+
+MemoryFile::MemoryFile(MemoryNode::NodePtr node, std::string const & filename)
+    : _node(std::move(node))
+      , _filename(filename)
+      , _access(_node != nullptr)
+      , _readPos(0)
+      , _mutex()
+{
+}
+
+MemoryFile::~MemoryFile()
+{
+    close();
+}
+
+std::size_t MemoryFile::write(Buffer const & buf, std::size_t size)
+{
+    if ( !canWrite() )
+        return 0;
+
+    return _node->append(buf.data(), std::min(size, buf.size()));
+}
+
+std::size_t MemoryFile::write(Buffer const & buf, std::size_t offset, std::size_t size)
+{
+    return write(buf.data(), offset, std::min(size, buf.size()));
+}
+
+std::size_t MemoryFile::write(DataT const * src, std::size_t offset, std::size_t size)
+{
+    if ( !canWrite() )
+        return 0;
+
+    return _node->write(src, offset, size);
+}
+
+MemoryFile::Buffer MemoryFile::read(std::size_t size)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    if ( !_access || !_node->readable )
+        return {};
+
+    auto totalSize = _node->size();
+    if ( _readPos >= totalSize )
+        return {};
+
+    Buffer buf(std::min(size, totalSize - _readPos));
+    auto n = _node->read(buf.data(), _readPos, buf.size());
+    buf.resize(n);
+    _readPos += n;
+
+    return buf;
+}
+
+MemoryFile::Buffer MemoryFile::readAll()
+{
+    if ( !canRead() )
+        return {};
+
+    return read(0, _node->size());
+}
+
+MemoryFile::Buffer MemoryFile::read(std::size_t offset, std::size_t size)
+{
+    if ( !canRead() )
+        return {};
+
+    auto totalSize = _node->size();
+    if ( offset > totalSize )
+        return {};
+
+    Buffer buf(std::min(size, totalSize - offset));
+    buf.resize(_node->read(buf.data(), offset, buf.size()));
+
+    return buf;
+}
+
+std::size_t MemoryFile::read(DataT * dst, std::size_t offset, std::size_t size)
+{
+    if ( !canRead() )
+        return 0;
+
+    return _node->read(dst, offset, size);
+}
+
+void MemoryFile::close()
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    _access = false;
+}
+
+FileInfo MemoryFile::info() const
+{
+    auto cftime = std::chrono::system_clock::to_time_t(_node->modifiedTime());
+
+    return { type::REGULAR, permision(), size(), std::ctime(&cftime), _filename };
+}
+
+std::size_t MemoryFile::size() const
+{
+    return _node->size();
+}
+
+std::string MemoryFile::filename() const
+{
+    return _filename;
+}
+
+FileInfo::PermisionsT MemoryFile::permision() const
+{
+    bool read = _node->readable;
+    bool write = _node->writable;
+
+    if ( read && write )
+        return FileInfo::RW;
+    else if ( read )
+        return FileInfo::READ;
+    else
+        return FileInfo::WRITE;
+}
+
+void MemoryFile::setPermision(Perms perms)
+{
+    if ( perms == Perms::READ )
+        _node->readable = true;
+    else if ( perms == Perms::WRITE )
+        _node->writable = true;
+    else
+        _node->readable = _node->writable = true;
+
+    std::lock_guard<std::mutex> lk(_mutex);
+    _access = true;
+}
+
+void MemoryFile::disableWrite()
+{
+    _node->writable = false;
+}
+
+void MemoryFile::disableRead()
+{
+    _node->readable = false;
+}
+
+void MemoryFile::disableAll()
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    _access = false;
+}
+
+bool MemoryFile::canRead() const
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    return _access && _node->readable;
+}
+
+bool MemoryFile::canWrite() const
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    return _access && _node->writable;
+}
+
+}
@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <mutex>
+#include "vfs/MemoryFile.h"
+#include "vfs/MemoryFileSystem.h"
+
+namespace VFS {
+
+MemoryFileSystem::MemoryFileSystem(std::string const & path)
+    : _path(path)
+      , _mounted(false)
+      , _root(std::make_shared<MemoryNode>(MemoryNode::Kind::DIRECTORY))
+      , _mutex()
+{
+    if ( _path.empty() || *_path.rbegin() != '/' )
+        _path.push_back('/');
+
+    mount(_path);
+}
+
+MemoryFileSystem::~MemoryFileSystem() { unmount(); }
+
+std::string MemoryFileSystem::path() const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _path;
+}
+
+bool MemoryFileSystem::isMounted() const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _mounted;
+}
+
+bool MemoryFileSystem::mount(std::string const & path)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    if ( _mounted || path.empty() )
+        return false;
+
+    _path = path;
+    if ( *_path.rbegin() != '/' )
+        _path.push_back('/');
+    _mounted = true;
+
+    return _mounted;
+}
+
+bool MemoryFileSystem::unmount()
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    if ( !_mounted )
+        return false;
+
+    _mounted = false;
+    _path = "";
+
+    return true;
+}
+
+IFS::IFilePtr MemoryFileSystem::open(std::string const & filename, Perms mode)
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( !_mounted || !split(filename, parts) )
+        return nullptr;
+
+    auto node = lookup(parts);
+    if ( node == nullptr || node->isDirectory() )
+        return nullptr;
+
+    if ( ( mode == Perms::READ && !node->readable ) || ( mode == Perms::WRITE && !node->writable ) )
+        return nullptr;
+
+    return IFilePtr( new MemoryFile(node, filename) );
+}
+
+bool MemoryFileSystem::remove(std::string const & filename)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( !_mounted || !split(filename, parts) || parts.empty() )
+        return false;
+
+    auto parent = parentOf(parts);
+    if ( parent == nullptr )
+        return false;
+
+    auto it = parent->children.find(parts.back());
+    if ( it == parent->children.end() )
+        return false;
+    if ( it->second->isDirectory() && !it->second->children.empty() )
+        return false;
+
+    // handles that are still open keep the node alive
+    parent->children.erase(it);
+
+    return true;
+}
+
+bool MemoryFileSystem::touchFile(std::string const & filename)
+{
+    return create(filename, MemoryNode::Kind::REGULAR);
+}
+
+bool MemoryFileSystem::makeDir(std::string const & dir)
+{
+    return create(dir, MemoryNode::Kind::DIRECTORY);
+}
+
+bool MemoryFileSystem::moveTo(std::string const & from, std::string const & to)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components fromParts;
+    Components toParts;
+    if ( !_mounted || !split(from, fromParts) || !split(to, toParts) || fromParts.empty() || toParts.empty() )
+        return false;
+
+    // a directory can't be moved inside itself
+    if ( toParts.size() >= fromParts.size() && std::equal(fromParts.begin(), fromParts.end(), toParts.begin()) )
+        return false;
+
+    auto fromParent = parentOf(fromParts);
+    auto toParent = parentOf(toParts);
+    if ( fromParent == nullptr || toParent == nullptr )
+        return false;
+
+    auto it = fromParent->children.find(fromParts.back());
+    if ( it == fromParent->children.end() || toParent->children.count(toParts.back()) != 0 )
+        return false;
+
+    toParent->children.emplace(toParts.back(), it->second);
+    fromParent->children.erase(it);
+
+    return true;
+}
+
+bool MemoryFileSystem::moveTo(std::string const & from, IFSPtr fsptr, std::string const & to)
+{
+    if ( fsptr == nullptr || !fsptr->isMounted() )
+        return false;
+
+    if ( fsptr.get() == this )
+        return moveTo(from, to);
+
+    if ( auto other = std::dynamic_pointer_cast<MemoryFileSystem>(fsptr) )
+    {
+        // same kind of tree, hand the node over without copying any content
+        auto node = detach(from);
+        if ( node == nullptr )
+            return false;
+        if ( other->attach(to, node) )
+            return true;
+
+        attach(from, node);
+        return false;
+    }
+
+    MemoryNode::NodePtr node;
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        Components parts;
+        if ( !_mounted || !split(from, parts) || parts.empty() )
+            return false;
+        node = lookup(parts);
+    }
+
+    // the type constants of another translation unit are other pointers, compare the text
+    if ( node == nullptr || std::string(fsptr->type(to)) != type::NOTFOUND )
+        return false;
+
+    // a copy that failed part way is taken back, children before their directory
+    std::vector<std::string> created;
+    if ( !exportTo(node, fsptr, to, created) )
+    {
+        for ( auto it = created.rbegin(); it != created.rend(); ++it )
+            fsptr->remove(*it);
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    split(from, parts);
+    auto parent = parentOf(parts);
+    if ( parent != nullptr )
+    {
+        auto it = parent->children.find(parts.back());
+        if ( it != parent->children.end() && it->second == node )
+            parent->children.erase(it);
+    }
+
+    return true;
+}
+
+IFS::EntryList MemoryFileSystem::list()
+{
+    return list(".");
+}
+
+IFS::EntryList MemoryFileSystem::list(std::string const & dir)
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( !_mounted || !split(dir, parts) )
+        return {};
+
+    auto node = lookup(parts);
+    if ( node == nullptr || !node->isDirectory() )
+        return {};
+
+    std::string prefix;
+    for ( auto const & part : parts )
+        prefix += part + '/';
+
+    EntryList result;
+    walk(node, prefix, result);
+    for ( auto & entry : result )
+        entry.insert(0, _path);
+
+    return result;
+}
+
+bool MemoryFileSystem::contain(std::string const & filename)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        Components parts;
+        if ( !_mounted || !split(filename, parts) )
+            return false;
+        if ( lookup(parts) != nullptr )
+            return true;
+    }
+
+    return search(filename) != type::NOTFOUND;
+}
+
+std::string MemoryFileSystem::search(std::string const & filename)
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( !_mounted || !split(filename, parts) )
+        return type::NOTFOUND;
+
+    EntryList entries;
+    walk(_root, "./", entries);
+    auto it = std::find_if(entries.begin(), entries.end(), [&filename] (std::string const & item) -> bool
+    {
+        return item.find(filename) != std::string::npos;
+    });
+
+    return it != entries.end() ? *it : type::NOTFOUND;
+}
+
+bool MemoryFileSystem::copy(std::string const & from, std::string const & to)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components fromParts;
+    Components toParts;
+    if ( !_mounted || !split(from, fromParts) || !split(to, toParts) || toParts.empty() )
+        return false;
+
+    auto source = lookup(fromParts);
+    auto toParent = parentOf(toParts);
+    if ( source == nullptr || source->isDirectory() || toParent == nullptr )
+        return false;
+    if ( toParent->children.count(toParts.back()) != 0 )
+        return false;
+
+    auto node = std::make_shared<MemoryNode>(MemoryNode::Kind::REGULAR);
+    node->cloneContent(*source);
+    node->readable = source->readable.load();
+    node->writable = source->writable.load();
+    toParent->children.emplace(toParts.back(), node);
+
+    return true;
+}
+
+type::FILETYPE MemoryFileSystem::type(std::string const & filename)
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( !_mounted || !split(filename, parts) )
+        return type::NOTFOUND;
+
+    auto node = lookup(parts);
+    if ( node == nullptr )
+        return type::NOTFOUND;
+
+    return node->isDirectory() ? type::DIRECTORY : type::REGULAR;
+}
+
+bool MemoryFileSystem::split(std::string const & filename, Components & parts) const
+{
+    if ( filename.empty() || filename.front() == '/' )
+        return false;
+
+    std::size_t begin = 0;
+    while ( begin <= filename.size() )
+    {
+        auto end = filename.find('/', begin);
+        if ( end == std::string::npos )
+            end = filename.size();
+
+        auto part = filename.substr(begin, end - begin);
+        if ( part == ".." )
+            return false;
+        if ( !part.empty() && part != "." )
+            parts.emplace_back(std::move(part));
+
+        begin = end + 1;
+    }
+
+    return true;
+}
+
+MemoryNode::NodePtr MemoryFileSystem::lookup(Components const & parts) const
+{
+    auto node = _root;
+    for ( auto const & part : parts )
+    {
+        if ( !node->isDirectory() )
+            return nullptr;
+
+        auto it = node->children.find(part);
+        if ( it == node->children.end() )
+            return nullptr;
+        node = it->second;
+    }
+
+    return node;
+}
+
+MemoryNode::NodePtr MemoryFileSystem::parentOf(Components const & parts) const
+{
+    if ( parts.empty() )
+        return nullptr;
+
+    auto node = lookup(Components(parts.begin(), parts.end() - 1));
+    return node != nullptr && node->isDirectory() ? node : nullptr;
+}
+
+bool MemoryFileSystem::create(std::string const & filename, MemoryNode::Kind kind)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( !_mounted || !split(filename, parts) || parts.empty() )
+        return false;
+
+    auto parent = parentOf(parts);
+    if ( parent == nullptr )
+        return false;
+
+    return parent->children.emplace(parts.back(), std::make_shared<MemoryNode>(kind)).second;
+}
+
+MemoryNode::NodePtr MemoryFileSystem::detach(std::string const & filename)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( !_mounted || !split(filename, parts) || parts.empty() )
+        return nullptr;
+
+    auto parent = parentOf(parts);
+    if ( parent == nullptr )
+        return nullptr;
+
+    auto it = parent->children.find(parts.back());
+    if ( it == parent->children.end() )
+        return nullptr;
+
+    auto node = it->second;
+    parent->children.erase(it);
+
+    return node;
+}
+
+bool MemoryFileSystem::attach(std::string const & filename, MemoryNode::NodePtr node)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( !_mounted || !split(filename, parts) || parts.empty() )
+        return false;
+
+    auto parent = parentOf(parts);
+    if ( parent == nullptr )
+        return false;
+
+    return parent->children.emplace(parts.back(), std::move(node)).second;
+}
+
+bool MemoryFileSystem::exportTo(MemoryNode::NodePtr const & node, IFSPtr const & fsptr, std::string const & to, std::vector<std::string> & created) const
+{
+    if ( node->isDirectory() )
+    {
+        MemoryNode::Children children;
+        {
+            std::shared_lock<std::shared_mutex> lock(_mutex);
+            children = node->children;
+        }
+
+        if ( !fsptr->makeDir(to) )
+            return false;
+        created.push_back(to);
+        for ( auto const & child : children )
+        {
+            if ( !exportTo(child.second, fsptr, to + '/' + child.first, created) )
+                return false;
+        }
+
+        return true;
+    }
+
+    if ( !fsptr->touchFile(to) )
+        return false;
+    created.push_back(to);
+    auto file = fsptr->open(to, Perms::RW);
+    if ( file == nullptr )
+        return false;
+
+    IFile::Buffer buf(MemoryNode::CHUNK_SIZE);
+    std::size_t offset = 0;
+    while ( auto n = node->read(buf.data(), offset, buf.size()) )
+    {
+        if ( file->write(buf, n) != n )
+            return false;
+        offset += n;
+    }
+
+    return true;
+}
+
+void MemoryFileSystem::walk(MemoryNode::NodePtr const & dir, std::string const & prefix, EntryList & result) const
+{
+    for ( auto const & child : dir->children )
+    {
+        result.emplace_back(prefix + child.first);
+        if ( child.second->isDirectory() )
+            walk(child.second, prefix + child.first + '/', result);
+    }
+}
+
+}
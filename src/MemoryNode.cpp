@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include "vfs/MemoryNode.h"
+
+namespace VFS {
+
+MemoryNode::MemoryNode(Kind kind)
+    : children()
+      , readable(true)
+      , writable(true)
+      , _kind(kind)
+      , _chunks()
+      , _size(0)
+      , _mtime(std::chrono::system_clock::now())
+      , _mutex()
+{
+}
+
+std::size_t MemoryNode::read(IFile::DataT * dst, std::size_t offset, std::size_t size) const
+{
+    std::shared_lock<std::shared_mutex> lk(_mutex);
+    if ( offset >= _size )
+        return 0;
+
+    auto validSize = std::min(size, _size - offset);
+    std::size_t done = 0;
+    while ( done < validSize )
+    {
+        auto pos = offset + done;
+        auto index = pos / CHUNK_SIZE;
+        auto inChunk = pos % CHUNK_SIZE;
+        auto n = std::min(CHUNK_SIZE - inChunk, validSize - done);
+
+        if ( index < _chunks.size() && _chunks[index] )
+            std::memcpy(dst + done, _chunks[index].get() + inChunk, n);
+        else
+            std::memset(dst + done, 0, n);  // hole
+
+        done += n;
+    }
+
+    return done;
+}
+
+std::size_t MemoryNode::write(IFile::DataT const * src, std::size_t offset, std::size_t size)
+{
+    std::unique_lock<std::shared_mutex> lk(_mutex);
+    return writeLocked(src, offset, size);
+}
+
+std::size_t MemoryNode::append(IFile::DataT const * src, std::size_t size)
+{
+    std::unique_lock<std::shared_mutex> lk(_mutex);
+    return writeLocked(src, _size, size);
+}
+
+std::size_t MemoryNode::writeLocked(IFile::DataT const * src, std::size_t offset, std::size_t size)
+{
+    if ( size == 0 )
+        return 0;
+
+    auto lastIndex = ( offset + size - 1 ) / CHUNK_SIZE;
+    if ( _chunks.size() <= lastIndex )
+        _chunks.resize(lastIndex + 1);
+
+    std::size_t done = 0;
+    while ( done < size )
+    {
+        auto pos = offset + done;
+        auto index = pos / CHUNK_SIZE;
+        auto inChunk = pos % CHUNK_SIZE;
+        auto n = std::min(CHUNK_SIZE - inChunk, size - done);
+
+        auto & chunk = _chunks[index];
+        if ( !chunk )
+        {
+            chunk = Chunk(new IFile::DataT[CHUNK_SIZE]());
+        }
+        else if ( chunk.use_count() > 1 )
+        {
+            // shared with a copy of this file, clone before modifying
+            Chunk own(new IFile::DataT[CHUNK_SIZE]);
+            std::memcpy(own.get(), chunk.get(), CHUNK_SIZE);
+            chunk = std::move(own);
+        }
+        std::memcpy(chunk.get() + inChunk, src + done, n);
+
+        done += n;
+    }
+
+    _size = std::max(_size, offset + size);
+    _mtime = std::chrono::system_clock::now();
+
+    return done;
+}
+
+void MemoryNode::cloneContent(MemoryNode const & other)
+{
+    if ( &other == this )
+        return;
+
+    std::vector<Chunk> chunks;
+    std::size_t size = 0;
+    {
+        std::shared_lock<std::shared_mutex> lk(other._mutex);
+        chunks = other._chunks;
+        size = other._size;
+    }
+
+    std::unique_lock<std::shared_mutex> lk(_mutex);
+    _chunks = std::move(chunks);
+    _size = size;
+    _mtime = std::chrono::system_clock::now();
+}
+
+std::size_t MemoryNode::size() const
+{
+    std::shared_lock<std::shared_mutex> lk(_mutex);
+    return _size;
+}
+
+std::chrono::system_clock::time_point MemoryNode::modifiedTime() const
+{
+    std::shared_lock<std::shared_mutex> lk(_mutex);
+    return _mtime;
+}
+
+} // namespace VFS
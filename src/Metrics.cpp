@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <sstream>
+#include "vfs/Metrics.h"
+
+namespace VFS {
+
+Metrics::Metrics()
+    : _shards(newShard(), fold)
+{
+}
+
+Metrics::~Metrics() = default;
+
+char const * Metrics::name(Op op)
+{
+    static char const * const names[] = {
+        "mount", "unmount", "open", "remove", "touchFile", "makeDir", "moveTo", "list", "contain", "search", "copy",
+        "type", "read", "write", "readAll", "readBatch", "writeBatch", "readAsync", "writeAsync", "fsync", "sync",
+        "size", "info", "close", "configure",
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<std::size_t>(Op::COUNT), "a name for every operation");
+
+    return op < Op::COUNT ? names[static_cast<std::size_t>(op)] : "unknown";
+}
+
+void Metrics::record(Op op, std::uint64_t nanos, std::uint64_t bytes, bool error)
+{
+    auto & counters = _shards.local(newShard).ops[static_cast<std::size_t>(op)];
+    bumpOwned(counters.calls, 1);
+    bumpOwned(counters.bytes, bytes);
+    if ( error )
+        bumpOwned(counters.errors, 1);
+    bumpOwned(counters.buckets[Histogram::bucketOf(nanos)], 1);
+}
+
+std::vector<Metrics::OpStats> Metrics::snapshot() const
+{
+    std::vector<OpStats> stats;
+    for ( std::size_t i = 0; i < static_cast<std::size_t>(Op::COUNT); ++i )
+        stats.push_back(OpStats{ static_cast<Op>(i), 0, 0, 0, Histogram() });
+
+    _shards.forEach([&stats] (Shard const & shard)
+    {
+        for ( auto & op : stats )
+        {
+            auto const & counters = shard.ops[static_cast<std::size_t>(op.op)];
+            op.calls += counters.calls.load(std::memory_order_relaxed);
+            op.bytes += counters.bytes.load(std::memory_order_relaxed);
+            op.errors += counters.errors.load(std::memory_order_relaxed);
+            for ( std::size_t b = 0; b < Histogram::BUCKETS; ++b )
+                op.latency.add(b, counters.buckets[b].load(std::memory_order_relaxed));
+        }
+    });
+    stats.erase(std::remove_if(stats.begin(), stats.end(), [] (OpStats const & op) { return op.calls == 0; }),
+                stats.end());
+
+    return stats;
+}
+
+std::string Metrics::toJson() const
+{
+    std::ostringstream out;
+    out << "{";
+    bool first = true;
+    for ( auto const & op : snapshot() )
+    {
+        auto const & latency = op.latency;
+        out << ( first ? "" : "," ) << "\"" << name(op.op) << "\":{"
+            << "\"calls\":" << op.calls << ",\"bytes\":" << op.bytes << ",\"errors\":" << op.errors
+            << ",\"latency_ns\":{\"min\":" << latency.min() << ",\"mean\":" << static_cast<std::uint64_t>(latency.mean())
+            << ",\"p50\":" << latency.percentile(50) << ",\"p90\":" << latency.percentile(90)
+            << ",\"p99\":" << latency.percentile(99) << ",\"p999\":" << latency.percentile(99.9)
+            << ",\"max\":" << latency.max() << ",\"buckets\":[";
+
+        // [upper bound, count] of the buckets that were hit
+        bool firstBucket = true;
+        for ( std::size_t b = 0; b < Histogram::BUCKETS; ++b )
+        {
+            if ( latency.at(b) == 0 )
+                continue;
+            out << ( firstBucket ? "" : "," ) << "[" << Histogram::upperBound(b) << "," << latency.at(b) << "]";
+            firstBucket = false;
+        }
+        out << "]}}";
+        first = false;
+    }
+    out << "}";
+
+    return out.str();
+}
+
+void Metrics::reset()
+{
+    _shards.forEach(clear);
+}
+
+std::unique_ptr<Metrics::Shard> Metrics::newShard()
+{
+    std::unique_ptr<Shard> shard(new Shard());
+    clear(*shard);
+
+    return shard;
+}
+
+void Metrics::clear(Shard & shard)
+{
+    for ( auto & counters : shard.ops )
+    {
+        counters.calls = 0;
+        counters.bytes = 0;
+        counters.errors = 0;
+        for ( auto & bucket : counters.buckets )
+            bucket = 0;
+    }
+}
+
+void Metrics::fold(Shard & into, Shard const & from)
+{
+    for ( std::size_t i = 0; i < into.ops.size(); ++i )
+    {
+        auto & counters = into.ops[i];
+        auto const & added = from.ops[i];
+        bumpOwned(counters.calls, added.calls.load(std::memory_order_relaxed));
+        bumpOwned(counters.bytes, added.bytes.load(std::memory_order_relaxed));
+        bumpOwned(counters.errors, added.errors.load(std::memory_order_relaxed));
+        for ( std::size_t b = 0; b < Histogram::BUCKETS; ++b )
+            bumpOwned(counters.buckets[b], added.buckets[b].load(std::memory_order_relaxed));
+    }
+}
+
+}
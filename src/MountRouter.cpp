@@ -0,0 +1,544 @@
+#include <algorithm>
+#include <set>
+#include "vfs/CopyEngine.h"
+#include "vfs/MountRouter.h"
+
+namespace VFS {
+
+namespace {
+
+bool startsWith(std::string const & str, std::string const & prefix)
+{
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+// An entry of list() or search() of a filesystem relative to it.
+std::string relative(std::string const & entry, std::string const & root)
+{
+    auto rel = startsWith(entry, root) ? entry.substr(root.size()) : entry;
+    while ( startsWith(rel, "./") || startsWith(rel, "/") )
+        rel.erase(0, rel[0] == '.' ? 2 : 1);
+    if ( rel == "." )
+        rel.clear();
+
+    return rel;
+}
+
+std::string inner(std::string const & rest)
+{
+    return rest.empty() ? "." : rest;
+}
+
+}
+
+MountRouter::MountRouter(std::string const & path)
+    : _path()
+      , _mounted(false)
+      , _root(std::make_shared<Node const>())
+      , _mutex()
+{
+    mount(path);
+}
+
+MountRouter::~MountRouter() { unmount(); }
+
+bool MountRouter::attach(std::string const & prefix, IFSPtr fs)
+{
+    std::string path;
+    if ( fs == nullptr || !fs->isMounted() || !normalize(prefix, path) )
+        return false;
+    if ( !path.empty() )
+        path.push_back('/');
+
+    std::lock_guard<std::mutex> lk(_mutex);
+    auto root = std::atomic_load(&_root);
+    Route found;
+    resolve(*root, path.empty() ? path : path.substr(0, path.size() - 1), found);
+    if ( found.node != nullptr && found.node->prefix == path )
+        return false;
+
+    publish(insert(*root, path, 0, fs));
+
+    return true;
+}
+
+bool MountRouter::detach(std::string const & prefix)
+{
+    std::string path;
+    if ( !normalize(prefix, path) )
+        return false;
+    if ( !path.empty() )
+        path.push_back('/');
+
+    std::lock_guard<std::mutex> lk(_mutex);
+    bool found = false;
+    auto next = erase(*std::atomic_load(&_root), path, 0, true, found);
+    if ( !found )
+        return false;
+
+    publish(next);
+
+    return true;
+}
+
+MountRouter::MountList MountRouter::mounts() const
+{
+    std::vector<Node const *> nodes;
+    auto root = std::atomic_load(&_root);
+    collect(*root, nodes);
+
+    MountList result;
+    for ( auto const * node : nodes )
+    {
+        auto prefix = node->prefix.empty() ? std::string(".") : node->prefix.substr(0, node->prefix.size() - 1);
+        result.emplace_back(prefix, node->fs);
+    }
+
+    return result;
+}
+
+std::string MountRouter::path() const
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    return _path;
+}
+
+bool MountRouter::isMounted() const
+{
+    return _mounted;
+}
+
+bool MountRouter::mount(std::string const & path)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    if ( _mounted || path.empty() )
+        return false;
+
+    _path = path;
+    if ( *_path.rbegin() != '/' )
+        _path.push_back('/');
+    _mounted = true;
+
+    return _mounted;
+}
+
+bool MountRouter::unmount()
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    if ( !_mounted )
+        return false;
+
+    _mounted = false;
+    _path = "";
+
+    return true;
+}
+
+IFS::IFilePtr MountRouter::open(std::string const & filename, Perms mode)
+{
+    std::string path;
+    Route found;
+    if ( !route(filename, path, found) || found.node == nullptr )
+        return nullptr;
+
+    return found.node->fs->open(found.rest, mode);
+}
+
+bool MountRouter::remove(std::string const & filename)
+{
+    std::string path;
+    Route found;
+    if ( !route(filename, path, found) || found.node == nullptr || found.above || found.rest == "." )
+        return false;
+
+    return found.node->fs->remove(found.rest);
+}
+
+bool MountRouter::touchFile(std::string const & filename)
+{
+    std::string path;
+    Route found;
+    if ( !route(filename, path, found) || found.node == nullptr || found.above || found.rest == "." )
+        return false;
+
+    return found.node->fs->touchFile(found.rest);
+}
+
+bool MountRouter::makeDir(std::string const & dir)
+{
+    std::string path;
+    Route found;
+    if ( !route(dir, path, found) || found.node == nullptr || found.above || found.rest == "." )
+        return false;
+
+    return found.node->fs->makeDir(found.rest);
+}
+
+bool MountRouter::moveTo(std::string const & from, std::string const & to)
+{
+    std::string source;
+    std::string target;
+    Route fromRoute;
+    Route toRoute;
+    if ( !route(from, source, fromRoute) || !route(to, target, toRoute, fromRoute.root) )
+        return false;
+    if ( fromRoute.node == nullptr || fromRoute.above || fromRoute.rest == "." )
+        return false;
+    if ( toRoute.node == nullptr || toRoute.above || toRoute.rest == "." )
+        return false;
+
+    if ( fromRoute.node->fs == toRoute.node->fs )
+        return fromRoute.node->fs->moveTo(fromRoute.rest, toRoute.rest);
+
+    return fromRoute.node->fs->moveTo(fromRoute.rest, toRoute.node->fs, toRoute.rest);
+}
+
+bool MountRouter::moveTo(std::string const & from, IFSPtr fsptr, std::string const & to)
+{
+    if ( fsptr == nullptr || !fsptr->isMounted() )
+        return false;
+
+    if ( fsptr.get() == this )
+        return moveTo(from, to);
+
+    std::string path;
+    Route found;
+    if ( !route(from, path, found) || found.node == nullptr || found.above || found.rest == "." )
+        return false;
+
+    return found.node->fs->moveTo(found.rest, fsptr, to);
+}
+
+IFS::EntryList MountRouter::list()
+{
+    return list(".");
+}
+
+IFS::EntryList MountRouter::list(std::string const & dir)
+{
+    std::string path;
+    Route found;
+    if ( !route(dir, path, found) )
+        return {};
+
+    auto const & root = *found.root;
+    auto prefix = path.empty() ? path : path + '/';
+    bool exists = path.empty() || found.above;
+    if ( found.node != nullptr && !exists )
+        exists = std::string(found.node->fs->type(found.rest)) == type::DIRECTORY;
+    if ( !exists )
+        return {};
+
+    // the filesystem dir is in and those attached below it, without what a longer prefix hides
+    std::vector<Node const *> nodes;
+    collect(root, nodes);
+    std::set<std::string> entries;
+    for ( auto const * node : nodes )
+    {
+        bool under = node->prefix.size() > prefix.size() && startsWith(node->prefix, prefix);
+        if ( node != found.node && !under )
+            continue;
+
+        if ( under )
+        {
+            for ( auto slash = node->prefix.find('/', prefix.size()); slash != std::string::npos; slash = node->prefix.find('/', slash + 1) )
+                entries.insert(node->prefix.substr(0, slash));
+        }
+
+        auto fsRoot = node->fs->path();
+        for ( auto const & entry : node->fs->list(node == found.node ? found.rest : ".") )
+        {
+            auto rel = relative(entry, fsRoot);
+            if ( rel.empty() )
+                continue;
+
+            auto full = node->prefix + rel;
+            Route owner;
+            resolve(root, full, owner);
+            if ( owner.node == node && !owner.above )
+                entries.insert(full);
+        }
+    }
+
+    EntryList result;
+    auto name = this->path();
+    for ( auto const & entry : entries )
+        result.push_back(name + entry);
+
+    return result;
+}
+
+bool MountRouter::contain(std::string const & filename)
+{
+    return std::string(type(filename)) != type::NOTFOUND || search(filename) != type::NOTFOUND;
+}
+
+std::string MountRouter::search(std::string const & filename)
+{
+    std::string path;
+    Route found;
+    if ( !route(filename, path, found) || path.empty() )
+        return type::NOTFOUND;
+    if ( found.above || ( found.node != nullptr && std::string(found.node->fs->type(found.rest)) != type::NOTFOUND ) )
+        return "./" + path;
+
+    auto const & root = *found.root;
+    std::vector<Node const *> nodes;
+    collect(root, nodes);
+    for ( auto const * node : nodes )
+    {
+        std::string hit = node->fs->search(filename);
+        if ( hit == type::NOTFOUND )
+            continue;
+
+        auto full = node->prefix + relative(hit, node->fs->path());
+        Route owner;
+        resolve(root, full, owner);
+        if ( owner.node == node && !owner.above )
+            return "./" + full;
+    }
+
+    return type::NOTFOUND;
+}
+
+bool MountRouter::copy(std::string const & from, std::string const & to)
+{
+    std::string source;
+    std::string target;
+    Route fromRoute;
+    Route toRoute;
+    if ( !route(from, source, fromRoute) || !route(to, target, toRoute, fromRoute.root) )
+        return false;
+    if ( fromRoute.node == nullptr || fromRoute.above || toRoute.node == nullptr || toRoute.above || toRoute.rest == "." )
+        return false;
+
+    auto & fromFs = fromRoute.node->fs;
+    auto & toFs = toRoute.node->fs;
+    if ( fromFs == toFs )
+        return fromFs->copy(fromRoute.rest, toRoute.rest);
+
+    // across filesystems, only regular files like copy() of every filesystem
+    if ( std::string(fromFs->type(fromRoute.rest)) != type::REGULAR || toFs->type(toRoute.rest) != std::string(type::NOTFOUND) )
+        return false;
+
+    auto input = fromFs->open(fromRoute.rest, Perms::READ);
+    if ( input == nullptr || !toFs->touchFile(toRoute.rest) )
+        return false;
+    auto output = toFs->open(toRoute.rest, Perms::RW);
+    if ( output == nullptr || !CopyEngine::stream(*input, *output).ok )
+    {
+        output = nullptr;
+        toFs->remove(toRoute.rest);
+        return false;
+    }
+
+    return true;
+}
+
+type::FILETYPE MountRouter::type(std::string const & filename)
+{
+    std::string path;
+    Route found;
+    if ( !route(filename, path, found) )
+        return type::NOTFOUND;
+    if ( path.empty() || found.above )
+        return type::DIRECTORY;
+    if ( found.node == nullptr )
+        return type::NOTFOUND;
+
+    return found.node->fs->type(found.rest);
+}
+
+bool MountRouter::normalize(std::string const & filename, std::string & path)
+{
+    if ( filename.empty() || filename.front() == '/' )
+        return false;
+
+    path.clear();
+    std::size_t begin = 0;
+    while ( begin <= filename.size() )
+    {
+        auto end = filename.find('/', begin);
+        if ( end == std::string::npos )
+            end = filename.size();
+
+        if ( end - begin == 2 && filename.compare(begin, 2, "..") == 0 )
+            return false;
+        if ( end > begin && !( end - begin == 1 && filename[begin] == '.' ) )
+        {
+            if ( !path.empty() )
+                path.push_back('/');
+            path.append(filename, begin, end - begin);
+        }
+
+        begin = end + 1;
+    }
+
+    return true;
+}
+
+void MountRouter::resolve(Node const & root, std::string const & path, Route & route)
+{
+    // the path is matched as if it ended with '/', the prefixes all do, so only whole parts match
+    auto length = path.size() + 1;
+    auto at = [&path] (std::size_t i) { return i < path.size() ? path[i] : '/'; };
+
+    Node const * node = &root;
+    Node const * best = root.fs != nullptr ? &root : nullptr;
+    std::size_t bestEnd = 0;
+    std::size_t pos = 0;
+    bool above = false;
+    while ( pos < length )
+    {
+        auto c = at(pos);
+        auto it = std::lower_bound(node->children.begin(), node->children.end(), c, [] (NodePtr const & child, char value)
+        {
+            return static_cast<unsigned char>(child->label[0]) < static_cast<unsigned char>(value);
+        });
+        if ( it == node->children.end() || ( *it )->label[0] != c )
+            break;
+
+        auto const & label = ( *it )->label;
+        std::size_t matched = 1;
+        while ( matched < label.size() && pos + matched < length && label[matched] == at(pos + matched) )
+            ++matched;
+        if ( matched < label.size() )
+        {
+            // the whole path ends inside the label, it is a directory above the prefixes below
+            above = pos + matched == length;
+            break;
+        }
+
+        pos += label.size();
+        node = it->get();
+        if ( node->fs != nullptr )
+        {
+            best = node;
+            bestEnd = pos;
+        }
+    }
+    if ( pos == length && bestEnd != length )
+        above = true;
+
+    route.node = best;
+    route.above = above;
+    route.rest = bestEnd >= length ? std::string(".") : inner(path.substr(bestEnd));
+}
+
+bool MountRouter::route(std::string const & filename, std::string & path, Route & route, NodePtr const & root) const
+{
+    if ( !_mounted || !normalize(filename, path) )
+        return false;
+
+    route.root = root != nullptr ? root : std::atomic_load(&_root);
+    resolve(*route.root, path, route);
+    if ( path.empty() && route.node == nullptr )
+        route.above = true;
+
+    return true;
+}
+
+MountRouter::NodePtr MountRouter::insert(Node const & node, std::string const & prefix, std::size_t pos, IFSPtr const & fs)
+{
+    auto copy = std::make_shared<Node>(node);
+    if ( pos == prefix.size() )
+    {
+        copy->prefix = prefix;
+        copy->fs = fs;
+        return copy;
+    }
+
+    auto c = prefix[pos];
+    auto it = std::lower_bound(copy->children.begin(), copy->children.end(), c, [] (NodePtr const & child, char value)
+    {
+        return static_cast<unsigned char>(child->label[0]) < static_cast<unsigned char>(value);
+    });
+    if ( it == copy->children.end() || ( *it )->label[0] != c )
+    {
+        auto leaf = std::make_shared<Node>();
+        leaf->label = prefix.substr(pos);
+        leaf->prefix = prefix;
+        leaf->fs = fs;
+        copy->children.insert(it, leaf);
+        return copy;
+    }
+
+    auto const & child = **it;
+    std::size_t common = 1;
+    while ( common < child.label.size() && pos + common < prefix.size() && child.label[common] == prefix[pos + common] )
+        ++common;
+    if ( common == child.label.size() )
+    {
+        *it = insert(child, prefix, pos + common, fs);
+        return copy;
+    }
+
+    // split the label where the prefixes part
+    auto rest = std::make_shared<Node>(child);
+    rest->label = child.label.substr(common);
+    auto split = std::make_shared<Node>();
+    split->label = child.label.substr(0, common);
+    split->children.push_back(rest);
+    *it = insert(*split, prefix, pos + common, fs);
+
+    return copy;
+}
+
+MountRouter::NodePtr MountRouter::erase(Node const & node, std::string const & prefix, std::size_t pos, bool root, bool & found)
+{
+    auto copy = std::make_shared<Node>(node);
+    if ( pos == prefix.size() )
+    {
+        found = node.fs != nullptr;
+        copy->fs = nullptr;
+        copy->prefix.clear();
+    }
+    else
+    {
+        auto c = prefix[pos];
+        auto it = std::find_if(copy->children.begin(), copy->children.end(), [c] (NodePtr const & child) { return child->label[0] == c; });
+        if ( it == copy->children.end() || prefix.compare(pos, ( *it )->label.size(), ( *it )->label) != 0 )
+        {
+            found = false;
+            return nullptr;
+        }
+
+        auto child = erase(**it, prefix, pos + ( *it )->label.size(), false, found);
+        if ( !found )
+            return nullptr;
+        if ( child == nullptr )
+            copy->children.erase(it);
+        else
+            *it = child;
+    }
+
+    if ( root || copy->fs != nullptr )
+        return copy;
+
+    // nothing is attached here any more, the node goes or merges with its only child
+    if ( copy->children.empty() )
+        return nullptr;
+    if ( copy->children.size() == 1 )
+    {
+        auto merged = std::make_shared<Node>(*copy->children.front());
+        merged->label = copy->label + merged->label;
+        return merged;
+    }
+
+    return copy;
+}
+
+void MountRouter::collect(Node const & node, std::vector<Node const *> & nodes)
+{
+    if ( node.fs != nullptr )
+        nodes.push_back(&node);
+    for ( auto const & child : node.children )
+        collect(*child, nodes);
+}
+
+void MountRouter::publish(NodePtr root)
+{
+    std::atomic_store(&_root, root);
+}
+
+}
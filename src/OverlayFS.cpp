@@ -0,0 +1,757 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include "vfs/CopyEngine.h"
+#include "vfs/OverlayFS.h"
+
+namespace VFS {
+
+namespace {
+
+constexpr std::size_t CHUNK = 1024 * 1024;  // of copyFile()
+
+// The entries of a layer relative to it, and whether they are directories.
+typedef std::vector<std::pair<std::string, bool>> Listing;
+
+std::string relative(std::string const & entry, std::string const & root)
+{
+    auto rel = entry.compare(0, root.size(), root) == 0 ? entry.substr(root.size()) : entry;
+    while ( rel.compare(0, 2, "./") == 0 || rel.compare(0, 1, "/") == 0 )
+        rel.erase(0, rel[0] == '.' ? 2 : 1);
+    if ( rel == "." )
+        rel.clear();
+
+    return rel;
+}
+
+Listing listLayer(IFS & layer)
+{
+    Listing listing;
+    auto root = layer.path();
+    for ( auto const & entry : layer.list() )
+    {
+        auto rel = relative(entry, root);
+        if ( !rel.empty() )
+            listing.emplace_back(rel, std::string(layer.type(rel)) == type::DIRECTORY);
+    }
+
+    return listing;
+}
+
+std::string basename(std::string const & path)
+{
+    auto slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool startsWith(std::string const & str, std::string const & prefix)
+{
+    return str.compare(0, prefix.size(), prefix) == 0;
+}
+
+}
+
+OverlayFS::OverlayFS(std::string const & path, IFSPtr upper, std::vector<IFSPtr> lowers)
+    : _path()
+      , _mounted(false)
+      , _layers()
+      , _index()
+      , _names()
+      , _partials()
+      , _mutex()
+{
+    _layers.push_back(upper);
+    _layers.insert(_layers.end(), lowers.begin(), lowers.end());
+    mount(path);
+}
+
+OverlayFS::~OverlayFS() { unmount(); }
+
+std::string OverlayFS::path() const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _path;
+}
+
+bool OverlayFS::isMounted() const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _mounted;
+}
+
+bool OverlayFS::mount(std::string const & path)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    if ( _mounted || path.empty() )
+        return false;
+    for ( auto const & layer : _layers )
+    {
+        if ( layer == nullptr || !layer->isMounted() )
+            return false;
+    }
+
+    _path = path;
+    if ( *_path.rbegin() != '/' )
+        _path.push_back('/');
+    build();
+    _mounted = true;
+
+    return _mounted;
+}
+
+bool OverlayFS::unmount()
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    if ( !_mounted )
+        return false;
+
+    _index.clear();
+    _names.clear();
+    _partials.clear();
+    _mounted = false;
+    _path = "";
+
+    return true;
+}
+
+IFS::IFilePtr OverlayFS::open(std::string const & filename, Perms mode)
+{
+    std::string path;
+    if ( !normalize(filename, path) )
+        return nullptr;
+
+    {
+        // what needs no change of the index opens under the shared lock
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        if ( !_mounted )
+            return nullptr;
+
+        auto it = _index.find(path);
+        if ( it == _index.end() || it->second.directory )
+            return nullptr;
+        if ( it->second.layer == 0 && !it->second.partial )
+            return _layers[0]->open(path, mode);
+        if ( it->second.layer != 0 && mode == Perms::READ )
+            return _layers[it->second.layer]->open(path, mode);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    if ( !_mounted )
+        return nullptr;
+
+    return openLocked(path, mode);
+}
+
+bool OverlayFS::remove(std::string const & filename)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    std::string path;
+    if ( !_mounted || !normalize(filename, path) || path.empty() )
+        return false;
+
+    return removeLocked(path);
+}
+
+bool OverlayFS::touchFile(std::string const & filename)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    std::string path;
+    if ( !_mounted || !normalize(filename, path) || path.empty() || startsWith(basename(path), WHITEOUT) )
+        return false;
+    if ( _index.count(path) != 0 || !parentExists(path) )
+        return false;
+
+    if ( !makeParents(path) || !_layers[0]->touchFile(path) )
+        return false;
+    insert(path, Entry{ 0, false, false, false, 0 });
+
+    return true;
+}
+
+bool OverlayFS::makeDir(std::string const & dir)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    std::string path;
+    if ( !_mounted || !normalize(dir, path) || path.empty() || startsWith(basename(path), WHITEOUT) )
+        return false;
+    if ( _index.count(path) != 0 || !parentExists(path) )
+        return false;
+
+    if ( !makeParents(path) || !_layers[0]->makeDir(path) )
+        return false;
+    insert(path, Entry{ 0, true, false, false, 0 });
+
+    return true;
+}
+
+bool OverlayFS::moveTo(std::string const & from, std::string const & to)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    std::string source;
+    std::string target;
+    if ( !_mounted || !normalize(from, source) || !normalize(to, target) || source.empty() || target.empty() )
+        return false;
+    if ( startsWith(basename(target), WHITEOUT) || startsWith(target, source + '/') )
+        return false;
+
+    auto it = _index.find(source);
+    if ( it == _index.end() || _index.count(target) != 0 || !parentExists(target) )
+        return false;
+
+    auto entry = it->second;
+    auto & upper = _layers[0];
+    if ( entry.directory )
+    {
+        // the lower layers would have to be told where it went, as overlayfs does with redirect_dir
+        if ( entry.below )
+            return false;
+
+        // the partial files in it would lose their lower halves
+        for ( auto child = _index.lower_bound(source + '/'); child != _index.end() && startsWith(child->first, source + '/'); ++child )
+        {
+            if ( child->second.partial && !finishCopyUp(child->first, child->second) )
+                return false;
+        }
+
+        if ( !makeParents(target) || !upper->moveTo(source, target) )
+            return false;
+
+        std::vector<std::pair<std::string, Entry>> moved;
+        for ( auto child = _index.lower_bound(source); child != _index.end() && startsWith(child->first, source); ++child )
+        {
+            if ( child->first == source || startsWith(child->first, source + '/') )
+                moved.emplace_back(target + child->first.substr(source.size()), child->second);
+        }
+        erase(source);
+        for ( auto const & item : moved )
+            insert(item.first, item.second);
+
+        return true;
+    }
+
+    if ( entry.partial && !finishCopyUp(source, it->second) )
+        return false;
+
+    if ( entry.layer == 0 )
+    {
+        if ( !makeParents(target) || !upper->moveTo(source, target) )
+            return false;
+        insert(target, Entry{ 0, false, false, false, 0 });
+    }
+    else if ( !copyFile(source, target) )
+        return false;
+
+    erase(source);
+    if ( entry.below && ( !makeParents(source) || !upper->touchFile(hidden(source, WHITEOUT)) ) )
+        return false;
+
+    return true;
+}
+
+bool OverlayFS::moveTo(std::string const & from, IFSPtr fsptr, std::string const & to)
+{
+    if ( fsptr == nullptr || !fsptr->isMounted() )
+        return false;
+
+    if ( fsptr.get() == this )
+        return moveTo(from, to);
+
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    std::string path;
+    if ( !_mounted || !normalize(from, path) )
+        return false;
+
+    auto it = _index.find(path);
+    if ( it == _index.end() || it->second.directory || std::string(fsptr->type(to)) != type::NOTFOUND )
+        return false;
+
+    auto source = openLocked(path, Perms::READ);
+    if ( source == nullptr )
+        return false;
+    if ( !fsptr->touchFile(to) )
+    {
+        source->close();
+        return false;
+    }
+
+    // the source goes only once the copy is synced
+    auto target = fsptr->open(to, Perms::RW);
+    bool copied = target != nullptr && CopyEngine::stream(*source, *target).ok;
+    source->close();
+    if ( target != nullptr )
+        target->close();
+    if ( !copied )
+    {
+        fsptr->remove(to);
+        return false;
+    }
+
+    return removeLocked(path);
+}
+
+IFS::EntryList OverlayFS::list()
+{
+    return list(".");
+}
+
+IFS::EntryList OverlayFS::list(std::string const & dir)
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    std::string path;
+    if ( !_mounted || !normalize(dir, path) )
+        return {};
+
+    std::string prefix;
+    if ( !path.empty() )
+    {
+        auto it = _index.find(path);
+        if ( it == _index.end() || !it->second.directory )
+            return {};
+        prefix = path + '/';
+    }
+
+    EntryList result;
+    for ( auto it = _index.lower_bound(prefix); it != _index.end() && startsWith(it->first, prefix); ++it )
+        result.push_back(_path + it->first);
+
+    return result;
+}
+
+bool OverlayFS::contain(std::string const & filename)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        std::string path;
+        if ( !_mounted || !normalize(filename, path) )
+            return false;
+        if ( path.empty() || _index.count(path) != 0 )
+            return true;
+    }
+
+    return search(filename) != type::NOTFOUND;
+}
+
+std::string OverlayFS::search(std::string const & filename)
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    std::string path;
+    if ( !_mounted || !normalize(filename, path) || path.empty() )
+        return type::NOTFOUND;
+
+    if ( _index.count(path) != 0 )
+        return "./" + path;
+
+    auto it = _names.find(path);
+    if ( it == _names.end() || it->second.empty() )
+        return type::NOTFOUND;
+
+    return "./" + *it->second.begin();
+}
+
+bool OverlayFS::copy(std::string const & from, std::string const & to)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    std::string source;
+    std::string target;
+    if ( !_mounted || !normalize(from, source) || !normalize(to, target) || target.empty() )
+        return false;
+    if ( startsWith(basename(target), WHITEOUT) )
+        return false;
+
+    auto it = _index.find(source);
+    if ( it == _index.end() || it->second.directory || _index.count(target) != 0 || !parentExists(target) )
+        return false;
+
+    return copyFile(source, target);
+}
+
+type::FILETYPE OverlayFS::type(std::string const & filename)
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    std::string path;
+    if ( !_mounted || !normalize(filename, path) )
+        return type::NOTFOUND;
+    if ( path.empty() )
+        return type::DIRECTORY;
+
+    auto it = _index.find(path);
+    if ( it == _index.end() )
+        return type::NOTFOUND;
+
+    return it->second.directory ? type::DIRECTORY : type::REGULAR;
+}
+
+bool OverlayFS::normalize(std::string const & filename, std::string & path)
+{
+    if ( filename.empty() || filename.front() == '/' )
+        return false;
+
+    path.clear();
+    std::size_t begin = 0;
+    while ( begin <= filename.size() )
+    {
+        auto end = filename.find('/', begin);
+        if ( end == std::string::npos )
+            end = filename.size();
+
+        auto part = filename.substr(begin, end - begin);
+        if ( part == ".." )
+            return false;
+        if ( !part.empty() && part != "." )
+        {
+            if ( !path.empty() )
+                path.push_back('/');
+            path += part;
+        }
+
+        begin = end + 1;
+    }
+
+    return true;
+}
+
+std::string OverlayFS::hidden(std::string const & path, char const * prefix)
+{
+    auto slash = path.rfind('/');
+    if ( slash == std::string::npos )
+        return prefix + path;
+
+    return path.substr(0, slash + 1) + prefix + path.substr(slash + 1);
+}
+
+void OverlayFS::build()
+{
+    _index.clear();
+    _names.clear();
+    _partials.clear();
+
+    // from the bottom up, every layer hides and replaces what those below it hold
+    std::vector<std::string> copyUps;
+    for ( auto layer = _layers.size(); layer-- > 0; )
+    {
+        auto listing = listLayer(*_layers[layer]);
+        auto copyUpLength = std::strlen(COPY_UP);
+        auto whiteoutLength = std::strlen(WHITEOUT);
+
+        for ( auto const & item : listing )
+        {
+            auto name = basename(item.first);
+            auto dir = item.first.substr(0, item.first.size() - name.size());
+            if ( startsWith(name, COPY_UP) )
+            {
+                if ( layer == 0 )
+                    copyUps.push_back(dir + name.substr(copyUpLength));
+            }
+            else if ( startsWith(name, WHITEOUT) )
+                erase(dir + name.substr(whiteoutLength));
+        }
+
+        for ( auto const & item : listing )
+        {
+            if ( startsWith(basename(item.first), WHITEOUT) )
+                continue;
+
+            bool below = layer != 0 || _index.count(item.first) != 0;
+            insert(item.first, Entry{ layer, item.second, below, false, 0 });
+        }
+    }
+
+    // a copy-up that is done only needs its state removed, one that isn't goes on where it stopped
+    for ( auto const & path : copyUps )
+    {
+        auto it = _index.find(path);
+        if ( it == _index.end() || it->second.layer != 0 )
+        {
+            _layers[0]->remove(hidden(path, COPY_UP));
+            continue;
+        }
+
+        CopyUpFile::Blocks state;
+        auto store = _layers[0]->open(hidden(path, COPY_UP), Perms::READ);
+        if ( store != nullptr && state.parse(store->readAll()) && state.layer != 0 && state.layer < _layers.size() && !state.complete() )
+        {
+            it->second.partial = true;
+            it->second.source = state.layer;
+            continue;
+        }
+
+        if ( store != nullptr )
+            store->close();
+        _layers[0]->remove(hidden(path, COPY_UP));
+    }
+}
+
+void OverlayFS::insert(std::string const & path, Entry const & entry)
+{
+    _index[path] = entry;
+    _names[basename(path)].insert(path);
+}
+
+void OverlayFS::erase(std::string const & path)
+{
+    auto it = _index.find(path);
+    if ( it == _index.end() )
+        return;
+
+    auto prefix = path + '/';
+    auto end = _index.lower_bound(prefix);
+    while ( end != _index.end() && startsWith(end->first, prefix) )
+        ++end;
+
+    for ( auto item = _index.lower_bound(prefix); item != end; ++item )
+    {
+        auto names = _names.find(basename(item->first));
+        if ( names != _names.end() && names->second.erase(item->first) != 0 && names->second.empty() )
+            _names.erase(names);
+    }
+    _index.erase(_index.lower_bound(prefix), end);
+
+    auto names = _names.find(basename(path));
+    if ( names != _names.end() && names->second.erase(path) != 0 && names->second.empty() )
+        _names.erase(names);
+    _index.erase(path);
+}
+
+bool OverlayFS::parentExists(std::string const & path) const
+{
+    auto slash = path.rfind('/');
+    if ( slash == std::string::npos )
+        return true;
+
+    auto it = _index.find(path.substr(0, slash));
+    return it != _index.end() && it->second.directory;
+}
+
+bool OverlayFS::makeParents(std::string const & path)
+{
+    auto & upper = _layers[0];
+    for ( auto slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1) )
+    {
+        auto dir = path.substr(0, slash);
+        if ( std::string(upper->type(dir)) != type::DIRECTORY && !upper->makeDir(dir) )
+            return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<CopyUpFile::Blocks> OverlayFS::blocks(std::string const & path, Entry const & entry)
+{
+    auto it = _partials.find(path);
+    if ( it != _partials.end() )
+    {
+        if ( auto state = it->second.lock() )
+            return state;
+    }
+
+    auto store = _layers[0]->open(hidden(path, COPY_UP), Perms::RW);
+    if ( store == nullptr )
+        return nullptr;
+
+    auto state = std::make_shared<CopyUpFile::Blocks>();
+    if ( !state->parse(store->readAll()) || state->layer != entry.source )
+        return nullptr;
+
+    state->store = store;
+    _partials[path] = state;
+
+    return state;
+}
+
+IFS::IFilePtr OverlayFS::openLocked(std::string const & path, Perms mode)
+{
+    auto it = _index.find(path);
+    if ( it == _index.end() || it->second.directory )
+        return nullptr;
+
+    auto & entry = it->second;
+    auto & upper = _layers[0];
+    if ( entry.layer != 0 )
+    {
+        auto & lower = _layers[entry.layer];
+        if ( mode == Perms::READ )
+            return lower->open(path, mode);
+
+        auto lowerFile = lower->open(path, Perms::READ);
+        if ( lowerFile == nullptr || !makeParents(path) || !upper->touchFile(path) )
+            return nullptr;
+
+        auto size = lowerFile->size();
+        if ( size == 0 )
+        {
+            entry = Entry{ 0, false, true, false, 0 };
+            return upper->open(path, mode);
+        }
+
+        // nothing is copied yet, the blocks are copied as they are written
+        auto state = std::make_shared<CopyUpFile::Blocks>();
+        state->layer = static_cast<std::uint32_t>(entry.layer);
+        state->lowerSize = size;
+        state->copied.assign(( size + CopyUpFile::BLOCK_SIZE - 1 ) / CopyUpFile::BLOCK_SIZE, 0);
+        state->dirty = true;
+
+        auto meta = hidden(path, COPY_UP);
+        if ( upper->touchFile(meta) )
+            state->store = upper->open(meta, Perms::RW);
+        auto upperFile = upper->open(path, mode);
+        if ( state->store == nullptr || !state->save() || upperFile == nullptr )
+        {
+            upper->remove(meta);
+            upper->remove(path);
+            return nullptr;
+        }
+
+        entry = Entry{ 0, false, true, true, static_cast<std::size_t>(state->layer) };
+        _partials[path] = state;
+
+        return std::make_shared<CopyUpFile>(lowerFile, upperFile, state);
+    }
+
+    if ( !entry.partial )
+        return upper->open(path, mode);
+
+    auto state = blocks(path, entry);
+    if ( state == nullptr )
+        return nullptr;
+
+    bool complete;
+    {
+        std::lock_guard<std::mutex> lk(state->mutex);
+        complete = state->complete();
+    }
+    if ( complete )
+        return finishCopyUp(path, entry) ? upper->open(path, mode) : nullptr;
+
+    auto lowerFile = _layers[entry.source]->open(path, Perms::READ);
+    auto upperFile = upper->open(path, mode);
+    if ( lowerFile == nullptr || upperFile == nullptr )
+        return nullptr;
+
+    return std::make_shared<CopyUpFile>(lowerFile, upperFile, state);
+}
+
+bool OverlayFS::copyFile(std::string const & from, std::string const & to)
+{
+    auto & upper = _layers[0];
+    auto source = openLocked(from, Perms::READ);
+    if ( source == nullptr || !makeParents(to) || !upper->touchFile(to) )
+        return false;
+
+    auto target = upper->open(to, Perms::RW);
+    if ( target == nullptr )
+    {
+        upper->remove(to);
+        return false;
+    }
+
+    IFile::Buffer buffer(CHUNK);
+    auto size = source->size();
+    for ( std::size_t offset = 0; offset < size; )
+    {
+        auto n = source->read(buffer.data(), offset, std::min(CHUNK, size - offset));
+        if ( n == 0 || target->write(buffer.data(), offset, n) != n )
+        {
+            target->close();
+            upper->remove(to);
+            return false;
+        }
+        offset += n;
+    }
+    target->close();
+    insert(to, Entry{ 0, false, false, false, 0 });
+
+    return true;
+}
+
+bool OverlayFS::finishCopyUp(std::string const & path, Entry & entry)
+{
+    auto state = blocks(path, entry);
+    if ( state == nullptr )
+        return false;
+
+    auto & upper = _layers[0];
+    auto lowerFile = _layers[entry.source]->open(path, Perms::READ);
+    auto upperFile = upper->open(path, Perms::RW);
+    if ( lowerFile == nullptr || upperFile == nullptr )
+        return false;
+
+    {
+        // handles still open may write meanwhile, a block is only copied while nobody can
+        std::lock_guard<std::mutex> lk(state->mutex);
+        IFile::Buffer block(CopyUpFile::BLOCK_SIZE);
+        for ( std::size_t b = 0; b < state->copied.size(); ++b )
+        {
+            if ( state->copied[b] != 0 )
+                continue;
+
+            auto start = b * CopyUpFile::BLOCK_SIZE;
+            auto length = std::min<std::size_t>(CopyUpFile::BLOCK_SIZE, state->lowerSize - start);
+            auto n = lowerFile->read(block.data(), start, length);
+            if ( upperFile->write(block.data(), start, n) != n )
+                return false;
+            state->copied[b] = 1;
+        }
+        state->store = nullptr;
+        state->dirty = false;
+    }
+    upperFile->close();
+    lowerFile->close();
+
+    upper->remove(hidden(path, COPY_UP));
+    _partials.erase(path);
+    entry.partial = false;
+    entry.source = 0;
+
+    return true;
+}
+
+bool OverlayFS::removeLocked(std::string const & path)
+{
+    auto it = _index.find(path);
+    if ( it == _index.end() )
+        return false;
+
+    auto entry = it->second;
+    if ( entry.directory )
+    {
+        auto child = _index.lower_bound(path + '/');
+        if ( child != _index.end() && startsWith(child->first, path + '/') )
+            return false;
+    }
+
+    // a directory of a lower layer may be in the upper one too, made there for what was put in it
+    auto & upper = _layers[0];
+    if ( entry.directory ? std::string(upper->type(path)) == type::DIRECTORY : entry.layer == 0 )
+    {
+        if ( entry.directory )
+        {
+            // only whiteouts and copy-up state are left in it, deepest first
+            auto root = upper->path();
+            std::vector<std::string> leftovers;
+            for ( auto const & item : upper->list(path) )
+                leftovers.push_back(relative(item, root));
+            std::sort(leftovers.begin(), leftovers.end(), [] (std::string const & a, std::string const & b)
+            {
+                return a.size() > b.size();
+            });
+            for ( auto const & item : leftovers )
+                upper->remove(item);
+        }
+
+        if ( !upper->remove(path) )
+            return false;
+        if ( entry.partial )
+        {
+            upper->remove(hidden(path, COPY_UP));
+            _partials.erase(path);
+        }
+    }
+
+    erase(path);
+    if ( entry.below && ( !makeParents(path) || !upper->touchFile(hidden(path, WHITEOUT)) ) )
+        return false;
+
+    return true;
+}
+
+}
@@ -0,0 +1,169 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "vfs/PathHandle.h"
+
+#if defined(__linux__) && __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#include <sys/syscall.h>
+#define VFS_HAS_OPENAT2 1
+#else
+#define VFS_HAS_OPENAT2 0
+#endif
+
+namespace VFS {
+
+namespace {
+
+constexpr std::size_t SHARDS = 16;
+constexpr std::size_t MIN_SWEEP = 64;   // entries of a shard before the expired ones are first swept
+
+}
+
+PathHandle PathHandle::intern(std::string const & path)
+{
+    std::string normalized;
+    if ( !normalize(path, normalized) )
+        return {};
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::weak_ptr<Data const>> entries;
+        std::size_t sweepAt = MIN_SWEEP;
+    };
+    static Shard shards[SHARDS];
+
+    auto hash = std::hash<std::string>()(normalized);
+    auto & shard = shards[hash % SHARDS];
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    auto & slot = shard.entries[normalized];
+    if ( auto data = slot.lock() )
+        return PathHandle(data);
+
+    auto data = std::make_shared<Data const>(Data{ normalized, hash });
+    slot = data;
+
+    // the entries of handles all dropped go once the shard doubled since the last sweep
+    if ( shard.entries.size() >= shard.sweepAt )
+    {
+        for ( auto it = shard.entries.begin(); it != shard.entries.end(); )
+            it = it->second.expired() ? shard.entries.erase(it) : std::next(it);
+        shard.sweepAt = std::max(MIN_SWEEP, shard.entries.size() * 2);
+    }
+
+    return PathHandle(data);
+}
+
+int PathHandle::openBeneath(int dir, std::string const & path, int flags, unsigned mode)
+{
+#if VFS_HAS_OPENAT2
+    static std::atomic<bool> missing(false);
+    if ( !missing )
+    {
+        open_how how{};
+        how.flags = static_cast<std::uint64_t>(flags | O_CLOEXEC);
+        how.mode = ( flags & ( O_CREAT | O_TMPFILE ) ) != 0 ? mode : 0;
+        how.resolve = RESOLVE_BENEATH;
+        int fd = static_cast<int>(::syscall(SYS_openat2, dir, path.c_str(), &how, sizeof(how)));
+        if ( fd >= 0 || errno != ENOSYS )
+            return fd;
+        missing = true;
+    }
+#endif
+
+    // an interned path has no ".." left, only symbolic links could still lead out: the path is walked a part at a
+    // time and none may be one
+    if ( path.empty() || path.front() == '/' )
+    {
+        errno = EXDEV;
+        return -1;
+    }
+
+    int at = dir;
+    std::size_t begin = 0;
+    for ( auto slash = path.find('/'); slash != std::string::npos; slash = path.find('/', begin) )
+    {
+        int next = ::openat(at, path.substr(begin, slash - begin).c_str(), O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if ( at != dir )
+            ::close(at);
+        if ( next < 0 )
+            return -1;
+        at = next;
+        begin = slash + 1;
+    }
+
+    int fd = ::openat(at, path.c_str() + begin, flags | O_NOFOLLOW | O_CLOEXEC, mode);
+    if ( at != dir )
+    {
+        int error = errno;
+        ::close(at);
+        errno = error;
+    }
+
+    return fd;
+}
+
+std::string const & PathHandle::str() const
+{
+    static std::string const none;
+    return _data != nullptr ? _data->path : none;
+}
+
+bool PathHandle::contains(PathHandle const & other) const
+{
+    if ( _data == nullptr || other._data == nullptr )
+        return false;
+    if ( _data == other._data || _data->path == "." )
+        return true;
+
+    auto const & path = _data->path;
+    auto const & below = other._data->path;
+    return below.size() > path.size() && below[path.size()] == '/' && below.compare(0, path.size(), path) == 0;
+}
+
+bool PathHandle::normalize(std::string const & path, std::string & normalized)
+{
+    if ( path.empty() || path.front() == '/' )
+        return false;
+
+    std::vector<std::pair<std::size_t, std::size_t>> parts;
+    std::size_t begin = 0;
+    while ( begin <= path.size() )
+    {
+        auto end = path.find('/', begin);
+        if ( end == std::string::npos )
+            end = path.size();
+
+        auto length = end - begin;
+        if ( length == 2 && path.compare(begin, 2, "..") == 0 )
+        {
+            if ( parts.empty() )
+                return false;
+            parts.pop_back();
+        }
+        else if ( length != 0 && !( length == 1 && path[begin] == '.' ) )
+            parts.emplace_back(begin, length);
+
+        begin = end + 1;
+    }
+
+    normalized.clear();
+    for ( auto const & part : parts )
+    {
+        if ( !normalized.empty() )
+            normalized.push_back('/');
+        normalized.append(path, part.first, part.second);
+    }
+    if ( normalized.empty() )
+        normalized = ".";
+
+    return true;
+}
+
+}
@@ -0,0 +1,442 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "vfs/PathIndex.h"
+
+namespace VFS {
+
+namespace {
+
+bool sameTime(timespec const & a, timespec const & b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// the search index sees the paths the way FileSystem::search() returns them
+std::string searchKey(std::string const & relative)
+{
+    return "./" + relative;
+}
+
+}
+
+PathIndex::PathIndex()
+    : _root()
+      , _tree()
+      , _entries(0)
+      , _search()
+      , _mutex()
+{
+}
+
+PathIndex::~PathIndex() = default;
+
+void PathIndex::build(std::string const & root)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    _root = root;
+    _tree.reset(new Node);
+    _tree->directory = true;
+    _entries = 0;
+    _search.clear();
+
+    scanTree(*_tree, _root);
+}
+
+void PathIndex::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    _root.clear();
+    _tree.reset();
+    _entries = 0;
+    _search.clear();
+}
+
+bool PathIndex::contains(std::string const & relative)
+{
+    Components parts;
+    if ( !split(relative, parts) )
+        return false;
+
+    // concurrent lookups only read the tree, the lock is taken exclusively when a directory must be read again
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        if ( _tree == nullptr )
+            return false;
+
+        auto known = lookup(parts);
+        if ( known != Lookup::STALE )
+            return known == Lookup::FOUND;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    if ( _tree == nullptr )
+        return false;
+
+    // walk down to the parent, reading again the directories that miss a component
+    Node * node = _tree.get();
+    std::string absolute = _root;
+    std::size_t depth = 0;
+    for ( ; depth + 1 < parts.size(); ++depth )
+    {
+        auto it = node->children.find(parts[depth]);
+        if ( it == node->children.end() || !it->second->directory )
+        {
+            if ( !revalidate(*node, absolute) )
+                break;
+            it = node->children.find(parts[depth]);
+            if ( it == node->children.end() || !it->second->directory )
+                return false;
+        }
+
+        node = it->second.get();
+        absolute += parts[depth] + '/';
+    }
+
+    // the parent is checked against the disk, a single stat when nothing changed
+    if ( depth + 1 >= parts.size() && revalidate(*node, absolute) )
+        return parts.empty() || node->children.count(parts.back()) != 0;
+
+    // the directory at depth vanished
+    if ( depth == 0 )
+    {
+        _tree->children.clear();
+        _tree->scanned = false;
+        _entries = 0;
+        _search.clear();
+    }
+    else if ( auto parent = find(parts, depth - 1) )
+    {
+        auto it = parent->children.find(parts[depth - 1]);
+        if ( it != parent->children.end() )
+        {
+            _entries -= forget(*it->second, absolute.substr(_root.size(), absolute.size() - _root.size() - 1));
+            parent->children.erase(it);
+        }
+    }
+
+    return false;
+}
+
+void PathIndex::insert(std::string const & relative, bool directory)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( _tree == nullptr || !split(relative, parts) || parts.empty() )
+        return;
+
+    // a parent the index doesn't know yet is picked up when it is looked up
+    auto parent = find(parts, parts.size() - 1);
+    if ( parent == nullptr || !parent->directory )
+        return;
+
+    auto & child = parent->children[parts.back()];
+    if ( child == nullptr )
+    {
+        child.reset(new Node);
+        ++_entries;
+        _search.add(searchKey(join(parts)));
+    }
+    child->directory = directory;
+
+    refreshParent(parts);
+}
+
+void PathIndex::erase(std::string const & relative)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components parts;
+    if ( _tree == nullptr || !split(relative, parts) || parts.empty() )
+        return;
+
+    auto parent = find(parts, parts.size() - 1);
+    if ( parent == nullptr )
+        return;
+
+    auto it = parent->children.find(parts.back());
+    if ( it != parent->children.end() )
+    {
+        _entries -= forget(*it->second, join(parts));
+        parent->children.erase(it);
+    }
+
+    refreshParent(parts);
+}
+
+void PathIndex::move(std::string const & from, std::string const & to)
+{
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    Components fromParts;
+    Components toParts;
+    if ( _tree == nullptr || !split(from, fromParts) || !split(to, toParts) || fromParts.empty() || toParts.empty() )
+        return;
+
+    auto fromParent = find(fromParts, fromParts.size() - 1);
+    if ( fromParent == nullptr )
+        return;
+
+    auto it = fromParent->children.find(fromParts.back());
+    if ( it == fromParent->children.end() )
+        return;
+
+    auto node = std::move(it->second);
+    fromParent->children.erase(it);
+    refreshParent(fromParts);
+    _entries -= forget(*node, join(fromParts));
+
+    auto toParent = find(toParts, toParts.size() - 1);
+    if ( toParent == nullptr || !toParent->directory )
+        return;
+
+    auto & slot = toParent->children[toParts.back()];
+    if ( slot != nullptr )
+        _entries -= forget(*slot, join(toParts));
+    slot = std::move(node);
+    _entries += remember(*slot, join(toParts));
+    refreshParent(toParts);
+}
+
+void PathIndex::forEach(std::function<bool(std::string const & relative)> const & visit) const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    if ( _tree == nullptr )
+        return;
+
+    std::function<bool(Node const &, std::string const &)> walk = [&] (Node const & node, std::string const & prefix)
+    {
+        for ( auto const & child : node.children )
+        {
+            auto path = prefix + child.first;
+            if ( !visit(path) )
+                return false;
+            if ( child.second->directory && !walk(*child.second, path + '/') )
+                return false;
+        }
+        return true;
+    };
+    walk(*_tree, "");
+}
+
+std::size_t PathIndex::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _entries;
+}
+
+SearchIndex::EntryList PathIndex::find(std::string const & pattern, std::size_t offset, std::size_t limit) const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _search.find(pattern, offset, limit);
+}
+
+SearchIndex::EntryList PathIndex::findPrefix(std::string const & prefix, std::size_t offset, std::size_t limit) const
+{
+    std::shared_lock<std::shared_mutex> lock(_mutex);
+    return _search.findPrefix(prefix.compare(0, 2, "./") == 0 ? prefix : searchKey(prefix), offset, limit);
+}
+
+bool PathIndex::split(std::string const & relative, Components & parts)
+{
+    if ( !relative.empty() && relative.front() == '/' )
+        return false;
+
+    std::size_t begin = 0;
+    while ( begin <= relative.size() )
+    {
+        auto end = relative.find('/', begin);
+        if ( end == std::string::npos )
+            end = relative.size();
+
+        auto part = relative.substr(begin, end - begin);
+        if ( part == ".." )
+            return false;
+        if ( !part.empty() && part != "." )
+            parts.emplace_back(std::move(part));
+
+        begin = end + 1;
+    }
+
+    return true;
+}
+
+PathIndex::Lookup PathIndex::lookup(Components const & parts) const
+{
+    auto fresh = [] (Node const & node, std::string const & absolute)
+    {
+        struct stat st;
+        return node.scanned && ::stat(absolute.c_str(), &st) == 0 && S_ISDIR(st.st_mode)
+            && st.st_ino == node.inode && sameTime(st.st_mtim, node.mtime);
+    };
+
+    Node const * node = _tree.get();
+    std::string absolute = _root;
+    for ( std::size_t depth = 0; depth + 1 < parts.size(); ++depth )
+    {
+        auto it = node->children.find(parts[depth]);
+        if ( it == node->children.end() || !it->second->directory )
+            return fresh(*node, absolute) ? Lookup::MISSING : Lookup::STALE;
+
+        node = it->second.get();
+        absolute += parts[depth] + '/';
+    }
+
+    if ( !fresh(*node, absolute) )
+        return Lookup::STALE;
+
+    return parts.empty() || node->children.count(parts.back()) != 0 ? Lookup::FOUND : Lookup::MISSING;
+}
+
+bool PathIndex::scan(Node & node, std::string const & absolute)
+{
+    DIR * dir = ::opendir(absolute.c_str());
+    if ( dir == nullptr )
+        return false;
+
+    // stat before reading, a change during the read is seen by the next revalidation
+    struct stat st;
+    if ( ::fstat(::dirfd(dir), &st) != 0 )
+    {
+        ::closedir(dir);
+        return false;
+    }
+
+    auto relative = absolute.substr(_root.size());
+    decltype(node.children) children;
+    std::vector<std::string> added;
+    while ( auto entry = ::readdir(dir) )
+    {
+        std::string name = entry->d_name;
+        if ( name == "." || name == ".." )
+            continue;
+
+        bool directory = entry->d_type == DT_DIR;
+        if ( entry->d_type == DT_UNKNOWN )
+        {
+            struct stat child;
+            directory = ::fstatat(::dirfd(dir), entry->d_name, &child, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(child.st_mode);
+        }
+
+        auto it = node.children.find(name);
+        if ( it != node.children.end() && it->second->directory == directory )
+        {
+            children.emplace(name, std::move(it->second));
+            node.children.erase(it);
+            continue;
+        }
+
+        std::unique_ptr<Node> child(new Node);
+        child->directory = directory;
+        children.emplace(name, std::move(child));
+        added.emplace_back(std::move(name));
+        ++_entries;
+    }
+    ::closedir(dir);
+
+    // a name that changed type is forgotten with its old subtree before it is added again
+    for ( auto const & gone : node.children )
+        _entries -= forget(*gone.second, relative + gone.first);
+    for ( auto const & name : added )
+        _search.add(searchKey(relative + name));
+
+    node.children = std::move(children);
+    node.scanned = true;
+    node.inode = st.st_ino;
+    node.mtime = st.st_mtim;
+
+    return true;
+}
+
+bool PathIndex::revalidate(Node & node, std::string const & absolute)
+{
+    if ( !node.scanned )
+        return scan(node, absolute);
+
+    struct stat st;
+    if ( ::stat(absolute.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) )
+        return false;
+
+    if ( st.st_ino != node.inode || !sameTime(st.st_mtim, node.mtime) )
+        return scan(node, absolute);
+
+    return true;
+}
+
+void PathIndex::scanTree(Node & node, std::string const & absolute)
+{
+    if ( !scan(node, absolute) )
+        return;
+
+    for ( auto & child : node.children )
+    {
+        if ( child.second->directory )
+            scanTree(*child.second, absolute + child.first + '/');
+    }
+}
+
+PathIndex::Node * PathIndex::find(Components const & parts, std::size_t count) const
+{
+    Node * node = _tree.get();
+    for ( std::size_t i = 0; node != nullptr && i < count; ++i )
+    {
+        auto it = node->children.find(parts[i]);
+        node = it != node->children.end() ? it->second.get() : nullptr;
+    }
+
+    return node;
+}
+
+void PathIndex::refreshParent(Components const & parts)
+{
+    // the change made through the index itself must not make the parent look stale
+    auto parent = find(parts, parts.size() - 1);
+    if ( parent == nullptr || !parent->scanned )
+        return;
+
+    std::string absolute = _root;
+    for ( std::size_t i = 0; i + 1 < parts.size(); ++i )
+        absolute += parts[i] + '/';
+
+    struct stat st;
+    if ( ::stat(absolute.c_str(), &st) == 0 )
+    {
+        parent->inode = st.st_ino;
+        parent->mtime = st.st_mtim;
+    }
+}
+
+std::string PathIndex::join(Components const & parts)
+{
+    std::string relative;
+    for ( auto const & part : parts )
+    {
+        if ( !relative.empty() )
+            relative += '/';
+        relative += part;
+    }
+
+    return relative;
+}
+
+std::size_t PathIndex::forget(Node const & node, std::string const & relative)
+{
+    _search.remove(searchKey(relative));
+
+    std::size_t total = 1;
+    for ( auto const & child : node.children )
+        total += forget(*child.second, relative + '/' + child.first);
+
+    return total;
+}
+
+std::size_t PathIndex::remember(Node const & node, std::string const & relative)
+{
+    _search.add(searchKey(relative));
+
+    std::size_t total = 1;
+    for ( auto const & child : node.children )
+        total += remember(*child.second, relative + '/' + child.first);
+
+    return total;
+}
+
+}
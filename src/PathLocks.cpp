@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <functional>
+#include "vfs/PathIndex.h"
+#include "vfs/PathLocks.h"
+
+namespace VFS {
+
+PathLocks::Guard & PathLocks::Guard::operator=(Guard && other) noexcept
+{
+    if ( this != &other )
+    {
+        unlock();
+        _held = std::move(other._held);
+        other._held.clear();
+    }
+
+    return *this;
+}
+
+void PathLocks::Guard::unlock()
+{
+    for ( auto it = _held.rbegin(); it != _held.rend(); ++it )
+    {
+        if ( it->second )
+            it->first->unlock();
+        else
+            it->first->unlock_shared();
+    }
+    _held.clear();
+}
+
+PathLocks::PathLocks(std::size_t stripes)
+    : _stripes()
+      , _mask(0)
+{
+    std::size_t count = 1;
+    while ( count < stripes )
+        count <<= 1;
+
+    _stripes.reset(new std::shared_mutex[count]);
+    _mask = count - 1;
+}
+
+PathLocks::~PathLocks() = default;
+
+PathLocks::Guard PathLocks::lock(std::string const & path)
+{
+    Request request;
+    add(request, path);
+
+    return acquire(request);
+}
+
+PathLocks::Guard PathLocks::lock(std::string const & first, std::string const & second)
+{
+    Request request;
+    add(request, first);
+    add(request, second);
+
+    return acquire(request);
+}
+
+void PathLocks::add(Request & request, std::string const & path) const
+{
+    // the same path always hashes the same, whatever way it was written
+    PathIndex::Components parts;
+    PathIndex::split(path, parts);
+
+    std::string prefix;
+    std::hash<std::string> hash;
+    request.emplace_back(hash(prefix) & _mask, parts.empty());
+    for ( std::size_t i = 0; i < parts.size(); ++i )
+    {
+        prefix += '/' + parts[i];
+        request.emplace_back(hash(prefix) & _mask, i + 1 == parts.size());
+    }
+}
+
+PathLocks::Guard PathLocks::acquire(Request & request)
+{
+    // one lock per stripe, exclusive if any path wants it so, in increasing order
+    std::sort(request.begin(), request.end(), [] (std::pair<std::size_t, bool> const & a, std::pair<std::size_t, bool> const & b)
+    {
+        return a.first < b.first || ( a.first == b.first && a.second > b.second );
+    });
+
+    Guard guard;
+    for ( std::size_t i = 0; i < request.size(); ++i )
+    {
+        if ( i != 0 && request[i].first == request[i - 1].first )
+            continue;
+
+        auto & stripe = _stripes[request[i].first];
+        if ( request[i].second )
+            stripe.lock();
+        else
+            stripe.lock_shared();
+        guard._held.emplace_back(&stripe, request[i].second);
+    }
+
+    return guard;
+}
+
+}
@@ -1,4 +1,15 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <thread>
 #include "vfs/RegularFile.h"
+#include "vfs/GroupCommit.h"
+#include "vfs/IoEngine.h"
 #include "vfs/IFS.h"
 #include "vfs/IFile.h"
 
@@ -6,19 +17,155 @@ namespace VFS {
 
 namespace fs = std::filesystem;
 
-RegularFile::RegularFile(std::string const & filename)
+namespace {
+
+// Reads of one stream may reach the file a little out of order when several threads serve it.
+constexpr std::size_t streamSlack = 128 * 1024;
+
+// Reads in a row that make a stream, and the data behind it dropped at once with dropBehind.
+constexpr std::size_t streamStreak = 2;
+constexpr std::size_t dropChunk = 1024 * 1024;
+
+// Marks the descriptor as in use for the lifetime of the guard, close() waits until no guard is left.
+class InflightGuard
+{
+public:
+    explicit InflightGuard(std::atomic<std::size_t> & counter) : _counter(counter) { ++_counter; }
+    ~InflightGuard() { --_counter; }
+    DISABLE_COPY(InflightGuard);
+
+private:
+    std::atomic<std::size_t> & _counter;
+};
+
+// Positions of the ranges sorted by offset, ranges at the same offset keep their order.
+template<typename RangeT>
+std::vector<std::size_t> byOffset(std::vector<RangeT> const & ranges)
+{
+    std::vector<std::size_t> order(ranges.size());
+    for ( std::size_t i = 0; i < order.size(); ++i )
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&ranges] (std::size_t a, std::size_t b)
+    {
+        return ranges[a].offset < ranges[b].offset;
+    });
+
+    return order;
+}
+
+// Run preadv or pwritev until every buffer is transferred or the file ends, IOV_MAX buffers per call.
+template<typename Call>
+std::size_t vectored(Call call, iovec * iov, std::size_t count, std::size_t offset)
+{
+    std::size_t total = 0;
+    while ( count > 0 )
+    {
+        auto n = call(iov, static_cast<int>(std::min<std::size_t>(count, IOV_MAX)), static_cast<off_t>(offset));
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            break;
+        total += n;
+        offset += n;
+
+        // drop the buffers done, shorten the one the call stopped in
+        std::size_t left = n;
+        while ( count > 0 && left >= iov->iov_len )
+        {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if ( count > 0 )
+        {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+
+    return total;
+}
+
+}
+
+RegularFile::RegularFile(std::string const & filename, std::shared_ptr<BlockCache> cache)
     : _filename(filename)
-      , _file(_filename, std::ios::in | std::ios::out | std::ios::app)
+      , _handle()
+      , _fd(::open(_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644))
       , _access(false)
-      , _perms()
-      , _writing(false)
+      , _perms(fs::perms::none)
+      , _inflight(0)
+      , _readPos(0)
+      , _appendEnd(0)
+      , _ranges()
+      , _cache(std::move(cache))
+      , _id()
       , _mutex()
       , _cv()
+      , _behindLimit(0)
+      , _behindDelay(DEFAULT_WRITE_BEHIND_DELAY)
+      , _dirty()
+      , _dirtyBytes(0)
+      , _dirtyEnd(0)
+      , _behindError(0)
+      , _flushTimer(0)
+      , _behindMutex()
+      , _lockStats()
+      , _timedLocks(nullptr)
+      , _aheadLimit(DEFAULT_READ_AHEAD)
+      , _dropBehind(false)
+      , _stream()
+      , _aheadMutex()
 {
-    if ( fs::exists(_filename) && _file.is_open() )
+    if ( _fd < 0 )
+        _fd = ::open(_filename.c_str(), O_RDONLY | O_CLOEXEC);
+
+    struct stat st;
+    if ( _fd >= 0 && ::fstat(_fd, &st) == 0 )
     {
         _access = true;
-        _perms = fs::status(_filename).permissions();
+        _perms = static_cast<fs::perms>(st.st_mode & 07777);
+        _id = { static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino) };
+    }
+    else
+    {
+        _cache = nullptr;
+    }
+}
+
+RegularFile::RegularFile(std::string const & filename, HandleTable::HandlePtr handle, std::shared_ptr<BlockCache> cache)
+    : _filename(filename)
+      , _handle(std::move(handle))
+      , _fd(_handle != nullptr ? _handle->fd() : -1)
+      , _access(_fd >= 0)
+      , _perms(fs::perms::none)
+      , _inflight(0)
+      , _readPos(0)
+      , _appendEnd(0)
+      , _ranges()
+      , _cache(_fd >= 0 ? std::move(cache) : nullptr)
+      , _id()
+      , _mutex()
+      , _cv()
+      , _behindLimit(0)
+      , _behindDelay(DEFAULT_WRITE_BEHIND_DELAY)
+      , _dirty()
+      , _dirtyBytes(0)
+      , _dirtyEnd(0)
+      , _behindError(0)
+      , _flushTimer(0)
+      , _behindMutex()
+      , _lockStats()
+      , _timedLocks(nullptr)
+      , _aheadLimit(DEFAULT_READ_AHEAD)
+      , _dropBehind(false)
+      , _stream()
+      , _aheadMutex()
+{
+    if ( _handle != nullptr )
+    {
+        _perms = static_cast<fs::perms>(_handle->mode() & 07777);
+        _id = _handle->id();
     }
 }
 
@@ -30,90 +177,358 @@ RegularFile::~RegularFile()
 
 std::size_t RegularFile::write(IFile::Buffer const & buf, std::size_t size)
 {
-    return write(buf, 0, size);
+    InflightGuard guard(_inflight);
+    if ( !canWrite() )
+        return 0;
+
+    size = std::min(size, buf.size());
+    if ( _behindLimit != 0 )
+        return writeBehind(buf.data(), 0, size, true);
+
+    auto offset = lockRange(0, size, true, Metrics::Op::WRITE);
+    auto n = pwriteAll(buf.data(), offset, size);
+    invalidate(offset, size);
+    unlockRange(offset, size);
+
+    return n;
 }
 
 std::size_t RegularFile::write(Buffer const & buf, std::size_t offset, std::size_t size)
 {
-    std::unique_lock<std::mutex> lk(_mutex);
-    if ( !_access || ( _perms & fs::perms::owner_write ) == fs::perms::none )
-        return 0;
-
-    _writing = true;
-    _cv.wait(lk, [this] () { return _writing; });
+    return write(buf.data(), offset, std::min(size, buf.size()));
+}
 
-    if ( offset > 0 )
-        _file.seekp(offset, std::ios::beg);
-    auto beginPos = _file.tellp();
-    auto getPos = _file.tellg();
-    _file.write(buf.data(), size);
-    if ( _file.fail() )
+std::size_t RegularFile::write(DataT const * src, std::size_t offset, std::size_t size)
+{
+    InflightGuard guard(_inflight);
+    if ( !canWrite() )
         return 0;
-    auto endPos = _file.tellp();
-    _file.seekg(getPos, std::ios::beg);
-    if ( offset > 0 )
-        _file.seekp(0, std::ios::end);
+    if ( _behindLimit != 0 )
+        return writeBehind(src, offset, size, false);
 
-    _writing = false;
-    lk.unlock();
-    _cv.notify_one();
+    lockRange(offset, size, false, Metrics::Op::WRITE);
+    auto n = pwriteAll(src, offset, size);
+    invalidate(offset, size);
+    unlockRange(offset, size);
 
-    return endPos - beginPos;
+    return n;
 }
 
 RegularFile::Buffer RegularFile::read(std::size_t size)
 {
-    return read(0, size);
+    InflightGuard guard(_inflight);
+    if ( !canRead() )
+        return {};
+
+    // the cursor is the only state shared by sequential reads
+    flush();
+    LockStats::Guard<std::unique_lock<std::mutex>> lk(_timedLocks, Metrics::Op::READ, _mutex);
+    auto totalSize = this->size();
+    if ( _readPos >= totalSize )
+        return {};
+
+    Buffer buf(std::min(size, totalSize - _readPos));
+    buf.resize(readAt(buf.data(), _readPos, buf.size()));
+    readAhead(_readPos, buf.size());
+    _readPos += buf.size();
+
+    return buf;
 }
 
 RegularFile::Buffer RegularFile::readAll()
 {
-    std::size_t totalSize = 0;
-    {
-        std::lock_guard<std::mutex> lk(_mutex);
-        totalSize = size();
-    }
-
-    return read(0, totalSize);
+    return read(0, size());
 }
 
 RegularFile::Buffer RegularFile::read(std::size_t offset, std::size_t size)
 {
-    std::unique_lock<std::mutex> lk(_mutex);
-    if ( !_access || ( _perms & fs::perms::owner_read ) == fs::perms::none )
+    InflightGuard guard(_inflight);
+    if ( !canRead() )
         return {};
 
-    auto totalSize= this->size();
+    auto totalSize = this->size();
     if ( offset > totalSize )
         return {};
 
-    auto validSize = ( size < totalSize ? size : totalSize );
+    Buffer buf(std::min(size, totalSize - offset));
+    buf.resize(read(buf.data(), offset, buf.size()));
+
+    return buf;
+}
+
+std::size_t RegularFile::read(DataT * dst, std::size_t offset, std::size_t size)
+{
+    InflightGuard guard(_inflight);
+    if ( !canRead() )
+        return 0;
+
+    // pread stops at the end of the file by itself, no need to stat first
+    flush(offset, size);
+    auto n = readAt(dst, offset, size);
+    if ( n < size && _dirtyEnd > offset + n )
+    {
+        // the range ends in a hole before data that is still buffered
+        flush();
+        n = readAt(dst, offset, size);
+    }
+    readAhead(offset, n);
 
-    _cv.wait(lk, [this] () { return !_writing; });
+    return n;
+}
 
-    if ( offset > 0 )
-        _file.seekg(offset, std::ios::beg);
-    Buffer buf(validSize, '.');
-    _file.read(buf.data(), validSize);
+std::size_t RegularFile::readBatch(std::vector<ReadRange> & ranges)
+{
+    InflightGuard guard(_inflight);
+    for ( auto & range : ranges )
+        range.read = 0;
+    if ( !canRead() )
+        return 0;
+    flush();
 
-    lk.unlock();
+    std::size_t total = 0;
+    if ( _cache != nullptr )
+    {
+        // cached blocks are copies, only the missing ones reach the file
+        for ( auto & range : ranges )
+        {
+            range.read = readCached(range.dst, range.offset, range.size);
+            total += range.read;
+        }
+        return total;
+    }
 
-    if ( _file.fail() )
-        return {};
+    // ranges that follow each other in the file are read by one preadv
+    auto order = byOffset(ranges);
+    std::vector<iovec> iov;
+    for ( std::size_t first = 0; first < order.size(); )
+    {
+        auto start = ranges[order[first]].offset;
+        auto end = start;
+        auto last = first;
+        iov.clear();
+        for ( ; last < order.size() && ranges[order[last]].offset == end; ++last )
+        {
+            auto & range = ranges[order[last]];
+            iov.push_back({ range.dst, range.size });
+            end += range.size;
+        }
 
-    return buf;
+        int fd = _fd;
+        auto n = vectored([fd] (iovec * v, int count, off_t at) { return ::preadv(fd, v, count, at); }, iov.data(), iov.size(), start);
+        for ( auto i = first; i < last; ++i )
+        {
+            auto & range = ranges[order[i]];
+            range.read = std::min(range.size, n);
+            n -= range.read;
+            total += range.read;
+        }
+        first = last;
+    }
+
+    return total;
 }
 
-void RegularFile::close()
+std::size_t RegularFile::writeBatch(std::vector<WriteRange> & ranges)
 {
-    std::lock_guard<std::mutex> lk(_mutex);
+    InflightGuard guard(_inflight);
+    for ( auto & range : ranges )
+        range.written = 0;
+    if ( !canWrite() )
+        return 0;
+    flush();
+
+    return writeRanges(ranges);
+}
+
+std::size_t RegularFile::writeRanges(std::vector<WriteRange> & ranges)
+{
+    // group the ranges that follow each other, one pwritev and one claimed range per group
+    auto order = byOffset(ranges);
+    std::vector<std::pair<std::size_t, std::size_t>> groups;     // [first, last) in order
+    std::vector<Range> claimed;
+    for ( std::size_t first = 0; first < order.size(); )
+    {
+        auto start = ranges[order[first]].offset;
+        auto end = start;
+        auto last = first;
+        for ( ; last < order.size() && ranges[order[last]].offset == end; ++last )
+            end += ranges[order[last]].size;
+
+        groups.emplace_back(first, last);
+        claimed.emplace_back(start, end);
+        first = last;
+    }
+    lockRanges(claimed, Metrics::Op::WRITE_BATCH);
+
+    std::size_t total = 0;
+    std::vector<iovec> iov;
+    for ( std::size_t g = 0; g < groups.size(); ++g )
+    {
+        iov.clear();
+        for ( auto i = groups[g].first; i < groups[g].second; ++i )
+            iov.push_back({ const_cast<DataT *>(ranges[order[i]].src), ranges[order[i]].size });
+
+        int fd = _fd;
+        auto n = vectored([fd] (iovec * v, int count, off_t at) { return ::pwritev(fd, v, count, at); }, iov.data(), iov.size(), claimed[g].first);
+        for ( auto i = groups[g].first; i < groups[g].second; ++i )
+        {
+            auto & range = ranges[order[i]];
+            range.written = std::min(range.size, n);
+            n -= range.written;
+            total += range.written;
+        }
+        invalidate(claimed[g].first, claimed[g].second - claimed[g].first);
+    }
+    unlockRanges(claimed);
+
+    return total;
+}
+
+void RegularFile::readAsync(DataT * dst, std::size_t offset, std::size_t size, Completion done)
+{
+    // the request keeps the descriptor open until it completes
+    ++_inflight;
+    if ( !canRead() )
+    {
+        --_inflight;
+        done(-EBADF);
+        return;
+    }
+    flush();
+
+    IoEngine::global()->read(_fd, dst, size, offset, [this, done = std::move(done)] (long result)
+    {
+        --_inflight;
+        done(result);
+    });
+}
+
+void RegularFile::writeAsync(DataT const * src, std::size_t offset, std::size_t size, Completion done)
+{
+    ++_inflight;
+    if ( !canWrite() )
+    {
+        --_inflight;
+        done(-EBADF);
+        return;
+    }
+    flush();
+
+    lockRange(offset, size, false, Metrics::Op::WRITE_ASYNC);
+    IoEngine::global()->write(_fd, src, size, offset, [this, offset, size, done = std::move(done)] (long result)
+    {
+        invalidate(offset, size);
+        unlockRange(offset, size);
+        --_inflight;
+        done(result);
+    });
+}
+
+void RegularFile::fsyncAsync(Completion done)
+{
+    ++_inflight;
     if ( !_access )
+    {
+        --_inflight;
+        done(-EBADF);
         return;
+    }
+    flush();
 
-    _file.flush();
-    _file.close();
+    IoEngine::global()->fsync(_fd, false, [this, done = std::move(done)] (long result)
+    {
+        --_inflight;
+        done(result);
+    });
+}
 
-    _access = false;
+long RegularFile::sync()
+{
+    return syncAll(false);
+}
+
+long RegularFile::datasync()
+{
+    return syncAll(true);
+}
+
+void RegularFile::setWriteBehind(std::size_t limit, std::chrono::milliseconds delay)
+{
+    std::uint64_t timer = 0;
+    {
+        std::lock_guard<std::mutex> lk(_behindMutex);
+        _behindLimit = limit;
+        _behindDelay = delay;
+        timer = _flushTimer;
+    }
+
+    // the task may be waiting for _behindMutex, it can't be cancelled with the lock held
+    if ( timer != 0 )
+        GroupCommit::global()->cancel(timer);
+
+    std::lock_guard<std::mutex> lk(_behindMutex);
+    if ( _flushTimer == timer )
+        _flushTimer = 0;
+    if ( limit == 0 )
+        flushLocked();
+    else if ( !_dirty.empty() )
+        scheduleFlush();
+}
+
+void RegularFile::setLockStats(bool enabled)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    if ( enabled && _lockStats == nullptr )
+        _lockStats = std::make_shared<LockStats>();
+    _timedLocks = enabled ? _lockStats.get() : nullptr;
+}
+
+std::shared_ptr<LockStats> RegularFile::lockStats()
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    return _lockStats;
+}
+
+void RegularFile::setReadAhead(std::size_t maxWindow, bool dropBehind)
+{
+    std::lock_guard<std::mutex> lk(_aheadMutex);
+    _aheadLimit = maxWindow;
+    _dropBehind = dropBehind;
+    _stream.window = std::min(_stream.window, maxWindow);
+}
+
+RegularFile::ReadAheadStats RegularFile::readAheadStats() const
+{
+    std::lock_guard<std::mutex> lk(_aheadMutex);
+    auto stats = _stream.stats;
+    stats.window = _stream.window;
+
+    return stats;
+}
+
+void RegularFile::close()
+{
+    if ( _behindLimit != 0 )
+        setWriteBehind(0);
+
+    {
+        std::unique_lock<std::mutex> lk(_mutex);
+        if ( _fd < 0 )
+            return;
+
+        _access = false;
+        _cv.wait(lk, [this] () { return _ranges.empty(); });
+    }
+
+    // calls that saw _access before it was cleared may still use the descriptor
+    while ( _inflight.load() != 0 )
+        std::this_thread::yield();
+
+    auto fd = _fd.exchange(-1);
+    if ( fd >= 0 && _handle == nullptr )
+        ::close(fd);
+    else if ( fd >= 0 )
+        _handle = nullptr;  // other files may still share the descriptor
 }
 
 FileInfo RegularFile::info() const
@@ -129,7 +544,15 @@ FileInfo RegularFile::info() const
 
 std::size_t RegularFile::size() const
 {
-    return fs::file_size(_filename);
+    // like read and write, the descriptor is only used while close() waits for the call
+    InflightGuard guard(_inflight);
+    struct stat st;
+    if ( _access && ::fstat(_fd, &st) == 0 )
+        return std::max<std::size_t>(st.st_size, _dirtyEnd);
+
+    std::error_code ec;
+    auto size = fs::file_size(_filename, ec);
+    return ec ? 0 : size;
 }
 
 std::string RegularFile::filename() const
@@ -141,9 +564,10 @@ FileInfo::PermisionsT RegularFile::permision() const
 {
     bool read = false;
     bool write = false;
-    if ( ( _perms & fs::perms::owner_read ) == fs::perms::none )
+    fs::perms perms = _perms;
+    if ( ( perms & fs::perms::owner_read ) == fs::perms::none )
         read = true;
-    if ( ( _perms & fs::perms::owner_write ) == fs::perms::none )
+    if ( ( perms & fs::perms::owner_write ) == fs::perms::none )
         write = true;
 
     if ( read && write )
@@ -157,34 +581,516 @@ FileInfo::PermisionsT RegularFile::permision() const
 
 void RegularFile::setPermision(Perms perms)
 {
+    fs::perms current = _perms;
     if ( perms == Perms::READ )
-        _perms |= fs::perms::owner_read | fs::perms::others_read | fs::perms::group_read;
+        current |= fs::perms::owner_read | fs::perms::others_read | fs::perms::group_read;
     else if ( perms == Perms::WRITE )
-        _perms |= fs::perms::owner_write;
+        current |= fs::perms::owner_write;
     else
-        _perms |= fs::perms::owner_write | fs::perms::owner_read | fs::perms::others_read | fs::perms::group_read;
+        current |= fs::perms::owner_write | fs::perms::owner_read | fs::perms::others_read | fs::perms::group_read;
 
-    fs::permissions( _filename, _perms );
-    _access = true;
+    _perms = current;
+    fs::permissions( _filename, current );
+    _access = _fd >= 0;
 }
 
 void RegularFile::disableWrite()
 {
     // currentPermissions & ~fs::perms::owner_write & ~fs::perms::group_write & ~fs::perms::others_write
-    _perms = ( _perms & ~fs::perms::owner_write );
+    fs::perms current = _perms;
+    _perms = ( current & ~fs::perms::owner_write );
     fs::permissions( _filename, _perms );
 }
 
 void RegularFile::disableRead()
 {
-    _perms = ( _perms & ~fs::perms::owner_read );
+    fs::perms current = _perms;
+    _perms = ( current & ~fs::perms::owner_read );
     fs::permissions( _filename, _perms );
 }
 
 void RegularFile::disableAll()
 {
-    std::lock_guard<std::mutex> lk(_mutex);
     _access = false;
 };
 
+bool RegularFile::canRead() const
+{
+    return _access && ( _perms.load() & fs::perms::owner_read ) != fs::perms::none;
+}
+
+bool RegularFile::canWrite() const
+{
+    return _access && ( _perms.load() & fs::perms::owner_write ) != fs::perms::none;
+}
+
+std::size_t RegularFile::readAt(DataT * dst, std::size_t offset, std::size_t size) const
+{
+    return _cache != nullptr ? readCached(dst, offset, size) : preadAll(dst, offset, size);
+}
+
+std::size_t RegularFile::readCached(DataT * dst, std::size_t offset, std::size_t size) const
+{
+    auto blockSize = _cache->blockSize();
+    std::size_t done = 0;
+    while ( done < size )
+    {
+        auto pos = offset + done;
+        auto block = pos / blockSize;
+        auto inBlock = pos % blockSize;
+        auto want = std::min(blockSize - inBlock, size - done);
+
+        std::size_t copied = 0;
+        if ( _cache->read(_id, block, inBlock, dst + done, want, copied) )
+        {
+            if ( copied == want )
+            {
+                done += copied;
+                continue;
+            }
+
+            // the cached block was the last one of the file, a write past the end since then left it as it was and
+            // it is read again unless it still ends the file
+            struct stat st;
+            if ( ::fstat(_fd, &st) == 0 && static_cast<std::size_t>(st.st_size) <= pos + copied )
+            {
+                done += copied;
+                break;
+            }
+            _cache->invalidate(_id, block, block);
+        }
+
+        // read the run of missing blocks the request still covers with one pread
+        constexpr std::size_t maxRun = 64;
+        auto lastBlock = ( offset + size - 1 ) / blockSize;
+        auto runEnd = block + 1;
+        while ( runEnd <= lastBlock && runEnd - block < maxRun && !_cache->contains(_id, runEnd) )
+            ++runEnd;
+
+        std::vector<std::uint64_t> epochs;
+        epochs.reserve(runEnd - block);
+        for ( auto b = block; b < runEnd; ++b )
+            epochs.push_back(_cache->epoch(_id, b));
+
+        thread_local Buffer scratch;
+        auto runSize = ( runEnd - block ) * blockSize;
+        if ( scratch.size() < runSize )
+            scratch.resize(runSize);
+        auto got = preadAll(scratch.data(), block * blockSize, runSize);
+
+        for ( auto b = block; b < runEnd && ( b - block ) * blockSize < got; ++b )
+        {
+            auto begin = ( b - block ) * blockSize;
+            _cache->insert(_id, b, scratch.data() + begin, std::min(blockSize, got - begin), epochs[b - block]);
+        }
+
+        auto available = got > inBlock ? std::min(got - inBlock, size - done) : 0;
+        std::memcpy(dst + done, scratch.data() + inBlock, available);
+        done += available;
+        if ( got < runSize )
+            break;  // end of file
+    }
+
+    return done;
+}
+
+void RegularFile::readAhead(std::size_t offset, std::size_t n)
+{
+    std::size_t limit = _aheadLimit;
+    if ( limit == 0 || n == 0 )
+        return;
+
+    std::size_t from = 0;
+    std::size_t to = 0;
+    std::size_t dropFrom = 0;
+    std::size_t dropTo = 0;
+    int pattern = -1;
+    {
+        std::lock_guard<std::mutex> lk(_aheadMutex);
+        auto & stream = _stream;
+        bool continues = offset <= stream.next + streamSlack && offset + streamSlack >= stream.next;
+        if ( !continues || stream.streak == 0 )
+        {
+            // a seek, whatever was read ahead is of no use to the reads from here on
+            if ( stream.window != 0 )
+                pattern = POSIX_FADV_NORMAL;
+            ++stream.stats.random;
+            stream = { offset + n, 1, 0, 0, 0, offset, stream.stats };
+        }
+        else
+        {
+            ++stream.stats.sequential;
+            ++stream.streak;
+            stream.next = std::max(stream.next, offset + n);
+            if ( stream.streak >= streamStreak && stream.window == 0 )
+            {
+                stream.window = std::min(READ_AHEAD_START, limit);
+                stream.end = stream.next;
+                stream.trigger = stream.next;
+                pattern = POSIX_FADV_SEQUENTIAL;
+                ++stream.stats.windows;
+            }
+            else if ( stream.window != 0 && stream.next >= stream.trigger )
+            {
+                // the reads caught up with the window, it was worth it
+                stream.window = std::min(stream.window * 2, limit);
+            }
+
+            if ( stream.window != 0 && stream.next >= stream.trigger )
+            {
+                from = std::max(stream.end, stream.next);
+                to = stream.next + stream.window;
+                stream.end = to;
+                stream.trigger = stream.next + stream.window / 2;
+            }
+
+            if ( _dropBehind && offset >= stream.dropped + dropChunk )
+            {
+                dropFrom = stream.dropped;
+                dropTo = offset;
+                stream.dropped = offset;
+            }
+        }
+    }
+
+    if ( pattern >= 0 )
+        advise(0, 0, pattern);
+    if ( dropTo > dropFrom )
+        advise(dropFrom, dropTo - dropFrom, POSIX_FADV_DONTNEED);
+    if ( to <= from )
+        return;
+
+    auto fileSize = size();
+    to = std::min(to, fileSize);
+    if ( to <= from )
+        return;
+
+    if ( _cache != nullptr )
+        prefetch(from, to - from);
+    else
+        advise(from, to - from, POSIX_FADV_WILLNEED);
+
+    std::lock_guard<std::mutex> lk(_aheadMutex);
+    _stream.stats.prefetched += to - from;
+}
+
+void RegularFile::prefetch(std::size_t offset, std::size_t size)
+{
+    auto blockSize = _cache->blockSize();
+    auto first = offset / blockSize;
+    auto last = ( offset + size - 1 ) / blockSize;
+
+    // one request per run of missing blocks, like readCached()
+    constexpr std::size_t maxRun = 64;
+    for ( auto block = first; block <= last; )
+    {
+        if ( _cache->contains(_id, block) )
+        {
+            ++block;
+            continue;
+        }
+
+        auto runEnd = block + 1;
+        while ( runEnd <= last && runEnd - block < maxRun && !_cache->contains(_id, runEnd) )
+            ++runEnd;
+
+        std::vector<std::uint64_t> epochs;
+        epochs.reserve(runEnd - block);
+        for ( auto b = block; b < runEnd; ++b )
+            epochs.push_back(_cache->epoch(_id, b));
+
+        // the request keeps the descriptor open until it completes
+        auto data = std::make_shared<Buffer>(( runEnd - block ) * blockSize);
+        ++_inflight;
+        IoEngine::global()->read(_fd, data->data(), data->size(), block * blockSize,
+                                 [this, data, block, epochs = std::move(epochs), blockSize] (long result)
+        {
+            std::size_t got = result > 0 ? result : 0;
+            for ( std::size_t i = 0; i < epochs.size() && i * blockSize < got; ++i )
+            {
+                auto begin = i * blockSize;
+                _cache->insert(_id, block + i, data->data() + begin, std::min(blockSize, got - begin), epochs[i]);
+            }
+            --_inflight;
+        });
+
+        block = runEnd;
+    }
+}
+
+void RegularFile::advise(std::size_t offset, std::size_t size, int advice)
+{
+    // the pattern is kept by the open file description, a descriptor shared through a HandleTable keeps its own
+    bool pattern = advice == POSIX_FADV_SEQUENTIAL || advice == POSIX_FADV_NORMAL;
+    if ( pattern && _handle != nullptr )
+        return;
+
+    ::posix_fadvise(_fd, static_cast<off_t>(offset), static_cast<off_t>(size), advice);
+}
+
+std::size_t RegularFile::preadAll(DataT * dst, std::size_t offset, std::size_t size) const
+{
+    std::size_t done = 0;
+    while ( done < size )
+    {
+        auto n = ::pread(_fd, dst + done, size - done, offset + done);
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            break;
+        done += n;
+    }
+
+    return done;
+}
+
+std::size_t RegularFile::pwriteAll(DataT const * src, std::size_t offset, std::size_t size)
+{
+    std::size_t done = 0;
+    while ( done < size )
+    {
+        auto n = ::pwrite(_fd, src + done, size - done, offset + done);
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            break;
+        done += n;
+    }
+
+    return done;
+}
+
+void RegularFile::invalidate(std::size_t offset, std::size_t size)
+{
+    if ( _cache == nullptr || size == 0 )
+        return;
+
+    auto blockSize = _cache->blockSize();
+    _cache->invalidate(_id, offset / blockSize, ( offset + size - 1 ) / blockSize);
+}
+
+std::size_t RegularFile::lockRange(std::size_t offset, std::size_t size, bool append, Metrics::Op op)
+{
+    LockStats::Wait wait(_timedLocks);
+    std::unique_lock<std::mutex> lk(_mutex, std::defer_lock);
+    wait.lock(lk);
+    if ( append )
+    {
+        offset = std::max(this->size(), _appendEnd);
+        _appendEnd = offset + size;
+    }
+
+    waitRanges(lk, { Range(offset, offset + size) }, wait, op);
+
+    return offset;
+}
+
+void RegularFile::lockRanges(std::vector<Range> const & ranges, Metrics::Op op)
+{
+    LockStats::Wait wait(_timedLocks);
+    std::unique_lock<std::mutex> lk(_mutex, std::defer_lock);
+    wait.lock(lk);
+    waitRanges(lk, ranges, wait, op);
+}
+
+void RegularFile::waitRanges(std::unique_lock<std::mutex> & lk, std::vector<Range> const & ranges, LockStats::Wait & wait, Metrics::Op op)
+{
+    auto overlaps = [this, &ranges] ()
+    {
+        return std::any_of(_ranges.begin(), _ranges.end(), [&ranges] (Claim const & inflight)
+        {
+            return std::any_of(ranges.begin(), ranges.end(), [&inflight] (Range const & range)
+            {
+                return range.first < inflight.range.second && inflight.range.first < range.second;
+            });
+        });
+    };
+    if ( overlaps() )
+    {
+        wait.contended();
+        _cv.wait(lk, [&overlaps] () { return !overlaps(); });
+    }
+
+    auto since = wait.done(op);
+    for ( auto const & range : ranges )
+        _ranges.push_back({ range, op, since });
+}
+
+void RegularFile::unlockRange(std::size_t offset, std::size_t size)
+{
+    unlockRanges({ Range(offset, offset + size) });
+}
+
+void RegularFile::unlockRanges(std::vector<Range> const & ranges)
+{
+    {
+        std::lock_guard<std::mutex> lk(_mutex);
+        LockStats * stats = _timedLocks;
+        auto now = stats != nullptr ? LockStats::Clock::now() : LockStats::Clock::time_point();
+        for ( auto const & range : ranges )
+        {
+            auto it = std::find_if(_ranges.begin(), _ranges.end(), [&range] (Claim const & claim) { return claim.range == range; });
+            if ( it == _ranges.end() )
+                continue;
+
+            // claims made while the stats were off have no start
+            if ( stats != nullptr && it->since != LockStats::Clock::time_point() )
+                stats->recordHold(it->op, LockStats::nanos(now - it->since));
+            _ranges.erase(it);
+        }
+        if ( _ranges.empty() )
+            _appendEnd = 0;
+    }
+    _cv.notify_all();
+}
+
+std::size_t RegularFile::writeBehind(DataT const * src, std::size_t offset, std::size_t size, bool append)
+{
+    std::unique_lock<std::mutex> lk(_behindMutex);
+
+    // a write that big gains nothing from the buffer
+    if ( size >= _behindLimit )
+    {
+        flushLocked();
+        lk.unlock();
+        offset = lockRange(offset, size, append, Metrics::Op::WRITE);
+        auto n = pwriteAll(src, offset, size);
+        invalidate(offset, size);
+        unlockRange(offset, size);
+        return n;
+    }
+
+    if ( append )
+    {
+        // reserved as lockRange() does, after the appends that went around the buffer and are still in flight, and
+        // counted in the size at once so those that come next land after this one
+        std::lock_guard<std::mutex> appendLk(_mutex);
+        offset = std::max(this->size(), _appendEnd);
+        _appendEnd = offset + size;
+        _dirtyEnd = std::max<std::size_t>(_dirtyEnd, offset + size);
+    }
+    coalesce(src, offset, size);
+    if ( _dirtyBytes >= _behindLimit )
+    {
+        flushLocked();
+    }
+    else
+    {
+        scheduleFlush();
+    }
+
+    return size;
+}
+
+void RegularFile::scheduleFlush()
+{
+    if ( _flushTimer != 0 )
+        return;
+
+    _flushTimer = GroupCommit::global()->schedule(GroupCommit::Clock::now() + _behindDelay, [this] ()
+    {
+        std::lock_guard<std::mutex> lk(_behindMutex);
+        _flushTimer = 0;
+        flushLocked();
+    });
+}
+
+void RegularFile::coalesce(DataT const * src, std::size_t offset, std::size_t size)
+{
+    auto end = offset + size;
+    _dirtyEnd = std::max<std::size_t>(_dirtyEnd, end);
+
+    // the first extent that touches [offset, end), if any
+    auto first = _dirty.upper_bound(offset);
+    if ( first != _dirty.begin() && std::prev(first)->first + std::prev(first)->second.size() >= offset )
+        --first;
+    auto last = first;
+    while ( last != _dirty.end() && last->first <= end )
+        ++last;
+
+    // sequential writes grow the extent they follow in place
+    if ( first != last && std::next(first) == last && first->first <= offset )
+    {
+        auto & extent = first->second;
+        auto grown = std::max(extent.size(), end - first->first);
+        _dirtyBytes += grown - extent.size();
+        extent.resize(grown);
+        std::memcpy(extent.data() + ( offset - first->first ), src, size);
+        return;
+    }
+
+    auto start = first != last ? std::min(offset, first->first) : offset;
+    auto stop = end;
+    for ( auto it = first; it != last; ++it )
+        stop = std::max(stop, it->first + it->second.size());
+
+    Buffer merged(stop - start);
+    for ( auto it = first; it != last; ++it )
+    {
+        std::memcpy(merged.data() + ( it->first - start ), it->second.data(), it->second.size());
+        _dirtyBytes -= it->second.size();
+    }
+    std::memcpy(merged.data() + ( offset - start ), src, size);
+    _dirty.erase(first, last);
+    _dirtyBytes += merged.size();
+    _dirty.emplace(start, std::move(merged));
+}
+
+void RegularFile::flush()
+{
+    if ( _dirtyBytes == 0 )
+        return;
+
+    std::lock_guard<std::mutex> lk(_behindMutex);
+    flushLocked();
+}
+
+void RegularFile::flush(std::size_t offset, std::size_t size)
+{
+    if ( _dirtyBytes == 0 )
+        return;
+
+    std::lock_guard<std::mutex> lk(_behindMutex);
+    auto it = _dirty.upper_bound(offset);
+    if ( it != _dirty.begin() && std::prev(it)->first + std::prev(it)->second.size() > offset )
+        --it;
+    if ( it != _dirty.end() && it->first < offset + size )
+        flushLocked();
+}
+
+void RegularFile::flushLocked()
+{
+    if ( _dirty.empty() )
+        return;
+
+    std::vector<WriteRange> ranges;
+    ranges.reserve(_dirty.size());
+    for ( auto const & extent : _dirty )
+        ranges.push_back({ extent.first, extent.second.size(), extent.second.data() });
+
+    // the buffer is cleared only after the data is in the file, readers that find it empty read the file
+    auto written = writeRanges(ranges);
+    if ( written != _dirtyBytes )
+    {
+        long expected = 0;
+        _behindError.compare_exchange_strong(expected, -EIO);
+    }
+    _dirty.clear();
+    _dirtyBytes = 0;
+    _dirtyEnd = 0;
+}
+
+long RegularFile::syncAll(bool dataOnly)
+{
+    InflightGuard guard(_inflight);
+    if ( !_access )
+        return -EBADF;
+
+    flush();
+    auto error = _behindError.exchange(0);
+    auto result = GroupCommit::global()->sync(_fd, dataOnly);
+
+    return error != 0 ? error : result;
+}
+
 }
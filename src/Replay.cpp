@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <set>
+#include <thread>
+#include "vfs/Replay.h"
+
+namespace VFS {
+
+Replay::Replay(std::vector<Tracer::Event> events)
+    : _threads()
+      , _files()
+      , _mutex()
+{
+    std::map<std::uint32_t, std::size_t> index;
+    for ( auto & event : events )
+    {
+        auto it = index.emplace(event.thread, _threads.size()).first;
+        if ( it->second == _threads.size() )
+            _threads.emplace_back();
+        _threads[it->second].push_back(std::move(event));
+    }
+
+    for ( auto & thread : _threads )
+        std::stable_sort(thread.begin(), thread.end(), [] (Tracer::Event const & a, Tracer::Event const & b) { return a.start < b.start; });
+}
+
+void Replay::prepare(IFS & fs) const
+{
+    // the path of every opened file and the end of what is read of it, but not what the trace makes itself
+    std::map<std::uint64_t, std::string> paths;
+    std::map<std::uint64_t, std::uint64_t> extents;
+    std::set<std::string> made;
+    for ( auto const & thread : _threads )
+    {
+        for ( auto const & event : thread )
+        {
+            if ( event.error )
+                continue;
+            if ( event.op == Metrics::Op::TOUCH_FILE || event.op == Metrics::Op::MAKE_DIR )
+                made.insert(event.path);
+            else if ( event.op == Metrics::Op::MOVE_TO || event.op == Metrics::Op::COPY )
+                made.insert(event.target);
+
+            if ( event.op == Metrics::Op::OPEN )
+                paths[event.handle] = event.path;
+            else if ( event.handle == 0 )
+                continue;
+
+            auto & extent = extents[event.handle];
+            if ( event.offset != Tracer::CURSOR )
+                extent = std::max(extent, event.offset + event.size);
+            else if ( event.op == Metrics::Op::READ || event.op == Metrics::Op::READ_ALL )
+                extent += event.bytes;
+        }
+    }
+
+    std::map<std::string, std::uint64_t> files;
+    for ( auto const & path : paths )
+    {
+        if ( made.count(path.second) == 0 )
+            files[path.second] = std::max(files[path.second], extents[path.first]);
+    }
+
+    for ( auto const & file : files )
+    {
+        for ( auto slash = file.first.find('/'); slash != std::string::npos; slash = file.first.find('/', slash + 1) )
+        {
+            auto dir = file.first.substr(0, slash);
+            if ( !dir.empty() && dir != "." && made.count(dir) == 0 && !fs.contain(dir) )
+                fs.makeDir(dir);
+        }
+        fs.touchFile(file.first);
+
+        auto opened = fs.open(file.first, Perms::RW);
+        if ( opened == nullptr )
+            continue;
+
+        IFile::Buffer zeros(1 << 20);
+        for ( auto size = opened->size(); size < file.second; )
+        {
+            auto n = opened->write(zeros.data(), size, std::min<std::uint64_t>(zeros.size(), file.second - size));
+            if ( n == 0 )
+                break;
+            size += n;
+        }
+        opened->close();
+    }
+}
+
+Replay::Result Replay::run(IFS::IFSPtr fs, Speed speed)
+{
+    {
+        std::lock_guard<std::mutex> lk(_mutex);
+        _files.clear();
+    }
+
+    // every call waits for the calls that ended before it started, counted by the rank of their end
+    std::vector<std::uint64_t> ends;
+    for ( auto const & thread : _threads )
+        for ( auto const & event : thread )
+            ends.push_back(event.start + event.latency);
+    std::sort(ends.begin(), ends.end());
+
+    std::vector<std::vector<std::size_t>> ranks(_threads.size()), needs(_threads.size());
+    std::vector<std::size_t> taken(ends.size(), 0);
+    for ( std::size_t i = 0; i < _threads.size(); ++i )
+    {
+        for ( auto const & event : _threads[i] )
+        {
+            auto end = event.start + event.latency;
+            auto rank = std::lower_bound(ends.begin(), ends.end(), end) - ends.begin();
+            ranks[i].push_back(rank + taken[rank]++);  // equal ends get ranks of their own
+            needs[i].push_back(std::lower_bound(ends.begin(), ends.end(), event.start) - ends.begin());
+        }
+    }
+
+    std::vector<char> done(ends.size(), 0);
+    std::size_t prefix = 0;     // the calls of the lowest ranks that are all done
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    std::vector<Result> results(_threads.size(), Result{ 0, 0, 0, std::chrono::nanoseconds(0) });
+    std::vector<std::thread> workers;
+    auto begin = Tracer::Clock::now();
+    for ( std::size_t i = 0; i < _threads.size(); ++i )
+    {
+        workers.emplace_back([&, i] ()
+        {
+            IFile::Buffer buffer;
+            for ( std::size_t j = 0; j < _threads[i].size(); ++j )
+            {
+                auto const & event = _threads[i][j];
+                {
+                    std::unique_lock<std::mutex> lk(mutex);
+                    cv.wait(lk, [&] () { return prefix >= needs[i][j]; });
+                }
+                if ( speed == Speed::ORIGINAL )
+                    std::this_thread::sleep_until(begin + std::chrono::nanoseconds(event.start));
+                if ( !call(*fs, event, buffer, results[i]) && !event.error )
+                    ++results[i].errors;
+
+                std::lock_guard<std::mutex> lk(mutex);
+                done[ranks[i][j]] = 1;
+                auto before = prefix;
+                while ( prefix < done.size() && done[prefix] )
+                    ++prefix;
+                if ( prefix != before )
+                    cv.notify_all();
+            }
+        });
+    }
+    for ( auto & worker : workers )
+        worker.join();
+
+    Result total{ 0, 0, 0, Tracer::Clock::now() - begin };
+    for ( auto const & result : results )
+    {
+        total.calls += result.calls;
+        total.errors += result.errors;
+        total.skipped += result.skipped;
+    }
+
+    std::lock_guard<std::mutex> lk(_mutex);
+    _files.clear();
+
+    return total;
+}
+
+bool Replay::call(IFS & fs, Tracer::Event const & event, IFile::Buffer & buffer, Result & result)
+{
+    auto const & path = event.path;
+    IFS::IFilePtr f;
+    if ( event.handle != 0 && event.op != Metrics::Op::OPEN )
+    {
+        f = file(event.handle);
+        if ( f == nullptr )
+        {
+            ++result.skipped;
+            return true;
+        }
+    }
+
+    auto size = static_cast<std::size_t>(event.size);
+    if ( buffer.size() < size )
+        buffer.resize(size);
+
+    ++result.calls;
+    switch ( event.op )
+    {
+        case Metrics::Op::OPEN:
+        {
+            f = fs.open(path, static_cast<Perms>(event.size));
+            if ( f == nullptr )
+                return false;
+
+            std::lock_guard<std::mutex> lk(_mutex);
+            _files[event.handle] = f;
+            return true;
+        }
+        case Metrics::Op::REMOVE:
+            return fs.remove(path);
+        case Metrics::Op::TOUCH_FILE:
+            return fs.touchFile(path);
+        case Metrics::Op::MAKE_DIR:
+            return fs.makeDir(path);
+        case Metrics::Op::MOVE_TO:
+            return fs.moveTo(path, event.target);
+        case Metrics::Op::LIST:
+            path.empty() ? fs.list() : fs.list(path);
+            return true;
+        case Metrics::Op::CONTAIN:
+            fs.contain(path);
+            return true;
+        case Metrics::Op::SEARCH:
+            return fs.search(path) != type::NOTFOUND;
+        case Metrics::Op::COPY:
+            return fs.copy(path, event.target);
+        case Metrics::Op::TYPE:
+            return std::string(fs.type(path)) != type::NOTFOUND;
+        case Metrics::Op::READ:
+            if ( event.offset == Tracer::CURSOR )
+                f->read(size);
+            else
+                f->read(buffer.data(), event.offset, size);
+            return true;
+        case Metrics::Op::WRITE:
+            if ( event.offset == Tracer::CURSOR )
+                return f->write(buffer, size) == size;
+            return f->write(buffer.data(), event.offset, size) == size;
+        case Metrics::Op::READ_ALL:
+            f->readAll();
+            return true;
+        case Metrics::Op::READ_BATCH:
+        {
+            std::vector<IFile::ReadRange> ranges = { { event.offset, size, buffer.data() } };
+            f->readBatch(ranges);
+            return true;
+        }
+        case Metrics::Op::WRITE_BATCH:
+        {
+            std::vector<IFile::WriteRange> ranges = { { event.offset, size, buffer.data() } };
+            return f->writeBatch(ranges) == size;
+        }
+        case Metrics::Op::READ_ASYNC:
+            return f->readAsync(buffer.data(), event.offset, size).get() >= 0;
+        case Metrics::Op::WRITE_ASYNC:
+            return f->writeAsync(buffer.data(), event.offset, size).get() == static_cast<long>(size);
+        case Metrics::Op::FSYNC:
+            return f->fsyncAsync().get() == 0;
+        case Metrics::Op::SYNC:
+            return ( event.size == 1 ? f->datasync() : f->sync() ) == 0;
+        case Metrics::Op::SIZE:
+            f->size();
+            return true;
+        case Metrics::Op::INFO:
+            f->info();
+            return true;
+        case Metrics::Op::CLOSE:
+        {
+            f->close();
+            std::lock_guard<std::mutex> lk(_mutex);
+            _files.erase(event.handle);
+            return true;
+        }
+        default:
+            // mount, unmount and the like would change what the other threads run against
+            --result.calls;
+            ++result.skipped;
+            return true;
+    }
+}
+
+IFS::IFilePtr Replay::file(std::uint64_t handle)
+{
+    std::lock_guard<std::mutex> lk(_mutex);
+    auto it = _files.find(handle);
+    return it != _files.end() ? it->second : nullptr;
+}
+
+}
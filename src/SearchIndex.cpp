@@ -0,0 +1,213 @@
+#include <algorithm>
+#include "vfs/SearchIndex.h"
+
+namespace VFS {
+
+namespace {
+
+// tombstones tolerated before the posting lists are rewritten
+constexpr std::size_t COMPACT_THRESHOLD = 1024;
+
+}
+
+SearchIndex::SearchIndex()
+    : _paths()
+      , _ids()
+      , _postings()
+      , _removed(0)
+{
+}
+
+SearchIndex::~SearchIndex() = default;
+
+void SearchIndex::add(std::string const & path)
+{
+    if ( path.empty() || _ids.count(path) != 0 )
+        return;
+
+    // ids only grow, so appending keeps every posting list sorted
+    auto id = static_cast<Id>(_paths.size());
+    _paths.push_back(path);
+    _ids.emplace(path, id);
+
+    for ( auto gram : trigrams(path) )
+        _postings[gram].push_back(id);
+}
+
+void SearchIndex::remove(std::string const & path)
+{
+    auto it = _ids.find(path);
+    if ( it == _ids.end() )
+        return;
+
+    std::string().swap(_paths[it->second]);
+    _ids.erase(it);
+
+    if ( ++_removed > COMPACT_THRESHOLD && _removed > _ids.size() )
+        compact();
+}
+
+void SearchIndex::clear()
+{
+    _paths.clear();
+    _ids.clear();
+    _postings.clear();
+    _removed = 0;
+}
+
+SearchIndex::EntryList SearchIndex::find(std::string const & pattern, std::size_t offset, std::size_t limit) const
+{
+    EntryList result;
+    if ( limit == 0 )
+        return result;
+
+    candidates(pattern, [&] (std::string const & path)
+    {
+        // the trigrams were all there, the substring may still not be
+        if ( path.find(pattern) == std::string::npos )
+            return true;
+        if ( offset != 0 )
+        {
+            --offset;
+            return true;
+        }
+        result.push_back(path);
+        return result.size() < limit;
+    });
+
+    return result;
+}
+
+SearchIndex::EntryList SearchIndex::findPrefix(std::string const & prefix, std::size_t offset, std::size_t limit) const
+{
+    EntryList result;
+    if ( limit == 0 )
+        return result;
+
+    candidates(prefix, [&] (std::string const & path)
+    {
+        if ( path.compare(0, prefix.size(), prefix) != 0 )
+            return true;
+        if ( offset != 0 )
+        {
+            --offset;
+            return true;
+        }
+        result.push_back(path);
+        return result.size() < limit;
+    });
+
+    return result;
+}
+
+std::vector<SearchIndex::Trigram> SearchIndex::trigrams(std::string const & text)
+{
+    std::vector<Trigram> grams;
+    if ( text.size() < 3 )
+        return grams;
+
+    grams.reserve(text.size() - 2);
+    for ( std::size_t i = 0; i + 3 <= text.size(); ++i )
+    {
+        grams.push_back(static_cast<Trigram>(static_cast<unsigned char>(text[i])) << 16
+                        | static_cast<Trigram>(static_cast<unsigned char>(text[i + 1])) << 8
+                        | static_cast<Trigram>(static_cast<unsigned char>(text[i + 2])));
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+
+    return grams;
+}
+
+template<typename Visit>
+void SearchIndex::candidates(std::string const & pattern, Visit visit) const
+{
+    auto grams = trigrams(pattern);
+    if ( grams.empty() )
+    {
+        for ( auto const & path : _paths )
+        {
+            if ( !path.empty() && !visit(path) )
+                return;
+        }
+        return;
+    }
+
+    std::vector<std::vector<Id> const *> lists;
+    lists.reserve(grams.size());
+    for ( auto gram : grams )
+    {
+        auto it = _postings.find(gram);
+        if ( it == _postings.end() )
+            return;
+        lists.push_back(&it->second);
+    }
+
+    // walk the shortest list and look its ids up in the others, every cursor only moves forward
+    std::sort(lists.begin(), lists.end(), [] (std::vector<Id> const * a, std::vector<Id> const * b)
+    {
+        return a->size() < b->size();
+    });
+    std::vector<std::vector<Id>::const_iterator> cursors;
+    cursors.reserve(lists.size());
+    for ( auto list : lists )
+        cursors.push_back(list->begin());
+
+    for ( auto id : *lists.front() )
+    {
+        bool everywhere = true;
+        for ( std::size_t i = 1; i < lists.size() && everywhere; ++i )
+        {
+            cursors[i] = std::lower_bound(cursors[i], lists[i]->end(), id);
+            if ( cursors[i] == lists[i]->end() )
+                return;
+            everywhere = *cursors[i] == id;
+        }
+
+        if ( everywhere && !_paths[id].empty() && !visit(_paths[id]) )
+            return;
+    }
+}
+
+void SearchIndex::compact()
+{
+    // renumber the live paths in order, which keeps the posting lists sorted
+    std::vector<Id> renumber(_paths.size());
+    std::vector<bool> alive(_paths.size(), false);
+    Id next = 0;
+    for ( std::size_t id = 0; id < _paths.size(); ++id )
+    {
+        if ( _paths[id].empty() )
+            continue;
+
+        alive[id] = true;
+        renumber[id] = next;
+        _ids[_paths[id]] = next;
+        if ( next != id )
+            _paths[next] = std::move(_paths[id]);
+        ++next;
+    }
+    _paths.resize(next);
+    _paths.shrink_to_fit();
+
+    for ( auto it = _postings.begin(); it != _postings.end(); )
+    {
+        auto & list = it->second;
+        std::size_t kept = 0;
+        for ( auto id : list )
+        {
+            if ( alive[id] )
+                list[kept++] = renumber[id];
+        }
+        list.resize(kept);
+
+        if ( list.empty() )
+            it = _postings.erase(it);
+        else
+            ++it;
+    }
+
+    _removed = 0;
+}
+
+}
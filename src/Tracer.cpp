@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cstring>
+#include "vfs/Tracer.h"
+
+namespace VFS {
+
+constexpr char const Tracer::MAGIC[8];
+constexpr std::chrono::milliseconds Tracer::FLUSH_INTERVAL;
+
+namespace {
+
+constexpr std::size_t RECORD_SIZE = 6 * 8 + 4 + 1 + 1 + 2 + 2;
+
+template<typename T>
+void put(std::string & out, T value)
+{
+    out.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+template<typename T>
+T take(char const *& in)
+{
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return value;
+}
+
+}
+
+Tracer::Ring::Ring(std::size_t slots, std::uint32_t thread)
+    : slots(new Slot[slots])
+      , mask(slots - 1)
+      , thread(thread)
+      , head(0)
+      , dropped(0)
+      , tail(0)
+{
+}
+
+Tracer::Tracer(std::string const & path, std::size_t slots)
+    : _slots(1)
+      , _epoch(Clock::now())
+      , _file(std::fopen(path.c_str(), "wb"))
+      , _handles(1)
+      , _threads(0)
+      , _rings()
+      , _mutex()
+      , _drainMutex()
+      , _cv()
+      , _stop(false)
+      , _flusher()
+{
+    while ( _slots < slots )
+        _slots <<= 1;
+
+    if ( _file == nullptr )
+        return;
+
+    std::string header(MAGIC, sizeof(MAGIC));
+    put(header, VERSION);
+    std::fwrite(header.data(), 1, header.size(), _file);
+    _flusher = std::thread([this] () { run(); });
+}
+
+Tracer::~Tracer()
+{
+    {
+        std::lock_guard<std::mutex> lk(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    if ( _flusher.joinable() )
+        _flusher.join();
+
+    drain();
+    if ( _file != nullptr )
+        std::fclose(_file);
+}
+
+void Tracer::record(Metrics::Op op, Clock::time_point start, Clock::time_point end, std::uint64_t handle, std::string const & path,
+                    std::string const & target, std::uint64_t offset, std::uint64_t size, std::uint64_t bytes, bool error)
+{
+    if ( _file == nullptr )
+        return;
+
+    auto & ring = _rings.local([this] () { return newRing(); });
+    auto head = ring.head.load(std::memory_order_relaxed);
+    if ( head - ring.tail.load(std::memory_order_acquire) > ring.mask )
+    {
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    auto & slot = ring.slots[head & ring.mask];
+    slot.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - _epoch).count();
+    slot.latency = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    slot.handle = handle;
+    slot.offset = offset;
+    slot.size = size;
+    slot.bytes = bytes;
+    slot.op = op;
+    slot.error = error;
+    slot.pathLength = static_cast<std::uint16_t>(std::min(path.size(), MAX_PATHS));
+    slot.targetLength = static_cast<std::uint16_t>(std::min(target.size(), MAX_PATHS - slot.pathLength));
+    std::memcpy(slot.paths, path.data(), slot.pathLength);
+    std::memcpy(slot.paths + slot.pathLength, target.data(), slot.targetLength);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::flush()
+{
+    drain();
+}
+
+Tracer::Stats Tracer::stats() const
+{
+    Stats stats{ 0, 0 };
+    _rings.forEach([&stats] (Ring const & ring)
+    {
+        stats.recorded += ring.head.load(std::memory_order_relaxed);
+        stats.dropped += ring.dropped.load(std::memory_order_relaxed);
+    });
+
+    return stats;
+}
+
+bool Tracer::load(std::string const & path, std::vector<Event> & events)
+{
+    events.clear();
+    auto file = std::fopen(path.c_str(), "rb");
+    if ( file == nullptr )
+        return false;
+
+    std::string data;
+    char chunk[64 * 1024];
+    std::size_t n;
+    while ( ( n = std::fread(chunk, 1, sizeof(chunk), file) ) > 0 )
+        data.append(chunk, n);
+    std::fclose(file);
+
+    char const * in = data.data();
+    auto end = in + data.size();
+    if ( data.size() < sizeof(MAGIC) + sizeof(VERSION) || std::memcmp(in, MAGIC, sizeof(MAGIC)) != 0 )
+        return false;
+    in += sizeof(MAGIC);
+    if ( take<std::uint32_t>(in) != VERSION )
+        return false;
+
+    bool complete = true;
+    while ( in != end )
+    {
+        if ( static_cast<std::size_t>(end - in) < RECORD_SIZE )
+        {
+            complete = false;
+            break;
+        }
+
+        Event event;
+        event.start = take<std::uint64_t>(in);
+        event.latency = take<std::uint64_t>(in);
+        event.handle = take<std::uint64_t>(in);
+        event.offset = take<std::uint64_t>(in);
+        event.size = take<std::uint64_t>(in);
+        event.bytes = take<std::uint64_t>(in);
+        event.thread = take<std::uint32_t>(in);
+        auto op = take<std::uint8_t>(in);
+        event.error = take<std::uint8_t>(in) != 0;
+        auto pathLength = take<std::uint16_t>(in);
+        auto targetLength = take<std::uint16_t>(in);
+        if ( op >= static_cast<std::uint8_t>(Metrics::Op::COUNT) || static_cast<std::size_t>(end - in) < std::size_t(pathLength) + targetLength )
+        {
+            complete = false;
+            break;
+        }
+
+        event.op = static_cast<Metrics::Op>(op);
+        event.path.assign(in, pathLength);
+        in += pathLength;
+        event.target.assign(in, targetLength);
+        in += targetLength;
+        events.push_back(std::move(event));
+    }
+
+    // the rings are drained one after the other, the file is ordered per thread only
+    std::stable_sort(events.begin(), events.end(), [] (Event const & a, Event const & b) { return a.start < b.start; });
+
+    return complete;
+}
+
+std::unique_ptr<Tracer::Ring> Tracer::newRing()
+{
+    return std::unique_ptr<Ring>(new Ring(_slots, _threads++));
+}
+
+void Tracer::drain()
+{
+    // the rings of threads that ended are kept, they may hold events still
+    std::vector<Ring *> rings;
+    _rings.forEach([&rings] (Ring & ring) { rings.push_back(&ring); });
+
+    std::lock_guard<std::mutex> lk(_drainMutex);
+    if ( _file == nullptr )
+        return;
+
+    std::string out;
+    for ( auto * ring : rings )
+    {
+        auto tail = ring->tail.load(std::memory_order_relaxed);
+        auto head = ring->head.load(std::memory_order_acquire);
+        for ( ; tail != head; ++tail )
+        {
+            auto const & slot = ring->slots[tail & ring->mask];
+            put(out, slot.start);
+            put(out, slot.latency);
+            put(out, slot.handle);
+            put(out, slot.offset);
+            put(out, slot.size);
+            put(out, slot.bytes);
+            put(out, ring->thread);
+            put(out, static_cast<std::uint8_t>(slot.op));
+            put(out, static_cast<std::uint8_t>(slot.error));
+            put(out, slot.pathLength);
+            put(out, slot.targetLength);
+            out.append(slot.paths, slot.pathLength + slot.targetLength);
+        }
+        // the slots are free again once copied out
+        ring->tail.store(tail, std::memory_order_release);
+    }
+
+    if ( !out.empty() )
+    {
+        std::fwrite(out.data(), 1, out.size(), _file);
+        std::fflush(_file);
+    }
+}
+
+void Tracer::run()
+{
+    std::unique_lock<std::mutex> lk(_mutex);
+    while ( !_stop )
+    {
+        _cv.wait_for(lk, FLUSH_INTERVAL);
+        lk.unlock();
+        drain();
+        lk.lock();
+    }
+}
+
+}
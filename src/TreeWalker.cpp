@@ -0,0 +1,302 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "vfs/TreeWalker.h"
+
+namespace VFS {
+
+namespace {
+
+// Directories waiting to be read by one worker, as paths relative to the root that end with '/'.
+struct Queue
+{
+    std::deque<std::string> tasks;
+    std::mutex mutex;
+};
+
+}
+
+TreeWalker::TreeWalker(std::size_t threads)
+    : _threads(threads != 0 ? threads : std::max<std::size_t>(std::thread::hardware_concurrency(), 1))
+      , _walkMutex()
+      , _poolMutex()
+      , _poolCv()
+      , _pool()
+      , _work(nullptr)
+      , _wanted(0)
+      , _busy(0)
+      , _round(0)
+      , _stop(false)
+{
+}
+
+TreeWalker::~TreeWalker()
+{
+    {
+        std::lock_guard<std::mutex> lk(_poolMutex);
+        _stop = true;
+    }
+    _poolCv.notify_all();
+    for ( auto & thread : _pool )
+        thread.join();
+}
+
+bool TreeWalker::walk(std::string const & root, Visit const & visit, bool sorted)
+{
+    if ( !sorted )
+        return run(root, [&visit] (std::size_t, std::string && path, bool directory) { visit(path, directory); });
+
+    std::vector<std::vector<std::pair<std::string, bool>>> found(_threads);
+    if ( !run(root, [&found] (std::size_t worker, std::string && path, bool directory)
+        {
+            found[worker].emplace_back(std::move(path), directory);
+        }) )
+        return false;
+
+    std::vector<std::pair<std::string, bool>> entries;
+    for ( auto & part : found )
+        std::move(part.begin(), part.end(), std::back_inserter(entries));
+    std::sort(entries.begin(), entries.end(), [] (std::pair<std::string, bool> const & a, std::pair<std::string, bool> const & b)
+    {
+        return sortedBefore(a.first, b.first);
+    });
+
+    for ( auto const & entry : entries )
+        visit(entry.first, entry.second);
+
+    return true;
+}
+
+TreeWalker::EntryList TreeWalker::collect(std::string const & root, bool sorted)
+{
+    int dir = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if ( dir < 0 )
+        return {};
+
+    auto entries = collect(dir, root, sorted);
+    ::close(dir);
+
+    return entries;
+}
+
+TreeWalker::EntryList TreeWalker::collect(int dir, std::string const & root, bool sorted)
+{
+    std::vector<EntryList> found(_threads);
+    run(dir, root, [&found] (std::size_t worker, std::string && path, bool)
+    {
+        found[worker].push_back(std::move(path));
+    });
+
+    EntryList entries = std::move(found.front());
+    for ( std::size_t i = 1; i < found.size(); ++i )
+        std::move(found[i].begin(), found[i].end(), std::back_inserter(entries));
+
+    if ( sorted )
+        std::sort(entries.begin(), entries.end(), sortedBefore);
+
+    return entries;
+}
+
+bool TreeWalker::sortedBefore(std::string const & a, std::string const & b)
+{
+    // '/' sorts before every other byte
+    auto length = std::min(a.size(), b.size());
+    for ( std::size_t i = 0; i < length; ++i )
+    {
+        if ( a[i] == b[i] )
+            continue;
+        if ( a[i] == '/' || b[i] == '/' )
+            return a[i] == '/';
+        return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[i]);
+    }
+
+    return a.size() < b.size();
+}
+
+bool TreeWalker::run(std::string const & root, Emit const & emit)
+{
+    int dir = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if ( dir < 0 )
+        return false;
+
+    auto walked = run(dir, root, emit);
+    ::close(dir);
+
+    return walked;
+}
+
+bool TreeWalker::run(int rootFd, std::string const & root, Emit const & emit)
+{
+    auto prefix = root;
+    if ( prefix.empty() || prefix.back() != '/' )
+        prefix.push_back('/');
+
+    std::unique_ptr<Queue[]> queues(new Queue[_threads]);
+    std::atomic<std::size_t> pending(1);    // directories queued or being read
+    std::atomic<std::size_t> queued(0);     // directories queued, changed with the lock of their queue
+    std::mutex idleMutex;
+    std::condition_variable idle;           // a directory was queued or the walk is done
+
+    auto wake = [&] (bool all)
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        if ( all )
+            idle.notify_all();
+        else
+            idle.notify_one();
+    };
+
+    auto read = [&] (std::string const & relative, std::size_t worker)
+    {
+        int fd = relative.empty() ? ::dup(rootFd)
+                                  : ::openat(rootFd, relative.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        DIR * dir = fd >= 0 ? ::fdopendir(fd) : nullptr;
+        if ( dir == nullptr )
+        {
+            if ( fd >= 0 )
+                ::close(fd);
+            return;
+        }
+
+        std::vector<std::string> subdirs;
+        while ( auto entry = ::readdir(dir) )
+        {
+            char const * name = entry->d_name;
+            if ( name[0] == '.' && ( name[1] == '\0' || ( name[1] == '.' && name[2] == '\0' ) ) )
+                continue;
+
+            bool directory = entry->d_type == DT_DIR;
+            if ( entry->d_type == DT_UNKNOWN )
+            {
+                struct stat st;
+                directory = ::fstatat(::dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+            }
+
+            auto path = relative + name;
+            if ( directory )
+                subdirs.push_back(path + '/');
+            emit(worker, prefix + path, directory);
+        }
+        ::closedir(dir);
+
+        if ( subdirs.empty() )
+            return;
+
+        pending += subdirs.size();
+        {
+            auto & queue = queues[worker];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for ( auto & subdir : subdirs )
+                queue.tasks.push_back(std::move(subdir));
+            queued += subdirs.size();
+        }
+        wake(subdirs.size() > 1);
+    };
+
+    auto work = [&] (std::size_t worker)
+    {
+        std::string task;
+        while ( pending.load() != 0 )
+        {
+            bool found = false;
+            {
+                auto & own = queues[worker];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if ( !own.tasks.empty() )
+                {
+                    task = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    --queued;
+                    found = true;
+                }
+            }
+
+            for ( std::size_t i = 1; i < _threads && !found; ++i )
+            {
+                auto & victim = queues[( worker + i ) % _threads];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if ( !victim.tasks.empty() )
+                {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    --queued;
+                    found = true;
+                }
+            }
+
+            if ( !found )
+            {
+                std::unique_lock<std::mutex> lock(idleMutex);
+                idle.wait(lock, [&] { return queued.load() != 0 || pending.load() == 0; });
+                continue;
+            }
+
+            read(task, worker);
+            if ( --pending == 0 )
+                wake(true);
+        }
+    };
+
+    read("", 0);
+    --pending;
+
+    spread(work, std::min(_threads - 1, pending.load()));
+
+    return true;
+}
+
+void TreeWalker::spread(std::function<void(std::size_t worker)> const & work, std::size_t count)
+{
+    std::unique_lock<std::mutex> walking(_walkMutex, std::defer_lock);
+    if ( count != 0 && walking.try_lock() )
+    {
+        std::lock_guard<std::mutex> lk(_poolMutex);
+        for ( auto worker = _pool.size() + 1; worker < _threads; ++worker )
+            _pool.emplace_back(&TreeWalker::help, this, worker);
+        _work = &work;
+        _wanted = count;
+        _busy = count;
+        ++_round;
+        _poolCv.notify_all();
+    }
+
+    work(0);
+
+    // the workers use what the walk keeps on its stack
+    if ( walking.owns_lock() )
+    {
+        std::unique_lock<std::mutex> lk(_poolMutex);
+        _poolCv.wait(lk, [this] { return _busy == 0; });
+    }
+}
+
+void TreeWalker::help(std::size_t worker)
+{
+    std::uint64_t done = 0;
+    std::unique_lock<std::mutex> lk(_poolMutex);
+    while ( true )
+    {
+        _poolCv.wait(lk, [this, worker, done] { return _stop || ( _round != done && worker <= _wanted ); });
+        if ( _stop )
+            return;
+
+        done = _round;
+        auto const & work = *_work;
+        lk.unlock();
+        work(worker);
+        lk.lock();
+        if ( --_busy == 0 )
+            _poolCv.notify_all();
+    }
+}
+
+}
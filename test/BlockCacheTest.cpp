@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+static VFS::BlockCache::FileId const file{ 1, 42 };
+
+TEST(BlockCacheTest, HitMiss) {
+    VFS::BlockCache cache(16 * 4, 4, 1);
+    EXPECT_EQ( cache.capacity(), 64 );
+
+    char out[4] = {};
+    std::size_t copied = 0;
+    EXPECT_TRUE( !cache.read(file, 0, 0, out, 4, copied) );
+    cache.insert(file, 0, "abcd", 4, cache.epoch(file, 0));
+    cache.insert(file, 1, "ef", 2, cache.epoch(file, 1));
+    EXPECT_TRUE( cache.read(file, 0, 1, out, 4, copied) );
+    EXPECT_EQ( std::string(out, copied), "bcd" );
+    EXPECT_TRUE( cache.read(file, 1, 0, out, 4, copied) );
+    EXPECT_EQ( std::string(out, copied), "ef" );
+
+    auto stats = cache.stats();
+    EXPECT_EQ( stats.hits, 2 );
+    EXPECT_EQ( stats.misses, 1 );
+    EXPECT_EQ( stats.insertions, 2 );
+}
+
+TEST(BlockCacheTest, Invalidate) {
+    VFS::BlockCache cache(16 * 4, 4, 4);
+    for ( std::uint64_t block = 0; block < 8; ++block )
+        cache.insert(file, block, "data", 4, cache.epoch(file, block));
+
+    cache.invalidate(file, 2, 3);
+    EXPECT_TRUE( cache.contains(file, 1) );
+    EXPECT_TRUE( !cache.contains(file, 2) );
+    EXPECT_TRUE( !cache.contains(file, 3) );
+
+    // data read before the invalidation is not cached
+    auto epoch = cache.epoch(file, 9);
+    cache.invalidate(file, 9, 9);
+    cache.insert(file, 9, "old!", 4, epoch);
+    EXPECT_TRUE( !cache.contains(file, 9) );
+
+    cache.invalidate(file);
+    EXPECT_TRUE( !cache.contains(file, 0) );
+    EXPECT_EQ( cache.stats().invalidations, 8 );
+}
+
+TEST(BlockCacheTest, ScanResistance) {
+    VFS::BlockCache cache(8 * 4, 4, 1);
+    auto touch = [&cache] (std::uint64_t block) {
+        char out[4];
+        std::size_t copied;
+        if ( !cache.read(file, block, 0, out, 4, copied) )
+            cache.insert(file, block, "data", 4, cache.epoch(file, block));
+    };
+
+    // blocks 0 and 1 are referenced again after leaving the FIFO, so they become hot
+    for ( std::uint64_t block = 0; block < 10; ++block )
+        touch(block);
+    touch(0);
+    touch(1);
+
+    // a long scan of blocks seen once doesn't push them out
+    for ( std::uint64_t block = 100; block < 1000; ++block )
+        touch(block);
+    EXPECT_TRUE( cache.contains(file, 0) );
+    EXPECT_TRUE( cache.contains(file, 1) );
+    EXPECT_TRUE( !cache.contains(file, 100) );
+}
+
+TEST(BlockCacheTest, RegularFile) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_blockcache";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    VFS::FileSystem fs( dir.string() );
+    auto cache = std::make_shared<VFS::BlockCache>(1 << 20, 4096, 4);
+    fs.setBlockCache(cache);
+    fs.touchFile("file.bin");
+
+    auto file = fs.open("file.bin");
+    VFS::IFile::Buffer data(3 * 4096 + 100, 'A');
+    EXPECT_EQ( file->write(data, 0, data.size()), data.size() );
+    EXPECT_EQ( file->read(0, data.size()), data );
+    EXPECT_EQ( cache->stats().hits, 0 );
+
+    // a second handle shares the blocks read by the first
+    auto other = fs.open("file.bin");
+    EXPECT_EQ( other->read(4000, 200), VFS::IFile::Buffer(200, 'A') );
+    EXPECT_EQ( cache->stats().hits, 2 );
+
+    VFS::IFile::Buffer patch(10, 'B');
+    EXPECT_EQ( other->write(patch, 4090, patch.size()), patch.size() );
+    EXPECT_EQ( file->read(4090, 10), patch );
+    EXPECT_EQ( file->write(patch, patch.size()), patch.size() );
+    EXPECT_EQ( file->read(data.size(), 100), patch );
+    EXPECT_EQ( file->size(), data.size() + patch.size() );
+
+    std::vector<std::thread> readers;
+    for ( int i = 0; i < 4; ++i )
+        readers.emplace_back([&file] () {
+            for ( int n = 0; n < 100; ++n )
+                EXPECT_EQ( file->read(8192, 100), VFS::IFile::Buffer(100, 'A') );
+        });
+    for ( auto & t : readers )
+        t.join();
+
+    // a write past the end leaves the cached last block short, the read goes on over the hole after it
+    auto end = file->size();
+    EXPECT_EQ( file->read(end - 10, 10).size(), 10u );
+    EXPECT_EQ( other->write(patch, end + 2 * 4096, patch.size()), patch.size() );
+    auto grown = file->read(end - 10, 2 * 4096 + 20);
+    ASSERT_EQ( grown.size(), 2 * 4096 + 20u );
+    EXPECT_EQ( VFS::IFile::Buffer(grown.begin() + 10, grown.begin() + 10 + 2 * 4096), VFS::IFile::Buffer(2 * 4096, 0) );
+    EXPECT_EQ( VFS::IFile::Buffer(grown.end() - 10, grown.end()), patch );
+
+    EXPECT_TRUE( fs.remove("file.bin") );
+    VFS::fs::remove_all(dir);
+}
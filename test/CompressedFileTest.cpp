@@ -0,0 +1,270 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+namespace {
+
+std::vector<std::shared_ptr<VFS::Codec>> codecs()
+{
+    std::vector<std::shared_ptr<VFS::Codec>> result = { VFS::Codec::passthrough() };
+    if ( VFS::Codec::zlib() != nullptr )
+        result.push_back(VFS::Codec::zlib());
+
+    return result;
+}
+
+// Text like a log, compresses well but not into nothing.
+std::string logLines(std::size_t size, unsigned seed)
+{
+    std::mt19937 random(seed);
+    std::string text;
+    while ( text.size() < size )
+        text += "2026-10-16 12:00:" + std::to_string(random() % 60) + " INFO request " + std::to_string(random() % 100000) + " served\n";
+    text.resize(size);
+
+    return text;
+}
+
+std::shared_ptr<VFS::CompressedFile::Store> load(std::string const & path, std::shared_ptr<VFS::Codec> codec)
+{
+    return VFS::CompressedFile::load(std::make_shared<VFS::RegularFile>(path), codec);
+}
+
+std::string content(VFS::IFile & file)
+{
+    auto data = file.readAll();
+    return std::string(data.begin(), data.end());
+}
+
+}
+
+TEST(CompressedFileTest, Blocks) {
+    auto path = ( VFS::fs::temp_directory_path() / "vfs_compressed_blocks" ).string();
+    for ( auto const & codec : codecs() )
+    {
+        VFS::fs::remove(path);
+        auto expected = logLines(1024 * 1024 + 1000, 1);
+        {
+            auto store = load(path, codec);
+            ASSERT_TRUE( store != nullptr );
+            VFS::CompressedFile file(store);
+
+            // streamed in 32 KiB writes, full blocks are stored while the writes go on
+            for ( std::size_t offset = 0; offset < expected.size(); offset += 32 * 1024 )
+            {
+                auto size = std::min<std::size_t>(32 * 1024, expected.size() - offset);
+                ASSERT_EQ( file.write(expected.data() + offset, offset, size), size );
+            }
+            EXPECT_EQ( file.size(), expected.size() );
+
+            // small writes across block boundaries only change the blocks they touch
+            std::mt19937 random(2);
+            for ( int i = 0; i < 200; ++i )
+            {
+                auto offset = random() % ( expected.size() - 100 );
+                auto patch = logLines(1 + random() % 100, i);
+                file.write(patch.data(), offset, patch.size());
+                expected.replace(offset, patch.size(), patch);
+            }
+            EXPECT_EQ( file.read(VFS::CompressedFile::BLOCK_SIZE - 10, 20), VFS::IFile::Buffer(expected.begin() + VFS::CompressedFile::BLOCK_SIZE - 10,
+                                                                                               expected.begin() + VFS::CompressedFile::BLOCK_SIZE + 10) );
+            EXPECT_EQ( file.sync(), 0 );
+            EXPECT_EQ( file.stats().dirty, 0u );
+            EXPECT_EQ( file.stats().raw, expected.size() );
+
+            // a write past the end leaves zeros in between
+            file.write(VFS::IFile::Buffer(4, 'z'), expected.size() + 3 * VFS::CompressedFile::BLOCK_SIZE, 4);
+            expected.append(3 * VFS::CompressedFile::BLOCK_SIZE, '\0');
+            expected.append(4, 'z');
+            EXPECT_EQ( content(file), expected );
+            EXPECT_EQ( file.read(10).size(), 10u );
+            EXPECT_EQ( file.read(10), VFS::IFile::Buffer(expected.begin() + 10, expected.begin() + 20) );
+        }
+
+        // everything reads back from the index once the file is opened again
+        auto store = load(path, VFS::Codec::passthrough());
+        ASSERT_TRUE( store != nullptr );
+        VFS::CompressedFile file(store);
+        EXPECT_EQ( file.size(), expected.size() );
+        EXPECT_EQ( content(file), expected );
+        auto stats = file.stats();
+        if ( codec->id() == VFS::Codec::ZLIB )
+        {
+            EXPECT_LT( stats.compressed * 3, stats.raw );
+            EXPECT_LT( VFS::fs::file_size(path) * 2, expected.size() );
+        }
+
+        // rewritten blocks reuse the space the version before the stored one had, blocks written from here on are
+        // stored as they are
+        std::uintmax_t stored = 0;
+        for ( int round = 0; round < 5; ++round )
+        {
+            file.write(expected.data(), 0, 256 * 1024);
+            EXPECT_EQ( file.sync(), 0 );
+            if ( round == 1 )
+                stored = VFS::fs::file_size(path);
+        }
+        EXPECT_LE( VFS::fs::file_size(path), stored + 4096 );
+        EXPECT_EQ( content(file), expected );
+    }
+
+    // closing a handle doesn't sync, a crash may leave the header of the last sync and what it points to is kept
+    // until the next one
+    VFS::fs::remove(path);
+    auto expected = logLines(256 * 1024, 3);
+    auto store = load(path, VFS::Codec::passthrough());
+    ASSERT_TRUE( store != nullptr );
+    VFS::CompressedFile file(store);
+    file.write(expected.data(), 0, expected.size());
+    EXPECT_EQ( file.sync(), 0 );
+    std::string header(64, '\0');
+    std::ifstream{ path, std::ios::binary }.read(&header[0], header.size());
+    for ( int round = 0; round < 3; ++round )
+    {
+        VFS::CompressedFile other(store);
+        auto text = logLines(expected.size(), 10 + round);
+        other.write(text.data(), 0, text.size());
+        other.close();
+    }
+    file.close();
+    store = nullptr;
+    std::fstream{ path, std::ios::binary | std::ios::in | std::ios::out }.write(header.data(), header.size());
+    VFS::CompressedFile crashed(load(path, VFS::Codec::passthrough()));
+    EXPECT_EQ( content(crashed), expected );
+    crashed.close();
+
+    // what isn't a compressed file is left alone
+    std::ofstream{ path } << "plain text";
+    EXPECT_TRUE( load(path, VFS::Codec::passthrough()) == nullptr );
+    VFS::fs::remove(path);
+}
+
+TEST(CompressedFileTest, Concurrent) {
+    auto path = ( VFS::fs::temp_directory_path() / "vfs_compressed_concurrent" ).string();
+    VFS::fs::remove(path);
+    auto codec = codecs().back();
+    auto store = load(path, codec);
+    ASSERT_TRUE( store != nullptr );
+
+    // handles of one store write their own ranges, unaligned to the blocks, while others read
+    constexpr std::size_t threads = 4;
+    constexpr std::size_t part = 300 * 1000;
+    std::vector<std::string> parts;
+    for ( std::size_t t = 0; t < threads; ++t )
+        parts.push_back(logLines(part, t));
+
+    std::vector<std::thread> workers;
+    for ( std::size_t t = 0; t < threads; ++t )
+    {
+        workers.emplace_back([&store, &parts, t] ()
+        {
+            VFS::CompressedFile file(store);
+            for ( std::size_t offset = 0; offset < part; offset += 7000 )
+            {
+                auto size = std::min<std::size_t>(7000, part - offset);
+                file.write(parts[t].data() + offset, t * part + offset, size);
+                char check[16];
+                file.read(check, t * part, sizeof(check));
+            }
+        });
+    }
+    for ( auto & worker : workers )
+        worker.join();
+
+    VFS::CompressedFile file(store);
+    std::string expected;
+    for ( auto const & p : parts )
+        expected += p;
+    EXPECT_EQ( content(file), expected );
+    file.close();
+    store = nullptr;
+
+    VFS::CompressedFile reopened(load(path, codec));
+    EXPECT_EQ( content(reopened), expected );
+    reopened.close();
+    VFS::fs::remove(path);
+}
+
+TEST(CompressedFileTest, FileSystem) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_compressed_fs";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir / "logs" / "raw");
+    std::ofstream{ dir / "logs" / "old" } << "written before";
+
+    auto codec = codecs().back();
+    VFS::FileSystem fs(dir.string());
+    EXPECT_TRUE( fs.setCompression(codec, "logs") );
+    EXPECT_TRUE( fs.setCompression(nullptr, "logs/raw") );
+    EXPECT_FALSE( fs.setCompression(codec, "../elsewhere") );
+
+    auto text = logLines(500 * 1000, 7);
+    for ( auto name : { "logs/today", "logs/raw/today", "today" } )
+    {
+        ASSERT_TRUE( fs.touchFile(name) );
+        auto file = fs.open(name);
+        ASSERT_TRUE( file != nullptr );
+        EXPECT_EQ( file->write(text.data(), 0, text.size()), text.size() );
+
+        // another open sees what is not stored yet
+        auto other = fs.open(name, VFS::Perms::READ);
+        EXPECT_EQ( other->size(), text.size() );
+        EXPECT_EQ( other->read(1000, 10), VFS::IFile::Buffer(text.begin() + 1000, text.begin() + 1010) );
+        file->close();
+        EXPECT_EQ( content(*other), text );
+    }
+
+    // only the compressed directory holds less than it was given
+    EXPECT_EQ( VFS::fs::file_size(dir / "today"), text.size() );
+    EXPECT_EQ( VFS::fs::file_size(dir / "logs" / "raw" / "today"), text.size() );
+    if ( codec->id() == VFS::Codec::ZLIB )
+    {
+        EXPECT_LT( VFS::fs::file_size(dir / "logs" / "today") * 2, text.size() );
+    }
+    EXPECT_EQ( content(*fs.open("logs/old")), "written before" );
+
+    // moved or copied within the filesystem the file stays compressed and reads back as it was written, also out of
+    // the compressed directory and with blocks not stored yet
+    ASSERT_TRUE( fs.moveTo("logs/today", "logs/yesterday") );
+    EXPECT_EQ( content(*fs.open("logs/yesterday")), text );
+    ASSERT_TRUE( fs.moveTo("logs/yesterday", "logs/raw/yesterday") );
+    EXPECT_EQ( content(*fs.open("logs/raw/yesterday")), text );
+    auto open = fs.open("logs/raw/yesterday");
+    open->write(VFS::IFile::Buffer(10, 'x'), 100, 10);
+    text.replace(100, 10, 10, 'x');
+    ASSERT_TRUE( fs.copy("logs/raw/yesterday", "copied") );
+    open = nullptr;
+    EXPECT_EQ( content(*fs.open("copied")), text );
+    EXPECT_EQ( content(*fs.open("copied", VFS::Perms::READ)), text );
+    if ( codec->id() == VFS::Codec::ZLIB )
+    {
+        EXPECT_LT( VFS::fs::file_size(dir / "logs" / "raw" / "yesterday") * 2, text.size() );
+        EXPECT_LT( VFS::fs::file_size(dir / "copied") * 2, text.size() );
+    }
+
+    // and when compression is turned off, only new files are plain
+    ASSERT_TRUE( fs.touchFile("logs/kept") );
+    fs.open("logs/kept")->write(text.data(), 0, text.size());
+    EXPECT_TRUE( fs.setCompression(nullptr, "logs") );
+    EXPECT_EQ( content(*fs.open("logs/kept")), text );
+    ASSERT_TRUE( fs.touchFile("logs/new") );
+    fs.open("logs/new")->write(text.data(), 0, text.size());
+    EXPECT_EQ( VFS::fs::file_size(dir / "logs" / "new"), text.size() );
+
+    // a file seen plain once and compressed since is read as compressed
+    ASSERT_TRUE( fs.touchFile("logs/late") );
+    EXPECT_EQ( fs.open("logs/late")->size(), 0u );
+    EXPECT_TRUE( fs.setCompression(codec, "logs") );
+    fs.open("logs/late")->write(text.data(), 0, text.size());
+    EXPECT_TRUE( fs.setCompression(nullptr, "logs") );
+    EXPECT_EQ( content(*fs.open("logs/late")), text );
+
+    // moved to another filesystem it is plain again
+    auto memfs = std::make_shared<VFS::MemoryFileSystem>("memfs");
+    ASSERT_TRUE( fs.moveTo("copied", memfs, "archived") );
+    EXPECT_EQ( content(*memfs->open("archived")), text );
+    VFS::fs::remove_all(dir);
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include "vfs/VFS.h"
+
+static std::string content(std::string const & path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+TEST(CopyEngineTest, Strategies) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_copyengine_strategies";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    auto from = ( dir / "from" ).string();
+    std::string data(3 * 1024 * 1024 + 17, 'x');
+    for ( std::size_t i = 0; i < data.size(); i += 4096 )
+        data[i] = static_cast<char>('a' + i % 26);
+    std::ofstream{ from, std::ios::binary } << data;
+
+    // every mechanism from the given one down ends up with the same file
+    using Strategy = VFS::CopyEngine::Strategy;
+    for ( auto first : { Strategy::REFLINK, Strategy::COPY_FILE_RANGE, Strategy::SENDFILE, Strategy::BUFFERED } )
+    {
+        auto to = ( dir / VFS::CopyEngine::name(first) ).string();
+        std::uint64_t reported = 0;
+        auto result = VFS::CopyEngine::copy(from, to, first, [&reported] (std::uint64_t copied, std::uint64_t total) {
+            EXPECT_LE( copied, total );
+            reported = copied;
+        });
+        EXPECT_TRUE( result.ok );
+        EXPECT_TRUE( result.strategy >= first );
+        EXPECT_EQ( result.bytes, data.size() );
+        EXPECT_EQ( reported, data.size() );
+        EXPECT_EQ( content(to), data );
+        std::cout << VFS::CopyEngine::name(first) << " -> " << VFS::CopyEngine::name(result.strategy) << std::endl;
+    }
+
+    EXPECT_TRUE( !VFS::CopyEngine::copy(from, ( dir / "buffered" ).string()).ok );
+    EXPECT_TRUE( !VFS::CopyEngine::copy(dir.string(), ( dir / "dir" ).string()).ok );
+    EXPECT_TRUE( !VFS::fs::exists(dir / "dir") );
+    VFS::fs::remove_all(dir);
+}
+
+TEST(CopyEngineTest, Sparse) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_copyengine_sparse";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    auto from = ( dir / "from" ).string();
+
+    // 4 KiB of data, a 64 MiB hole, 4 KiB of data, then a trailing hole
+    constexpr off_t hole = 64 * 1024 * 1024;
+    int fd = ::open(from.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE( fd, 0 );
+    std::string block(4096, 'd');
+    EXPECT_EQ( ::pwrite(fd, block.data(), block.size(), 0), 4096 );
+    EXPECT_EQ( ::pwrite(fd, block.data(), block.size(), hole), 4096 );
+    EXPECT_EQ( ::ftruncate(fd, 2 * hole), 0 );
+    ::close(fd);
+
+    auto to = ( dir / "to" ).string();
+    auto result = VFS::CopyEngine::copy(from, to, VFS::CopyEngine::Strategy::BUFFERED);
+    ASSERT_TRUE( result.ok );
+    EXPECT_EQ( VFS::fs::file_size(to), static_cast<std::uintmax_t>(2 * hole) );
+
+    struct stat source, target;
+    ::stat(from.c_str(), &source);
+    ::stat(to.c_str(), &target);
+    // only filesystems that report holes keep them, the others copy zeroes
+    if ( result.bytes < static_cast<std::uint64_t>(hole) )
+    {
+        EXPECT_LE( target.st_blocks, source.st_blocks + 16 );
+    }
+
+    std::ifstream in(to, std::ios::binary);
+    in.seekg(hole - 1);
+    EXPECT_EQ( in.get(), 0 );
+    EXPECT_EQ( in.get(), 'd' );
+    VFS::fs::remove_all(dir);
+}
+
+TEST(CopyEngineTest, FileSystem) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_copyengine_fs";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    std::ofstream{ dir / "file" } << "copied";
+    VFS::fs::permissions(dir / "file", VFS::fs::perms::owner_read | VFS::fs::perms::owner_write | VFS::fs::perms::group_read);
+
+    VFS::FileSystem fs( dir.string() );
+    auto result = fs.copyFile("file", "copy");
+    EXPECT_TRUE( result.ok );
+    EXPECT_EQ( result.bytes, 6 );
+    EXPECT_TRUE( result.strategy != VFS::CopyEngine::Strategy::NONE );
+    EXPECT_EQ( content(( dir / "copy" ).string()), "copied" );
+    EXPECT_EQ( VFS::fs::status(dir / "copy").permissions(), VFS::fs::status(dir / "file").permissions() );
+    EXPECT_TRUE( fs.contain("copy") );
+    EXPECT_TRUE( !fs.copy("file", "copy") );
+    VFS::fs::remove_all(dir);
+}
+
+TEST(CopyEngineTest, Stream) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_copyengine_stream";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    std::string data(2 * VFS::CopyEngine::BUFFER_SIZE + 99, 's');
+    for ( std::size_t i = 0; i < data.size(); i += 1000 )
+        data[i] = static_cast<char>('a' + i % 26);
+    std::ofstream{ dir / "from", std::ios::binary } << data;
+
+    // a disk file into memory and back, the chunks alternate between the two buffers
+    VFS::MemoryFileSystem memory( "memfs" );
+    ASSERT_TRUE( memory.touchFile("copy") );
+    VFS::RegularFile from(( dir / "from" ).string());
+    auto copy = memory.open("copy");
+    auto result = VFS::CopyEngine::stream(from, *copy);
+    EXPECT_TRUE( result.ok );
+    EXPECT_TRUE( result.strategy == VFS::CopyEngine::Strategy::STREAM );
+    EXPECT_EQ( result.bytes, data.size() );
+    EXPECT_EQ( copy->size(), data.size() );
+
+    VFS::RegularFile back(( dir / "back" ).string());
+    EXPECT_TRUE( VFS::CopyEngine::stream(*copy, back).ok );
+    EXPECT_EQ( content(( dir / "back" ).string()), data );
+    VFS::fs::remove_all(dir);
+}
+
+TEST(CopyEngineTest, MoveAcross) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_copyengine_move";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir / "tree" / "sub");
+    std::ofstream{ dir / "tree" / "a" } << "first";
+    std::ofstream{ dir / "tree" / "sub" / "b" } << "second";
+    std::ofstream{ dir / "single" } << "alone";
+    VFS::fs::permissions(dir / "single", VFS::fs::perms::owner_read | VFS::fs::perms::owner_write);
+    auto mtime = VFS::fs::last_write_time(dir / "single") - std::chrono::hours(24);
+    VFS::fs::last_write_time(dir / "single", mtime);
+
+    auto source = std::make_shared<VFS::FileSystem>( dir.string() );
+    auto memory = std::make_shared<VFS::MemoryFileSystem>( "memfs" );
+    EXPECT_TRUE( source->moveTo("tree", memory, "tree") );
+    EXPECT_TRUE( !VFS::fs::exists(dir / "tree") );
+    EXPECT_STREQ( memory->type("tree/sub"), VFS::type::DIRECTORY );
+    auto b = memory->open("tree/sub/b");
+    ASSERT_TRUE( b != nullptr );
+    EXPECT_EQ( b->readAll(), VFS::IFile::Buffer({ 's', 'e', 'c', 'o', 'n', 'd' }) );
+
+    // a target that already exists stops the move before anything happens
+    std::ofstream{ dir / "tree" } << "back";
+    EXPECT_TRUE( !source->moveTo("tree", memory, "tree") );
+    EXPECT_TRUE( VFS::fs::exists(dir / "tree") );
+
+    // /dev/shm is usually another device, rename() fails with EXDEV there and the file is streamed
+    auto other = VFS::fs::path("/dev/shm") / "vfs_copyengine_move";
+    if ( !VFS::fs::is_directory(other.parent_path()) )
+        other = dir / "other";
+    VFS::fs::remove_all(other);
+    VFS::fs::create_directories(other);
+    auto target = std::make_shared<VFS::FileSystem>( other.string() );
+    EXPECT_TRUE( source->moveTo("single", target, "single") );
+    EXPECT_TRUE( !VFS::fs::exists(dir / "single") );
+    EXPECT_EQ( content(( other / "single" ).string()), "alone" );
+    EXPECT_EQ( VFS::fs::status(other / "single").permissions(), VFS::fs::perms::owner_read | VFS::fs::perms::owner_write );
+    EXPECT_TRUE( VFS::fs::last_write_time(other / "single") == mtime );
+    VFS::fs::remove_all(other);
+    VFS::fs::remove_all(dir);
+}
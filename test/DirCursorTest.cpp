@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <string>
+#include "vfs/VFS.h"
+
+static std::string tempTree(std::string const & name) {
+    auto dir = VFS::fs::temp_directory_path() / name;
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir / "dir1" / "sub1");
+    VFS::fs::create_directories(dir / "dir2");
+    for ( int i = 0; i < 20; ++i )
+        std::ofstream{ dir / ( "file" + std::to_string(i) ) };
+    std::ofstream{ dir / "dir1" / "file20" };
+    std::ofstream{ dir / "dir1" / "sub1" / "file21" };
+    std::ofstream{ dir / "dir2" / "file22" };
+    return dir.string() + "/";
+}
+
+TEST(DirCursorTest, Batches) {
+    auto root = tempTree("vfs_dircursor_batches");
+    VFS::DirCursor flat(root, false);
+    auto top = flat.next(100);
+    EXPECT_EQ( top.size(), 22 );
+    EXPECT_TRUE( flat.next().empty() );
+    EXPECT_TRUE( flat.done() );
+    EXPECT_EQ( flat.cookie(), VFS::DirCursor::END );
+
+    VFS::DirCursor all(root);
+    std::vector<std::string> entries;
+    for ( auto batch = all.next(4); !batch.empty(); batch = all.next(4) )
+    {
+        EXPECT_LE( batch.size(), 4 );
+        entries.insert(entries.end(), batch.begin(), batch.end());
+    }
+    EXPECT_EQ( entries.size(), 26 );
+
+    // depth first: a directory comes right before its children
+    auto sub = std::find(entries.begin(), entries.end(), root + "dir1/sub1");
+    ASSERT_TRUE( sub != entries.end() );
+    EXPECT_EQ( *std::next(sub), root + "dir1/sub1/file21" );
+    VFS::fs::remove_all(root);
+}
+
+TEST(DirCursorTest, Cookie) {
+    auto root = tempTree("vfs_dircursor_cookie");
+    std::set<std::string> seen;
+    std::string cookie;
+    std::size_t total = 0;
+    // a new cursor for every page, as a stateless server would do
+    while ( cookie != VFS::DirCursor::END )
+    {
+        VFS::DirCursor cursor(root, true, cookie);
+        auto batch = cursor.next(3);
+        total += batch.size();
+        seen.insert(batch.begin(), batch.end());
+        cookie = cursor.cookie();
+    }
+    EXPECT_EQ( total, 26 );
+    EXPECT_EQ( seen.size(), 26 );
+    EXPECT_TRUE( seen.count(root + "dir1/sub1/file21") );
+
+    VFS::DirCursor end(root, true, VFS::DirCursor::END);
+    EXPECT_TRUE( end.done() );
+    VFS::DirCursor missing(root + "nothing");
+    EXPECT_TRUE( missing.next().empty() );
+    VFS::fs::remove_all(root);
+}
+
+TEST(DirCursorTest, FileSystem) {
+    auto root = tempTree("vfs_dircursor_fs");
+    VFS::FileSystem fs( root );
+    auto listed = fs.list("dir1");
+    EXPECT_EQ( std::set<std::string>(listed.begin(), listed.end()),
+               std::set<std::string>({ root + "dir1/file20", root + "dir1/sub1", root + "dir1/sub1/file21" }) );
+
+    auto cursor = fs.openDir("dir1", false);
+    ASSERT_TRUE( cursor != nullptr );
+    EXPECT_EQ( cursor->next().size(), 2 );
+    EXPECT_TRUE( fs.openDir("file1") == nullptr );
+    EXPECT_TRUE( fs.openDir("nothing") == nullptr );
+    VFS::fs::remove_all(root);
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+TEST(GroupCommitTest, Batching) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_groupcommit_batching";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+
+    constexpr int files = 4;
+    constexpr int threads = 16;
+    constexpr int rounds = 20;
+    std::vector<int> fds;
+    for ( int i = 0; i < files; ++i )
+        fds.push_back(::open(( dir / std::to_string(i) ).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+
+    // requests that come in while the committer is busy go into one commit, with one sync per file
+    VFS::GroupCommit commit;
+    std::promise<void> release;
+    std::atomic<bool> busy(false);
+    auto released = release.get_future().share();
+    commit.schedule(VFS::GroupCommit::Clock::now(), [&busy, released] () { busy = true; released.wait(); });
+    while ( !busy )
+        std::this_thread::yield();
+
+    std::vector<std::thread> workers;
+    for ( int t = 0; t < threads; ++t )
+        workers.emplace_back([&fds, &commit, t] () { EXPECT_EQ( commit.sync(fds[t % files]), 0 ); });
+    while ( commit.stats().requests != static_cast<std::uint64_t>(threads) )
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    release.set_value();
+    for ( auto & worker : workers )
+        worker.join();
+
+    auto stats = commit.stats();
+    EXPECT_EQ( stats.commits, 1u );
+    EXPECT_EQ( stats.syncs, static_cast<std::uint64_t>(files) );
+
+    // every thread writes and syncs on its own, the commits are shared
+    workers.clear();
+    for ( int t = 0; t < threads; ++t )
+    {
+        workers.emplace_back([&fds, &commit, t] ()
+        {
+            int fd = fds[t % files];
+            for ( int i = 0; i < rounds; ++i )
+            {
+                EXPECT_EQ( ::pwrite(fd, "x", 1, t * rounds + i), 1 );
+                EXPECT_EQ( commit.sync(fd, i % 2 == 0), 0 );
+            }
+        });
+    }
+    for ( auto & worker : workers )
+        worker.join();
+
+    stats = commit.stats();
+    EXPECT_EQ( stats.requests, static_cast<std::uint64_t>(threads + threads * rounds) );
+    EXPECT_LT( stats.commits, stats.requests );
+    EXPECT_LT( stats.syncs, stats.requests );
+
+    EXPECT_EQ( commit.sync(-1), -EBADF );
+    for ( auto fd : fds )
+        ::close(fd);
+    VFS::fs::remove_all(dir);
+}
+
+TEST(GroupCommitTest, Timers) {
+    VFS::GroupCommit commit;
+    std::atomic<int> order(0);
+    std::atomic<int> first(0);
+    std::atomic<int> second(0);
+    auto now = VFS::GroupCommit::Clock::now();
+    commit.schedule(now + std::chrono::milliseconds(20), [&] () { second = ++order; });
+    commit.schedule(now + std::chrono::milliseconds(5), [&] () { first = ++order; });
+    auto dropped = commit.schedule(now + std::chrono::hours(1), [&] () { ++order; });
+    commit.cancel(dropped);
+
+    for ( int i = 0; i < 200 && second == 0; ++i )
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ( first, 1 );
+    EXPECT_EQ( second, 2 );
+
+    // cancelling a running task waits for it
+    std::promise<void> started;
+    std::atomic<bool> done(false);
+    auto running = commit.schedule(VFS::GroupCommit::Clock::now(), [&started, &done] ()
+    {
+        started.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        done = true;
+    });
+    started.get_future().wait();
+    commit.cancel(running);
+    EXPECT_TRUE( done );
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+TEST(HandleTableTest, Reuse) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_handletable_reuse";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir / "sub");
+    auto path = ( dir / "file" ).string();
+    std::ofstream{ path } << "shared";
+
+    VFS::HandleTable table;
+    auto first = table.acquire(path);
+    ASSERT_TRUE( first != nullptr );
+    auto second = table.acquire(path);
+    EXPECT_EQ( first, second );
+    EXPECT_EQ( table.stats().opens, 1u );
+    EXPECT_EQ( table.stats().hits, 1u );
+    EXPECT_TRUE( table.acquire(( dir / "sub" ).string()) == nullptr );
+    EXPECT_TRUE( table.acquire(( dir / "missing" ).string()) == nullptr );
+
+    // files on the same handle close independently
+    {
+        VFS::RegularFile a(path, first);
+        VFS::MappedFile b(path, second);
+        a.close();
+        EXPECT_EQ( b.readAll(), VFS::IFile::Buffer({ 's', 'h', 'a', 'r', 'e', 'd' }) );
+    }
+
+    // a file replaced behind the table has no links left on the old handle, nor what was learned of the old file
+    first->setCompressed(false);
+    EXPECT_EQ( second->compressed(), 0 );
+    std::ofstream{ dir / "next" } << "replaced";
+    std::rename(( dir / "next" ).c_str(), path.c_str());
+    auto third = table.acquire(path);
+    EXPECT_NE( third, first );
+    EXPECT_EQ( third->compressed(), -1 );
+    EXPECT_EQ( VFS::RegularFile(path, third).readAll().size(), 8u );
+
+    table.invalidate(dir.string());
+    EXPECT_EQ( table.size(), 0u );
+    VFS::fs::remove_all(dir);
+}
+
+TEST(HandleTableTest, Budget) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_handletable_budget";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    for ( int i = 0; i < 8; ++i )
+        std::ofstream{ dir / std::to_string(i) } << i;
+
+    VFS::HandleTable table(4);
+    auto held = table.acquire(( dir / "0" ).string());
+    for ( int i = 1; i < 8; ++i )
+        table.acquire(( dir / std::to_string(i) ).string());
+    EXPECT_EQ( table.size(), 4u );
+    EXPECT_EQ( table.stats().evictions, 4u );
+
+    // the handle in use stayed, the least recently used free ones went
+    table.acquire(( dir / "0" ).string());
+    table.acquire(( dir / "7" ).string());
+    EXPECT_EQ( table.stats().hits, 2u );
+    table.acquire(( dir / "1" ).string());
+    EXPECT_EQ( table.stats().opens, 9u );
+
+    table.setBudget(0);
+    EXPECT_EQ( table.size(), 1u );
+    held = nullptr;
+    table.setBudget(0);
+    EXPECT_EQ( table.size(), 0u );
+    VFS::fs::remove_all(dir);
+}
+
+TEST(HandleTableTest, FileSystem) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_handletable_fs";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir / "dir");
+    std::ofstream{ dir / "dir" / "file" } << "before";
+
+    VFS::FileSystem fs( dir.string() );
+    std::vector<std::thread> threads;
+    for ( int t = 0; t < 4; ++t )
+    {
+        threads.emplace_back([&fs] ()
+        {
+            for ( int i = 0; i < 100; ++i )
+            {
+                auto file = fs.open("dir/file", i % 2 == 0 ? VFS::Perms::RW : VFS::Perms::READ);
+                ASSERT_TRUE( file != nullptr );
+                EXPECT_EQ( file->size(), 6u );
+            }
+        });
+    }
+    for ( auto & thread : threads )
+        thread.join();
+    EXPECT_LE( fs.handleStats().opens, 4u );
+    EXPECT_GE( fs.handleStats().hits, 396u );
+    EXPECT_TRUE( fs.open("dir") == nullptr );
+
+    // removing or renaming through the filesystem drops the handle of the old file
+    auto open = fs.open("dir/file");
+    EXPECT_TRUE( fs.remove("dir/file") );
+    EXPECT_TRUE( fs.open("dir/file") == nullptr );
+    EXPECT_EQ( open->readAll().size(), 6u );
+    std::ofstream{ dir / "dir" / "file" } << "after!!";
+    EXPECT_EQ( fs.open("dir/file")->size(), 7u );
+    EXPECT_TRUE( fs.moveTo("dir", "moved") );
+    EXPECT_TRUE( fs.open("dir/file") == nullptr );
+    EXPECT_EQ( fs.open("moved/file")->size(), 7u );
+
+    // a move to another filesystem that fails keeps the handle
+    auto memfs = std::make_shared<VFS::MemoryFileSystem>("memfs");
+    auto opens = fs.handleStats().opens;
+    EXPECT_FALSE( fs.moveTo("moved/file", memfs, "missing/file") );
+    EXPECT_EQ( fs.open("moved/file")->size(), 7u );
+    EXPECT_EQ( fs.handleStats().opens, opens );
+    VFS::fs::remove_all(dir);
+}
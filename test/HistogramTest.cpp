@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include "vfs/VFS.h"
+
+TEST(HistogramTest, Buckets) {
+    // every bucket starts right after the one before and holds what falls into it
+    for ( std::size_t i = 1; i < VFS::Histogram::BUCKETS; ++i )
+    {
+        EXPECT_EQ( VFS::Histogram::lowerBound(i), VFS::Histogram::upperBound(i - 1) + 1 );
+        EXPECT_EQ( VFS::Histogram::bucketOf(VFS::Histogram::lowerBound(i)), i );
+        EXPECT_EQ( VFS::Histogram::bucketOf(VFS::Histogram::upperBound(i)), i );
+    }
+
+    // a bucket is no wider than 1/SUB_BUCKETS of its values
+    for ( std::uint64_t value : { 17ull, 1000ull, 123456789ull, 1ull << 40 } )
+    {
+        auto bucket = VFS::Histogram::bucketOf(value);
+        auto width = VFS::Histogram::upperBound(bucket) - VFS::Histogram::lowerBound(bucket) + 1;
+        EXPECT_LE( width * VFS::Histogram::SUB_BUCKETS, value );
+    }
+    EXPECT_EQ( VFS::Histogram::bucketOf(~0ull), VFS::Histogram::BUCKETS - 1 );
+}
+
+TEST(HistogramTest, Percentiles) {
+    VFS::Histogram histogram;
+    EXPECT_EQ( histogram.percentile(50), 0u );
+    EXPECT_EQ( histogram.max(), 0u );
+
+    for ( std::uint64_t value = 1; value <= 1000; ++value )
+        histogram.record(value * 1000);
+    EXPECT_EQ( histogram.count(), 1000u );
+
+    // within the precision of a bucket
+    auto near = [] (std::uint64_t value, std::uint64_t expected) { return value >= expected && value <= expected + expected / 16; };
+    EXPECT_TRUE( near(histogram.percentile(50), 500000) );
+    EXPECT_TRUE( near(histogram.percentile(99), 990000) );
+    EXPECT_TRUE( near(histogram.max(), 1000000) );
+    EXPECT_LE( histogram.min(), 1000u );
+    EXPECT_NEAR( histogram.mean(), 500500, 500500 / 16 );
+
+    VFS::Histogram other;
+    other.record(1ull << 30);
+    histogram.merge(other);
+    EXPECT_EQ( histogram.count(), 1001u );
+    EXPECT_GE( histogram.percentile(100), 1ull << 30 );
+    EXPECT_TRUE( near(histogram.percentile(50), 500000) );
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+namespace {
+
+std::map<std::string, VFS::Metrics::OpStats> byName(VFS::Metrics const & metrics)
+{
+    std::map<std::string, VFS::Metrics::OpStats> stats;
+    for ( auto const & op : metrics.snapshot() )
+        stats.emplace(VFS::Metrics::name(op.op), op);
+
+    return stats;
+}
+
+}
+
+TEST(InstrumentedFSTest, Counts) {
+    auto memfs = std::make_shared<VFS::MemoryFileSystem>("memfs");
+    VFS::InstrumentedFS fs(memfs);
+
+    ASSERT_TRUE( fs.touchFile("file") );
+    EXPECT_FALSE( fs.touchFile("file") );
+    auto file = fs.open("file");
+    ASSERT_TRUE( file != nullptr );
+    EXPECT_TRUE( fs.open("missing") == nullptr );
+    EXPECT_EQ( file->write(VFS::IFile::Buffer(100, 'x'), 0, 100), 100u );
+    EXPECT_EQ( file->read(0, 60).size(), 60u );
+    EXPECT_EQ( file->readAll().size(), 100u );
+    EXPECT_EQ( fs.search("file"), "./file" );
+    EXPECT_EQ( fs.search("missing"), VFS::type::NOTFOUND );
+    EXPECT_EQ( fs.list().size(), 1u );
+
+    auto stats = byName(*fs.metrics());
+    EXPECT_EQ( stats["touchFile"].calls, 2u );
+    EXPECT_EQ( stats["touchFile"].errors, 1u );
+    EXPECT_EQ( stats["open"].calls, 2u );
+    EXPECT_EQ( stats["open"].errors, 1u );
+    EXPECT_EQ( stats["write"].bytes, 100u );
+    EXPECT_EQ( stats["read"].bytes, 60u );
+    EXPECT_EQ( stats["readAll"].bytes, 100u );
+    EXPECT_EQ( stats["search"].calls, 2u );
+    EXPECT_EQ( stats["search"].errors, 1u );
+    EXPECT_EQ( stats["list"].latency.count(), 1u );
+    EXPECT_EQ( stats.count("copy"), 0u );
+
+    auto json = fs.metrics()->toJson();
+    EXPECT_NE( json.find("\"search\":{\"calls\":2,\"bytes\":0,\"errors\":1"), std::string::npos );
+    EXPECT_NE( json.find("\"p99\":"), std::string::npos );
+
+    fs.metrics()->reset();
+    EXPECT_TRUE( fs.metrics()->snapshot().empty() );
+}
+
+TEST(InstrumentedFSTest, Async) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_instrumented_async";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    auto disk = std::make_shared<VFS::FileSystem>(dir.string());
+    VFS::InstrumentedFS fs(disk);
+
+    ASSERT_TRUE( fs.touchFile("file") );
+    auto file = fs.open("file");
+    ASSERT_TRUE( file != nullptr );
+    std::string data(4096, 'a');
+    EXPECT_EQ( file->writeAsync(data.data(), 0, data.size()).get(), 4096 );
+    EXPECT_EQ( file->fsyncAsync().get(), 0 );
+    std::vector<char> back(4096);
+    EXPECT_EQ( file->readAsync(back.data(), 0, back.size()).get(), 4096 );
+    EXPECT_EQ( file->sync(), 0 );
+
+    auto stats = byName(*fs.metrics());
+    EXPECT_EQ( stats["writeAsync"].bytes, 4096u );
+    EXPECT_EQ( stats["readAsync"].bytes, 4096u );
+    EXPECT_EQ( stats["fsync"].calls, 1u );
+    EXPECT_EQ( stats["sync"].calls, 1u );
+
+    // moving to a decorated filesystem reaches the one it wraps
+    auto other = std::make_shared<VFS::InstrumentedFS>(std::make_shared<VFS::FileSystem>(dir.string()), fs.metrics());
+    file->close();
+    ASSERT_TRUE( fs.makeDir("sub") );
+    EXPECT_TRUE( fs.moveTo("file", other, "sub/file") );
+    EXPECT_TRUE( VFS::fs::exists(dir / "sub" / "file") );
+    EXPECT_EQ( byName(*fs.metrics())["moveTo"].errors, 0u );
+
+    VFS::fs::remove_all(dir);
+}
+
+TEST(InstrumentedFSTest, Threads) {
+    VFS::InstrumentedFS fs(std::make_shared<VFS::MemoryFileSystem>("memfs"));
+    ASSERT_TRUE( fs.touchFile("file") );
+    auto file = fs.open("file");
+    file->write(VFS::IFile::Buffer(16, 'x'), 0, 16);
+
+    // every thread records into its own counters, the snapshot adds them up while they run
+    constexpr int threads = 4, calls = 1000;
+    std::vector<std::thread> workers;
+    for ( int t = 0; t < threads; ++t )
+    {
+        workers.emplace_back([&] ()
+        {
+            char buf[16];
+            for ( int i = 0; i < calls; ++i )
+                file->read(buf, 0, sizeof(buf));
+        });
+    }
+    for ( int i = 0; i < 10; ++i )
+        fs.metrics()->snapshot();
+    for ( auto & worker : workers )
+        worker.join();
+
+    auto stats = byName(*fs.metrics());
+    EXPECT_EQ( stats["read"].calls, std::uint64_t(threads * calls) );
+    EXPECT_EQ( stats["read"].bytes, std::uint64_t(threads * calls * 16) );
+    EXPECT_EQ( stats["read"].latency.count(), std::uint64_t(threads * calls) );
+}
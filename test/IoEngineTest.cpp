@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+#include "vfs/VFS.h"
+
+static void roundTrip(VFS::IoEngine & engine, std::string const & name) {
+    auto path = ( VFS::fs::temp_directory_path() / name ).string();
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    ASSERT_GE( fd, 0 );
+
+    // hundreds of requests in flight from one thread
+    constexpr std::size_t requests = 300;
+    constexpr std::size_t blockSize = 512;
+    std::vector<char> out(requests * blockSize);
+    for ( std::size_t i = 0; i < out.size(); ++i )
+        out[i] = static_cast<char>('a' + ( i / blockSize ) % 26);
+
+    std::vector<std::promise<long>> written(requests);
+    for ( std::size_t i = 0; i < requests; ++i )
+        engine.write(fd, out.data() + i * blockSize, blockSize, i * blockSize, [&written, i] (long result) { written[i].set_value(result); });
+    for ( auto & promise : written )
+        EXPECT_EQ( promise.get_future().get(), static_cast<long>(blockSize) );
+
+    std::promise<long> synced;
+    engine.fsync(fd, true, [&synced] (long result) { synced.set_value(result); });
+    EXPECT_EQ( synced.get_future().get(), 0 );
+
+    std::vector<char> in(out.size() + 100);
+    std::atomic<std::size_t> total(0);
+    std::vector<std::promise<void>> read(requests);
+    for ( std::size_t i = 0; i < requests; ++i )
+    {
+        engine.read(fd, in.data() + i * blockSize, blockSize, i * blockSize, [&total, &read, i] (long result)
+        {
+            total += result;
+            read[i].set_value();
+        });
+    }
+    for ( auto & promise : read )
+        promise.get_future().wait();
+    EXPECT_EQ( total.load(), out.size() );
+    EXPECT_TRUE( std::equal(out.begin(), out.end(), in.begin()) );
+
+    // short at the end of the file, an error for a bad descriptor
+    std::promise<long> tail;
+    engine.read(fd, in.data(), 200, out.size() - 100, [&tail] (long result) { tail.set_value(result); });
+    EXPECT_EQ( tail.get_future().get(), 100 );
+    std::promise<long> bad;
+    engine.read(-1, in.data(), 10, 0, [&bad] (long result) { bad.set_value(result); });
+    EXPECT_EQ( bad.get_future().get(), -EBADF );
+
+    ::close(fd);
+    VFS::fs::remove(path);
+}
+
+TEST(IoEngineTest, Uring) {
+    VFS::IoEngine engine(64);
+    if ( !engine.usesUring() )
+        std::cout << "io_uring unavailable, the thread pool is tested instead" << std::endl;
+    roundTrip(engine, "vfs_ioengine_uring.bin");
+}
+
+TEST(IoEngineTest, ThreadPool) {
+    VFS::IoEngine engine(64, 4, false);
+    EXPECT_TRUE( !engine.usesUring() );
+    roundTrip(engine, "vfs_ioengine_pool.bin");
+
+    std::promise<long> work;
+    engine.submit([] () { return 42L; }, [&work] (long result) { work.set_value(result); });
+    EXPECT_EQ( work.get_future().get(), 42 );
+}
+
+TEST(IoEngineTest, Files) {
+    auto path = ( VFS::fs::temp_directory_path() / "vfs_ioengine_file.txt" ).string();
+    VFS::fs::remove(path);
+    std::string data = "asynchronous hello";
+    {
+        VFS::RegularFile file(path, std::make_shared<VFS::BlockCache>());
+        std::vector<char> cached(5);
+        EXPECT_EQ( file.read(cached.data(), 0, 5), 0 );
+        EXPECT_EQ( file.writeAsync(data.data(), 0, data.size()).get(), static_cast<long>(data.size()) );
+        EXPECT_EQ( file.fsyncAsync().get(), 0 );
+
+        std::vector<char> back(data.size());
+        EXPECT_EQ( file.readAsync(back.data(), 0, back.size()).get(), static_cast<long>(data.size()) );
+        EXPECT_EQ( std::string(back.begin(), back.end()), data );
+        // the write went past the cache, which must not serve stale blocks
+        EXPECT_EQ( file.read(0, 5), VFS::IFile::Buffer(data.begin(), data.begin() + 5) );
+    }
+
+    VFS::MappedFile mapped(path);
+    std::vector<char> back(12);
+    EXPECT_EQ( mapped.readAsync(back.data(), 0, back.size()).get(), 12 );
+    EXPECT_EQ( std::string(back.begin(), back.end()), "asynchronous" );
+    EXPECT_EQ( mapped.fsyncAsync().get(), 0 );
+
+    VFS::RegularFile closed(path);
+    closed.close();
+    EXPECT_EQ( closed.readAsync(back.data(), 0, back.size()).get(), -EBADF );
+    VFS::fs::remove(path);
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+namespace {
+
+std::map<std::string, VFS::LockStats::OpStats> byName(VFS::LockStats const & stats)
+{
+    std::map<std::string, VFS::LockStats::OpStats> ops;
+    for ( auto const & op : stats.snapshot() )
+        ops.emplace(VFS::Metrics::name(op.op), op);
+
+    return ops;
+}
+
+}
+
+TEST(LockStatsTest, Guard) {
+    VFS::LockStats stats;
+    std::mutex mutex;
+    {
+        VFS::LockStats::Guard<std::unique_lock<std::mutex>> lock(nullptr, VFS::Metrics::Op::READ, mutex);
+    }
+    EXPECT_TRUE( stats.snapshot().empty() );
+
+    // the second thread finds the lock taken for 20ms
+    std::thread holder;
+    {
+        VFS::LockStats::Guard<std::unique_lock<std::mutex>> lock(&stats, VFS::Metrics::Op::WRITE, mutex);
+        holder = std::thread([&] ()
+        {
+            VFS::LockStats::Guard<std::unique_lock<std::mutex>> lock(&stats, VFS::Metrics::Op::READ, mutex);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    holder.join();
+
+    auto ops = byName(stats);
+    ASSERT_EQ( ops.size(), 2u );
+    EXPECT_EQ( ops["write"].acquisitions, 1u );
+    EXPECT_EQ( ops["write"].contended, 0u );
+    EXPECT_GE( ops["write"].hold.max(), 20000000u );
+    EXPECT_EQ( ops["read"].contended, 1u );
+    EXPECT_GE( ops["read"].wait.max(), 10000000u );
+    EXPECT_EQ( ops["read"].hold.count(), 1u );
+
+    stats.reset();
+    EXPECT_TRUE( stats.snapshot().empty() );
+
+    // what threads counted stays when they end, and a thread may end after the stats it counted for
+    std::vector<std::thread> threads;
+    for ( int t = 0; t < 8; ++t )
+    {
+        threads.emplace_back([&stats, &mutex] ()
+        {
+            VFS::LockStats::Guard<std::unique_lock<std::mutex>> lock(&stats, VFS::Metrics::Op::OPEN, mutex);
+        });
+    }
+    for ( auto & thread : threads )
+        thread.join();
+    ops = byName(stats);
+    EXPECT_EQ( ops["open"].acquisitions, 8u );
+    EXPECT_EQ( ops["open"].hold.count(), 8u );
+
+    std::unique_ptr<VFS::LockStats> gone(new VFS::LockStats());
+    std::promise<void> counted;
+    std::promise<void> destroyed;
+    std::thread late([&] ()
+    {
+        {
+            VFS::LockStats::Guard<std::unique_lock<std::mutex>> lock(gone.get(), VFS::Metrics::Op::OPEN, mutex);
+        }
+        counted.set_value();
+        destroyed.get_future().wait();
+    });
+    counted.get_future().wait();
+    EXPECT_EQ( byName(*gone)["open"].acquisitions, 1u );
+    gone.reset();
+    destroyed.set_value();
+    late.join();
+}
+
+TEST(LockStatsTest, FileSystem) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_lockstats";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    VFS::FileSystem fs(dir.string());
+    EXPECT_TRUE( fs.lockStats() == nullptr );
+
+    fs.setLockStats(true);
+    ASSERT_TRUE( fs.touchFile("file") );
+    auto file = fs.open("file");
+    ASSERT_TRUE( file != nullptr );
+    EXPECT_EQ( std::string(fs.type("file")), VFS::type::REGULAR );
+
+    auto ops = byName(*fs.lockStats());
+    EXPECT_EQ( ops["touchFile"].acquisitions, 1u );
+    EXPECT_EQ( ops["open"].acquisitions, 1u );
+    EXPECT_EQ( ops["type"].hold.count(), 1u );
+
+    // writers of the same range take turns, the file tells how long they waited
+    auto regular = std::dynamic_pointer_cast<VFS::RegularFile>(file);
+    ASSERT_TRUE( regular != nullptr && regular->lockStats() != nullptr );
+    std::vector<std::thread> writers;
+    for ( int t = 0; t < 4; ++t )
+    {
+        writers.emplace_back([&file] ()
+        {
+            std::vector<char> data(1 << 20, 'w');
+            for ( int i = 0; i < 20; ++i )
+                file->write(data.data(), 0, data.size());
+        });
+    }
+    for ( auto & writer : writers )
+        writer.join();
+    EXPECT_EQ( file->read(16).size(), 16u );
+
+    auto fileOps = byName(*regular->lockStats());
+    EXPECT_EQ( fileOps["write"].acquisitions, 80u );
+    EXPECT_EQ( fileOps["write"].hold.count(), 80u );
+    EXPECT_EQ( fileOps["read"].acquisitions, 1u );
+
+    // disabled, the numbers stay and nothing is added
+    fs.setLockStats(false);
+    fs.touchFile("other");
+    EXPECT_EQ( byName(*fs.lockStats())["touchFile"].acquisitions, 1u );
+
+    file->close();
+    VFS::fs::remove_all(dir);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "vfs/VFS.h"
+
+static std::string tempDir(std::string const & name) {
+    auto dir = VFS::fs::temp_directory_path() / name;
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    return dir.string() + "/";
+}
+
+TEST(MappedFileTest, Read) {
+    auto dir = tempDir("vfs_mappedfile_read");
+    VFS::RegularFile writer(dir + "data.bin");
+    std::string text = "0123456789abcdefghij";
+    writer.write(text.data(), 0, text.size());
+
+    VFS::MappedFile file(dir + "data.bin");
+    EXPECT_EQ( file.size(), text.size() );
+    EXPECT_EQ( file.read(10, 5), ( VFS::IFile::Buffer{ 'a', 'b', 'c', 'd', 'e' } ) );
+    EXPECT_EQ( file.read(15, 100).size(), 5 );
+    EXPECT_TRUE( file.read(100, 5).empty() );
+    EXPECT_EQ( file.read(4).size(), 4 );
+    EXPECT_EQ( file.read(2), ( VFS::IFile::Buffer{ '4', '5' } ) );
+    EXPECT_EQ( std::string(file.view(0, 10)), "0123456789" );
+    EXPECT_EQ( file.readAll().size(), text.size() );
+
+    char raw[3];
+    EXPECT_EQ( file.read(raw, 18, 3), 2 );
+    EXPECT_EQ( file.write(raw, 0, 2), 0 );  // opened read-only
+
+    file.advise(VFS::MappedFile::Access::SEQUENTIAL);
+    file.disableRead();
+    EXPECT_TRUE( file.view(0, 10).empty() );
+    VFS::fs::remove_all(dir);
+}
+
+TEST(MappedFileTest, Grow) {
+    auto dir = tempDir("vfs_mappedfile_grow");
+    VFS::RegularFile writer(dir + "data.bin");
+    VFS::IFile::Buffer head(100, 'A');
+    writer.write(head, 0, head.size());
+
+    VFS::MappedFile file(dir + "data.bin");
+    auto before = file.view(0, 100);
+    EXPECT_EQ( before.size(), 100 );
+
+    // the file is extended far past the first mapping, earlier views stay valid
+    VFS::IFile::Buffer tail(1 << 20, 'B');
+    writer.write(tail, head.size(), tail.size());
+    EXPECT_EQ( file.read(100 + ( 1 << 19 ), 4), VFS::IFile::Buffer(4, 'B') );
+    EXPECT_EQ( before, std::string(100, 'A') );
+    EXPECT_EQ( file.readAll().size(), head.size() + tail.size() );
+
+    VFS::MappedFile rw(dir + "data.bin", true);
+    EXPECT_EQ( rw.write(head, head.size()), head.size() );
+    EXPECT_EQ( file.read(head.size() + tail.size(), 200), head );
+    VFS::fs::remove_all(dir);
+}
+
+TEST(MappedFileTest, OpenReadOnly) {
+    auto dir = tempDir("vfs_mappedfile_open");
+    VFS::FileSystem fs( dir );
+    fs.touchFile("file.txt");
+    auto mapped = fs.open("file.txt", VFS::Perms::READ);
+    EXPECT_TRUE( std::dynamic_pointer_cast<VFS::MappedFile>(mapped) != nullptr );
+    EXPECT_TRUE( std::dynamic_pointer_cast<VFS::RegularFile>(fs.open("file.txt")) != nullptr );
+    EXPECT_EQ( fs.open("missing.txt", VFS::Perms::READ), nullptr );
+    VFS::fs::remove_all(dir);
+}
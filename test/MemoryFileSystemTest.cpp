@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <thread>
+#include "vfs/VFS.h"
+
+// Every test runs in its own process, so each one builds the tree it needs.
+static void populate(VFS::IFS & fs) {
+  fs.makeDir("dir1");
+  fs.makeDir("dir1/sub1");
+  fs.touchFile("file1.txt");
+  fs.touchFile("file2.txt");
+  fs.touchFile("dir1/file3.txt");
+  fs.touchFile("dir1/sub1/file4.txt");
+}
+
+TEST(MemoryFileSystemTest, Mount) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  EXPECT_EQ( fs.path(), "memfs/" );
+  EXPECT_TRUE( fs.isMounted() );
+  EXPECT_TRUE( !fs.mount("other") );
+  EXPECT_TRUE( fs.unmount() );
+  EXPECT_TRUE( !fs.touchFile("file.txt") );
+  EXPECT_TRUE( fs.mount("memfs") );
+  EXPECT_TRUE( fs.touchFile("file.txt") );
+}
+
+TEST(MemoryFileSystemTest, MakeDir) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  EXPECT_TRUE( fs.makeDir("./dir1") );
+  EXPECT_TRUE( fs.makeDir("./dir1/sub1") );
+  EXPECT_TRUE( !fs.makeDir("./dir1") );
+  EXPECT_TRUE( !fs.makeDir("../dir2") );
+  EXPECT_TRUE( !fs.makeDir("/dir2") );
+  EXPECT_TRUE( !fs.makeDir("missing/dir2") );
+  EXPECT_STREQ( fs.type("dir1/sub1"), VFS::type::DIRECTORY );
+}
+
+TEST(MemoryFileSystemTest, TouchFile) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  fs.makeDir("dir1");
+  EXPECT_TRUE( fs.touchFile("./file1.txt") );
+  EXPECT_TRUE( fs.touchFile("./dir1/file3.txt") );
+  EXPECT_TRUE( !fs.touchFile("file1.txt") );
+  EXPECT_TRUE( !fs.touchFile("../file5.txt") );
+  EXPECT_TRUE( !fs.touchFile("/file6.txt") );
+  EXPECT_TRUE( !fs.touchFile("missing/file7.txt") );
+  EXPECT_STREQ( fs.type("dir1/file3.txt"), VFS::type::REGULAR );
+  EXPECT_STREQ( fs.type("dir1/none"), VFS::type::NOTFOUND );
+}
+
+TEST(MemoryFileSystemTest, OpenFile) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  populate(fs);
+  EXPECT_TRUE( fs.open("file1.txt") != nullptr );
+  EXPECT_TRUE( fs.open("./dir1/sub1/file4.txt") != nullptr );
+  EXPECT_EQ( fs.open("dir1"), nullptr );
+  EXPECT_EQ( fs.open("../file1.txt"), nullptr );
+  EXPECT_EQ( fs.open("/file1.txt"), nullptr );
+  EXPECT_EQ( fs.open("./dir1/file.txt"), nullptr );
+}
+
+TEST(MemoryFileSystemTest, ReadWrite) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  fs.touchFile("file1.txt");
+  auto file = fs.open("file1.txt");
+  VFS::IFile::Buffer buf(100, 'A');
+  VFS::IFile::Buffer buf2(10, 'B');
+  EXPECT_EQ( file->write(buf, buf.size()), buf.size() );
+  EXPECT_EQ( file->write(buf2, 10, buf2.size()), buf2.size() );
+  EXPECT_EQ( file->write(buf, buf.size()), buf.size() );
+  EXPECT_EQ( file->size(), 200 );
+  EXPECT_EQ( file->read(10, 10), buf2 );
+  EXPECT_EQ( file->read(5), VFS::IFile::Buffer(5, 'A') );
+  EXPECT_EQ( file->read(10), ( VFS::IFile::Buffer{ 'A', 'A', 'A', 'A', 'A', 'B', 'B', 'B', 'B', 'B' } ) );
+  EXPECT_EQ( file->readAll().size(), 200 );
+  EXPECT_TRUE( file->read(300, 10).empty() );
+
+  // crossing several chunks and leaving a hole in front
+  auto big = VFS::MemoryNode::CHUNK_SIZE * 3;
+  VFS::IFile::Buffer data(big, 'C');
+  EXPECT_EQ( file->write(data, big, data.size()), data.size() );
+  EXPECT_EQ( file->size(), 2 * big );
+  EXPECT_EQ( file->read(big - 1, 2), ( VFS::IFile::Buffer{ '\0', 'C' } ) );
+  EXPECT_EQ( file->read(big, big), data );
+  EXPECT_EQ( fs.open("file1.txt")->size(), file->size() );
+
+  // caller-owned memory
+  char raw[4] = { 'x', 'y', 'z', 'w' };
+  EXPECT_EQ( file->write(raw, 0, sizeof(raw)), sizeof(raw) );
+  char out[4] = {};
+  EXPECT_EQ( file->read(out, 1, 3), 3 );
+  EXPECT_EQ( std::string(out, 3), "yzw" );
+  VFS::IFile::Buffer reused;
+  EXPECT_EQ( file->read(reused, 2 * big - 2, 10), 2 );
+  EXPECT_EQ( reused, VFS::IFile::Buffer(2, 'C') );
+}
+
+TEST(MemoryFileSystemTest, Permissions) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  fs.touchFile("file2.txt");
+  auto file = fs.open("file2.txt");
+  VFS::IFile::Buffer buf(10, 'A');
+  file->disableWrite();
+  EXPECT_EQ( file->write(buf, buf.size()), 0 );
+  EXPECT_EQ( fs.open("file2.txt", VFS::Perms::WRITE), nullptr );
+  file->setPermision(VFS::Perms::RW);
+  EXPECT_EQ( file->write(buf, buf.size()), buf.size() );
+  file->disableAll();
+  EXPECT_TRUE( file->readAll().empty() );
+}
+
+TEST(MemoryFileSystemTest, Copy) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  populate(fs);
+  VFS::IFile::Buffer buf(100, 'A');
+  fs.open("file1.txt")->write(buf, buf.size());
+  EXPECT_TRUE( fs.copy("file1.txt", "file_copy.txt") );
+  EXPECT_TRUE( !fs.copy("file1.txt", "file_copy.txt") );
+  EXPECT_TRUE( !fs.copy("dir1", "dir_copy") );
+
+  auto original = fs.open("file1.txt");
+  auto copied = fs.open("file_copy.txt");
+  EXPECT_EQ( copied->readAll(), original->readAll() );
+
+  // the copy shares chunks until one side is written
+  VFS::IFile::Buffer buf2(10, 'Z');
+  copied->write(buf2, 0, buf2.size());
+  EXPECT_EQ( copied->read(0, 10), buf2 );
+  EXPECT_EQ( original->read(0, 10), VFS::IFile::Buffer(10, 'A') );
+}
+
+TEST(MemoryFileSystemTest, Move) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  populate(fs);
+  EXPECT_TRUE( !fs.moveTo("file2.txt", "/dir1") );
+  EXPECT_TRUE( !fs.moveTo("file2.txt", "../dir1") );
+  EXPECT_TRUE( !fs.moveTo("file2.txt", "file1.txt") );
+  EXPECT_TRUE( fs.moveTo("file2.txt", "dir1/moved.txt") );
+  EXPECT_TRUE( !fs.moveTo("dir1", "dir1/sub1/dir1") );
+  EXPECT_TRUE( fs.moveTo("dir1/sub1", "dir2") );
+  EXPECT_STREQ( fs.type("dir2/file4.txt"), VFS::type::REGULAR );
+  EXPECT_STREQ( fs.type("dir1/sub1"), VFS::type::NOTFOUND );
+
+  VFS::IFile::Buffer buf(10, 'Z');
+  fs.open("dir1/moved.txt")->write(buf, buf.size());
+  VFS::IFS::IFSPtr other = std::make_shared<VFS::MemoryFileSystem>("other");
+  EXPECT_TRUE( fs.moveTo("dir1/moved.txt", other, "moved.txt") );
+  EXPECT_STREQ( fs.type("dir1/moved.txt"), VFS::type::NOTFOUND );
+  EXPECT_EQ( other->open("moved.txt")->readAll(), buf );
+
+  // a name that is only part of another one is free on a disk filesystem as well
+  auto dir = VFS::fs::temp_directory_path() / "vfs_memfs_move";
+  VFS::fs::remove_all(dir);
+  VFS::fs::create_directories(dir / "data");
+  std::ofstream{ dir / "data" / "a1" };
+  auto disk = std::make_shared<VFS::FileSystem>(dir.string());
+  EXPECT_TRUE( fs.moveTo("file1.txt", disk, "a") );
+  EXPECT_STREQ( fs.type("file1.txt"), VFS::type::NOTFOUND );
+  EXPECT_TRUE( VFS::fs::is_regular_file(dir / "a") );
+  VFS::fs::remove_all(dir);
+
+  // a copy that fails part way leaves nothing behind on the target and the source in place
+  // (an overlay takes no names of whiteouts)
+  EXPECT_TRUE( fs.touchFile("dir2/.wh.file") );
+  auto overlay = std::make_shared<VFS::OverlayFS>("overlay", std::make_shared<VFS::MemoryFileSystem>("upper"), std::vector<VFS::IFS::IFSPtr>());
+  EXPECT_TRUE( !fs.moveTo("dir2", overlay, "dir2") );
+  EXPECT_TRUE( overlay->list().empty() );
+  EXPECT_STREQ( fs.type("dir2/file4.txt"), VFS::type::REGULAR );
+}
+
+TEST(MemoryFileSystemTest, ListEntry) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  populate(fs);
+  auto entry = fs.list();
+  EXPECT_EQ( entry.size(), 6 );
+  EXPECT_EQ( entry.front(), "memfs/dir1" );
+  entry = fs.list("dir1/sub1");
+  EXPECT_EQ( entry, VFS::IFS::EntryList{ "memfs/dir1/sub1/file4.txt" } );
+  EXPECT_EQ( fs.list("/").size(), 0 );
+}
+
+TEST(MemoryFileSystemTest, Search) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  populate(fs);
+  EXPECT_TRUE( fs.contain("file1.txt") );
+  EXPECT_TRUE( fs.contain("./dir1/sub1/file4.txt") );
+  EXPECT_TRUE( fs.contain("sub1") );
+  EXPECT_TRUE( !fs.contain("file9") );
+  EXPECT_EQ( fs.search("file4.txt"), "./dir1/sub1/file4.txt" );
+  EXPECT_EQ( fs.search("nothing"), VFS::type::NOTFOUND );
+}
+
+TEST(MemoryFileSystemTest, Remove) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  populate(fs);
+  VFS::IFile::Buffer buf(10, 'A');
+  auto file = fs.open("file1.txt");
+  file->write(buf, buf.size());
+  EXPECT_TRUE( !fs.remove("dir1/sub1") );
+  EXPECT_TRUE( fs.remove("dir1/sub1/file4.txt") );
+  EXPECT_TRUE( fs.remove("dir1/sub1") );
+  EXPECT_TRUE( fs.remove("./file1.txt") );
+  EXPECT_TRUE( !fs.remove("file1.txt") );
+  EXPECT_TRUE( !fs.remove("/file2.txt") );
+  EXPECT_EQ( file->readAll(), buf );
+}
+
+TEST(MemoryFileSystemTest, MultiThread) {
+  VFS::MemoryFileSystem fs( "memfs" );
+  fs.touchFile("shared.txt");
+  auto file = fs.open("shared.txt");
+  auto writer = [&file] (char ch) {
+    VFS::IFile::Buffer buf(1000, ch);
+    for ( int i = 0; i < 100; ++i )
+      EXPECT_EQ( file->write(buf, buf.size()), buf.size() );
+  };
+  std::thread t1(writer, 'C');
+  std::thread t2(writer, 'D');
+  t1.join();
+  t2.join();
+  EXPECT_EQ( file->size(), 200 * 1000 );
+}
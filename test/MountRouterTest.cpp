@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+namespace {
+
+std::shared_ptr<VFS::MemoryFileSystem> withFile(std::string const & name, std::string const & content)
+{
+    auto fs = std::make_shared<VFS::MemoryFileSystem>("memfs");
+    fs->touchFile(name);
+    fs->open(name)->write(VFS::IFile::Buffer(content.begin(), content.end()), 0, content.size());
+
+    return fs;
+}
+
+// Runs hook once from the next list(), to change the mounts from inside a call.
+class Hooked : public VFS::MemoryFileSystem
+{
+public:
+    using VFS::MemoryFileSystem::MemoryFileSystem;
+    using VFS::MemoryFileSystem::list;
+
+    EntryList list(std::string const & dir) override
+    {
+        auto hook = std::move(_hook);
+        _hook = nullptr;
+        if ( hook )
+            hook();
+
+        return VFS::MemoryFileSystem::list(dir);
+    }
+
+    void setHook(std::function<void()> hook) { _hook = std::move(hook); }
+
+private:
+    std::function<void()> _hook;
+};
+
+std::string readAll(VFS::IFS & fs, std::string const & name)
+{
+    auto file = fs.open(name);
+    if ( file == nullptr )
+        return "";
+
+    auto data = file->readAll();
+    return std::string(data.begin(), data.end());
+}
+
+}
+
+TEST(MountRouterTest, Resolve) {
+    VFS::MountRouter router("router");
+    auto root = withFile("file", "root");
+    auto data = withFile("file", "data");
+    auto deep = withFile("file", "deep");
+    ASSERT_TRUE( router.attach(".", root) );
+    ASSERT_TRUE( router.attach("mnt/data", data) );
+    ASSERT_TRUE( router.attach("mnt/data/deep", deep) );
+    ASSERT_TRUE( router.attach("mnt/database", std::make_shared<VFS::MemoryFileSystem>("memfs")) );
+    EXPECT_FALSE( router.attach("mnt/data/", data) );
+
+    // the longest prefix takes it, and only whole parts of the path match
+    EXPECT_EQ( readAll(router, "file"), "root" );
+    EXPECT_EQ( readAll(router, "mnt/data/file"), "data" );
+    EXPECT_EQ( readAll(router, "./mnt//data/deep/file"), "deep" );
+    EXPECT_TRUE( router.open("mnt/dat/file") == nullptr );
+    EXPECT_TRUE( router.open("mnt/database/file") == nullptr );
+
+    EXPECT_STREQ( router.type("mnt"), VFS::type::DIRECTORY );
+    EXPECT_STREQ( router.type("mnt/data"), VFS::type::DIRECTORY );
+    EXPECT_STREQ( router.type("mnt/dat"), VFS::type::NOTFOUND );
+    EXPECT_FALSE( router.remove("mnt/data") );
+    EXPECT_FALSE( router.remove("mnt") );
+    EXPECT_FALSE( router.touchFile("mnt") );
+
+    EXPECT_EQ( router.list(), VFS::IFS::EntryList({ "router/file", "router/mnt", "router/mnt/data", "router/mnt/data/deep",
+                                                    "router/mnt/data/deep/file", "router/mnt/data/file", "router/mnt/database" }) );
+    EXPECT_EQ( router.list("mnt/data/deep"), VFS::IFS::EntryList({ "router/mnt/data/deep/file" }) );
+    ASSERT_TRUE( router.touchFile("mnt/data/deep/only") );
+    EXPECT_TRUE( deep->contain("only") );
+    EXPECT_EQ( router.search("only"), "./mnt/data/deep/only" );
+    EXPECT_EQ( router.search("mnt/data/file"), "./mnt/data/file" );
+
+    ASSERT_TRUE( router.detach("mnt/data") );
+    EXPECT_FALSE( router.detach("mnt/data") );
+    EXPECT_TRUE( router.open("mnt/data/file") == nullptr );
+    EXPECT_EQ( readAll(router, "mnt/data/deep/file"), "deep" );
+    EXPECT_EQ( router.mounts().size(), 3u );
+}
+
+TEST(MountRouterTest, AcrossMounts) {
+    auto router = std::make_shared<VFS::MountRouter>("router");
+    auto a = withFile("file", "content");
+    auto b = std::make_shared<VFS::MemoryFileSystem>("memfs");
+    ASSERT_TRUE( router->attach("a", a) );
+    ASSERT_TRUE( router->attach("b", b) );
+
+    ASSERT_TRUE( router->copy("a/file", "b/copied") );
+    EXPECT_EQ( readAll(*b, "copied"), "content" );
+    EXPECT_FALSE( router->copy("a/file", "b/copied") );
+
+    ASSERT_TRUE( router->moveTo("a/file", "b/moved") );
+    EXPECT_FALSE( a->contain("file") );
+    EXPECT_EQ( readAll(*router, "b/moved"), "content" );
+
+    ASSERT_TRUE( router->moveTo("b/moved", "b/renamed") );
+    EXPECT_EQ( readAll(*b, "renamed"), "content" );
+    EXPECT_FALSE( router->moveTo("b", "a/b") );
+}
+
+TEST(MountRouterTest, Concurrent) {
+    VFS::MountRouter router("router");
+    constexpr int mounts = 2000;
+    for ( int i = 0; i < mounts; ++i )
+        ASSERT_TRUE( router.attach("m/" + std::to_string(i), withFile("file", std::to_string(i))) );
+
+    // mounts come and go while the others are resolved
+    std::atomic<bool> stop(false);
+    std::thread writer([&router, &stop] ()
+    {
+        for ( int round = 0; !stop; ++round )
+        {
+            auto prefix = "m/" + std::to_string(round % 50) + "/extra";
+            router.attach(prefix, std::make_shared<VFS::MemoryFileSystem>("memfs"));
+            router.detach(prefix);
+        }
+    });
+
+    std::vector<std::thread> readers;
+    std::atomic<int> wrong(0);
+    for ( int t = 0; t < 4; ++t )
+    {
+        readers.emplace_back([&router, &wrong, t] ()
+        {
+            for ( int i = t; i < mounts; i += 4 )
+            {
+                if ( readAll(router, "m/" + std::to_string(i) + "/file") != std::to_string(i) )
+                    ++wrong;
+            }
+        });
+    }
+    for ( auto & reader : readers )
+        reader.join();
+    stop = true;
+    writer.join();
+
+    EXPECT_EQ( wrong, 0 );
+    EXPECT_EQ( router.mounts().size(), static_cast<std::size_t>(mounts) );
+
+    // a detached filesystem is released at once, also when a thread still alive went through it before
+    auto kept = withFile("file", "kept");
+    std::weak_ptr<VFS::MemoryFileSystem> released = kept;
+    ASSERT_TRUE( router.attach("kept", std::move(kept)) );
+    std::promise<void> resolved;
+    std::promise<void> done;
+    std::thread caller([&router, &resolved, &done] ()
+    {
+        EXPECT_EQ( readAll(router, "kept/file"), "kept" );
+        resolved.set_value();
+        done.get_future().wait();
+    });
+    resolved.get_future().wait();
+    ASSERT_TRUE( router.detach("kept") );
+    EXPECT_TRUE( released.expired() );
+    done.set_value();
+    caller.join();
+}
+
+TEST(MountRouterTest, Nested) {
+    auto outer = std::make_shared<VFS::MountRouter>("outer");
+    auto inner = std::make_shared<VFS::MountRouter>("inner");
+    auto hooked = std::make_shared<Hooked>("memfs");
+    hooked->touchFile("file");
+    ASSERT_TRUE( inner->attach("h", hooked) );
+    ASSERT_TRUE( outer->attach("in", inner) );
+    ASSERT_TRUE( outer->attach("x", withFile("file", "x")) );
+
+    // the mounts of both routers change under a call, which goes on with the trees it started with
+    hooked->setHook([&outer, &inner] ()
+    {
+        inner->detach("h");
+        inner->attach("h2", withFile("file", "h2"));
+        outer->detach("x");
+        outer->attach("y", withFile("file", "y"));
+        EXPECT_EQ( readAll(*outer, "in/h2/file"), "h2" );
+        EXPECT_EQ( readAll(*outer, "y/file"), "y" );
+    });
+    EXPECT_EQ( outer->list(), VFS::IFS::EntryList({ "outer/in", "outer/in/h", "outer/in/h/file", "outer/x", "outer/x/file" }) );
+    EXPECT_EQ( outer->list(), VFS::IFS::EntryList({ "outer/in", "outer/in/h2", "outer/in/h2/file", "outer/y", "outer/y/file" }) );
+}
@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+namespace {
+
+typedef std::shared_ptr<VFS::MemoryFileSystem> MemFSPtr;
+
+void writeFile(VFS::IFS & fs, std::string const & name, VFS::IFile::Buffer const & data)
+{
+    ASSERT_TRUE( fs.touchFile(name) );
+    auto file = fs.open(name);
+    ASSERT_TRUE( file != nullptr );
+    ASSERT_EQ( file->write(data, 0, data.size()), data.size() );
+}
+
+VFS::IFile::Buffer pattern(std::size_t size)
+{
+    VFS::IFile::Buffer data(size);
+    for ( std::size_t i = 0; i < size; ++i )
+        data[i] = static_cast<char>('a' + i % 26);
+
+    return data;
+}
+
+// A file in memory that notes its syncs in a log shared with others.
+class Logged : public VFS::MemoryFile
+{
+public:
+    Logged(std::string const & name, std::vector<std::string> & log)
+        : VFS::MemoryFile(std::make_shared<VFS::MemoryNode>(VFS::MemoryNode::Kind::REGULAR), name)
+          , _log(log)
+    {
+    }
+
+    // datasync() comes here as well
+    long sync() override { _log.push_back(filename()); return VFS::MemoryFile::sync(); }
+
+private:
+    std::vector<std::string> & _log;
+};
+
+MemFSPtr base()
+{
+    auto lower = std::make_shared<VFS::MemoryFileSystem>("lower");
+    lower->makeDir("dir");
+    writeFile(*lower, "dir/a", VFS::IFile::Buffer(10, 'a'));
+    writeFile(*lower, "dir/b", VFS::IFile::Buffer(10, 'b'));
+    writeFile(*lower, "top", VFS::IFile::Buffer(10, 't'));
+
+    return lower;
+}
+
+}
+
+TEST(OverlayFSTest, Merge) {
+    auto lower = base();
+    auto upper = std::make_shared<VFS::MemoryFileSystem>("upper");
+    VFS::OverlayFS fs("overlay", upper, { lower });
+
+    EXPECT_EQ( fs.list(), VFS::IFS::EntryList({ "overlay/dir", "overlay/dir/a", "overlay/dir/b", "overlay/top" }) );
+    EXPECT_STREQ( fs.type("dir"), VFS::type::DIRECTORY );
+    EXPECT_STREQ( fs.type("dir/a"), VFS::type::REGULAR );
+    EXPECT_EQ( fs.search("b"), "./dir/b" );
+
+    ASSERT_TRUE( fs.touchFile("dir/c") );
+    ASSERT_TRUE( fs.remove("dir/a") );
+    EXPECT_FALSE( fs.remove("dir") );
+    EXPECT_STREQ( fs.type("dir/a"), VFS::type::NOTFOUND );
+    EXPECT_EQ( fs.list("dir"), VFS::IFS::EntryList({ "overlay/dir/b", "overlay/dir/c" }) );
+    EXPECT_TRUE( fs.open("dir/a") == nullptr );
+
+    // the lower layer is never changed, the whiteout is in the upper one
+    EXPECT_TRUE( lower->contain("dir/a") );
+    EXPECT_STREQ( upper->type("dir/.wh.a"), VFS::type::REGULAR );
+
+    ASSERT_TRUE( fs.moveTo("top", "dir/top") );
+    EXPECT_STREQ( fs.type("top"), VFS::type::NOTFOUND );
+    EXPECT_EQ( fs.open("dir/top")->readAll(), VFS::IFile::Buffer(10, 't') );
+    EXPECT_FALSE( fs.moveTo("dir", "moved") );
+
+    // moved to another filesystem the file is there in full and gone from the overlay, also under a name that is
+    // only part of another one
+    auto dir = VFS::fs::temp_directory_path() / "vfs_overlay_move";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir / "data");
+    std::ofstream{ dir / "data" / "b1" };
+    auto disk = std::make_shared<VFS::FileSystem>(dir.string());
+    ASSERT_TRUE( fs.moveTo("dir/b", disk, "b") );
+    EXPECT_EQ( disk->open("b")->readAll(), VFS::IFile::Buffer(10, 'b') );
+    EXPECT_STREQ( fs.type("dir/b"), VFS::type::NOTFOUND );
+    EXPECT_FALSE( fs.moveTo("dir/c", disk, "b") );
+    EXPECT_TRUE( fs.contain("dir/c") );
+    ASSERT_TRUE( fs.moveTo("dir/c", disk, "c") );
+    VFS::fs::remove_all(dir);
+
+    // a directory removed and made again hides what the lower layer has in it
+    ASSERT_TRUE( fs.remove("dir/top") );
+    ASSERT_TRUE( fs.remove("dir") );
+    ASSERT_TRUE( fs.makeDir("dir") );
+    EXPECT_EQ( fs.list("dir"), VFS::IFS::EntryList() );
+
+    VFS::OverlayFS again("again", upper, { lower });
+    EXPECT_EQ( again.list(), VFS::IFS::EntryList({ "again/dir" }) );
+
+    // a mount sees what the lower layer holds then, and the whiteout of a name like the copy-up state stays one
+    writeFile(*lower, "later", VFS::IFile::Buffer(1, 'l'));
+    writeFile(*lower, ".cu.later", VFS::IFile::Buffer(1, 'c'));
+    ASSERT_TRUE( again.unmount() );
+    ASSERT_TRUE( again.mount("again") );
+    EXPECT_TRUE( again.contain("later") );
+    ASSERT_TRUE( again.remove(".cu.later") );
+    ASSERT_TRUE( again.unmount() );
+    ASSERT_TRUE( again.mount("again") );
+    EXPECT_FALSE( again.contain(".cu.later") );
+    EXPECT_TRUE( again.contain("later") );
+}
+
+TEST(OverlayFSTest, CopyUp) {
+    auto size = 5 * VFS::CopyUpFile::BLOCK_SIZE + 100;
+    auto data = pattern(size);
+    auto lower = std::make_shared<VFS::MemoryFileSystem>("lower");
+    writeFile(*lower, "big", data);
+    auto upper = std::make_shared<VFS::MemoryFileSystem>("upper");
+
+    {
+        VFS::OverlayFS fs("overlay", upper, { lower });
+        auto file = fs.open("big");
+        ASSERT_TRUE( file != nullptr );
+        ASSERT_EQ( file->size(), size );
+
+        auto offset = 3 * VFS::CopyUpFile::BLOCK_SIZE + 5;
+        ASSERT_EQ( file->write(VFS::IFile::Buffer(1, '!'), offset, 1), 1u );
+        data[offset] = '!';
+        EXPECT_EQ( file->readAll(), data );
+
+        // only the block written is in the upper layer
+        EXPECT_EQ( upper->open("big")->size(), 4 * VFS::CopyUpFile::BLOCK_SIZE );
+        EXPECT_EQ( lower->open("big")->readAll(), pattern(size) );
+        EXPECT_EQ( fs.list(), VFS::IFS::EntryList({ "overlay/big" }) );
+    }
+
+    // the copy goes on where it stopped
+    {
+        VFS::OverlayFS fs("overlay", upper, { lower });
+        auto file = fs.open("big", VFS::Perms::READ);
+        ASSERT_TRUE( file != nullptr );
+        EXPECT_EQ( file->readAll(), data );
+
+        auto offset = VFS::CopyUpFile::BLOCK_SIZE - 1;
+        ASSERT_EQ( fs.open("big")->write(VFS::IFile::Buffer(2, '?'), offset, 2), 2u );
+        data[offset] = data[offset + 1] = '?';
+        EXPECT_EQ( fs.open("big")->readAll(), data );
+
+        // a move finishes the copy
+        ASSERT_TRUE( fs.moveTo("big", "moved") );
+        EXPECT_EQ( upper->list(), VFS::IFS::EntryList({ "upper/.wh.big", "upper/moved" }) );
+        EXPECT_EQ( fs.open("moved")->readAll(), data );
+    }
+
+    // a block a write covers whole is read from the upper layer only once the write got there
+    ASSERT_TRUE( upper->touchFile("failing") );
+    auto failing = upper->open("failing");
+    failing->disableWrite();
+    auto blocks = std::make_shared<VFS::CopyUpFile::Blocks>();
+    blocks->layer = 0;
+    blocks->lowerSize = size;
+    blocks->copied.assign(6, 0);
+    VFS::CopyUpFile file(lower->open("big"), failing, blocks);
+    EXPECT_EQ( file.write(VFS::IFile::Buffer(VFS::CopyUpFile::BLOCK_SIZE, 'x'), VFS::CopyUpFile::BLOCK_SIZE, VFS::CopyUpFile::BLOCK_SIZE), 0u );
+    EXPECT_EQ( file.readAll(), pattern(size) );
+    EXPECT_FALSE( blocks->complete() );
+    EXPECT_EQ( blocks->copied[1], 0 );
+
+    // the map of the blocks is synced, after the blocks it marks copied
+    std::vector<std::string> log;
+    auto logged = std::make_shared<VFS::CopyUpFile::Blocks>();
+    logged->layer = 1;
+    logged->lowerSize = size;
+    logged->copied.assign(6, 0);
+    logged->store = std::make_shared<Logged>("map", log);
+    VFS::CopyUpFile copying(lower->open("big"), std::make_shared<Logged>("data", log), logged);
+    ASSERT_EQ( copying.write(VFS::IFile::Buffer(1, '!'), 0, 1), 1u );
+    EXPECT_EQ( copying.datasync(), 0 );
+    EXPECT_EQ( log, std::vector<std::string>({ "data", "map" }) );
+    log.clear();
+    ASSERT_EQ( copying.write(VFS::IFile::Buffer(1, '?'), VFS::CopyUpFile::BLOCK_SIZE, 1), 1u );
+    copying.close();
+    EXPECT_EQ( log, std::vector<std::string>({ "data", "map" }) );
+}
+
+TEST(OverlayFSTest, SharedBase) {
+    auto lower = base();
+    std::vector<std::shared_ptr<VFS::OverlayFS>> views;
+    for ( int i = 0; i < 8; ++i )
+        views.push_back(std::make_shared<VFS::OverlayFS>("view", std::make_shared<VFS::MemoryFileSystem>("upper"), std::vector<VFS::IFS::IFSPtr>{ lower }));
+
+    std::vector<std::thread> threads;
+    for ( std::size_t i = 0; i < views.size(); ++i )
+    {
+        threads.emplace_back([&views, i] ()
+        {
+            auto & fs = *views[i];
+            auto file = fs.open("dir/a");
+            ASSERT_TRUE( file != nullptr );
+            file->write(VFS::IFile::Buffer(1, static_cast<char>('0' + i)), 0, 1);
+            fs.touchFile("mine" + std::to_string(i));
+            fs.remove("top");
+        });
+    }
+    for ( auto & thread : threads )
+        thread.join();
+
+    for ( std::size_t i = 0; i < views.size(); ++i )
+    {
+        auto & fs = *views[i];
+        EXPECT_EQ( fs.open("dir/a")->read(0, 2), VFS::IFile::Buffer({ static_cast<char>('0' + i), 'a' }) );
+        EXPECT_TRUE( fs.contain("mine" + std::to_string(i)) );
+        EXPECT_FALSE( fs.contain("mine" + std::to_string(( i + 1 ) % views.size())) );
+        EXPECT_FALSE( fs.contain("top") );
+    }
+    EXPECT_EQ( lower->open("dir/a")->readAll(), VFS::IFile::Buffer(10, 'a') );
+    EXPECT_TRUE( lower->contain("top") );
+}
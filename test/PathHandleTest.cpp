@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include "vfs/VFS.h"
+
+TEST(PathHandleTest, Intern) {
+    auto path = VFS::PathHandle::intern("a//b/./c/..");
+    ASSERT_TRUE( path.valid() );
+    EXPECT_EQ( path.str(), "a/b" );
+    EXPECT_EQ( path, VFS::PathHandle::intern("a/b") );
+    EXPECT_EQ( path, VFS::PathHandle::intern("./a/b/") );
+    EXPECT_NE( path, VFS::PathHandle::intern("a/c") );
+    EXPECT_EQ( VFS::PathHandle::intern(".").str(), "." );
+    EXPECT_EQ( VFS::PathHandle::intern("a/..").str(), "." );
+
+    EXPECT_FALSE( VFS::PathHandle::intern("").valid() );
+    EXPECT_FALSE( VFS::PathHandle::intern("/etc").valid() );
+    EXPECT_FALSE( VFS::PathHandle::intern("..").valid() );
+    EXPECT_FALSE( VFS::PathHandle::intern("a/../../b").valid() );
+    EXPECT_FALSE( VFS::PathHandle().valid() );
+
+    // by whole parts, not by the text
+    EXPECT_TRUE( path.contains(VFS::PathHandle::intern("a/b/c")) );
+    EXPECT_TRUE( path.contains(path) );
+    EXPECT_FALSE( path.contains(VFS::PathHandle::intern("a/bc")) );
+    EXPECT_FALSE( path.contains(VFS::PathHandle::intern("a")) );
+    EXPECT_TRUE( VFS::PathHandle::intern(".").contains(path) );
+
+    std::unordered_set<VFS::PathHandle> set{ path, VFS::PathHandle::intern("a/b"), VFS::PathHandle::intern("x") };
+    EXPECT_EQ( set.size(), 2u );
+}
+
+TEST(PathHandleTest, FileSystem) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_pathhandle";
+    auto outside = VFS::fs::temp_directory_path() / "vfs_pathhandle_outside";
+    VFS::fs::remove_all(dir);
+    VFS::fs::remove_all(outside);
+    VFS::fs::create_directories(dir);
+    VFS::fs::create_directories(outside);
+    std::ofstream{ outside / "secret" } << "secret";
+    VFS::fs::create_directory_symlink(outside, dir / "escape");
+
+    VFS::FileSystem fs(dir.string());
+    auto sub = VFS::PathHandle::intern("sub");
+    auto file = VFS::PathHandle::intern("sub/file");
+    ASSERT_TRUE( fs.makeDir(sub) );
+    ASSERT_TRUE( fs.touchFile(file) );
+    EXPECT_FALSE( fs.touchFile(file) );
+    EXPECT_STREQ( fs.type(file), VFS::type::REGULAR );
+    EXPECT_STREQ( fs.type("sub/../sub/file"), VFS::type::REGULAR );
+
+    auto opened = fs.open(file);
+    ASSERT_TRUE( opened != nullptr );
+    EXPECT_EQ( opened->write(VFS::IFile::Buffer(5, 'x'), 0, 5), 5u );
+    opened->close();
+
+    auto copied = VFS::PathHandle::intern("sub/copied");
+    ASSERT_TRUE( fs.copyFile(file, copied).ok );
+    EXPECT_FALSE( fs.copyFile(file, copied).ok );
+    EXPECT_FALSE( fs.moveTo(file, copied) );
+    ASSERT_TRUE( fs.moveTo(file, VFS::PathHandle::intern("moved")) );
+    EXPECT_EQ( fs.open("moved", VFS::Perms::READ)->readAll(), VFS::IFile::Buffer(5, 'x') );
+    EXPECT_TRUE( fs.remove(copied) );
+    EXPECT_TRUE( fs.remove(sub) );
+
+    // nothing outside the root is reached, neither by ".." nor through a symbolic link
+    EXPECT_TRUE( fs.open("../vfs_pathhandle_outside/secret") == nullptr );
+    EXPECT_TRUE( fs.open("escape/secret") == nullptr );
+    EXPECT_FALSE( fs.touchFile("escape/planted") );
+    EXPECT_FALSE( fs.makeDir("escape/planted") );
+    EXPECT_FALSE( fs.remove("escape/secret") );
+    EXPECT_FALSE( fs.copy("escape/secret", "stolen") );
+    EXPECT_FALSE( fs.contain("escape/../escape/secret") );
+    EXPECT_STREQ( fs.type("escape/secret"), VFS::type::NONE );
+    EXPECT_STREQ( fs.type("escape"), VFS::type::SYMLINK );
+    EXPECT_TRUE( fs.list("escape").empty() );
+    EXPECT_TRUE( fs.openDir("escape") == nullptr );
+
+    // not by a move to another filesystem either, on either side
+    auto memfs = std::make_shared<VFS::MemoryFileSystem>("memfs");
+    EXPECT_FALSE( fs.moveTo("escape/secret", memfs, "stolen") );
+    auto other = std::make_shared<VFS::FileSystem>(outside.string());
+    VFS::fs::create_directory_symlink(dir, outside / "back");
+    ASSERT_TRUE( fs.touchFile("moving") );
+    EXPECT_FALSE( other->moveTo("back/moving", memfs, "stolen") );
+    EXPECT_FALSE( fs.moveTo("moving", other, "back/arrived") );
+    EXPECT_FALSE( VFS::fs::exists(dir / "arrived") );
+    EXPECT_FALSE( memfs->contain("stolen") );
+
+    // nor by the names of a cookie
+    ASSERT_TRUE( fs.makeDir("listed") );
+    auto cursor = fs.openDir(".", true, "0:0;2:..0;");
+    ASSERT_TRUE( cursor != nullptr );
+    for ( auto const & entry : cursor->next(1000) )
+        EXPECT_EQ( entry.find("vfs_pathhandle_outside"), std::string::npos );
+
+    EXPECT_FALSE( VFS::fs::exists(outside / "planted") );
+    EXPECT_TRUE( VFS::fs::exists(outside / "secret") );
+
+    VFS::fs::remove_all(dir);
+    VFS::fs::remove_all(outside);
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include "vfs/VFS.h"
+
+static std::string tempTree(std::string const & name) {
+    auto dir = VFS::fs::temp_directory_path() / name;
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir / "dir1" / "sub1");
+    VFS::fs::create_directories(dir / "dir2");
+    std::ofstream{ dir / "file1.txt" };
+    std::ofstream{ dir / "dir1" / "file2.txt" };
+    std::ofstream{ dir / "dir1" / "sub1" / "file3.txt" };
+    return dir.string() + "/";
+}
+
+TEST(PathIndexTest, Build) {
+    auto root = tempTree("vfs_pathindex_build");
+    VFS::PathIndex index;
+    index.build(root);
+    EXPECT_EQ( index.size(), 6 );
+    EXPECT_TRUE( index.contains("file1.txt") );
+    EXPECT_TRUE( index.contains("./dir1/sub1/file3.txt") );
+    EXPECT_TRUE( index.contains("dir1//sub1") );
+    EXPECT_TRUE( index.contains(".") );
+    EXPECT_TRUE( !index.contains("dir1/file3.txt") );
+    EXPECT_TRUE( !index.contains("file1.txt/x") );
+    EXPECT_TRUE( !index.contains("../file1.txt") );
+    VFS::fs::remove_all(root);
+}
+
+TEST(PathIndexTest, Update) {
+    auto root = tempTree("vfs_pathindex_update");
+    VFS::PathIndex index;
+    index.build(root);
+
+    VFS::fs::create_directory(root + "dir3");
+    index.insert("dir3", true);
+    std::ofstream{ root + "dir3/file4.txt" };
+    index.insert("dir3/file4.txt", false);
+    EXPECT_TRUE( index.contains("dir3/file4.txt") );
+
+    VFS::fs::rename(root + "dir1", root + "dir2/moved");
+    index.move("dir1", "dir2/moved");
+    EXPECT_TRUE( !index.contains("dir1/file2.txt") );
+    EXPECT_TRUE( index.contains("dir2/moved/sub1/file3.txt") );
+
+    VFS::fs::remove_all(root + "dir2/moved");
+    index.erase("dir2/moved");
+    EXPECT_EQ( index.size(), 4 );
+
+    std::size_t visited = 0;
+    index.forEach([&visited] (std::string const &) { return ++visited < 2; });
+    EXPECT_EQ( visited, 2 );
+    VFS::fs::remove_all(root);
+}
+
+TEST(PathIndexTest, ExternalChanges) {
+    auto root = tempTree("vfs_pathindex_external");
+    VFS::PathIndex index;
+    index.build(root);
+
+    // changes made behind the index are seen through the parent directory
+    std::ofstream{ root + "dir2/new.txt" };
+    EXPECT_TRUE( index.contains("dir2/new.txt") );
+    VFS::fs::remove(root + "dir1/file2.txt");
+    EXPECT_TRUE( !index.contains("dir1/file2.txt") );
+    VFS::fs::create_directories(root + "dir4/deep");
+    std::ofstream{ root + "dir4/deep/file5.txt" };
+    EXPECT_TRUE( index.contains("dir4/deep/file5.txt") );
+
+    VFS::fs::remove_all(root + "dir1");
+    EXPECT_TRUE( !index.contains("dir1/sub1/file3.txt") );
+    EXPECT_TRUE( !index.contains("dir1") );
+    EXPECT_EQ( index.size(), 6 );
+    VFS::fs::remove_all(root);
+}
+
+TEST(PathIndexTest, FileSystem) {
+    auto root = tempTree("vfs_pathindex_fs");
+    VFS::FileSystem fs( root );
+    EXPECT_TRUE( fs.contain("file1.txt") );
+    EXPECT_TRUE( fs.contain("./dir1/sub1") );
+    EXPECT_TRUE( fs.contain("sub1") );
+    EXPECT_EQ( fs.search("file3.txt"), "./dir1/sub1/file3.txt" );
+
+    EXPECT_TRUE( fs.touchFile("dir2/file6.txt") );
+    EXPECT_EQ( fs.search("file6"), "./dir2/file6.txt" );
+    EXPECT_TRUE( fs.moveTo("dir2/file6.txt", "file7.txt") );
+    EXPECT_EQ( fs.search("file6"), VFS::type::NOTFOUND );
+    EXPECT_TRUE( fs.copy("file7.txt", "dir2/file8.txt") );
+    EXPECT_TRUE( fs.contain("dir2/file8.txt") );
+    EXPECT_TRUE( fs.remove("dir2/file8.txt") );
+    EXPECT_TRUE( !fs.contain("file8") );
+
+    VFS::fs::remove(root + "file7.txt");
+    EXPECT_EQ( fs.search("file7"), VFS::type::NOTFOUND );
+    VFS::fs::remove_all(root);
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+TEST(PathLocksTest, Exclusion) {
+    VFS::PathLocks locks;
+    auto guard = locks.lock("a/b");
+
+    std::atomic<bool> parent(false);
+    std::atomic<bool> sibling(false);
+    std::thread removeParent([&] { auto g = locks.lock("./a"); parent = true; });
+    std::thread createSibling([&] { auto g = locks.lock("a//c"); sibling = true; });
+
+    // a file next to a/b can be created, a can't be removed under it
+    createSibling.join();
+    EXPECT_TRUE( sibling );
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_TRUE( !parent );
+
+    guard.unlock();
+    removeParent.join();
+    EXPECT_TRUE( parent );
+}
+
+TEST(PathLocksTest, Rename) {
+    VFS::PathLocks locks(4);
+    std::vector<std::thread> threads;
+    std::size_t renames = 0;
+    for ( int t = 0; t < 4; ++t )
+    {
+        threads.emplace_back([&locks, &renames, t] {
+            for ( int i = 0; i < 2000; ++i )
+            {
+                // opposite directions, ordered locking keeps them from deadlocking
+                auto guard = t % 2 == 0 ? locks.lock("dir1/x", "dir2/y") : locks.lock("dir2/y", "dir1/x");
+                ++renames;
+            }
+        });
+    }
+    for ( auto & thread : threads )
+        thread.join();
+    EXPECT_EQ( renames, 8000 );
+}
+
+TEST(PathLocksTest, Lookup) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_pathlocks_throughput";
+    VFS::fs::remove_all(dir);
+    for ( int d = 0; d < 16; ++d )
+    {
+        VFS::fs::create_directories(dir / ( "dir" + std::to_string(d) ));
+        for ( int f = 0; f < 16; ++f )
+            std::ofstream{ dir / ( "dir" + std::to_string(d) ) / ( "file" + std::to_string(f) ) };
+    }
+    VFS::FileSystem fs( dir.string() );
+
+    auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for ( unsigned threads = 1; threads <= std::max(cores, 4u); threads *= 2 )
+    {
+        std::atomic<std::size_t> found(0);
+        std::vector<std::thread> workers;
+        for ( unsigned t = 0; t < threads; ++t )
+        {
+            workers.emplace_back([&fs, &found, t] {
+                for ( int i = 0; i < 2000; ++i )
+                {
+                    auto name = "dir" + std::to_string(( i + t ) % 16) + "/file" + std::to_string(i % 16);
+                    if ( fs.contain(name) && std::string(fs.type(name)) == VFS::type::REGULAR )
+                        ++found;
+                }
+            });
+        }
+        // mutations of other directories don't stop the lookups
+        EXPECT_TRUE( fs.makeDir("busy" + std::to_string(threads)) );
+        EXPECT_TRUE( fs.touchFile("busy" + std::to_string(threads) + "/file") );
+        EXPECT_TRUE( fs.moveTo("busy" + std::to_string(threads) + "/file", "busy" + std::to_string(threads) + "/moved") );
+        for ( auto & worker : workers )
+            worker.join();
+
+        EXPECT_EQ( found.load(), threads * 2000 );
+    }
+    VFS::fs::remove_all(dir);
+}
@@ -1,7 +1,10 @@
 #include <gtest/gtest.h>
 #include <unistd.h>
+#include <atomic>
+#include <cstring>
 #include <iostream>
 #include <thread>
+#include <vector>
 #include "vfs/VFS.h"
 
 auto filePath = "/home/maple/workspace/code/vfs/test/data/file2.txt";
@@ -67,3 +70,270 @@ TEST(RegularFileTest, MultiThread) {
     t3.join();
     t4.join();
 }
+
+TEST(RegularFileTest, PositionalIO) {
+    auto path = ( VFS::fs::temp_directory_path() / "vfs_regularfile_positional.txt" ).string();
+    VFS::fs::remove(path);
+    VFS::RegularFile f(path);
+
+    // every block is written by one of four writers, then checked by eight concurrent readers
+    constexpr std::size_t blocks = 64;
+    constexpr std::size_t blockSize = 4096;
+    auto writer = [&f] (std::size_t first) {
+        for ( auto i = first; i < blocks; i += 4 )
+        {
+            VFS::IFile::Buffer block(blockSize, static_cast<char>('a' + i % 26));
+            EXPECT_EQ( f.write(block, i * blockSize, block.size()), block.size() );
+        }
+    };
+    std::vector<std::thread> threads;
+    for ( std::size_t i = 0; i < 4; ++i )
+        threads.emplace_back(writer, i);
+    for ( auto & t : threads )
+        t.join();
+    threads.clear();
+    EXPECT_EQ( f.size(), blocks * blockSize );
+
+    auto reader = [&f] (std::size_t seed) {
+        for ( std::size_t n = 0; n < blocks; ++n )
+        {
+            auto i = ( seed + n * 7 ) % blocks;
+            auto block = f.read(i * blockSize, blockSize);
+            EXPECT_EQ( block, VFS::IFile::Buffer(blockSize, static_cast<char>('a' + i % 26)) );
+        }
+    };
+    for ( std::size_t i = 0; i < 8; ++i )
+        threads.emplace_back(reader, i);
+    for ( auto & t : threads )
+        t.join();
+
+    // the cursor overloads append and read sequentially
+    VFS::IFile::Buffer tail(10, 'Z');
+    EXPECT_EQ( f.write(tail, tail.size()), tail.size() );
+    EXPECT_EQ( f.read(blocks * blockSize, 20), tail );
+    EXPECT_EQ( f.read(blockSize).size(), blockSize );
+    EXPECT_EQ( f.read(1), VFS::IFile::Buffer(1, 'b') );
+
+    // size() while the file is closed and its descriptor given to another file never sees the other one
+    auto expected = f.size();
+    std::atomic<bool> closed(false);
+    std::thread sizer([&f, &closed, expected] ()
+    {
+        while ( !closed )
+            EXPECT_EQ( f.size(), expected );
+    });
+    f.close();
+    VFS::RegularFile other(path + ".other");
+    EXPECT_EQ( other.write(VFS::IFile::Buffer(1, 'o'), 0, 1), 1u );
+    closed = true;
+    sizer.join();
+    EXPECT_EQ( f.size(), expected );
+    other.close();
+    VFS::fs::remove(path + ".other");
+
+    EXPECT_TRUE( f.read(0, 10).empty() );
+    VFS::fs::remove(path);
+}
+
+TEST(RegularFileTest, CallerBuffer) {
+    auto path = ( VFS::fs::temp_directory_path() / "vfs_regularfile_caller.txt" ).string();
+    VFS::fs::remove(path);
+    VFS::RegularFile f(path);
+
+    std::string text = "hello caller-owned memory";
+    EXPECT_EQ( f.write(text.data(), 0, text.size()), text.size() );
+
+    char raw[6] = {};
+    EXPECT_EQ( f.read(raw, 6, 6), 6 );
+    EXPECT_EQ( std::string(raw, 6), "caller" );
+    EXPECT_EQ( f.read(raw, text.size() - 3, 6), 3 );
+
+    // the reused buffer keeps its storage across reads
+    VFS::IFile::Buffer buf;
+    EXPECT_EQ( f.read(buf, 0, 5), 5 );
+    auto storage = buf.data();
+    EXPECT_EQ( std::string(buf.begin(), buf.end()), "hello" );
+    EXPECT_EQ( f.read(buf, 20, 5), 5 );
+    EXPECT_EQ( std::string(buf.begin(), buf.end()), "emory" );
+    EXPECT_EQ( buf.data(), storage );
+    EXPECT_EQ( f.read(buf, 100, 5), 0 );
+    EXPECT_TRUE( buf.empty() );
+    VFS::fs::remove(path);
+}
+
+TEST(RegularFileTest, Batch) {
+    auto path = ( VFS::fs::temp_directory_path() / "vfs_regularfile_batch.txt" ).string();
+    VFS::fs::remove(path);
+    for ( auto cache : { std::shared_ptr<VFS::BlockCache>(), std::make_shared<VFS::BlockCache>(1 << 20, 16) } )
+    {
+        VFS::RegularFile f(path, cache);
+
+        // gathered from three buffers, two of them adjacent in the file, given out of order
+        std::string a = "0123456789", b = "abcdef", c = "XYZ";
+        std::vector<VFS::IFile::WriteRange> writes = {
+            { 10, b.size(), b.data() }, { 0, a.size(), a.data() }, { 30, c.size(), c.data() } };
+        EXPECT_EQ( f.writeBatch(writes), 19 );
+        EXPECT_EQ( writes[0].written, 6 );
+        EXPECT_EQ( f.size(), 33 );
+
+        char x[4] = {}, y[8] = {}, z[10] = {}, w[2] = {};
+        std::vector<VFS::IFile::ReadRange> reads = {
+            { 30, 10, z }, { 2, 4, x }, { 6, 8, y }, { 40, 2, w } };
+        EXPECT_EQ( f.readBatch(reads), 15 );
+        EXPECT_EQ( std::string(x, 4), "2345" );
+        EXPECT_EQ( std::string(y, 8), "6789abcd" );
+        EXPECT_EQ( reads[0].read, 3 );
+        EXPECT_EQ( std::string(z, 3), "XYZ" );
+        EXPECT_EQ( reads[3].read, 0 );
+        VFS::fs::remove(path);
+    }
+
+    // the default implementation of the other files reads range by range
+    VFS::MemoryFileSystem memfs( "memfs" );
+    memfs.touchFile("file");
+    auto file = memfs.open("file");
+    std::string text = "memory ranges";
+    std::vector<VFS::IFile::WriteRange> writes = { { 7, 6, text.data() + 7 }, { 0, 7, text.data() } };
+    EXPECT_EQ( file->writeBatch(writes), text.size() );
+    char m[6] = {};
+    std::vector<VFS::IFile::ReadRange> reads = { { 0, 6, m } };
+    EXPECT_EQ( file->readBatch(reads), 6 );
+    EXPECT_EQ( std::string(m, 6), "memory" );
+}
+
+TEST(RegularFileTest, WriteBehind) {
+    auto path = ( VFS::fs::temp_directory_path() / "vfs_regularfile_behind.txt" ).string();
+    VFS::fs::remove(path);
+    VFS::RegularFile f(path, std::make_shared<VFS::BlockCache>());
+    VFS::RegularFile other(path);
+    f.setWriteBehind(1024, std::chrono::hours(1));
+
+    // small writes stay in memory, merged into one extent, and read back through the buffer
+    std::string block(16, 'w');
+    for ( std::size_t i = 0; i < 8; ++i )
+        EXPECT_EQ( f.write(block.data(), i * 16, 16), 16 );
+    EXPECT_EQ( f.write(block.data(), 200, 8), 8 );
+    EXPECT_EQ( f.size(), 208 );
+    EXPECT_EQ( other.size(), 0 );
+    EXPECT_EQ( f.read(120, 8), VFS::IFile::Buffer(8, 'w') );
+    EXPECT_EQ( other.size(), 208 );
+    EXPECT_EQ( f.read(128, 4), VFS::IFile::Buffer(4, 0) );
+
+    // appends land after the buffered end, sync() writes them out
+    VFS::IFile::Buffer tail(4, 't');
+    EXPECT_EQ( f.write(tail, 4), 4 );
+    EXPECT_EQ( f.sync(), 0 );
+    EXPECT_EQ( other.read(208, 4), tail );
+
+    // the size threshold flushes without a sync
+    std::string big(600, 'b');
+    f.write(big.data(), 0, big.size());
+    EXPECT_EQ( other.read(0, 1), VFS::IFile::Buffer(1, 'w') );
+    f.write(big.data(), 600, big.size());
+    EXPECT_EQ( other.read(0, 1), VFS::IFile::Buffer(1, 'b') );
+
+    // and so does the delay
+    f.setWriteBehind(1024, std::chrono::milliseconds(10));
+    f.write(tail.data(), 0, 4);
+    for ( int i = 0; i < 500 && other.read(0, 1) != VFS::IFile::Buffer(1, 't'); ++i )
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_EQ( other.read(0, 1), VFS::IFile::Buffer(1, 't') );
+
+    // what is left is written when the file closes
+    f.write(tail.data(), 2000, 4);
+    EXPECT_EQ( f.datasync(), 0 );
+    f.write(block.data(), 3000, 16);
+    f.close();
+    EXPECT_EQ( other.read(3000, 16), VFS::IFile::Buffer(16, 'w') );
+    VFS::fs::remove(path);
+
+    // concurrent appends, buffered or too big for the buffer, never land on each other
+    for ( std::size_t limit : { 16, 256 } )
+    {
+        VFS::RegularFile appended(path);
+        appended.setWriteBehind(limit, std::chrono::hours(1));
+        std::vector<std::thread> writers;
+        for ( char t = 0; t < 8; ++t )
+        {
+            writers.emplace_back([&appended, t] ()
+            {
+                for ( int i = 0; i < 500; ++i )
+                    appended.write(VFS::IFile::Buffer(i % 7 == 0 ? 512 : 64, 'a' + t), i % 7 == 0 ? 512 : 64);
+            });
+        }
+        for ( auto & writer : writers )
+            writer.join();
+        EXPECT_EQ( appended.sync(), 0 );
+
+        std::size_t records[8] = {};
+        auto data = appended.readAll();
+        for ( std::size_t offset = 0; offset < data.size(); offset += 64 )
+        {
+            ASSERT_EQ( VFS::IFile::Buffer(data.begin() + offset, data.begin() + offset + 64), VFS::IFile::Buffer(64, data[offset]) );
+            ASSERT_TRUE( data[offset] >= 'a' && data[offset] < 'a' + 8 );
+            ++records[data[offset] - 'a'];
+        }
+        for ( auto count : records )
+            EXPECT_EQ( count, 72 * 8 + 428 );
+        appended.close();
+        VFS::fs::remove(path);
+    }
+}
+
+TEST(RegularFileTest, ReadAhead) {
+    auto path = ( VFS::fs::temp_directory_path() / "vfs_regularfile_readahead.txt" ).string();
+    VFS::fs::remove(path);
+    std::string content(4 * 1024 * 1024, 0);
+    for ( std::size_t i = 0; i < content.size(); ++i )
+        content[i] = static_cast<char>('a' + i % 26);
+    VFS::RegularFile(path).write(content.data(), 0, content.size());
+
+    for ( auto cache : { std::shared_ptr<VFS::BlockCache>(), std::make_shared<VFS::BlockCache>(16 << 20, 64 * 1024) } )
+    {
+        VFS::RegularFile f(path, cache);
+        f.setReadAhead(1024 * 1024, true);
+
+        // a stream of 32 KiB reads opens a window that grows up to the limit
+        constexpr std::size_t chunk = 32 * 1024;
+        char buf[chunk];
+        for ( std::size_t offset = 0; offset < 2 * 1024 * 1024; offset += chunk )
+        {
+            ASSERT_EQ( f.read(buf, offset, chunk), chunk );
+            ASSERT_EQ( std::memcmp(buf, content.data() + offset, chunk), 0 );
+        }
+        auto stats = f.readAheadStats();
+        EXPECT_EQ( stats.random, 1u );
+        EXPECT_EQ( stats.sequential, 63u );
+        EXPECT_EQ( stats.windows, 1u );
+        EXPECT_EQ( stats.window, 1024 * 1024u );
+        EXPECT_GE( stats.prefetched, 2 * 1024 * 1024u );
+
+        // a seek collapses the window, the reads after it start over
+        EXPECT_EQ( f.read(buf, 100, 10), 10u );
+        EXPECT_EQ( std::memcmp(buf, content.data() + 100, 10), 0 );
+        EXPECT_EQ( f.readAheadStats().window, 0u );
+        EXPECT_EQ( f.readAheadStats().windows, 1u );
+
+        // the cursor of read(size) is followed the same way, and off is off
+        f.setReadAhead(0);
+        EXPECT_EQ( f.read(chunk).size(), chunk );
+        EXPECT_EQ( f.read(chunk).size(), chunk );
+        EXPECT_EQ( f.readAheadStats().window, 0u );
+        f.setReadAhead();
+        EXPECT_EQ( f.read(chunk).size(), chunk );
+        EXPECT_EQ( f.read(chunk).size(), chunk );
+        EXPECT_EQ( f.readAheadStats().window, VFS::RegularFile::READ_AHEAD_START );
+        f.close();
+
+        // with a cache the data after the stream is there without a read of its own, close() waited for it
+        if ( cache != nullptr )
+        {
+            VFS::RegularFile other(path, cache);
+            auto misses = cache->stats().misses;
+            EXPECT_EQ( other.read(buf, 2 * 1024 * 1024, chunk), chunk );
+            EXPECT_EQ( std::memcmp(buf, content.data() + 2 * 1024 * 1024, chunk), 0 );
+            EXPECT_EQ( cache->stats().misses, misses );
+        }
+    }
+    VFS::fs::remove(path);
+}
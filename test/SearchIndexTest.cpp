@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include "vfs/VFS.h"
+
+TEST(SearchIndexTest, Find) {
+    VFS::SearchIndex index;
+    index.add("./dir1/file1.txt");
+    index.add("./dir1/file2.log");
+    index.add("./dir2/notes.txt");
+    index.add("./dir2/notes.txt");
+    EXPECT_EQ( index.size(), 3 );
+
+    EXPECT_EQ( index.find("file"), VFS::SearchIndex::EntryList({ "./dir1/file1.txt", "./dir1/file2.log" }) );
+    EXPECT_EQ( index.find(".txt"), VFS::SearchIndex::EntryList({ "./dir1/file1.txt", "./dir2/notes.txt" }) );
+    EXPECT_EQ( index.find("dir2/n"), VFS::SearchIndex::EntryList({ "./dir2/notes.txt" }) );
+    EXPECT_EQ( index.find("2"), VFS::SearchIndex::EntryList({ "./dir1/file2.log", "./dir2/notes.txt" }) );
+    EXPECT_TRUE( index.find("txtt").empty() );
+    // every trigram is there, the substring isn't
+    EXPECT_TRUE( index.find("dir1/file1.log").empty() );
+
+    EXPECT_EQ( index.find("/", 1, 1), VFS::SearchIndex::EntryList({ "./dir1/file2.log" }) );
+    EXPECT_TRUE( index.find("/", 3).empty() );
+    EXPECT_TRUE( index.find("/", 0, 0).empty() );
+
+    EXPECT_EQ( index.findPrefix("./dir1/"), VFS::SearchIndex::EntryList({ "./dir1/file1.txt", "./dir1/file2.log" }) );
+    EXPECT_TRUE( index.findPrefix("dir1").empty() );
+    EXPECT_EQ( index.findPrefix(".", 2), VFS::SearchIndex::EntryList({ "./dir2/notes.txt" }) );
+}
+
+TEST(SearchIndexTest, Remove) {
+    VFS::SearchIndex index;
+    for ( int i = 0; i < 5000; ++i )
+        index.add("./file" + std::to_string(i));
+    for ( int i = 0; i < 5000; ++i )
+    {
+        if ( i % 1000 != 0 )
+            index.remove("./file" + std::to_string(i));
+    }
+
+    // the removals above compacted the posting lists on the way
+    EXPECT_EQ( index.size(), 5 );
+    EXPECT_EQ( index.find("file"), VFS::SearchIndex::EntryList({ "./file0", "./file1000", "./file2000", "./file3000", "./file4000" }) );
+    EXPECT_EQ( index.find("e30"), VFS::SearchIndex::EntryList({ "./file3000" }) );
+    index.add("./file1");
+    EXPECT_EQ( index.find("file1"), VFS::SearchIndex::EntryList({ "./file1000", "./file1" }) );
+
+    index.clear();
+    EXPECT_EQ( index.size(), 0 );
+    EXPECT_TRUE( index.find("file").empty() );
+}
+
+TEST(SearchIndexTest, FileSystem) {
+    auto dir = VFS::fs::temp_directory_path() / "vfs_searchindex_fs";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir / "src" / "core");
+    std::ofstream{ dir / "src" / "main.cpp" };
+    std::ofstream{ dir / "src" / "core" / "index.cpp" };
+    std::ofstream{ dir / "README.md" };
+    auto root = dir.string() + "/";
+
+    VFS::FileSystem fs( root );
+    EXPECT_EQ( fs.searchAll(".cpp").size(), 2 );
+    EXPECT_EQ( fs.searchPrefix("src/").size(), 3 );
+    EXPECT_EQ( fs.searchPrefix("./README"), VFS::IFS::EntryList({ "./README.md" }) );
+
+    EXPECT_TRUE( fs.moveTo("src/core", "core") );
+    EXPECT_EQ( fs.searchAll("index"), VFS::IFS::EntryList({ "./core/index.cpp" }) );
+    EXPECT_TRUE( fs.searchPrefix("src/core").empty() );
+    EXPECT_TRUE( fs.touchFile("src/util.cpp") );
+    EXPECT_EQ( fs.searchAll(".cpp").size(), 3 );
+    EXPECT_EQ( fs.search("util"), "./src/util.cpp" );
+
+    // changes made outside show up once the directory is looked at again
+    std::ofstream{ dir / "core" / "extra.cpp" };
+    EXPECT_TRUE( fs.contain("core/extra.cpp") );
+    EXPECT_EQ( fs.searchAll("extra"), VFS::IFS::EntryList({ "./core/extra.cpp" }) );
+    VFS::fs::remove_all(dir / "core");
+    EXPECT_EQ( fs.search("extra"), VFS::type::NOTFOUND );
+    EXPECT_TRUE( fs.searchAll("core").empty() );
+    VFS::fs::remove_all(dir);
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+namespace {
+
+struct Counter
+{
+    std::atomic<std::uint64_t> value{ 0 };
+};
+
+std::unique_ptr<Counter> newCounter()
+{
+    return std::unique_ptr<Counter>(new Counter());
+}
+
+void add(Counter & into, Counter const & from)
+{
+    VFS::bumpOwned(into.value, from.value.load());
+}
+
+std::size_t count(VFS::ThreadShards<Counter> const & shards, std::uint64_t & sum)
+{
+    std::size_t count = 0;
+    sum = 0;
+    shards.forEach([&count, &sum] (Counter const & shard)
+    {
+        ++count;
+        sum += shard.value.load();
+    });
+
+    return count;
+}
+
+}
+
+TEST(ThreadShardsTest, Threads) {
+    VFS::ThreadShards<Counter> folded(newCounter(), add);
+    VFS::ThreadShards<Counter> kept;
+    auto & mine = folded.local(newCounter);
+    EXPECT_EQ( &folded.local(newCounter), &mine );
+    EXPECT_NE( &kept.local(newCounter), &mine );
+    VFS::bumpOwned(mine.value, 1);
+
+    // every thread has a shard of its own, given back when it ends or left as it is
+    std::vector<std::thread> threads;
+    for ( int t = 0; t < 4; ++t )
+    {
+        threads.emplace_back([&folded, &kept] ()
+        {
+            for ( int i = 0; i < 1000; ++i )
+            {
+                VFS::bumpOwned(folded.local(newCounter).value, 1);
+                VFS::bumpOwned(kept.local(newCounter).value, 1);
+            }
+        });
+    }
+    for ( auto & thread : threads )
+        thread.join();
+
+    std::uint64_t sum = 0;
+    EXPECT_EQ( count(folded, sum), 2u );
+    EXPECT_EQ( sum, 4001u );
+    EXPECT_EQ( count(kept, sum), 5u );
+    EXPECT_EQ( sum, 4000u );
+
+    // a thread may end after the shards it used, and uses new ones at other places
+    std::unique_ptr<VFS::ThreadShards<Counter>> gone(new VFS::ThreadShards<Counter>(newCounter(), add));
+    std::atomic<bool> used(false);
+    std::atomic<bool> released(false);
+    std::thread late([&gone, &used, &released] ()
+    {
+        VFS::bumpOwned(gone->local(newCounter).value, 1);
+        used = true;
+        while ( !released )
+            std::this_thread::yield();
+        VFS::ThreadShards<Counter> next(newCounter(), add);
+        EXPECT_EQ( next.local(newCounter).value.load(), 0u );
+    });
+    while ( !used )
+        std::this_thread::yield();
+    gone.reset();
+    released = true;
+    late.join();
+}
@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+namespace {
+
+std::string tracePath(char const * name)
+{
+    return ( VFS::fs::temp_directory_path() / name ).string();
+}
+
+// a workload of two threads on their own files
+void work(VFS::IFS & fs)
+{
+    fs.makeDir("dir");
+    std::vector<std::thread> threads;
+    for ( int t = 0; t < 2; ++t )
+    {
+        threads.emplace_back([&fs, t] ()
+        {
+            auto name = "dir/file" + std::to_string(t);
+            fs.touchFile(name);
+            auto file = fs.open(name);
+            VFS::IFile::Buffer data(4096, 'x');
+            for ( int i = 0; i < 10; ++i )
+                file->write(data.data(), i * 4096, data.size());
+            file->read(0, 8192);
+            file->sync();
+            file->close();
+            fs.search("file" + std::to_string(t));
+        });
+    }
+    for ( auto & thread : threads )
+        thread.join();
+    fs.moveTo("dir/file0", "dir/moved");
+}
+
+}
+
+TEST(TracerTest, RoundTrip) {
+    auto path = tracePath("vfs_tracer_roundtrip.trace");
+    {
+        auto tracer = std::make_shared<VFS::Tracer>(path);
+        ASSERT_TRUE( tracer->good() );
+        VFS::InstrumentedFS fs(std::make_shared<VFS::MemoryFileSystem>("memfs"), nullptr, tracer);
+        work(fs);
+        EXPECT_EQ( tracer->stats().dropped, 0u );
+    }
+
+    std::vector<VFS::Tracer::Event> events;
+    ASSERT_TRUE( VFS::Tracer::load(path, events) );
+    // makeDir, 2 x (touchFile, open, 10 writes, read, sync, close, search), moveTo
+    ASSERT_EQ( events.size(), 2u + 2 * 16 );
+
+    std::set<std::uint32_t> threads;
+    std::set<std::uint64_t> handles;
+    for ( std::size_t i = 0; i < events.size(); ++i )
+    {
+        threads.insert(events[i].thread);
+        if ( events[i].handle != 0 )
+            handles.insert(events[i].handle);
+        if ( i != 0 )
+        {
+            EXPECT_LE( events[i - 1].start, events[i].start );
+        }
+    }
+    EXPECT_EQ( threads.size(), 3u );
+    EXPECT_EQ( handles.size(), 2u );
+
+    EXPECT_EQ( events.front().op, VFS::Metrics::Op::MAKE_DIR );
+    EXPECT_EQ( events.front().path, "dir" );
+    EXPECT_EQ( events.back().op, VFS::Metrics::Op::MOVE_TO );
+    EXPECT_EQ( events.back().target, "dir/moved" );
+    for ( auto const & event : events )
+    {
+        if ( event.op == VFS::Metrics::Op::WRITE )
+        {
+            EXPECT_EQ( event.size, 4096u );
+            EXPECT_EQ( event.bytes, 4096u );
+            EXPECT_EQ( event.offset % 4096, 0u );
+        }
+    }
+
+    // a cut trace keeps what is whole
+    VFS::fs::resize_file(path, VFS::fs::file_size(path) - 3);
+    EXPECT_FALSE( VFS::Tracer::load(path, events) );
+    EXPECT_EQ( events.size(), 2u + 2 * 16 - 1 );
+    VFS::fs::remove(path);
+}
+
+TEST(TracerTest, Dropped) {
+    auto path = tracePath("vfs_tracer_dropped.trace");
+    std::uint64_t recorded = 0;
+    {
+        // a ring of 4 slots can't keep up with a tight loop
+        VFS::Tracer tracer(path, 4);
+        std::string name("file");
+        auto now = VFS::Tracer::Clock::now();
+        for ( int i = 0; i < 10000; ++i )
+            tracer.record(VFS::Metrics::Op::READ, now, now, 1, name, std::string(), i, 1, 1, false);
+        auto stats = tracer.stats();
+        EXPECT_EQ( stats.recorded + stats.dropped, 10000u );
+        EXPECT_GT( stats.dropped, 0u );
+        recorded = stats.recorded;
+    }
+
+    std::vector<VFS::Tracer::Event> events;
+    ASSERT_TRUE( VFS::Tracer::load(path, events) );
+    EXPECT_EQ( events.size(), recorded );
+    VFS::fs::remove(path);
+}
+
+TEST(TracerTest, Replay) {
+    auto path = tracePath("vfs_tracer_replay.trace");
+    auto dir = VFS::fs::temp_directory_path() / "vfs_tracer_replay";
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    {
+        VFS::InstrumentedFS fs(std::make_shared<VFS::FileSystem>(dir.string()), nullptr, std::make_shared<VFS::Tracer>(path));
+        work(fs);
+    }
+
+    std::vector<VFS::Tracer::Event> events;
+    ASSERT_TRUE( VFS::Tracer::load(path, events) );
+    auto span = std::chrono::nanoseconds(events.back().start);
+
+    // against an empty memory filesystem, as fast as it goes
+    VFS::Replay fast(events);
+    EXPECT_EQ( fast.threads(), 3u );
+    auto memfs = std::make_shared<VFS::MemoryFileSystem>("memfs");
+    auto result = fast.run(memfs, VFS::Replay::Speed::FAST);
+    EXPECT_EQ( result.errors, 0u );
+    EXPECT_EQ( result.calls + result.skipped, events.size() );
+    EXPECT_TRUE( memfs->contain("dir/moved") );
+    EXPECT_EQ( memfs->open("dir/file1")->size(), 40960u );
+
+    // at the traced times, the trace makes its files itself
+    VFS::fs::remove_all(dir);
+    VFS::fs::create_directories(dir);
+    auto disk = std::make_shared<VFS::FileSystem>(dir.string());
+    VFS::Replay original(events);
+    original.prepare(*disk);
+    EXPECT_FALSE( VFS::fs::exists(dir / "dir") );
+    result = original.run(disk, VFS::Replay::Speed::ORIGINAL);
+    EXPECT_EQ( result.errors, 0u );
+    EXPECT_GE( result.elapsed, span );
+    EXPECT_TRUE( VFS::fs::exists(dir / "dir" / "moved") );
+
+    // a trace that only reads finds its file made as large as it reads
+    {
+        VFS::InstrumentedFS fs(std::make_shared<VFS::FileSystem>(dir.string()), nullptr, std::make_shared<VFS::Tracer>(path));
+        auto file = fs.open("dir/moved");
+        char buf[100];
+        file->read(buf, 100000, sizeof(buf));
+    }
+    ASSERT_TRUE( VFS::Tracer::load(path, events) );
+    memfs = std::make_shared<VFS::MemoryFileSystem>("memfs");
+    VFS::Replay reads(events);
+    reads.prepare(*memfs);
+    EXPECT_EQ( memfs->open("dir/moved")->size(), 100100u );
+    EXPECT_EQ( reads.run(memfs, VFS::Replay::Speed::FAST).errors, 0u );
+
+    VFS::fs::remove_all(dir);
+    VFS::fs::remove(path);
+}
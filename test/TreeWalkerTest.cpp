@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs/VFS.h"
+
+static std::string tempTree(std::string const & name) {
+    auto dir = VFS::fs::temp_directory_path() / name;
+    VFS::fs::remove_all(dir);
+    for ( int i = 0; i < 8; ++i )
+    {
+        auto sub = dir / ( "dir" + std::to_string(i) );
+        VFS::fs::create_directories(sub / "a" / "b");
+        std::ofstream{ sub / "file" };
+        std::ofstream{ sub / "a" / "b" / "file" };
+    }
+    std::ofstream{ dir / "top" };
+    return dir.string();
+}
+
+TEST(TreeWalkerTest, Collect) {
+    auto root = tempTree("vfs_treewalker_collect");
+    std::set<std::string> expected;
+    for ( auto const & entry : VFS::fs::recursive_directory_iterator(root) )
+        expected.insert(entry.path().string());
+
+    VFS::TreeWalker walker(4);
+    auto entries = walker.collect(root);
+    EXPECT_EQ( entries.size(), expected.size() );
+    EXPECT_EQ( std::set<std::string>(entries.begin(), entries.end()), expected );
+
+    // sorted is the same for every thread count
+    auto sorted = walker.collect(root, true);
+    EXPECT_EQ( sorted, VFS::TreeWalker(1).collect(root, true) );
+    EXPECT_EQ( sorted.front(), root + "/dir0" );
+    EXPECT_EQ( sorted[1], root + "/dir0/a" );
+    EXPECT_EQ( sorted.back(), root + "/top" );
+
+    EXPECT_TRUE( walker.collect(root + "/top").empty() );
+    EXPECT_TRUE( !walker.walk(root + "/nothing", [] (std::string const &, bool) {}) );
+    VFS::fs::remove_all(root);
+}
+
+TEST(TreeWalkerTest, Walk) {
+    auto root = tempTree("vfs_treewalker_walk");
+    VFS::TreeWalker walker(3);
+    std::atomic<std::size_t> files(0);
+    std::atomic<std::size_t> dirs(0);
+    EXPECT_TRUE( walker.walk(root, [&] (std::string const &, bool directory) { ++( directory ? dirs : files ); }) );
+    EXPECT_EQ( files.load(), 17 );
+    EXPECT_EQ( dirs.load(), 24 );
+
+    std::vector<std::string> order;
+    EXPECT_TRUE( walker.walk(root, [&order] (std::string const & path, bool) { order.push_back(path); }, true) );
+    EXPECT_TRUE( std::is_sorted(order.begin(), order.end(), VFS::TreeWalker::sortedBefore) );
+    EXPECT_TRUE( VFS::TreeWalker::sortedBefore("a/b", "a-b") );
+
+    // the threads of the pool walk again and again, walks at the same time are all done in full
+    std::atomic<std::size_t> threads(0);
+    for ( int i = 0; i < 20; ++i )
+    {
+        walker.walk(root, [&threads] (std::string const &, bool)
+        {
+            thread_local bool counted = false;
+            if ( !counted )
+                ++threads;
+            counted = true;
+        });
+    }
+    EXPECT_LE( threads.load(), walker.threads() );
+
+    std::vector<std::thread> walks;
+    std::atomic<int> wrong(0);
+    for ( int t = 0; t < 4; ++t )
+    {
+        walks.emplace_back([&walker, &root, &wrong] ()
+        {
+            for ( int i = 0; i < 20; ++i )
+            {
+                if ( walker.collect(root).size() != 41 )
+                    ++wrong;
+            }
+        });
+    }
+    for ( auto & walk : walks )
+        walk.join();
+    EXPECT_EQ( wrong, 0 );
+    VFS::fs::remove_all(root);
+}
+
+TEST(TreeWalkerTest, FileSystem) {
+    auto root = tempTree("vfs_treewalker_fs");
+    VFS::FileSystem fs( root );
+    fs.setWalkThreads(4);
+    EXPECT_EQ( fs.list("dir3"), VFS::IFS::EntryList({ root + "/dir3/a", root + "/dir3/a/b", root + "/dir3/a/b/file", root + "/dir3/file" }) );
+
+    // the same order whatever the threads
+    auto entries = fs.list();
+    EXPECT_EQ( entries.size(), 41 );
+    EXPECT_TRUE( std::is_sorted(entries.begin(), entries.end(), VFS::TreeWalker::sortedBefore) );
+    fs.setWalkThreads(1);
+    EXPECT_EQ( fs.list(), entries );
+    VFS::fs::remove_all(root);
+}
@@ -0,0 +1,84 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "vfs/VFS.h"
+
+// Runs a trace written by a Tracer against a filesystem again and prints how it went, with the latencies of the
+// replayed calls as JSON (see Metrics::toJson()):
+//   vfs_replay [--fast] [--prepare] TRACE DIR     against a FileSystem mounted on DIR
+//   vfs_replay [--fast] --memory TRACE            against an empty MemoryFileSystem, prepared first
+// --fast calls as fast as possible instead of at the traced times, --prepare makes the files the trace opens.
+
+namespace {
+
+int usage()
+{
+    std::cerr << "usage: vfs_replay [--fast] [--prepare] TRACE DIR\n"
+              << "       vfs_replay [--fast] --memory TRACE\n";
+    return 2;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    auto speed = VFS::Replay::Speed::ORIGINAL;
+    bool prepare = false, memory = false;
+    std::vector<std::string> args;
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( std::strcmp(argv[i], "--fast") == 0 )
+            speed = VFS::Replay::Speed::FAST;
+        else if ( std::strcmp(argv[i], "--prepare") == 0 )
+            prepare = true;
+        else if ( std::strcmp(argv[i], "--memory") == 0 )
+            memory = true;
+        else
+            args.push_back(argv[i]);
+    }
+    if ( args.size() != ( memory ? 1u : 2u ) )
+        return usage();
+
+    std::vector<VFS::Tracer::Event> events;
+    if ( !VFS::Tracer::load(args[0], events) )
+    {
+        if ( events.empty() )
+        {
+            std::cerr << "vfs_replay: " << args[0] << " is not a trace\n";
+            return 1;
+        }
+        std::cerr << "vfs_replay: " << args[0] << " is cut short, replaying " << events.size() << " events\n";
+    }
+
+    VFS::IFS::IFSPtr target;
+    if ( memory )
+    {
+        target = std::make_shared<VFS::MemoryFileSystem>("memfs");
+        prepare = true;
+    }
+    else
+    {
+        target = std::make_shared<VFS::FileSystem>(args[1]);
+        if ( !target->isMounted() )
+        {
+            std::cerr << "vfs_replay: can't mount " << args[1] << "\n";
+            return 1;
+        }
+    }
+
+    VFS::Replay replay(std::move(events));
+    if ( prepare )
+        replay.prepare(*target);
+
+    auto measured = std::make_shared<VFS::InstrumentedFS>(target);
+    auto result = replay.run(measured, speed);
+    std::cerr << "threads " << replay.threads() << ", calls " << result.calls << ", errors " << result.errors
+              << ", skipped " << result.skipped << ", "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(result.elapsed).count() << " ms\n";
+    std::cout << measured->metrics()->toJson() << "\n";
+
+    return result.errors == 0 ? 0 : 1;
+}